@@ -27,6 +27,7 @@
 
 #include "audio-io.h"
 #include "audio-resampler.h"
+#include "audio-kernels.h"
 
 extern profiler_name_store_t *obs_get_profiler_name_store(void);
 
@@ -37,21 +38,68 @@ extern profiler_name_store_t *obs_get_profiler_name_store(void);
 		int invalid = 0; \
 	} while (0)
 
-struct audio_input {
-	struct audio_convert_info conversion;
+/* blocks a worker may fall behind by before audio is dropped for it.  the
+ * dropped audio is replaced by silence once the worker catches up, so the
+ * callback still gets continuous timestamps. */
+#define MAX_WORKER_BLOCKS 256
+
+/* inputs of a mix that want the same format share one of these, so each
+ * format is only converted once per tick */
+struct audio_conversion {
+	struct audio_convert_info info;
 	audio_resampler_t *resampler;
+	size_t planes;
+	size_t block_size;
+	long refs;
+
+	struct audio_data data;
+	bool success;
+};
 
+struct audio_block {
+	uint64_t timestamp;
+	uint32_t frames;
+
+	/* audio dropped right before this block */
+	uint64_t gap_ts;
+	uint64_t gap_frames;
+};
+
+/* runs the callback of a threaded input on its own thread */
+struct audio_worker {
+	pthread_t thread;
+	pthread_mutex_t mutex;
+	os_sem_t *blocks_available;
+	volatile bool stop;
+	bool self_destroy;
+
+	struct circlebuf blocks;
+	struct circlebuf planes[MAX_AV_PLANES];
+	uint8_t *buffer[MAX_AV_PLANES];
+	size_t buffer_size;
+	uint8_t *silence;
+	uint64_t gap_ts;
+	uint64_t gap_frames;
+
+	size_t num_planes;
+	size_t block_size;
+	uint32_t samples_per_sec;
+	size_t mix_idx;
 	audio_output_callback_t callback;
 	void *param;
 };
 
-static inline void audio_input_free(struct audio_input *input)
-{
-	audio_resampler_destroy(input->resampler);
-}
+struct audio_input {
+	struct audio_conversion *conversion;
+	struct audio_worker *worker;
+
+	audio_output_callback_t callback;
+	void *param;
+};
 
 struct audio_mix {
 	DARRAY(struct audio_input) inputs;
+	DARRAY(struct audio_conversion *) conversions;
 	float buffer[MAX_AUDIO_CHANNELS][AUDIO_OUTPUT_FRAMES];
 };
 
@@ -74,29 +122,72 @@ struct audio_output {
 
 /* ------------------------------------------------------------------------- */
 
-static bool resample_audio_output(struct audio_input *input,
-				  struct audio_data *data)
+static void resample_audio_output(struct audio_output *audio,
+				  struct audio_mix *mix,
+				  struct audio_conversion *conv,
+				  uint64_t timestamp, uint32_t frames)
 {
-	bool success = true;
+	struct audio_data *data = &conv->data;
 
-	if (input->resampler) {
+	memset(data, 0, sizeof(*data));
+	for (size_t i = 0; i < audio->planes; i++)
+		data->data[i] = (uint8_t *)mix->buffer[i];
+	data->frames = frames;
+	data->timestamp = timestamp;
+	conv->success = true;
+
+	if (conv->resampler) {
 		uint8_t *output[MAX_AV_PLANES];
-		uint32_t frames;
+		uint32_t out_frames;
 		uint64_t offset;
 
 		memset(output, 0, sizeof(output));
 
-		success = audio_resampler_resample(
-			input->resampler, output, &frames, &offset,
+		conv->success = audio_resampler_resample(
+			conv->resampler, output, &out_frames, &offset,
 			(const uint8_t *const *)data->data, data->frames);
 
 		for (size_t i = 0; i < MAX_AV_PLANES; i++)
 			data->data[i] = output[i];
-		data->frames = frames;
+		data->frames = out_frames;
 		data->timestamp -= offset;
 	}
+}
 
-	return success;
+static void audio_worker_push(struct audio_worker *worker,
+			      const struct audio_data *data)
+{
+	struct audio_block block = {data->timestamp, data->frames};
+	size_t size = data->frames * worker->block_size;
+
+	pthread_mutex_lock(&worker->mutex);
+
+	/* blocking here would hold up every other mix and encoder, so an
+	 * encoder that can't keep up loses audio instead.  the gap is kept
+	 * track of and filled in before the next block that gets queued. */
+	if (worker->blocks.size / sizeof(block) >= MAX_WORKER_BLOCKS) {
+		if (!worker->gap_frames) {
+			blog(LOG_WARNING, "audio-io: Encoder on mix %d can't "
+					  "keep up, dropping audio",
+			     (int)worker->mix_idx);
+			worker->gap_ts = data->timestamp;
+		}
+		worker->gap_frames += data->frames;
+		pthread_mutex_unlock(&worker->mutex);
+		return;
+	}
+
+	block.gap_ts = worker->gap_ts;
+	block.gap_frames = worker->gap_frames;
+	worker->gap_frames = 0;
+
+	circlebuf_push_back(&worker->blocks, &block, sizeof(block));
+	for (size_t i = 0; i < worker->num_planes; i++)
+		circlebuf_push_back(&worker->planes[i], data->data[i], size);
+
+	pthread_mutex_unlock(&worker->mutex);
+
+	os_sem_post(worker->blocks_available);
 }
 
 static inline void do_audio_output(struct audio_output *audio, size_t mix_idx,
@@ -107,22 +198,29 @@ static inline void do_audio_output(struct audio_output *audio, size_t mix_idx,
 
 	pthread_mutex_lock(&audio->input_mutex);
 
+	for (size_t i = 0; i < mix->conversions.num; i++)
+		resample_audio_output(audio, mix, mix->conversions.array[i],
+				      timestamp, frames);
+
 	for (size_t i = mix->inputs.num; i > 0; i--) {
 		struct audio_input *input = mix->inputs.array + (i - 1);
 
-		for (size_t i = 0; i < audio->planes; i++)
-			data.data[i] = (uint8_t *)mix->buffer[i];
-		data.frames = frames;
-		data.timestamp = timestamp;
+		if (!input->conversion->success)
+			continue;
+
+		data = input->conversion->data;
 
-		if (resample_audio_output(input, &data))
+		if (input->worker)
+			audio_worker_push(input->worker, &data);
+		else
 			input->callback(input->param, mix_idx, &data);
 	}
 
 	pthread_mutex_unlock(&audio->input_mutex);
 }
 
-static inline void clamp_audio_output(struct audio_output *audio, size_t bytes)
+static inline void clamp_audio_output(struct audio_output *audio, size_t bytes,
+				      uint32_t active_mixes)
 {
 	size_t float_size = bytes / sizeof(float);
 
@@ -130,20 +228,11 @@ static inline void clamp_audio_output(struct audio_output *audio, size_t bytes)
 		struct audio_mix *mix = &audio->mixes[mix_idx];
 
 		/* do not process mixing if a specific mix is inactive */
-		if (!mix->inputs.num)
+		if ((active_mixes & (1 << mix_idx)) == 0)
 			continue;
 
-		for (size_t plane = 0; plane < audio->planes; plane++) {
-			float *mix_data = mix->buffer[plane];
-			float *mix_end = &mix_data[float_size];
-
-			while (mix_data < mix_end) {
-				float val = *mix_data;
-				val = (val > 1.0f) ? 1.0f : val;
-				val = (val < -1.0f) ? -1.0f : val;
-				*(mix_data++) = val;
-			}
-		}
+		for (size_t plane = 0; plane < audio->planes; plane++)
+			audio_clamp_floats(mix->buffer[plane], float_size);
 	}
 }
 
@@ -171,14 +260,17 @@ static void input_and_output(struct audio_output *audio, uint64_t audio_time,
 	}
 	pthread_mutex_unlock(&audio->input_mutex);
 
-	/* clear mix buffers */
+	/* clear mix buffers, inactive mixes are neither mixed nor output */
 	for (size_t mix_idx = 0; mix_idx < MAX_AUDIO_MIXES; mix_idx++) {
 		struct audio_mix *mix = &audio->mixes[mix_idx];
 
-		memset(mix->buffer, 0, sizeof(mix->buffer));
-
-		for (size_t i = 0; i < audio->planes; i++)
+		for (size_t i = 0; i < audio->planes; i++) {
 			data[mix_idx].data[i] = mix->buffer[i];
+
+			if ((active_mixes & (1 << mix_idx)) != 0)
+				memset(mix->buffer[i], 0,
+				       sizeof(mix->buffer[i]));
+		}
 	}
 
 	/* get new audio data */
@@ -188,11 +280,14 @@ static void input_and_output(struct audio_output *audio, uint64_t audio_time,
 		return;
 
 	/* clamps audio data to -1.0..1.0 */
-	clamp_audio_output(audio, bytes);
+	clamp_audio_output(audio, bytes, active_mixes);
 
-	/* output */
-	for (size_t i = 0; i < MAX_AUDIO_MIXES; i++)
-		do_audio_output(audio, i, new_ts, AUDIO_OUTPUT_FRAMES);
+	/* output (a mix connected since the mixers were gathered is skipped
+	 * for this tick, as its buffer was not cleared or mixed) */
+	for (size_t i = 0; i < MAX_AUDIO_MIXES; i++) {
+		if ((active_mixes & (1 << i)) != 0)
+			do_audio_output(audio, i, new_ts, AUDIO_OUTPUT_FRAMES);
+	}
 }
 
 static void *audio_thread(void *param)
@@ -239,6 +334,155 @@ static void *audio_thread(void *param)
 
 /* ------------------------------------------------------------------------- */
 
+static void audio_worker_free(struct audio_worker *worker)
+{
+	circlebuf_free(&worker->blocks);
+	for (size_t i = 0; i < MAX_AV_PLANES; i++) {
+		circlebuf_free(&worker->planes[i]);
+		bfree(worker->buffer[i]);
+	}
+
+	bfree(worker->silence);
+	os_sem_destroy(worker->blocks_available);
+	pthread_mutex_destroy(&worker->mutex);
+	bfree(worker);
+}
+
+/* passes silence for audio that was dropped while the worker was behind,
+ * so the callback doesn't lose its place in time */
+static bool audio_worker_fill_gap(struct audio_worker *worker, uint64_t ts,
+				  uint64_t frames)
+{
+	uint64_t offset = 0;
+
+	while (offset < frames) {
+		struct audio_data data = {0};
+		uint64_t left = frames - offset;
+
+		for (size_t i = 0; i < worker->num_planes; i++)
+			data.data[i] = worker->silence;
+		data.frames = left < AUDIO_OUTPUT_FRAMES ? (uint32_t)left
+							 : AUDIO_OUTPUT_FRAMES;
+		data.timestamp = ts + audio_frames_to_ns(worker->samples_per_sec,
+							 offset);
+		worker->callback(worker->param, worker->mix_idx, &data);
+
+		if (os_atomic_load_bool(&worker->stop))
+			return false;
+
+		offset += data.frames;
+	}
+
+	return true;
+}
+
+static void *audio_worker_thread(void *param)
+{
+	struct audio_worker *worker = param;
+
+	os_set_thread_name("audio-io: encoder worker");
+
+	while (os_sem_wait(worker->blocks_available) == 0) {
+		struct audio_data data = {0};
+		struct audio_block block;
+		size_t size;
+
+		if (os_atomic_load_bool(&worker->stop))
+			break;
+
+		pthread_mutex_lock(&worker->mutex);
+		circlebuf_pop_front(&worker->blocks, &block, sizeof(block));
+		size = block.frames * worker->block_size;
+
+		if (size > worker->buffer_size) {
+			for (size_t i = 0; i < worker->num_planes; i++)
+				worker->buffer[i] =
+					brealloc(worker->buffer[i], size);
+			worker->buffer_size = size;
+		}
+
+		for (size_t i = 0; i < worker->num_planes; i++) {
+			circlebuf_pop_front(&worker->planes[i],
+					    worker->buffer[i], size);
+			data.data[i] = worker->buffer[i];
+		}
+		pthread_mutex_unlock(&worker->mutex);
+
+		if (block.gap_frames &&
+		    !audio_worker_fill_gap(worker, block.gap_ts,
+					   block.gap_frames))
+			break;
+
+		data.frames = block.frames;
+		data.timestamp = block.timestamp;
+		worker->callback(worker->param, worker->mix_idx, &data);
+
+		/* the callback may have disconnected its own input */
+		if (os_atomic_load_bool(&worker->stop))
+			break;
+
+		profile_reenable_thread();
+	}
+
+	if (worker->self_destroy)
+		audio_worker_free(worker);
+	return NULL;
+}
+
+static struct audio_worker *
+audio_worker_create(struct audio_conversion *conv, size_t mix_idx,
+		    audio_output_callback_t callback, void *param)
+{
+	struct audio_worker *worker = bzalloc(sizeof(struct audio_worker));
+	worker->num_planes = conv->planes;
+	worker->block_size = conv->block_size;
+	worker->samples_per_sec = conv->info.samples_per_sec;
+	worker->silence = bzalloc(AUDIO_OUTPUT_FRAMES * conv->block_size);
+	worker->mix_idx = mix_idx;
+	worker->callback = callback;
+	worker->param = param;
+
+	if (pthread_mutex_init(&worker->mutex, NULL) != 0)
+		goto fail_mutex;
+	if (os_sem_init(&worker->blocks_available, 0) != 0)
+		goto fail;
+	if (pthread_create(&worker->thread, NULL, audio_worker_thread,
+			   worker) != 0)
+		goto fail;
+
+	return worker;
+
+fail:
+	os_sem_destroy(worker->blocks_available);
+	pthread_mutex_destroy(&worker->mutex);
+fail_mutex:
+	bfree(worker->silence);
+	bfree(worker);
+	blog(LOG_ERROR, "audio_worker_create: Failed to create worker");
+	return NULL;
+}
+
+/* queued audio is discarded.  once this returns, the callback is no longer
+ * running and won't be called again, unless this is called from the
+ * callback itself, in which case the worker goes away when it returns. */
+static void audio_worker_destroy(struct audio_worker *worker)
+{
+	if (!worker)
+		return;
+
+	os_atomic_set_bool(&worker->stop, true);
+
+	if (pthread_equal(pthread_self(), worker->thread)) {
+		worker->self_destroy = true;
+		pthread_detach(worker->thread);
+		return;
+	}
+
+	os_sem_post(worker->blocks_available);
+	pthread_join(worker->thread, NULL);
+	audio_worker_free(worker);
+}
+
 static size_t audio_get_input_idx(const audio_t *audio, size_t mix_idx,
 				  audio_output_callback_t callback, void *param)
 {
@@ -254,38 +498,76 @@ static size_t audio_get_input_idx(const audio_t *audio, size_t mix_idx,
 	return DARRAY_INVALID;
 }
 
-static inline bool audio_input_init(struct audio_input *input,
-				    struct audio_output *audio)
+static struct audio_conversion *
+audio_conversion_get(struct audio_output *audio, struct audio_mix *mix,
+		     const struct audio_convert_info *info)
 {
-	if (input->conversion.format != audio->info.format ||
-	    input->conversion.samples_per_sec != audio->info.samples_per_sec ||
-	    input->conversion.speakers != audio->info.speakers) {
+	struct audio_conversion *conv;
+
+	for (size_t i = 0; i < mix->conversions.num; i++) {
+		conv = mix->conversions.array[i];
+
+		if (conv->info.format == info->format &&
+		    conv->info.samples_per_sec == info->samples_per_sec &&
+		    conv->info.speakers == info->speakers) {
+			conv->refs++;
+			return conv;
+		}
+	}
+
+	conv = bzalloc(sizeof(struct audio_conversion));
+	conv->info = *info;
+	conv->refs = 1;
+
+	if (info->format != audio->info.format ||
+	    info->samples_per_sec != audio->info.samples_per_sec ||
+	    info->speakers != audio->info.speakers) {
 		struct resample_info from = {
 			.format = audio->info.format,
 			.samples_per_sec = audio->info.samples_per_sec,
 			.speakers = audio->info.speakers};
 
 		struct resample_info to = {
-			.format = input->conversion.format,
-			.samples_per_sec = input->conversion.samples_per_sec,
-			.speakers = input->conversion.speakers};
+			.format = info->format,
+			.samples_per_sec = info->samples_per_sec,
+			.speakers = info->speakers};
 
-		input->resampler = audio_resampler_create(&to, &from);
-		if (!input->resampler) {
-			blog(LOG_ERROR, "audio_input_init: Failed to "
+		conv->resampler = audio_resampler_create(&to, &from);
+		if (!conv->resampler) {
+			blog(LOG_ERROR, "audio_conversion_get: Failed to "
 					"create resampler");
-			return false;
+			bfree(conv);
+			return NULL;
 		}
-	} else {
-		input->resampler = NULL;
 	}
 
-	return true;
+	conv->planes = is_audio_planar(info->format)
+			       ? get_audio_channels(info->speakers)
+			       : 1;
+	conv->block_size = (is_audio_planar(info->format)
+				    ? 1
+				    : get_audio_channels(info->speakers)) *
+			   get_audio_bytes_per_channel(info->format);
+
+	da_push_back(mix->conversions, &conv);
+	return conv;
 }
 
-bool audio_output_connect(audio_t *audio, size_t mi,
+static void audio_conversion_release(struct audio_mix *mix,
+				     struct audio_conversion *conv)
+{
+	if (--conv->refs > 0)
+		return;
+
+	da_erase_item(mix->conversions, &conv);
+	audio_resampler_destroy(conv->resampler);
+	bfree(conv);
+}
+
+static bool connect_input(audio_t *audio, size_t mi,
 			  const struct audio_convert_info *conversion,
-			  audio_output_callback_t callback, void *param)
+			  audio_output_callback_t callback, void *param,
+			  bool threaded)
 {
 	bool success = false;
 
@@ -296,28 +578,37 @@ bool audio_output_connect(audio_t *audio, size_t mi,
 
 	if (audio_get_input_idx(audio, mi, callback, param) == DARRAY_INVALID) {
 		struct audio_mix *mix = &audio->mixes[mi];
-		struct audio_input input;
+		struct audio_convert_info info;
+		struct audio_input input = {0};
 		input.callback = callback;
 		input.param = param;
 
 		if (conversion) {
-			input.conversion = *conversion;
+			info = *conversion;
 		} else {
-			input.conversion.format = audio->info.format;
-			input.conversion.speakers = audio->info.speakers;
-			input.conversion.samples_per_sec =
-				audio->info.samples_per_sec;
+			info.format = audio->info.format;
+			info.speakers = audio->info.speakers;
+			info.samples_per_sec = audio->info.samples_per_sec;
 		}
 
-		if (input.conversion.format == AUDIO_FORMAT_UNKNOWN)
-			input.conversion.format = audio->info.format;
-		if (input.conversion.speakers == SPEAKERS_UNKNOWN)
-			input.conversion.speakers = audio->info.speakers;
-		if (input.conversion.samples_per_sec == 0)
-			input.conversion.samples_per_sec =
-				audio->info.samples_per_sec;
+		if (info.format == AUDIO_FORMAT_UNKNOWN)
+			info.format = audio->info.format;
+		if (info.speakers == SPEAKERS_UNKNOWN)
+			info.speakers = audio->info.speakers;
+		if (info.samples_per_sec == 0)
+			info.samples_per_sec = audio->info.samples_per_sec;
+
+		input.conversion = audio_conversion_get(audio, mix, &info);
+		success = !!input.conversion;
+
+		if (success && threaded) {
+			input.worker = audio_worker_create(input.conversion, mi,
+							   callback, param);
+			success = !!input.worker;
+			if (!success)
+				audio_conversion_release(mix, input.conversion);
+		}
 
-		success = audio_input_init(&input, audio);
 		if (success)
 			da_push_back(mix->inputs, &input);
 	}
@@ -327,9 +618,26 @@ bool audio_output_connect(audio_t *audio, size_t mi,
 	return success;
 }
 
+bool audio_output_connect(audio_t *audio, size_t mi,
+			  const struct audio_convert_info *conversion,
+			  audio_output_callback_t callback, void *param)
+{
+	return connect_input(audio, mi, conversion, callback, param, false);
+}
+
+bool audio_output_connect_threaded(audio_t *audio, size_t mi,
+				   const struct audio_convert_info *conversion,
+				   audio_output_callback_t callback,
+				   void *param)
+{
+	return connect_input(audio, mi, conversion, callback, param, true);
+}
+
 void audio_output_disconnect(audio_t *audio, size_t mix_idx,
 			     audio_output_callback_t callback, void *param)
 {
+	struct audio_worker *worker = NULL;
+
 	if (!audio || mix_idx >= MAX_AUDIO_MIXES)
 		return;
 
@@ -338,11 +646,17 @@ void audio_output_disconnect(audio_t *audio, size_t mix_idx,
 	size_t idx = audio_get_input_idx(audio, mix_idx, callback, param);
 	if (idx != DARRAY_INVALID) {
 		struct audio_mix *mix = &audio->mixes[mix_idx];
-		audio_input_free(mix->inputs.array + idx);
+		struct audio_input *input = mix->inputs.array + idx;
+
+		worker = input->worker;
+		audio_conversion_release(mix, input->conversion);
 		da_erase(mix->inputs, idx);
 	}
 
 	pthread_mutex_unlock(&audio->input_mutex);
+
+	/* outside of the lock, the callback may be waiting on it */
+	audio_worker_destroy(worker);
 }
 
 static inline bool valid_audio_params(const struct audio_output_info *info)
@@ -407,10 +721,14 @@ void audio_output_close(audio_t *audio)
 	for (size_t mix_idx = 0; mix_idx < MAX_AUDIO_MIXES; mix_idx++) {
 		struct audio_mix *mix = &audio->mixes[mix_idx];
 
-		for (size_t i = 0; i < mix->inputs.num; i++)
-			audio_input_free(mix->inputs.array + i);
+		for (size_t i = 0; i < mix->inputs.num; i++) {
+			struct audio_input *input = mix->inputs.array + i;
+			audio_worker_destroy(input->worker);
+			audio_conversion_release(mix, input->conversion);
+		}
 
 		da_free(mix->inputs);
+		da_free(mix->conversions);
 	}
 
 	os_event_destroy(audio->stop_event);
@@ -216,6 +216,10 @@ typedef void (*audio_output_callback_t)(void *param, size_t mix_idx,
 EXPORT bool audio_output_connect(audio_t *video, size_t mix_idx,
 				 const struct audio_convert_info *conversion,
 				 audio_output_callback_t callback, void *param);
+EXPORT bool audio_output_connect_threaded(
+	audio_t *audio, size_t mix_idx,
+	const struct audio_convert_info *conversion,
+	audio_output_callback_t callback, void *param);
 EXPORT void audio_output_disconnect(audio_t *video, size_t mix_idx,
 				    audio_output_callback_t callback,
 				    void *param);
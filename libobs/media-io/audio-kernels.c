@@ -0,0 +1,275 @@
+#include "audio-kernels.h"
+
+#include "../util/simd-dispatch.h"
+#include "../util/threading.h"
+
+struct audio_kernels {
+	enum audio_kernels_impl impl;
+	void (*mix)(float *dst, const float *src, size_t count);
+	void (*clamp)(float *data, size_t count);
+	void (*scale)(float *data, float vol, size_t count);
+	void (*multiply)(float *data, const float *vol, size_t count);
+};
+
+/* ------------------------------------------------------------------------- */
+/* scalar, also used for the tails of the vector versions */
+
+static void mix_scalar(float *dst, const float *src, size_t count)
+{
+	float *end = dst + count;
+	while (dst < end)
+		*(dst++) += *(src++);
+}
+
+static void clamp_scalar(float *data, size_t count)
+{
+	float *end = data + count;
+
+	while (data < end) {
+		float val = *data;
+		val = (val > 1.0f) ? 1.0f : val;
+		val = (val < -1.0f) ? -1.0f : val;
+		*(data++) = val;
+	}
+}
+
+static void scale_scalar(float *data, float vol, size_t count)
+{
+	float *end = data + count;
+	while (data < end)
+		*(data++) *= vol;
+}
+
+static void multiply_scalar(float *data, const float *vol, size_t count)
+{
+	float *end = data + count;
+	while (data < end)
+		*(data++) *= *(vol++);
+}
+
+static const struct audio_kernels kernels_scalar = {
+	AUDIO_KERNELS_SCALAR,
+	mix_scalar,
+	clamp_scalar,
+	scale_scalar,
+	multiply_scalar,
+};
+
+/* ------------------------------------------------------------------------- */
+/* SSE2 (simde on other architectures) */
+
+static void mix_sse2(float *dst, const float *src, size_t count)
+{
+	size_t i = 0;
+
+	for (; i + 8 <= count; i += 8) {
+		__m128 a0 = _mm_loadu_ps(dst + i);
+		__m128 a1 = _mm_loadu_ps(dst + i + 4);
+		__m128 b0 = _mm_loadu_ps(src + i);
+		__m128 b1 = _mm_loadu_ps(src + i + 4);
+		_mm_storeu_ps(dst + i, _mm_add_ps(a0, b0));
+		_mm_storeu_ps(dst + i + 4, _mm_add_ps(a1, b1));
+	}
+
+	mix_scalar(dst + i, src + i, count - i);
+}
+
+/* min/max return their second operand if either one is NaN, which keeps NaN
+ * samples unchanged just like the scalar comparisons do */
+static void clamp_sse2(float *data, size_t count)
+{
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 neg_one = _mm_set1_ps(-1.0f);
+	size_t i = 0;
+
+	for (; i + 4 <= count; i += 4) {
+		__m128 val = _mm_loadu_ps(data + i);
+		val = _mm_min_ps(one, val);
+		val = _mm_max_ps(neg_one, val);
+		_mm_storeu_ps(data + i, val);
+	}
+
+	clamp_scalar(data + i, count - i);
+}
+
+static void scale_sse2(float *data, float vol, size_t count)
+{
+	const __m128 mul = _mm_set1_ps(vol);
+	size_t i = 0;
+
+	for (; i + 8 <= count; i += 8) {
+		__m128 a0 = _mm_loadu_ps(data + i);
+		__m128 a1 = _mm_loadu_ps(data + i + 4);
+		_mm_storeu_ps(data + i, _mm_mul_ps(a0, mul));
+		_mm_storeu_ps(data + i + 4, _mm_mul_ps(a1, mul));
+	}
+
+	scale_scalar(data + i, vol, count - i);
+}
+
+static void multiply_sse2(float *data, const float *vol, size_t count)
+{
+	size_t i = 0;
+
+	for (; i + 4 <= count; i += 4) {
+		__m128 a = _mm_loadu_ps(data + i);
+		__m128 b = _mm_loadu_ps(vol + i);
+		_mm_storeu_ps(data + i, _mm_mul_ps(a, b));
+	}
+
+	multiply_scalar(data + i, vol + i, count - i);
+}
+
+static const struct audio_kernels kernels_sse2 = {
+	AUDIO_KERNELS_SSE2,
+	mix_sse2,
+	clamp_sse2,
+	scale_sse2,
+	multiply_sse2,
+};
+
+/* ------------------------------------------------------------------------- */
+/* AVX (x86 only, float math does not need AVX2) */
+
+#ifdef SIMD_HAVE_AVX
+AVX_TARGET static void mix_avx(float *dst, const float *src, size_t count)
+{
+	size_t i = 0;
+
+	for (; i + 16 <= count; i += 16) {
+		__m256 a0 = _mm256_loadu_ps(dst + i);
+		__m256 a1 = _mm256_loadu_ps(dst + i + 8);
+		__m256 b0 = _mm256_loadu_ps(src + i);
+		__m256 b1 = _mm256_loadu_ps(src + i + 8);
+		_mm256_storeu_ps(dst + i, _mm256_add_ps(a0, b0));
+		_mm256_storeu_ps(dst + i + 8, _mm256_add_ps(a1, b1));
+	}
+
+	mix_sse2(dst + i, src + i, count - i);
+}
+
+AVX_TARGET static void clamp_avx(float *data, size_t count)
+{
+	const __m256 one = _mm256_set1_ps(1.0f);
+	const __m256 neg_one = _mm256_set1_ps(-1.0f);
+	size_t i = 0;
+
+	for (; i + 8 <= count; i += 8) {
+		__m256 val = _mm256_loadu_ps(data + i);
+		val = _mm256_min_ps(one, val);
+		val = _mm256_max_ps(neg_one, val);
+		_mm256_storeu_ps(data + i, val);
+	}
+
+	clamp_sse2(data + i, count - i);
+}
+
+AVX_TARGET static void scale_avx(float *data, float vol, size_t count)
+{
+	const __m256 mul = _mm256_set1_ps(vol);
+	size_t i = 0;
+
+	for (; i + 16 <= count; i += 16) {
+		__m256 a0 = _mm256_loadu_ps(data + i);
+		__m256 a1 = _mm256_loadu_ps(data + i + 8);
+		_mm256_storeu_ps(data + i, _mm256_mul_ps(a0, mul));
+		_mm256_storeu_ps(data + i + 8, _mm256_mul_ps(a1, mul));
+	}
+
+	scale_sse2(data + i, vol, count - i);
+}
+
+AVX_TARGET static void multiply_avx(float *data, const float *vol,
+				    size_t count)
+{
+	size_t i = 0;
+
+	for (; i + 8 <= count; i += 8) {
+		__m256 a = _mm256_loadu_ps(data + i);
+		__m256 b = _mm256_loadu_ps(vol + i);
+		_mm256_storeu_ps(data + i, _mm256_mul_ps(a, b));
+	}
+
+	multiply_sse2(data + i, vol + i, count - i);
+}
+
+static const struct audio_kernels kernels_avx = {
+	AUDIO_KERNELS_AVX,
+	mix_avx,
+	clamp_avx,
+	scale_avx,
+	multiply_avx,
+};
+#endif
+
+/* ------------------------------------------------------------------------- */
+
+static const struct audio_kernels *kernels = NULL;
+static pthread_once_t kernels_once = PTHREAD_ONCE_INIT;
+
+static const struct audio_kernels *find_kernels(enum audio_kernels_impl impl)
+{
+	switch (impl) {
+	case AUDIO_KERNELS_SCALAR:
+		return &kernels_scalar;
+	case AUDIO_KERNELS_SSE2:
+		return &kernels_sse2;
+	case AUDIO_KERNELS_AVX:
+#ifdef SIMD_HAVE_AVX
+		if (simd_cpu_has_avx())
+			return &kernels_avx;
+#endif
+		break;
+	}
+
+	return NULL;
+}
+
+static void init_kernels(void)
+{
+	const struct audio_kernels *best = find_kernels(AUDIO_KERNELS_AVX);
+	kernels = best ? best : &kernels_sse2;
+}
+
+static inline const struct audio_kernels *get_kernels(void)
+{
+	pthread_once(&kernels_once, init_kernels);
+	return kernels;
+}
+
+void audio_mix_floats(float *dst, const float *src, size_t count)
+{
+	get_kernels()->mix(dst, src, count);
+}
+
+void audio_clamp_floats(float *data, size_t count)
+{
+	get_kernels()->clamp(data, count);
+}
+
+void audio_scale_floats(float *data, float vol, size_t count)
+{
+	get_kernels()->scale(data, vol, count);
+}
+
+void audio_multiply_floats(float *data, const float *vol, size_t count)
+{
+	get_kernels()->multiply(data, vol, count);
+}
+
+enum audio_kernels_impl audio_kernels_get_impl(void)
+{
+	return get_kernels()->impl;
+}
+
+bool audio_kernels_set_impl(enum audio_kernels_impl impl)
+{
+	const struct audio_kernels *new_kernels = find_kernels(impl);
+	if (!new_kernels)
+		return false;
+
+	/* keep a later first use from overwriting the forced table */
+	pthread_once(&kernels_once, init_kernels);
+	kernels = new_kernels;
+	return true;
+}
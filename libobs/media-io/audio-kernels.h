@@ -0,0 +1,42 @@
+#pragma once
+
+#include "../util/c99defs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Float sample kernels used by the audio pipeline (mixing, clamping and
+ * volume).  The implementation is picked at runtime from the best one the
+ * CPU supports; every implementation produces bit-identical output.
+ */
+
+enum audio_kernels_impl {
+	AUDIO_KERNELS_SCALAR,
+	AUDIO_KERNELS_SSE2,
+	AUDIO_KERNELS_AVX,
+};
+
+/* dst[i] += src[i] */
+EXPORT void audio_mix_floats(float *dst, const float *src, size_t count);
+
+/* data[i] = clamp(data[i], -1.0f, 1.0f), NaN is left as is */
+EXPORT void audio_clamp_floats(float *data, size_t count);
+
+/* data[i] *= vol */
+EXPORT void audio_scale_floats(float *data, float vol, size_t count);
+
+/* data[i] *= vol[i] */
+EXPORT void audio_multiply_floats(float *data, const float *vol,
+				  size_t count);
+
+EXPORT enum audio_kernels_impl audio_kernels_get_impl(void);
+
+/* forces a specific implementation, mainly for testing.  returns false if
+ * the CPU does not support it. */
+EXPORT bool audio_kernels_set_impl(enum audio_kernels_impl impl);
+
+#ifdef __cplusplus
+}
+#endif
@@ -17,7 +17,39 @@
 
 #include "format-conversion.h"
 
-#include "../util/sse-intrin.h"
+#include "../util/simd-dispatch.h"
+#include "../util/threading.h"
+
+/*
+ * Each kernel converts two rows (one row for packed 4:2:2) starting at the
+ * given pointers.  The AVX2 kernels hand the last few pixels of a row to the
+ * baseline kernels, so any width the baseline supports works for both.
+ */
+
+struct format_kernels {
+	enum format_conversion_impl impl;
+
+	/* out[] holds the row pointers of each output plane */
+	void (*uyvx_to_i420)(const uint8_t *img, uint32_t in_linesize,
+			     uint8_t *const out[], uint32_t lum_linesize,
+			     uint32_t width);
+	void (*uyvx_to_nv12)(const uint8_t *img, uint32_t in_linesize,
+			     uint8_t *const out[], uint32_t lum_linesize,
+			     uint32_t width);
+	void (*uyvx_to_i444)(const uint8_t *img, uint32_t in_linesize,
+			     uint8_t *const out[], uint32_t lum_linesize,
+			     uint32_t width);
+
+	/* in[] holds the row pointers of each input plane */
+	void (*i420_to_packed)(const uint8_t *const in[], uint32_t lum_linesize,
+			       uint8_t *output, uint32_t out_linesize,
+			       uint32_t pairs);
+	void (*nv12_to_packed)(const uint8_t *const in[], uint32_t lum_linesize,
+			       uint8_t *output, uint32_t out_linesize,
+			       uint32_t pairs);
+	void (*packed422_to_packed)(const uint8_t *input, uint8_t *output,
+				    uint32_t pairs, bool leading_lum);
+};
 
 /* ...surprisingly, if I don't use a macro to force inlining, it causes the
  * CPU usage to boost by a tremendous amount in debug builds. */
@@ -90,75 +122,530 @@ static FORCE_INLINE uint32_t min_uint32(uint32_t a, uint32_t b)
 	return a < b ? a : b;
 }
 
-void compress_uyvx_to_i420(const uint8_t *input, uint32_t in_linesize,
-			   uint32_t start_y, uint32_t end_y, uint8_t *output[],
-			   const uint32_t out_linesize[])
+/* ------------------------------------------------------------------------- */
+/* baseline: SSE2 (simde on other architectures) and plain C */
+
+static void uyvx_to_i420_sse2(const uint8_t *img, uint32_t in_linesize,
+			      uint8_t *const out[], uint32_t lum_linesize,
+			      uint32_t width)
 {
-	uint8_t *lum_plane = output[0];
-	uint8_t *u_plane = output[1];
-	uint8_t *v_plane = output[2];
-	uint32_t width = min_uint32(in_linesize, out_linesize[0]);
-	uint32_t y;
+	uint8_t *lum_plane = out[0];
+	uint8_t *u_plane = out[1];
+	uint8_t *v_plane = out[2];
 
 	__m128i lum_mask = _mm_set1_epi32(0x0000FF00);
 	__m128i uv_mask = _mm_set1_epi16(0x00FF);
 
-	for (y = start_y; y < end_y; y += 2) {
-		uint32_t y_pos = y * in_linesize;
-		uint32_t chroma_y_pos = (y >> 1) * out_linesize[1];
-		uint32_t lum_y_pos = y * out_linesize[0];
-		uint32_t x;
-
-		for (x = 0; x < width; x += 4) {
-			const uint8_t *img = input + y_pos + x * 4;
-			uint32_t lum_pos0 = lum_y_pos + x;
-			uint32_t lum_pos1 = lum_pos0 + out_linesize[0];
-
-			__m128i line1 = _mm_load_si128((const __m128i *)img);
-			__m128i line2 = _mm_load_si128(
-				(const __m128i *)(img + in_linesize));
-
-			pack_shift(lum_plane, lum_pos0, lum_pos1, line1, line2,
-				   lum_mask, 1);
-			pack_ch_2plane(u_plane, v_plane,
-				       chroma_y_pos + (x >> 1), line1, line2,
-				       uv_mask);
+	for (uint32_t x = 0; x < width; x += 4) {
+		const uint8_t *pixels = img + x * 4;
+		uint32_t lum_pos0 = x;
+		uint32_t lum_pos1 = lum_pos0 + lum_linesize;
+
+		__m128i line1 = _mm_load_si128((const __m128i *)pixels);
+		__m128i line2 =
+			_mm_load_si128((const __m128i *)(pixels + in_linesize));
+
+		pack_shift(lum_plane, lum_pos0, lum_pos1, line1, line2,
+			   lum_mask, 1);
+		pack_ch_2plane(u_plane, v_plane, (x >> 1), line1, line2,
+			       uv_mask);
+	}
+}
+
+static void uyvx_to_nv12_sse2(const uint8_t *img, uint32_t in_linesize,
+			      uint8_t *const out[], uint32_t lum_linesize,
+			      uint32_t width)
+{
+	uint8_t *lum_plane = out[0];
+	uint8_t *chroma_plane = out[1];
+
+	__m128i lum_mask = _mm_set1_epi32(0x0000FF00);
+	__m128i uv_mask = _mm_set1_epi16(0x00FF);
+
+	for (uint32_t x = 0; x < width; x += 4) {
+		const uint8_t *pixels = img + x * 4;
+		uint32_t lum_pos0 = x;
+		uint32_t lum_pos1 = lum_pos0 + lum_linesize;
+
+		__m128i line1 = _mm_load_si128((const __m128i *)pixels);
+		__m128i line2 =
+			_mm_load_si128((const __m128i *)(pixels + in_linesize));
+
+		pack_shift(lum_plane, lum_pos0, lum_pos1, line1, line2,
+			   lum_mask, 1);
+		pack_ch_1plane(chroma_plane, x, line1, line2, uv_mask);
+	}
+}
+
+static void uyvx_to_i444_sse2(const uint8_t *img, uint32_t in_linesize,
+			      uint8_t *const out[], uint32_t lum_linesize,
+			      uint32_t width)
+{
+	uint8_t *lum_plane = out[0];
+	uint8_t *u_plane = out[1];
+	uint8_t *v_plane = out[2];
+
+	__m128i lum_mask = _mm_set1_epi32(0x0000FF00);
+	__m128i u_mask = _mm_set1_epi32(0x000000FF);
+	__m128i v_mask = _mm_set1_epi32(0x00FF0000);
+
+	for (uint32_t x = 0; x < width; x += 4) {
+		const uint8_t *pixels = img + x * 4;
+		uint32_t lum_pos0 = x;
+		uint32_t lum_pos1 = lum_pos0 + lum_linesize;
+
+		__m128i line1 = _mm_load_si128((const __m128i *)pixels);
+		__m128i line2 =
+			_mm_load_si128((const __m128i *)(pixels + in_linesize));
+
+		pack_shift(lum_plane, lum_pos0, lum_pos1, line1, line2,
+			   lum_mask, 1);
+		pack_val(u_plane, lum_pos0, lum_pos1, line1, line2, u_mask);
+		pack_shift(v_plane, lum_pos0, lum_pos1, line1, line2, v_mask,
+			   2);
+	}
+}
+
+static void i420_to_packed_c(const uint8_t *const in[], uint32_t lum_linesize,
+			     uint8_t *output, uint32_t out_linesize,
+			     uint32_t pairs)
+{
+	const uint8_t *chroma0 = in[1];
+	const uint8_t *chroma1 = in[2];
+	register const uint8_t *lum0, *lum1;
+	register uint32_t *output0, *output1;
+
+	lum0 = in[0];
+	lum1 = lum0 + lum_linesize;
+	output0 = (uint32_t *)output;
+	output1 = (uint32_t *)(output + out_linesize);
+
+	for (uint32_t x = 0; x < pairs; x++) {
+		uint32_t out;
+		out = (*(chroma0++) << 8) | *(chroma1++);
+
+		*(output0++) = (*(lum0++) << 16) | out;
+		*(output0++) = (*(lum0++) << 16) | out;
+
+		*(output1++) = (*(lum1++) << 16) | out;
+		*(output1++) = (*(lum1++) << 16) | out;
+	}
+}
+
+static void nv12_to_packed_c(const uint8_t *const in[], uint32_t lum_linesize,
+			     uint8_t *output, uint32_t out_linesize,
+			     uint32_t pairs)
+{
+	const uint16_t *chroma = (const uint16_t *)in[1];
+	register const uint8_t *lum0, *lum1;
+	register uint32_t *output0, *output1;
+
+	lum0 = in[0];
+	lum1 = lum0 + lum_linesize;
+	output0 = (uint32_t *)output;
+	output1 = (uint32_t *)(output + out_linesize);
+
+	for (uint32_t x = 0; x < pairs; x++) {
+		uint32_t out = *(chroma++) << 8;
+
+		*(output0++) = *(lum0++) | out;
+		*(output0++) = *(lum0++) | out;
+
+		*(output1++) = *(lum1++) | out;
+		*(output1++) = *(lum1++) | out;
+	}
+}
+
+static void packed422_to_packed_c(const uint8_t *input, uint8_t *output,
+				  uint32_t pairs, bool leading_lum)
+{
+	register const uint32_t *input32 = (const uint32_t *)input;
+	register const uint32_t *input32_end = input32 + pairs;
+	register uint32_t *output32 = (uint32_t *)output;
+
+	if (leading_lum) {
+		while (input32 < input32_end) {
+			register uint32_t dw = *input32;
+
+			output32[0] = dw;
+			dw &= 0xFFFFFF00;
+			dw |= (uint8_t)(dw >> 16);
+			output32[1] = dw;
+
+			output32 += 2;
+			input32++;
+		}
+	} else {
+		while (input32 < input32_end) {
+			register uint32_t dw = *input32;
+
+			output32[0] = dw;
+			dw &= 0xFFFF00FF;
+			dw |= (dw >> 16) & 0xFF00;
+			output32[1] = dw;
+
+			output32 += 2;
+			input32++;
 		}
 	}
 }
 
-void compress_uyvx_to_nv12(const uint8_t *input, uint32_t in_linesize,
+static const struct format_kernels kernels_sse2 = {
+	FORMAT_CONVERSION_SSE2,
+	uyvx_to_i420_sse2,
+	uyvx_to_nv12_sse2,
+	uyvx_to_i444_sse2,
+	i420_to_packed_c,
+	nv12_to_packed_c,
+	packed422_to_packed_c,
+};
+
+/* ------------------------------------------------------------------------- */
+/* AVX2 (x86 only), 8 pixels per row at a time */
+
+#ifdef SIMD_HAVE_AVX
+/* splits 8 UYVX pixels into their Y, U and V bytes, one 64-bit lane each */
+AVX2_TARGET static inline __m256i split_uyvx_avx2(const uint8_t *pixels)
+{
+	const __m256i shuffle = _mm256_setr_epi8(
+		1, 5, 9, 13, 0, 4, 8, 12, 2, 6, 10, 14, -1, -1, -1, -1, 1, 5,
+		9, 13, 0, 4, 8, 12, 2, 6, 10, 14, -1, -1, -1, -1);
+	const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+
+	__m256i val = _mm256_loadu_si256((const __m256i *)pixels);
+	val = _mm256_shuffle_epi8(val, shuffle);
+	return _mm256_permutevar8x32_epi32(val, order);
+}
+
+/* averages each 2x2 block of two split lines the same way pack_ch_* does.
+ * the low lane gets the 4 U bytes, the high lane the 4 V bytes. */
+AVX2_TARGET static inline __m256i average_uv_avx2(__m256i line1, __m256i line2)
+{
+	__m128i uv1 = _mm256_castsi256_si128(
+		_mm256_permute4x64_epi64(line1, _MM_SHUFFLE(3, 3, 2, 1)));
+	__m128i uv2 = _mm256_castsi256_si128(
+		_mm256_permute4x64_epi64(line2, _MM_SHUFFLE(3, 3, 2, 1)));
+
+	__m256i sum = _mm256_add_epi16(_mm256_cvtepu8_epi16(uv1),
+				       _mm256_cvtepu8_epi16(uv2));
+	sum = _mm256_madd_epi16(sum, _mm256_set1_epi16(1));
+	sum = _mm256_srli_epi32(sum, 2);
+	sum = _mm256_packus_epi32(sum, sum);
+	return _mm256_packus_epi16(sum, sum);
+}
+
+AVX2_TARGET static inline void store_lum_avx2(uint8_t *lum0, uint8_t *lum1,
+					      __m256i line1, __m256i line2)
+{
+	_mm_storel_epi64((__m128i *)lum0, _mm256_castsi256_si128(line1));
+	_mm_storel_epi64((__m128i *)lum1, _mm256_castsi256_si128(line2));
+}
+
+AVX2_TARGET static void uyvx_to_i420_avx2(const uint8_t *img,
+					  uint32_t in_linesize,
+					  uint8_t *const out[],
+					  uint32_t lum_linesize, uint32_t width)
+{
+	uint32_t x = 0;
+
+	for (; x + 8 <= width; x += 8) {
+		const uint8_t *pixels = img + x * 4;
+		__m256i line1 = split_uyvx_avx2(pixels);
+		__m256i line2 = split_uyvx_avx2(pixels + in_linesize);
+		__m256i uv = average_uv_avx2(line1, line2);
+
+		store_lum_avx2(out[0] + x, out[0] + x + lum_linesize, line1,
+			       line2);
+		*(uint32_t *)(out[1] + x / 2) =
+			(uint32_t)_mm_cvtsi128_si32(_mm256_castsi256_si128(uv));
+		*(uint32_t *)(out[2] + x / 2) = (uint32_t)_mm_cvtsi128_si32(
+			_mm256_extracti128_si256(uv, 1));
+	}
+
+	if (x < width) {
+		uint8_t *const tail[] = {out[0] + x, out[1] + x / 2,
+					 out[2] + x / 2};
+		uyvx_to_i420_sse2(img + x * 4, in_linesize, tail, lum_linesize,
+				  width - x);
+	}
+}
+
+AVX2_TARGET static void uyvx_to_nv12_avx2(const uint8_t *img,
+					  uint32_t in_linesize,
+					  uint8_t *const out[],
+					  uint32_t lum_linesize, uint32_t width)
+{
+	uint32_t x = 0;
+
+	for (; x + 8 <= width; x += 8) {
+		const uint8_t *pixels = img + x * 4;
+		__m256i line1 = split_uyvx_avx2(pixels);
+		__m256i line2 = split_uyvx_avx2(pixels + in_linesize);
+		__m256i uv = average_uv_avx2(line1, line2);
+
+		store_lum_avx2(out[0] + x, out[0] + x + lum_linesize, line1,
+			       line2);
+		_mm_storel_epi64((__m128i *)(out[1] + x),
+				 _mm_unpacklo_epi8(
+					 _mm256_castsi256_si128(uv),
+					 _mm256_extracti128_si256(uv, 1)));
+	}
+
+	if (x < width) {
+		uint8_t *const tail[] = {out[0] + x, out[1] + x};
+		uyvx_to_nv12_sse2(img + x * 4, in_linesize, tail, lum_linesize,
+				  width - x);
+	}
+}
+
+AVX2_TARGET static void uyvx_to_i444_avx2(const uint8_t *img,
+					  uint32_t in_linesize,
+					  uint8_t *const out[],
+					  uint32_t lum_linesize, uint32_t width)
+{
+	uint32_t x = 0;
+
+	for (; x + 8 <= width; x += 8) {
+		const uint8_t *pixels = img + x * 4;
+		__m256i line1 = split_uyvx_avx2(pixels);
+		__m256i line2 = split_uyvx_avx2(pixels + in_linesize);
+		__m128i lo1 = _mm256_castsi256_si128(line1);
+		__m128i lo2 = _mm256_castsi256_si128(line2);
+
+		store_lum_avx2(out[0] + x, out[0] + x + lum_linesize, line1,
+			       line2);
+		_mm_storel_epi64((__m128i *)(out[1] + x),
+				 _mm_unpackhi_epi64(lo1, lo1));
+		_mm_storel_epi64((__m128i *)(out[1] + x + lum_linesize),
+				 _mm_unpackhi_epi64(lo2, lo2));
+		_mm_storel_epi64((__m128i *)(out[2] + x),
+				 _mm256_extracti128_si256(line1, 1));
+		_mm_storel_epi64((__m128i *)(out[2] + x + lum_linesize),
+				 _mm256_extracti128_si256(line2, 1));
+	}
+
+	if (x < width) {
+		uint8_t *const tail[] = {out[0] + x, out[1] + x, out[2] + x};
+		uyvx_to_i444_sse2(img + x * 4, in_linesize, tail, lum_linesize,
+				  width - x);
+	}
+}
+
+/* writes 16 packed pixels, each chroma value covering two of them */
+AVX2_TARGET static inline void store_packed_avx2(uint8_t *output, __m128i lum,
+						 int lum_shift, __m256i chroma)
+{
+	const __m256i dup_lo = _mm256_setr_epi32(0, 0, 1, 1, 2, 2, 3, 3);
+	const __m256i dup_hi = _mm256_setr_epi32(4, 4, 5, 5, 6, 6, 7, 7);
+	const __m128i shift = _mm_cvtsi32_si128(lum_shift);
+
+	__m256i lum_lo = _mm256_sll_epi32(_mm256_cvtepu8_epi32(lum), shift);
+	__m256i lum_hi = _mm256_sll_epi32(
+		_mm256_cvtepu8_epi32(_mm_srli_si128(lum, 8)), shift);
+
+	_mm256_storeu_si256(
+		(__m256i *)output,
+		_mm256_or_si256(lum_lo,
+				_mm256_permutevar8x32_epi32(chroma, dup_lo)));
+	_mm256_storeu_si256(
+		(__m256i *)(output + 32),
+		_mm256_or_si256(lum_hi,
+				_mm256_permutevar8x32_epi32(chroma, dup_hi)));
+}
+
+AVX2_TARGET static void i420_to_packed_avx2(const uint8_t *const in[],
+					    uint32_t lum_linesize,
+					    uint8_t *output,
+					    uint32_t out_linesize,
+					    uint32_t pairs)
+{
+	uint32_t x = 0;
+
+	for (; x + 8 <= pairs; x += 8) {
+		const uint8_t *lum0 = in[0] + x * 2;
+		const uint8_t *lum1 = lum0 + lum_linesize;
+		__m256i chroma0 = _mm256_cvtepu8_epi32(
+			_mm_loadl_epi64((const __m128i *)(in[1] + x)));
+		__m256i chroma1 = _mm256_cvtepu8_epi32(
+			_mm_loadl_epi64((const __m128i *)(in[2] + x)));
+		__m256i chroma =
+			_mm256_or_si256(_mm256_slli_epi32(chroma0, 8), chroma1);
+
+		store_packed_avx2(output + x * 8,
+				  _mm_loadu_si128((const __m128i *)lum0), 16,
+				  chroma);
+		store_packed_avx2(output + x * 8 + out_linesize,
+				  _mm_loadu_si128((const __m128i *)lum1), 16,
+				  chroma);
+	}
+
+	if (x < pairs) {
+		const uint8_t *const tail[] = {in[0] + x * 2, in[1] + x,
+					       in[2] + x};
+		i420_to_packed_c(tail, lum_linesize, output + x * 8,
+				 out_linesize, pairs - x);
+	}
+}
+
+AVX2_TARGET static void nv12_to_packed_avx2(const uint8_t *const in[],
+					    uint32_t lum_linesize,
+					    uint8_t *output,
+					    uint32_t out_linesize,
+					    uint32_t pairs)
+{
+	uint32_t x = 0;
+
+	for (; x + 8 <= pairs; x += 8) {
+		const uint8_t *lum0 = in[0] + x * 2;
+		const uint8_t *lum1 = lum0 + lum_linesize;
+		__m256i chroma = _mm256_cvtepu16_epi32(
+			_mm_loadu_si128((const __m128i *)(in[1] + x * 2)));
+		chroma = _mm256_slli_epi32(chroma, 8);
+
+		store_packed_avx2(output + x * 8,
+				  _mm_loadu_si128((const __m128i *)lum0), 0,
+				  chroma);
+		store_packed_avx2(output + x * 8 + out_linesize,
+				  _mm_loadu_si128((const __m128i *)lum1), 0,
+				  chroma);
+	}
+
+	if (x < pairs) {
+		const uint8_t *const tail[] = {in[0] + x * 2, in[1] + x * 2};
+		nv12_to_packed_c(tail, lum_linesize, output + x * 8,
+				 out_linesize, pairs - x);
+	}
+}
+
+AVX2_TARGET static void packed422_to_packed_avx2(const uint8_t *input,
+						 uint8_t *output,
+						 uint32_t pairs,
+						 bool leading_lum)
+{
+	/* the second pixel of each pair takes its own luma in place of the
+	 * first one's */
+	const __m256i keep_mask = _mm256_set1_epi32(
+		leading_lum ? (int)0xFFFFFF00 : (int)0xFFFF00FF);
+	const __m256i lum_mask =
+		_mm256_set1_epi32(leading_lum ? 0x000000FF : 0x0000FF00);
+	uint32_t x = 0;
+
+	for (; x + 8 <= pairs; x += 8) {
+		__m256i dw =
+			_mm256_loadu_si256((const __m256i *)(input + x * 4));
+		__m256i second = _mm256_or_si256(
+			_mm256_and_si256(dw, keep_mask),
+			_mm256_and_si256(_mm256_srli_epi32(dw, 16), lum_mask));
+		__m256i lo = _mm256_unpacklo_epi32(dw, second);
+		__m256i hi = _mm256_unpackhi_epi32(dw, second);
+
+		_mm256_storeu_si256((__m256i *)(output + x * 8),
+				    _mm256_permute2x128_si256(lo, hi, 0x20));
+		_mm256_storeu_si256((__m256i *)(output + x * 8 + 32),
+				    _mm256_permute2x128_si256(lo, hi, 0x31));
+	}
+
+	if (x < pairs)
+		packed422_to_packed_c(input + x * 4, output + x * 8, pairs - x,
+				      leading_lum);
+}
+
+static const struct format_kernels kernels_avx2 = {
+	FORMAT_CONVERSION_AVX2,
+	uyvx_to_i420_avx2,
+	uyvx_to_nv12_avx2,
+	uyvx_to_i444_avx2,
+	i420_to_packed_avx2,
+	nv12_to_packed_avx2,
+	packed422_to_packed_avx2,
+};
+#endif
+
+/* ------------------------------------------------------------------------- */
+
+static const struct format_kernels *kernels = NULL;
+static pthread_once_t kernels_once = PTHREAD_ONCE_INIT;
+
+static const struct format_kernels *
+find_kernels(enum format_conversion_impl impl)
+{
+	switch (impl) {
+	case FORMAT_CONVERSION_SSE2:
+		return &kernels_sse2;
+	case FORMAT_CONVERSION_AVX2:
+#ifdef SIMD_HAVE_AVX
+		if (simd_cpu_has_avx2())
+			return &kernels_avx2;
+#endif
+		break;
+	}
+
+	return NULL;
+}
+
+static void init_kernels(void)
+{
+	const struct format_kernels *best =
+		find_kernels(FORMAT_CONVERSION_AVX2);
+	kernels = best ? best : &kernels_sse2;
+}
+
+static inline const struct format_kernels *get_kernels(void)
+{
+	pthread_once(&kernels_once, init_kernels);
+	return kernels;
+}
+
+enum format_conversion_impl format_conversion_get_impl(void)
+{
+	return get_kernels()->impl;
+}
+
+bool format_conversion_set_impl(enum format_conversion_impl impl)
+{
+	const struct format_kernels *new_kernels = find_kernels(impl);
+	if (!new_kernels)
+		return false;
+
+	/* keep a later first use from overwriting the forced table */
+	pthread_once(&kernels_once, init_kernels);
+	kernels = new_kernels;
+	return true;
+}
+
+/* ------------------------------------------------------------------------- */
+
+void compress_uyvx_to_i420(const uint8_t *input, uint32_t in_linesize,
 			   uint32_t start_y, uint32_t end_y, uint8_t *output[],
 			   const uint32_t out_linesize[])
 {
-	uint8_t *lum_plane = output[0];
-	uint8_t *chroma_plane = output[1];
+	const struct format_kernels *k = get_kernels();
 	uint32_t width = min_uint32(in_linesize, out_linesize[0]);
-	uint32_t y;
-
-	__m128i lum_mask = _mm_set1_epi32(0x0000FF00);
-	__m128i uv_mask = _mm_set1_epi16(0x00FF);
 
-	for (y = start_y; y < end_y; y += 2) {
-		uint32_t y_pos = y * in_linesize;
+	for (uint32_t y = start_y; y < end_y; y += 2) {
 		uint32_t chroma_y_pos = (y >> 1) * out_linesize[1];
-		uint32_t lum_y_pos = y * out_linesize[0];
-		uint32_t x;
+		uint8_t *const out[] = {output[0] + y * out_linesize[0],
+					output[1] + chroma_y_pos,
+					output[2] + chroma_y_pos};
 
-		for (x = 0; x < width; x += 4) {
-			const uint8_t *img = input + y_pos + x * 4;
-			uint32_t lum_pos0 = lum_y_pos + x;
-			uint32_t lum_pos1 = lum_pos0 + out_linesize[0];
+		k->uyvx_to_i420(input + y * in_linesize, in_linesize, out,
+				out_linesize[0], width);
+	}
+}
+
+void compress_uyvx_to_nv12(const uint8_t *input, uint32_t in_linesize,
+			   uint32_t start_y, uint32_t end_y, uint8_t *output[],
+			   const uint32_t out_linesize[])
+{
+	const struct format_kernels *k = get_kernels();
+	uint32_t width = min_uint32(in_linesize, out_linesize[0]);
 
-			__m128i line1 = _mm_load_si128((const __m128i *)img);
-			__m128i line2 = _mm_load_si128(
-				(const __m128i *)(img + in_linesize));
+	for (uint32_t y = start_y; y < end_y; y += 2) {
+		uint8_t *const out[] = {output[0] + y * out_linesize[0],
+					output[1] + (y >> 1) * out_linesize[1]};
 
-			pack_shift(lum_plane, lum_pos0, lum_pos1, line1, line2,
-				   lum_mask, 1);
-			pack_ch_1plane(chroma_plane, chroma_y_pos + x, line1,
-				       line2, uv_mask);
-		}
+		k->uyvx_to_nv12(input + y * in_linesize, in_linesize, out,
+				out_linesize[0], width);
 	}
 }
 
@@ -166,37 +653,17 @@ void convert_uyvx_to_i444(const uint8_t *input, uint32_t in_linesize,
 			  uint32_t start_y, uint32_t end_y, uint8_t *output[],
 			  const uint32_t out_linesize[])
 {
-	uint8_t *lum_plane = output[0];
-	uint8_t *u_plane = output[1];
-	uint8_t *v_plane = output[2];
+	const struct format_kernels *k = get_kernels();
 	uint32_t width = min_uint32(in_linesize, out_linesize[0]);
-	uint32_t y;
 
-	__m128i lum_mask = _mm_set1_epi32(0x0000FF00);
-	__m128i u_mask = _mm_set1_epi32(0x000000FF);
-	__m128i v_mask = _mm_set1_epi32(0x00FF0000);
-
-	for (y = start_y; y < end_y; y += 2) {
-		uint32_t y_pos = y * in_linesize;
+	for (uint32_t y = start_y; y < end_y; y += 2) {
 		uint32_t lum_y_pos = y * out_linesize[0];
-		uint32_t x;
-
-		for (x = 0; x < width; x += 4) {
-			const uint8_t *img = input + y_pos + x * 4;
-			uint32_t lum_pos0 = lum_y_pos + x;
-			uint32_t lum_pos1 = lum_pos0 + out_linesize[0];
-
-			__m128i line1 = _mm_load_si128((const __m128i *)img);
-			__m128i line2 = _mm_load_si128(
-				(const __m128i *)(img + in_linesize));
-
-			pack_shift(lum_plane, lum_pos0, lum_pos1, line1, line2,
-				   lum_mask, 1);
-			pack_val(u_plane, lum_pos0, lum_pos1, line1, line2,
-				 u_mask);
-			pack_shift(v_plane, lum_pos0, lum_pos1, line1, line2,
-				   v_mask, 2);
-		}
+		uint8_t *const out[] = {output[0] + lum_y_pos,
+					output[1] + lum_y_pos,
+					output[2] + lum_y_pos};
+
+		k->uyvx_to_i444(input + y * in_linesize, in_linesize, out,
+				out_linesize[0], width);
 	}
 }
 
@@ -204,33 +671,19 @@ void decompress_420(const uint8_t *const input[], const uint32_t in_linesize[],
 		    uint32_t start_y, uint32_t end_y, uint8_t *output,
 		    uint32_t out_linesize)
 {
+	const struct format_kernels *k = get_kernels();
 	uint32_t start_y_d2 = start_y / 2;
 	uint32_t width_d2 = in_linesize[0] / 2;
 	uint32_t height_d2 = end_y / 2;
-	uint32_t y;
-
-	for (y = start_y_d2; y < height_d2; y++) {
-		const uint8_t *chroma0 = input[1] + y * in_linesize[1];
-		const uint8_t *chroma1 = input[2] + y * in_linesize[2];
-		register const uint8_t *lum0, *lum1;
-		register uint32_t *output0, *output1;
-		uint32_t x;
-
-		lum0 = input[0] + y * 2 * in_linesize[0];
-		lum1 = lum0 + in_linesize[0];
-		output0 = (uint32_t *)(output + y * 2 * out_linesize);
-		output1 = (uint32_t *)((uint8_t *)output0 + out_linesize);
 
-		for (x = 0; x < width_d2; x++) {
-			uint32_t out;
-			out = (*(chroma0++) << 8) | *(chroma1++);
+	for (uint32_t y = start_y_d2; y < height_d2; y++) {
+		const uint8_t *const in[] = {input[0] + y * 2 * in_linesize[0],
+					     input[1] + y * in_linesize[1],
+					     input[2] + y * in_linesize[2]};
 
-			*(output0++) = (*(lum0++) << 16) | out;
-			*(output0++) = (*(lum0++) << 16) | out;
-
-			*(output1++) = (*(lum1++) << 16) | out;
-			*(output1++) = (*(lum1++) << 16) | out;
-		}
+		k->i420_to_packed(in, in_linesize[0],
+				  output + y * 2 * out_linesize, out_linesize,
+				  width_d2);
 	}
 }
 
@@ -238,32 +691,18 @@ void decompress_nv12(const uint8_t *const input[], const uint32_t in_linesize[],
 		     uint32_t start_y, uint32_t end_y, uint8_t *output,
 		     uint32_t out_linesize)
 {
+	const struct format_kernels *k = get_kernels();
 	uint32_t start_y_d2 = start_y / 2;
 	uint32_t width_d2 = min_uint32(in_linesize[0], out_linesize) / 2;
 	uint32_t height_d2 = end_y / 2;
-	uint32_t y;
 
-	for (y = start_y_d2; y < height_d2; y++) {
-		const uint16_t *chroma;
-		register const uint8_t *lum0, *lum1;
-		register uint32_t *output0, *output1;
-		uint32_t x;
+	for (uint32_t y = start_y_d2; y < height_d2; y++) {
+		const uint8_t *const in[] = {input[0] + y * 2 * in_linesize[0],
+					     input[1] + y * in_linesize[1]};
 
-		chroma = (const uint16_t *)(input[1] + y * in_linesize[1]);
-		lum0 = input[0] + y * 2 * in_linesize[0];
-		lum1 = lum0 + in_linesize[0];
-		output0 = (uint32_t *)(output + y * 2 * out_linesize);
-		output1 = (uint32_t *)((uint8_t *)output0 + out_linesize);
-
-		for (x = 0; x < width_d2; x++) {
-			uint32_t out = *(chroma++) << 8;
-
-			*(output0++) = *(lum0++) | out;
-			*(output0++) = *(lum0++) | out;
-
-			*(output1++) = *(lum1++) | out;
-			*(output1++) = *(lum1++) | out;
-		}
+		k->nv12_to_packed(in, in_linesize[0],
+				  output + y * 2 * out_linesize, out_linesize,
+				  width_d2);
 	}
 }
 
@@ -271,48 +710,11 @@ void decompress_422(const uint8_t *input, uint32_t in_linesize,
 		    uint32_t start_y, uint32_t end_y, uint8_t *output,
 		    uint32_t out_linesize, bool leading_lum)
 {
+	const struct format_kernels *k = get_kernels();
 	uint32_t width_d2 = min_uint32(in_linesize, out_linesize) / 2;
-	uint32_t y;
-
-	register const uint32_t *input32;
-	register const uint32_t *input32_end;
-	register uint32_t *output32;
 
-	if (leading_lum) {
-		for (y = start_y; y < end_y; y++) {
-			input32 = (const uint32_t *)(input + y * in_linesize);
-			input32_end = input32 + width_d2;
-			output32 = (uint32_t *)(output + y * out_linesize);
-
-			while (input32 < input32_end) {
-				register uint32_t dw = *input32;
-
-				output32[0] = dw;
-				dw &= 0xFFFFFF00;
-				dw |= (uint8_t)(dw >> 16);
-				output32[1] = dw;
-
-				output32 += 2;
-				input32++;
-			}
-		}
-	} else {
-		for (y = start_y; y < end_y; y++) {
-			input32 = (const uint32_t *)(input + y * in_linesize);
-			input32_end = input32 + width_d2;
-			output32 = (uint32_t *)(output + y * out_linesize);
-
-			while (input32 < input32_end) {
-				register uint32_t dw = *input32;
-
-				output32[0] = dw;
-				dw &= 0xFFFF00FF;
-				dw |= (dw >> 16) & 0xFF00;
-				output32[1] = dw;
-
-				output32 += 2;
-				input32++;
-			}
-		}
-	}
+	for (uint32_t y = start_y; y < end_y; y++)
+		k->packed422_to_packed(input + y * in_linesize,
+				       output + y * out_linesize, width_d2,
+				       leading_lum);
 }
@@ -25,8 +25,16 @@ extern "C" {
 
 /*
  * Functions for converting to and from packed 444 YUV
+ *
+ * The implementation is picked at runtime from the best one the CPU
+ * supports; every implementation produces bit-identical output.
  */
 
+enum format_conversion_impl {
+	FORMAT_CONVERSION_SSE2,
+	FORMAT_CONVERSION_AVX2,
+};
+
 EXPORT void compress_uyvx_to_i420(const uint8_t *input, uint32_t in_linesize,
 				  uint32_t start_y, uint32_t end_y,
 				  uint8_t *output[],
@@ -56,6 +64,12 @@ EXPORT void decompress_422(const uint8_t *input, uint32_t in_linesize,
 			   uint32_t start_y, uint32_t end_y, uint8_t *output,
 			   uint32_t out_linesize, bool leading_lum);
 
+EXPORT enum format_conversion_impl format_conversion_get_impl(void);
+
+/* forces a specific implementation, mainly for testing.  returns false if
+ * the CPU does not support it. */
+EXPORT bool format_conversion_set_impl(enum format_conversion_impl impl);
+
 #ifdef __cplusplus
 }
 #endif
@@ -19,9 +19,14 @@
 
 #include "../util/base.h"
 #include "../util/bmem.h"
+#include "../util/circlebuf.h"
+#include "../util/darray.h"
+#include "../util/dstr.h"
 #include "../util/platform.h"
+#include "../util/threading.h"
 
 #include <libavformat/avformat.h>
+#include <stdio.h>
 
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -32,9 +37,44 @@
 #define CODEC_FLAG_GLOBAL_H CODEC_FLAG_GLOBAL_HEADER
 #endif
 
+/* packets the reader may get ahead of the writer by */
+#define REMUX_QUEUE_SIZE 512
+
+/* output is written in large chunks instead of AVIO's default 32k */
+#define REMUX_IO_BUFFER_SIZE (4 * 1024 * 1024)
+
+/* files a batch remuxes at once.  each file already has a reader and a
+ * writer thread, and remuxing is bound by disk I/O, so more files at once
+ * mostly adds seeking. */
+#define REMUX_BATCH_THREADS 2
+
+#if LIBAVFORMAT_VERSION_MAJOR >= 61
+#define AVIO_WRITE_CONST const
+#else
+#define AVIO_WRITE_CONST
+#endif
+
+struct remux_packet {
+	AVPacket *pkt;
+	float progress;
+};
+
 struct media_remux_job {
 	int64_t in_size;
 	AVFormatContext *ifmt_ctx, *ofmt_ctx;
+
+	FILE *out_file;
+	int64_t *last_dts;
+
+	pthread_t read_thread;
+	bool read_thread_active;
+	volatile bool stop;
+	int read_ret;
+
+	pthread_mutex_t queue_mutex;
+	os_sem_t *queue_space;
+	os_sem_t *queue_packets;
+	struct circlebuf queue;
 };
 
 static inline void init_size(media_remux_job_t job, const char *in_filename)
@@ -71,6 +111,62 @@ static inline bool init_input(media_remux_job_t job, const char *in_filename)
 	return true;
 }
 
+static int write_output(void *opaque, AVIO_WRITE_CONST uint8_t *buf,
+			int size)
+{
+	FILE *file = opaque;
+	size_t written = fwrite(buf, 1, size, file);
+	return written == (size_t)size ? size : AVERROR(EIO);
+}
+
+static int64_t seek_output(void *opaque, int64_t offset, int whence)
+{
+	FILE *file = opaque;
+	int64_t pos, size;
+
+	if (whence == AVSEEK_SIZE) {
+		pos = os_ftelli64(file);
+		if (os_fseeki64(file, 0, SEEK_END) != 0)
+			return -1;
+
+		size = os_ftelli64(file);
+		os_fseeki64(file, pos, SEEK_SET);
+		return size;
+	}
+
+	if (os_fseeki64(file, offset, whence) != 0)
+		return -1;
+	return os_ftelli64(file);
+}
+
+/* the output goes through our own AVIO context so that the muxer hands the
+ * file system a few large writes rather than many small ones */
+static bool open_output_file(media_remux_job_t job, const char *out_filename)
+{
+	uint8_t *buffer;
+
+	job->out_file = os_fopen(out_filename, "wb");
+	if (!job->out_file)
+		return false;
+
+	/* AVIO does the buffering */
+	setvbuf(job->out_file, NULL, _IONBF, 0);
+
+	buffer = av_malloc(REMUX_IO_BUFFER_SIZE);
+	if (!buffer)
+		return false;
+
+	job->ofmt_ctx->pb = avio_alloc_context(buffer, REMUX_IO_BUFFER_SIZE, 1,
+					       job->out_file, NULL,
+					       write_output, seek_output);
+	if (!job->ofmt_ctx->pb) {
+		av_free(buffer);
+		return false;
+	}
+
+	return true;
+}
+
 static inline bool init_output(media_remux_job_t job, const char *out_filename)
 {
 	int ret;
@@ -126,9 +222,7 @@ static inline bool init_output(media_remux_job_t job, const char *out_filename)
 #endif
 
 	if (!(job->ofmt_ctx->oformat->flags & AVFMT_NOFILE)) {
-		ret = avio_open(&job->ofmt_ctx->pb, out_filename,
-				AVIO_FLAG_WRITE);
-		if (ret < 0) {
+		if (!open_output_file(job, out_filename)) {
 			blog(LOG_ERROR,
 			     "media_remux: Failed to open output"
 			     " file '%s'",
@@ -137,6 +231,10 @@ static inline bool init_output(media_remux_job_t job, const char *out_filename)
 		}
 	}
 
+	job->last_dts = bmalloc(sizeof(int64_t) * job->ifmt_ctx->nb_streams);
+	for (unsigned i = 0; i < job->ifmt_ctx->nb_streams; i++)
+		job->last_dts[i] = AV_NOPTS_VALUE;
+
 	return true;
 }
 
@@ -159,6 +257,13 @@ bool media_remux_job_create(media_remux_job_t *job, const char *in_filename,
 
 	init_size(*job, in_filename);
 
+	if (pthread_mutex_init(&(*job)->queue_mutex, NULL) != 0)
+		goto fail_mutex;
+	if (os_sem_init(&(*job)->queue_space, REMUX_QUEUE_SIZE) != 0)
+		goto fail;
+	if (os_sem_init(&(*job)->queue_packets, 0) != 0)
+		goto fail;
+
 #if LIBAVCODEC_VERSION_INT < AV_VERSION_INT(58, 9, 100)
 	av_register_all();
 #endif
@@ -173,12 +278,20 @@ bool media_remux_job_create(media_remux_job_t *job, const char *in_filename,
 
 fail:
 	media_remux_job_destroy(*job);
+	*job = NULL;
+	return false;
+
+fail_mutex:
+	bfree(*job);
+	*job = NULL;
 	return false;
 }
 
-static inline void process_packet(AVPacket *pkt, AVStream *in_stream,
-				  AVStream *out_stream)
+static inline void process_packet(media_remux_job_t job, AVPacket *pkt,
+				  AVStream *in_stream, AVStream *out_stream)
 {
+	int64_t *last_dts = &job->last_dts[pkt->stream_index];
+
 	pkt->pts = av_rescale_q_rnd(pkt->pts, in_stream->time_base,
 				    out_stream->time_base,
 				    AV_ROUND_NEAR_INF | AV_ROUND_PASS_MINMAX);
@@ -188,38 +301,169 @@ static inline void process_packet(AVPacket *pkt, AVStream *in_stream,
 	pkt->duration = (int)av_rescale_q(pkt->duration, in_stream->time_base,
 					  out_stream->time_base);
 	pkt->pos = -1;
+
+	/* muxers reject non-increasing dts, which used to drop the packet
+	 * entirely.  nudge it forward instead. */
+	if (pkt->dts != AV_NOPTS_VALUE) {
+		if (*last_dts != AV_NOPTS_VALUE && pkt->dts <= *last_dts) {
+			pkt->dts = *last_dts + 1;
+			if (pkt->pts != AV_NOPTS_VALUE && pkt->pts < pkt->dts)
+				pkt->pts = pkt->dts;
+		}
+
+		*last_dts = pkt->dts;
+	}
 }
 
-static inline int process_packets(media_remux_job_t job,
-				  media_remux_progress_callback callback,
-				  void *data)
+/* progress by the position of the packet in the timeline, which unlike the
+ * file position is also right for files with a large index or trailer */
+static inline float packet_progress(media_remux_job_t job, AVPacket *pkt,
+				    AVStream *in_stream, float last)
 {
-	AVPacket pkt;
+	AVFormatContext *ctx = job->ifmt_ctx;
+	int64_t start = ctx->start_time != AV_NOPTS_VALUE ? ctx->start_time : 0;
+	int64_t ts;
+
+	if (ctx->duration > 0 && pkt->dts != AV_NOPTS_VALUE) {
+		ts = av_rescale_q(pkt->dts, in_stream->time_base,
+				  AV_TIME_BASE_Q) -
+		     start;
+		if (ts < 0)
+			return last;
+		if (ts > ctx->duration)
+			return 100.f;
+
+		return (float)ts / (float)ctx->duration * 100.f;
+	}
 
-	int ret, throttle = 0;
-	for (;;) {
-		ret = av_read_frame(job->ifmt_ctx, &pkt);
+	if (pkt->pos >= 0 && job->in_size > 0)
+		return (float)pkt->pos / (float)job->in_size * 100.f;
+
+	return last;
+}
+
+static void push_packet(media_remux_job_t job, AVPacket *pkt, float progress)
+{
+	struct remux_packet rp = {pkt, progress};
+
+	os_sem_wait(job->queue_space);
+
+	pthread_mutex_lock(&job->queue_mutex);
+	circlebuf_push_back(&job->queue, &rp, sizeof(rp));
+	pthread_mutex_unlock(&job->queue_mutex);
+
+	os_sem_post(job->queue_packets);
+}
+
+static struct remux_packet pop_packet(media_remux_job_t job)
+{
+	struct remux_packet rp;
+
+	os_sem_wait(job->queue_packets);
+
+	pthread_mutex_lock(&job->queue_mutex);
+	circlebuf_pop_front(&job->queue, &rp, sizeof(rp));
+	pthread_mutex_unlock(&job->queue_mutex);
+
+	os_sem_post(job->queue_space);
+	return rp;
+}
+
+/* reads and fixes up packets ahead of the writer.  a NULL packet marks the
+ * end, with read_ret telling why. */
+static void *read_thread(void *data)
+{
+	media_remux_job_t job = data;
+	float progress = 0.f;
+	int ret = 0;
+
+	os_set_thread_name("media_remux: read");
+
+	while (!os_atomic_load_bool(&job->stop)) {
+		AVPacket *pkt = av_packet_alloc();
+		AVStream *in_stream;
+
+		if (!pkt) {
+			ret = AVERROR(ENOMEM);
+			break;
+		}
+
+		ret = av_read_frame(job->ifmt_ctx, pkt);
 		if (ret < 0) {
 			if (ret != AVERROR_EOF)
 				blog(LOG_ERROR,
 				     "media_remux: Error reading"
 				     " packet: %s",
 				     av_err2str(ret));
+			av_packet_free(&pkt);
+			break;
+		}
+
+		in_stream = job->ifmt_ctx->streams[pkt->stream_index];
+		progress = packet_progress(job, pkt, in_stream, progress);
+
+		process_packet(job, pkt, in_stream,
+			       job->ofmt_ctx->streams[pkt->stream_index]);
+		push_packet(job, pkt, progress);
+	}
+
+	job->read_ret = ret;
+	push_packet(job, NULL, progress);
+	return NULL;
+}
+
+static void stop_read_thread(media_remux_job_t job)
+{
+	struct remux_packet rp;
+
+	if (!job->read_thread_active)
+		return;
+
+	/* drain the queue so the reader can't block on a full one */
+	os_atomic_set_bool(&job->stop, true);
+	do {
+		rp = pop_packet(job);
+		av_packet_free(&rp.pkt);
+	} while (rp.pkt);
+
+	pthread_join(job->read_thread, NULL);
+	job->read_thread_active = false;
+}
+
+static inline int process_packets(media_remux_job_t job,
+				  media_remux_progress_callback callback,
+				  void *data)
+{
+	int ret, throttle = 0;
+
+	if (pthread_create(&job->read_thread, NULL, read_thread, job) != 0) {
+		blog(LOG_ERROR, "media_remux: Failed to create read thread");
+		return AVERROR(ENOMEM);
+	}
+
+	job->read_thread_active = true;
+
+	for (;;) {
+		struct remux_packet rp = pop_packet(job);
+		if (!rp.pkt) {
+			ret = job->read_ret;
+			job->read_thread_active = false;
+			pthread_join(job->read_thread, NULL);
 			break;
 		}
 
 		if (callback != NULL && throttle++ > 10) {
-			float progress = pkt.pos / (float)job->in_size * 100.f;
-			if (!callback(data, progress))
+			if (!callback(data, rp.progress)) {
+				av_packet_free(&rp.pkt);
+				stop_read_thread(job);
+				ret = 0;
 				break;
+			}
 			throttle = 0;
 		}
 
-		process_packet(&pkt, job->ifmt_ctx->streams[pkt.stream_index],
-			       job->ofmt_ctx->streams[pkt.stream_index]);
-
-		ret = av_interleaved_write_frame(job->ofmt_ctx, &pkt);
-		av_packet_unref(&pkt);
+		ret = av_interleaved_write_frame(job->ofmt_ctx, rp.pkt);
+		av_packet_free(&rp.pkt);
 
 		if (ret < 0) {
 			blog(LOG_ERROR, "media_remux: Error muxing packet: %s",
@@ -230,6 +474,7 @@ static inline int process_packets(media_remux_job_t job,
 			if (ret == AVERROR_INVALIDDATA || ret == -EINVAL)
 				continue;
 
+			stop_read_thread(job);
 			break;
 		}
 	}
@@ -279,10 +524,218 @@ void media_remux_job_destroy(media_remux_job_t job)
 
 	avformat_close_input(&job->ifmt_ctx);
 
-	if (job->ofmt_ctx && !(job->ofmt_ctx->oformat->flags & AVFMT_NOFILE))
-		avio_close(job->ofmt_ctx->pb);
+	if (job->out_file) {
+		if (job->ofmt_ctx->pb) {
+			av_freep(&job->ofmt_ctx->pb->buffer);
+#if LIBAVFORMAT_VERSION_INT >= AV_VERSION_INT(57, 80, 100)
+			avio_context_free(&job->ofmt_ctx->pb);
+#else
+			av_freep(&job->ofmt_ctx->pb);
+#endif
+		}
+
+		fclose(job->out_file);
+	}
 
 	avformat_free_context(job->ofmt_ctx);
 
+	os_sem_destroy(job->queue_packets);
+	os_sem_destroy(job->queue_space);
+	pthread_mutex_destroy(&job->queue_mutex);
+	circlebuf_free(&job->queue);
+	bfree(job->last_dts);
+
 	bfree(job);
 }
+
+/* ------------------------------------------------------------------------- */
+
+struct media_remux_batch {
+	const char *const *in_filenames;
+	const char *const *out_filenames;
+	size_t count;
+
+	pthread_mutex_t mutex;
+	size_t next;
+	float *progress;
+	bool failed;
+	bool canceled;
+
+	media_remux_progress_callback *callback;
+	void *data;
+};
+
+struct batch_job_progress {
+	struct media_remux_batch *batch;
+	size_t idx;
+};
+
+/* reports the average over all files, serialized across the workers */
+static bool batch_job_callback(void *data, float percent)
+{
+	struct batch_job_progress *job_progress = data;
+	struct media_remux_batch *batch = job_progress->batch;
+	float total = 0.f;
+	bool proceed;
+
+	pthread_mutex_lock(&batch->mutex);
+	batch->progress[job_progress->idx] = percent;
+
+	for (size_t i = 0; i < batch->count; i++)
+		total += batch->progress[i];
+
+	proceed = !batch->canceled;
+	if (proceed && batch->callback) {
+		proceed = batch->callback(batch->data,
+					  total / (float)batch->count);
+		if (!proceed)
+			batch->canceled = true;
+	}
+	pthread_mutex_unlock(&batch->mutex);
+
+	return proceed;
+}
+
+static void *batch_thread(void *data)
+{
+	struct media_remux_batch *batch = data;
+
+	os_set_thread_name("media_remux: batch");
+
+	for (;;) {
+		struct batch_job_progress job_progress = {batch, 0};
+		media_remux_job_t job;
+		bool success = false;
+
+		pthread_mutex_lock(&batch->mutex);
+		job_progress.idx = batch->next++;
+		if (batch->canceled)
+			job_progress.idx = batch->count;
+		pthread_mutex_unlock(&batch->mutex);
+
+		if (job_progress.idx >= batch->count)
+			break;
+
+		if (media_remux_job_create(&job,
+					   batch->in_filenames[job_progress.idx],
+					   batch->out_filenames[job_progress.idx])) {
+			success = media_remux_job_process(
+				job, batch_job_callback, &job_progress);
+			media_remux_job_destroy(job);
+		}
+
+		if (!success) {
+			blog(LOG_WARNING, "media_remux: Failed to remux '%s'",
+			     batch->in_filenames[job_progress.idx]);
+
+			pthread_mutex_lock(&batch->mutex);
+			batch->failed = true;
+			pthread_mutex_unlock(&batch->mutex);
+		}
+
+		batch_job_callback(&job_progress, 100.f);
+	}
+
+	return NULL;
+}
+
+bool media_remux_batch_process(const char *const *in_filenames,
+			       const char *const *out_filenames, size_t count,
+			       media_remux_progress_callback callback,
+			       void *data)
+{
+	struct media_remux_batch batch = {0};
+	DARRAY(pthread_t) threads;
+	size_t num_threads;
+
+	if (!count)
+		return true;
+
+	batch.in_filenames = in_filenames;
+	batch.out_filenames = out_filenames;
+	batch.count = count;
+	batch.callback = callback;
+	batch.data = data;
+	batch.progress = bzalloc(sizeof(float) * count);
+
+	if (pthread_mutex_init(&batch.mutex, NULL) != 0) {
+		bfree(batch.progress);
+		return false;
+	}
+
+	num_threads = REMUX_BATCH_THREADS;
+	if (num_threads > count)
+		num_threads = count;
+
+	da_init(threads);
+	for (size_t i = 0; i < num_threads; i++) {
+		pthread_t thread;
+		if (pthread_create(&thread, NULL, batch_thread, &batch) == 0)
+			da_push_back(threads, &thread);
+	}
+
+	/* if no thread could be created, do the work here */
+	if (!threads.num)
+		batch_thread(&batch);
+
+	for (size_t i = 0; i < threads.num; i++)
+		pthread_join(threads.array[i], NULL);
+
+	da_free(threads);
+	pthread_mutex_destroy(&batch.mutex);
+	bfree(batch.progress);
+
+	return !batch.failed && !batch.canceled;
+}
+
+bool media_remux_directory(const char *in_dir, const char *in_ext,
+			   const char *out_dir, const char *out_ext,
+			   media_remux_progress_callback callback, void *data)
+{
+	DARRAY(char *) in_files;
+	DARRAY(char *) out_files;
+	struct os_dirent *ent;
+	os_dir_t *dir;
+	bool success;
+
+	dir = os_opendir(in_dir);
+	if (!dir) {
+		blog(LOG_ERROR, "media_remux: Could not open directory '%s'",
+		     in_dir);
+		return false;
+	}
+
+	da_init(in_files);
+	da_init(out_files);
+
+	while ((ent = os_readdir(dir)) != NULL) {
+		const char *ext = os_get_path_extension(ent->d_name);
+		struct dstr in_path = {0};
+		struct dstr out_path = {0};
+
+		if (ent->directory || !ext || astrcmpi(ext, in_ext) != 0)
+			continue;
+
+		dstr_printf(&in_path, "%s/%s", in_dir, ent->d_name);
+		dstr_printf(&out_path, "%s/%.*s%s", out_dir,
+			    (int)(ext - ent->d_name), ent->d_name, out_ext);
+
+		da_push_back(in_files, &in_path.array);
+		da_push_back(out_files, &out_path.array);
+	}
+
+	os_closedir(dir);
+
+	success = media_remux_batch_process((const char *const *)in_files.array,
+					    (const char *const *)out_files.array,
+					    in_files.num, callback, data);
+
+	for (size_t i = 0; i < in_files.num; i++) {
+		bfree(in_files.array[i]);
+		bfree(out_files.array[i]);
+	}
+
+	da_free(in_files);
+	da_free(out_files);
+	return success;
+}
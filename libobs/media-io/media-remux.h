@@ -36,6 +36,21 @@ EXPORT bool media_remux_job_process(media_remux_job_t job,
 				    void *data);
 EXPORT void media_remux_job_destroy(media_remux_job_t job);
 
+/* remuxes a list of files, two at a time.  progress is the average over all
+ * files.  returns false if any file failed or it was canceled. */
+EXPORT bool media_remux_batch_process(const char *const *in_filenames,
+				      const char *const *out_filenames,
+				      size_t count,
+				      media_remux_progress_callback callback,
+				      void *data);
+
+/* remuxes every file in in_dir ending in in_ext (e.g. ".mkv") to a file of
+ * the same name ending in out_ext in out_dir */
+EXPORT bool media_remux_directory(const char *in_dir, const char *in_ext,
+				  const char *out_dir, const char *out_ext,
+				  media_remux_progress_callback callback,
+				  void *data);
+
 #ifdef __cplusplus
 }
 #endif
@@ -21,7 +21,9 @@
 #include "../util/platform.h"
 #include "../util/profiler.h"
 #include "../util/threading.h"
+#include "../util/trace.h"
 #include "../util/darray.h"
+#include "../util/circlebuf.h"
 #include "../util/util_uint64.h"
 
 #include "format-conversion.h"
@@ -33,11 +35,20 @@ extern profiler_name_store_t *obs_get_profiler_name_store(void);
 
 #define MAX_CONVERT_BUFFERS 3
 #define MAX_CACHE_SIZE 16
+#define MAX_INPUT_QUEUE 2
 
 struct cached_frame_info {
 	struct video_data frame;
 	int skipped;
 	int count;
+
+	/* number of input threads still using this frame */
+	long refs;
+};
+
+struct video_input_job {
+	struct video_data frame;
+	size_t cache_idx;
 };
 
 struct video_input {
@@ -48,14 +59,22 @@ struct video_input {
 
 	void (*callback)(void *param, struct video_data *frame);
 	void *param;
-};
 
-static inline void video_input_free(struct video_input *input)
-{
-	for (size_t i = 0; i < MAX_CONVERT_BUFFERS; i++)
-		video_frame_free(&input->frame[i]);
-	video_scaler_destroy(input->scaler);
-}
+	/* result of the last scale on the video thread, shared with later
+	 * inputs that want the same conversion of the same frame */
+	struct video_data scaled;
+	bool scaled_valid;
+
+	/* only used when the input has its own thread */
+	struct video_output *video;
+	bool threaded;
+	pthread_t thread;
+	os_sem_t *queue_sem;
+	pthread_mutex_t queue_mutex;
+	struct circlebuf queue;
+	volatile bool stop;
+	volatile long skipped_frames;
+};
 
 struct video_output {
 	struct video_output_info info;
@@ -68,21 +87,32 @@ struct video_output {
 	uint64_t frame_time;
 	volatile long skipped_frames;
 	volatile long total_frames;
+	volatile long scale_dedup_hits;
 
 	bool initialized;
+	bool parallel_inputs;
 
 	pthread_mutex_t input_mutex;
-	DARRAY(struct video_input) inputs;
+	DARRAY(struct video_input *) inputs;
 
 	size_t available_frames;
 	size_t first_added;
 	size_t last_added;
 	struct cached_frame_info cache[MAX_CACHE_SIZE];
 
+	/* frames the video thread is done with, but which may still be in use
+	 * by input threads.  they are returned to the cache in order. */
+	size_t first_busy;
+	size_t busy_frames;
+
 	volatile bool raw_active;
 	volatile long gpu_refs;
+
+	const char *scale_dedup_name;
 };
 
+static void video_input_destroy(struct video_input *input);
+
 /* ------------------------------------------------------------------------- */
 
 static inline bool scale_video_output(struct video_input *input,
@@ -116,9 +146,118 @@ static inline bool scale_video_output(struct video_input *input,
 	return success;
 }
 
+static inline bool same_conversion(const struct video_scale_info *a,
+				   const struct video_scale_info *b)
+{
+	return a->format == b->format && a->width == b->width &&
+	       a->height == b->height && a->range == b->range &&
+	       a->colorspace == b->colorspace;
+}
+
+/* input_mutex must be locked.  looks for an input earlier in the list that
+ * has already scaled the current frame to the same target. */
+static struct video_input *find_scaled_input(struct video_output *video,
+					     size_t idx)
+{
+	struct video_input *input = video->inputs.array[idx];
+
+	for (size_t i = 0; i < idx; i++) {
+		struct video_input *prev = video->inputs.array[i];
+
+		if (prev->scaled_valid &&
+		    same_conversion(&prev->conversion, &input->conversion))
+			return prev;
+	}
+
+	return NULL;
+}
+
+/* data_mutex must be locked */
+static inline void release_cached_frames(struct video_output *video)
+{
+	while (video->busy_frames) {
+		if (video->cache[video->first_busy].refs)
+			break;
+
+		if (++video->first_busy == video->info.cache_size)
+			video->first_busy = 0;
+		video->busy_frames--;
+
+		if (++video->available_frames == video->info.cache_size)
+			video->last_added = video->first_added;
+	}
+}
+
+static const char *video_input_name = "video_input";
+static const char *video_dispatch_name = "video_dispatch";
+static const char *skipped_frame_name = "skipped_frame";
+
+static void *video_input_thread(void *param)
+{
+	struct video_input *input = param;
+	struct video_output *video = input->video;
+
+	os_set_thread_name("video-io: input thread");
+	trace_set_thread_name("video-io: input thread");
+
+	while (os_sem_wait(input->queue_sem) == 0) {
+		struct video_input_job job;
+
+		if (os_atomic_load_bool(&input->stop))
+			break;
+
+		pthread_mutex_lock(&input->queue_mutex);
+		circlebuf_pop_front(&input->queue, &job, sizeof(job));
+		pthread_mutex_unlock(&input->queue_mutex);
+
+		if (scale_video_output(input, &job.frame)) {
+			uint64_t trace_ts = trace_begin();
+			input->callback(input->param, &job.frame);
+			trace_end(video_input_name, job.frame.timestamp,
+				  trace_ts);
+		}
+
+		pthread_mutex_lock(&video->data_mutex);
+		video->cache[job.cache_idx].refs--;
+		release_cached_frames(video);
+		pthread_mutex_unlock(&video->data_mutex);
+	}
+
+	return NULL;
+}
+
+static void video_input_queue_frame(struct video_output *video,
+				    struct video_input *input,
+				    struct video_data *frame, size_t cache_idx)
+{
+	struct video_input_job job = {*frame, cache_idx};
+
+	pthread_mutex_lock(&input->queue_mutex);
+
+	/* if this input's encoder is lagging, skip the frame for this input
+	 * only rather than holding up every other input */
+	if (input->queue.size >= MAX_INPUT_QUEUE * sizeof(job)) {
+		pthread_mutex_unlock(&input->queue_mutex);
+		os_atomic_inc_long(&input->skipped_frames);
+		trace_instant(skipped_frame_name, frame->timestamp);
+		return;
+	}
+
+	pthread_mutex_lock(&video->data_mutex);
+	video->cache[cache_idx].refs++;
+	pthread_mutex_unlock(&video->data_mutex);
+
+	circlebuf_push_back(&input->queue, &job, sizeof(job));
+	pthread_mutex_unlock(&input->queue_mutex);
+
+	os_sem_post(input->queue_sem);
+}
+
 static inline bool video_output_cur_frame(struct video_output *video)
 {
 	struct cached_frame_info *frame_info;
+	size_t cache_idx;
+	uint64_t trace_ts;
 	bool complete;
 	bool skipped;
 
@@ -126,22 +265,55 @@ static inline bool video_output_cur_frame(struct video_output *video)
 
 	pthread_mutex_lock(&video->data_mutex);
 
-	frame_info = &video->cache[video->first_added];
+	cache_idx = video->first_added;
+	frame_info = &video->cache[cache_idx];
 
 	pthread_mutex_unlock(&video->data_mutex);
 
 	/* -------------------------------- */
 
 	pthread_mutex_lock(&video->input_mutex);
+	trace_ts = trace_begin();
 
 	for (size_t i = 0; i < video->inputs.num; i++) {
-		struct video_input *input = video->inputs.array + i;
+		struct video_input *input = video->inputs.array[i];
 		struct video_data frame = frame_info->frame;
+		struct video_input *scaled;
+
+		input->scaled_valid = false;
+
+		if (input->threaded) {
+			video_input_queue_frame(video, input, &frame,
+						cache_idx);
+			continue;
+		}
+
+		if (!input->scaler) {
+			input->callback(input->param, &frame);
+			continue;
+		}
 
-		if (scale_video_output(input, &frame))
+		/* outputs sharing a scaled size/format only scale once */
+		scaled = find_scaled_input(video, i);
+		if (scaled) {
+			/* the entry's call count is the number of reuses */
+			profile_start(video->scale_dedup_name);
+			memcpy(frame.data, scaled->scaled.data,
+			       sizeof(frame.data));
+			memcpy(frame.linesize, scaled->scaled.linesize,
+			       sizeof(frame.linesize));
+			profile_end(video->scale_dedup_name);
+			os_atomic_inc_long(&video->scale_dedup_hits);
+
+			input->callback(input->param, &frame);
+		} else if (scale_video_output(input, &frame)) {
+			input->scaled = frame;
+			input->scaled_valid = true;
 			input->callback(input->param, &frame);
+		}
 	}
 
+	trace_end(video_dispatch_name, frame_info->frame.timestamp, trace_ts);
 	pthread_mutex_unlock(&video->input_mutex);
 
 	/* -------------------------------- */
@@ -156,11 +328,12 @@ static inline bool video_output_cur_frame(struct video_output *video)
 		if (++video->first_added == video->info.cache_size)
 			video->first_added = 0;
 
-		if (++video->available_frames == video->info.cache_size)
-			video->last_added = video->first_added;
+		video->busy_frames++;
+		release_cached_frames(video);
 	} else if (skipped) {
 		--frame_info->skipped;
 		os_atomic_inc_long(&video->skipped_frames);
+		trace_instant(skipped_frame_name, frame_info->frame.timestamp);
 	}
 
 	pthread_mutex_unlock(&video->data_mutex);
@@ -175,10 +348,14 @@ static void *video_thread(void *param)
 	struct video_output *video = param;
 
 	os_set_thread_name("video-io: video thread");
+	trace_set_thread_name("video-io: video thread");
 
 	const char *video_thread_name =
 		profile_store_name(obs_get_profiler_name_store(),
 				   "video_thread(%s)", video->info.name);
+	video->scale_dedup_name = profile_store_name(
+		obs_get_profiler_name_store(), "scale_dedup_hit(%s)",
+		video->info.name);
 
 	while (os_sem_wait(video->update_semaphore) == 0) {
 		if (video->stop)
@@ -271,7 +448,7 @@ void video_output_close(video_t *video)
 	video_output_stop(video);
 
 	for (size_t i = 0; i < video->inputs.num; i++)
-		video_input_free(&video->inputs.array[i]);
+		video_input_destroy(video->inputs.array[i]);
 	da_free(video->inputs);
 
 	for (size_t i = 0; i < video->info.cache_size; i++)
@@ -289,7 +466,7 @@ static size_t video_get_input_idx(const video_t *video,
 				  void *param)
 {
 	for (size_t i = 0; i < video->inputs.num; i++) {
-		struct video_input *input = video->inputs.array + i;
+		struct video_input *input = video->inputs.array[i];
 		if (input->callback == callback && input->param == param)
 			return i;
 	}
@@ -297,6 +474,97 @@ static size_t video_get_input_idx(const video_t *video,
 	return DARRAY_INVALID;
 }
 
+static bool video_input_start_thread(struct video_input *input,
+				     struct video_output *video)
+{
+	input->video = video;
+	input->stop = false;
+	pthread_mutex_init_value(&input->queue_mutex);
+
+	if (pthread_mutex_init(&input->queue_mutex, NULL) != 0)
+		return false;
+	if (os_sem_init(&input->queue_sem, 0) != 0)
+		goto fail;
+	if (pthread_create(&input->thread, NULL, video_input_thread, input) !=
+	    0)
+		goto fail;
+
+	input->threaded = true;
+	return true;
+
+fail:
+	os_sem_destroy(input->queue_sem);
+	pthread_mutex_destroy(&input->queue_mutex);
+	return false;
+}
+
+static void video_input_stop_thread(struct video_input *input)
+{
+	struct video_output *video = input->video;
+
+	os_atomic_set_bool(&input->stop, true);
+	os_sem_post(input->queue_sem);
+	pthread_join(input->thread, NULL);
+
+	/* release any frames that were still queued */
+	pthread_mutex_lock(&video->data_mutex);
+	while (input->queue.size) {
+		struct video_input_job job;
+		circlebuf_pop_front(&input->queue, &job, sizeof(job));
+		video->cache[job.cache_idx].refs--;
+	}
+	release_cached_frames(video);
+	pthread_mutex_unlock(&video->data_mutex);
+
+	circlebuf_free(&input->queue);
+	os_sem_destroy(input->queue_sem);
+	pthread_mutex_destroy(&input->queue_mutex);
+	input->threaded = false;
+}
+
+/* with a single input there is nothing to stall, so inputs only get their
+ * own thread once a second one is connected.  called with input_mutex held,
+ * so the video thread is not dispatching to any serial input. */
+static void update_input_threads(struct video_output *video)
+{
+	bool threaded = video->parallel_inputs && video->inputs.num > 1;
+
+	for (size_t i = 0; i < video->inputs.num; i++) {
+		struct video_input *input = video->inputs.array[i];
+
+		if (input->threaded == threaded)
+			continue;
+
+		if (!threaded)
+			video_input_stop_thread(input);
+		else if (!video_input_start_thread(input, video))
+			blog(LOG_WARNING, "video-io: Failed to create input "
+					  "thread, falling back to the video "
+					  "thread");
+	}
+}
+
+static void video_input_destroy(struct video_input *input)
+{
+	long skipped;
+
+	if (input->threaded) {
+		video_input_stop_thread(input);
+
+		skipped = os_atomic_load_long(&input->skipped_frames);
+		if (skipped)
+			blog(LOG_INFO,
+			     "video-io: input skipped %ld frames due to "
+			     "encoding lag",
+			     skipped);
+	}
+
+	for (size_t i = 0; i < MAX_CONVERT_BUFFERS; i++)
+		video_frame_free(&input->frame[i]);
+	video_scaler_destroy(input->scaler);
+	bfree(input);
+}
+
 static inline bool video_input_init(struct video_input *input,
 				    struct video_output *video)
 {
@@ -338,6 +606,7 @@ static inline void reset_frames(video_t *video)
 {
 	os_atomic_set_long(&video->skipped_frames, 0);
 	os_atomic_set_long(&video->total_frames, 0);
+	os_atomic_set_long(&video->scale_dedup_hits, 0);
 }
 
 bool video_output_connect(
@@ -352,26 +621,26 @@ bool video_output_connect(
 	pthread_mutex_lock(&video->input_mutex);
 
 	if (video_get_input_idx(video, callback, param) == DARRAY_INVALID) {
-		struct video_input input;
-		memset(&input, 0, sizeof(input));
+		struct video_input *input = bzalloc(sizeof(*input));
 
-		input.callback = callback;
-		input.param = param;
+		input->callback = callback;
+		input->param = param;
 
 		if (conversion) {
-			input.conversion = *conversion;
+			input->conversion = *conversion;
 		} else {
-			input.conversion.format = video->info.format;
-			input.conversion.width = video->info.width;
-			input.conversion.height = video->info.height;
+			input->conversion.format = video->info.format;
+			input->conversion.width = video->info.width;
+			input->conversion.height = video->info.height;
 		}
 
-		if (input.conversion.width == 0)
-			input.conversion.width = video->info.width;
-		if (input.conversion.height == 0)
-			input.conversion.height = video->info.height;
+		if (input->conversion.width == 0)
+			input->conversion.width = video->info.width;
+		if (input->conversion.height == 0)
+			input->conversion.height = video->info.height;
+
+		success = video_input_init(input, video);
 
-		success = video_input_init(&input, video);
 		if (success) {
 			if (video->inputs.num == 0) {
 				if (!os_atomic_load_long(&video->gpu_refs)) {
@@ -380,6 +649,9 @@ bool video_output_connect(
 				os_atomic_set_bool(&video->raw_active, true);
 			}
 			da_push_back(video->inputs, &input);
+			update_input_threads(video);
+		} else {
+			video_input_destroy(input);
 		}
 	}
 
@@ -410,6 +682,8 @@ void video_output_disconnect(video_t *video,
 					      struct video_data *frame),
 			     void *param)
 {
+	struct video_input *input = NULL;
+
 	if (!video || !callback)
 		return;
 
@@ -417,8 +691,9 @@ void video_output_disconnect(video_t *video,
 
 	size_t idx = video_get_input_idx(video, callback, param);
 	if (idx != DARRAY_INVALID) {
-		video_input_free(video->inputs.array + idx);
+		input = video->inputs.array[idx];
 		da_erase(video->inputs, idx);
+		update_input_threads(video);
 
 		if (video->inputs.num == 0) {
 			os_atomic_set_bool(&video->raw_active, false);
@@ -429,6 +704,43 @@ void video_output_disconnect(video_t *video,
 	}
 
 	pthread_mutex_unlock(&video->input_mutex);
+
+	/* the input thread may be inside the callback, so it is stopped
+	 * outside of the input mutex */
+	if (input)
+		video_input_destroy(input);
+}
+
+void video_output_set_parallel_inputs(video_t *video, bool parallel)
+{
+	if (!video)
+		return;
+
+	pthread_mutex_lock(&video->input_mutex);
+	video->parallel_inputs = parallel;
+	update_input_threads(video);
+	pthread_mutex_unlock(&video->input_mutex);
+}
+
+uint32_t video_output_get_input_skipped_frames(
+	video_t *video, void (*callback)(void *param, struct video_data *frame),
+	void *param)
+{
+	uint32_t skipped = 0;
+
+	if (!video || !callback)
+		return 0;
+
+	pthread_mutex_lock(&video->input_mutex);
+
+	size_t idx = video_get_input_idx(video, callback, param);
+	if (idx != DARRAY_INVALID)
+		skipped = (uint32_t)os_atomic_load_long(
+			&video->inputs.array[idx]->skipped_frames);
+
+	pthread_mutex_unlock(&video->input_mutex);
+
+	return skipped;
 }
 
 bool video_output_active(const video_t *video)
@@ -554,6 +866,11 @@ uint32_t video_output_get_total_frames(const video_t *video)
 	return (uint32_t)os_atomic_load_long(&video->total_frames);
 }
 
+uint32_t video_output_get_scale_dedup_hits(const video_t *video)
+{
+	return (uint32_t)os_atomic_load_long(&video->scale_dedup_hits);
+}
+
 /* Note: These four functions below are a very slight bit of a hack.  If the
  * texture encoder thread is active while the raw encoder thread is active, the
  * total frame count will just be doubled while they're both active.  Which is
@@ -242,6 +242,16 @@ EXPORT void video_output_disconnect(video_t *video,
 						     struct video_data *frame),
 				    void *param);
 
+/**
+ * While more than one raw video input is connected, gives each of them its
+ * own thread with a small frame queue, so a slow input skips frames instead
+ * of stalling the other inputs.  A single input stays on the video thread.
+ */
+EXPORT void video_output_set_parallel_inputs(video_t *video, bool parallel);
+EXPORT uint32_t video_output_get_input_skipped_frames(
+	video_t *video, void (*callback)(void *param, struct video_data *frame),
+	void *param);
+
 EXPORT bool video_output_active(const video_t *video);
 
 EXPORT const struct video_output_info *
@@ -260,6 +270,7 @@ EXPORT double video_output_get_frame_rate(const video_t *video);
 
 EXPORT uint32_t video_output_get_skipped_frames(const video_t *video);
 EXPORT uint32_t video_output_get_total_frames(const video_t *video);
+EXPORT uint32_t video_output_get_scale_dedup_hits(const video_t *video);
 
 extern void video_output_inc_texture_encoders(video_t *video);
 extern void video_output_dec_texture_encoders(video_t *video);
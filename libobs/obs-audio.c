@@ -18,6 +18,7 @@
 #include <inttypes.h>
 #include "obs-internal.h"
 #include "util/util_uint64.h"
+#include "media-io/audio-kernels.h"
 
 struct ts_info {
 	uint64_t start;
@@ -34,11 +35,18 @@ static void push_audio_tree(obs_source_t *parent, obs_source_t *source, void *p)
 
 	if (da_find(audio->render_order, &source, 0) == DARRAY_INVALID) {
 		obs_source_t *s = obs_source_get_ref(source);
-		if (s)
-			da_push_back(audio->render_order, &s);
+		if (!s)
+			return;
+		da_push_back(audio->render_order, &s);
 	}
 
-	UNUSED_PARAMETER(parent);
+	/* only needed to render the tree in parallel */
+	if (parent && worker_pool_num_threads(audio->render_pool)) {
+		struct audio_tree_edge edge = {obs_source_get_ref(parent),
+					       source};
+		if (edge.parent)
+			da_push_back(audio->render_edges, &edge);
+	}
 }
 
 static inline size_t convert_time_to_frames(size_t sample_rate, uint64_t t)
@@ -47,8 +55,9 @@ static inline size_t convert_time_to_frames(size_t sample_rate, uint64_t t)
 }
 
 static inline void mix_audio(struct audio_output_data *mixes,
-			     obs_source_t *source, size_t channels,
-			     size_t sample_rate, struct ts_info *ts)
+			     obs_source_t *source, uint32_t mixers,
+			     size_t channels, size_t sample_rate,
+			     struct ts_info *ts)
 {
 	size_t total_floats = AUDIO_OUTPUT_FRAMES;
 	size_t start_point = 0;
@@ -66,17 +75,14 @@ static inline void mix_audio(struct audio_output_data *mixes,
 	}
 
 	for (size_t mix_idx = 0; mix_idx < MAX_AUDIO_MIXES; mix_idx++) {
-		for (size_t ch = 0; ch < channels; ch++) {
-			register float *mix = mixes[mix_idx].data[ch];
-			register float *aud =
-				source->audio_output_buf[mix_idx][ch];
-			register float *end;
+		if ((mixers & (1 << mix_idx)) == 0)
+			continue;
 
-			mix += start_point;
-			end = aud + total_floats;
+		for (size_t ch = 0; ch < channels; ch++) {
+			float *mix = mixes[mix_idx].data[ch];
+			float *aud = source->audio_output_buf[mix_idx][ch];
 
-			while (aud < end)
-				*(mix++) += *(aud++);
+			audio_mix_floats(mix + start_point, aud, total_floats);
 		}
 	}
 }
@@ -435,10 +441,180 @@ static inline const char *calc_min_ts(struct obs_core_data *data,
 	return buffering_name;
 }
 
+static void render_audio_source(struct obs_core_audio *audio,
+				obs_source_t *source, uint32_t mixers,
+				size_t channels, size_t sample_rate,
+				size_t audio_size, uint64_t start_ts)
+{
+	obs_source_audio_render(source, mixers, channels, sample_rate,
+				audio_size);
+
+	/* if a source has gone backward in time and we can no
+	 * longer buffer, drop some or all of its audio */
+	if (audio->total_buffering_ticks == MAX_BUFFERING_TICKS &&
+	    source->audio_ts < start_ts) {
+		if (source->info.audio_render) {
+			blog(LOG_DEBUG,
+			     "render audio source %s timestamp has "
+			     "gone backwards",
+			     obs_source_get_name(source));
+
+			/* just avoid further damage */
+			source->audio_pending = true;
+#if DEBUG_AUDIO == 1
+			/* this should really be fixed */
+			assert(false);
+#endif
+		} else {
+			pthread_mutex_lock(&source->audio_buf_mutex);
+			bool rerender = ignore_audio(source, channels,
+						     sample_rate, start_ts);
+			pthread_mutex_unlock(&source->audio_buf_mutex);
+
+			/* if we (potentially) recovered, re-render */
+			if (rerender)
+				obs_source_audio_render(source, mixers,
+							channels, sample_rate,
+							audio_size);
+		}
+	}
+}
+
+/* ------------------------------------------------------------------------- */
+/* parallel rendering
+ *
+ * Composite sources (scenes, transitions) mix the audio of their children in
+ * their audio_render callback, which is where most of the audio thread's
+ * time goes, so they can only be rendered once their children are done.
+ * Sources are put into levels: sources without audio_render are level 0,
+ * composite sources are one level above their highest child.  All sources
+ * of a level are independent of each other, so each level is rendered on
+ * the worker pool, one level after the other.
+ *
+ * Only libobs' own processing and sources flagged OBS_SOURCE_PARALLEL_AUDIO
+ * go to the pool.  Other audio_render and audio_mix callbacks may not
+ * expect to be called from more than one thread, so they stay on the audio
+ * thread. */
+
+struct audio_render_batch {
+	struct obs_core_audio *audio;
+	uint32_t mixers;
+	size_t channels;
+	size_t sample_rate;
+	size_t audio_size;
+	uint64_t start_ts;
+};
+
+static void render_audio_task(void *param, size_t idx)
+{
+	struct audio_render_batch *batch = param;
+	struct obs_core_audio *audio = batch->audio;
+
+	render_audio_source(audio, audio->render_tasks.array[idx],
+			    batch->mixers, batch->channels, batch->sample_rate,
+			    batch->audio_size, batch->start_ts);
+}
+
+static inline bool render_audio_in_parallel(const obs_source_t *source)
+{
+	if (source->info.output_flags & OBS_SOURCE_PARALLEL_AUDIO)
+		return true;
+
+	return !source->info.audio_render && !source->info.audio_mix;
+}
+
+static size_t calc_render_levels(struct obs_core_audio *audio)
+{
+	size_t max_level = 0;
+	bool changed = true;
+
+	for (size_t i = 0; i < audio->render_order.num; i++) {
+		obs_source_t *source = audio->render_order.array[i];
+		source->audio_render_level = source->info.audio_render ? 1 : 0;
+	}
+
+	/* edges are listed children first, so one pass is normally enough.
+	 * a tree that changed while it was being enumerated may need more. */
+	for (size_t pass = 0; changed && pass < audio->render_order.num;
+	     pass++) {
+		changed = false;
+
+		for (size_t i = 0; i < audio->render_edges.num; i++) {
+			struct audio_tree_edge *edge =
+				&audio->render_edges.array[i];
+			size_t level = edge->child->audio_render_level + 1;
+
+			if (edge->parent->info.audio_render &&
+			    edge->parent->audio_render_level < level) {
+				edge->parent->audio_render_level = level;
+				changed = true;
+			}
+		}
+	}
+
+	for (size_t i = 0; i < audio->render_order.num; i++) {
+		obs_source_t *source = audio->render_order.array[i];
+		if (source->audio_render_level > max_level)
+			max_level = source->audio_render_level;
+	}
+
+	return max_level;
+}
+
+static void render_audio_sources(struct obs_core_audio *audio, uint32_t mixers,
+				 size_t channels, size_t sample_rate,
+				 size_t audio_size, uint64_t start_ts)
+{
+	struct audio_render_batch batch;
+	size_t max_level;
+
+	if (!worker_pool_num_threads(audio->render_pool)) {
+		for (size_t i = 0; i < audio->render_order.num; i++)
+			render_audio_source(audio, audio->render_order.array[i],
+					    mixers, channels, sample_rate,
+					    audio_size, start_ts);
+		return;
+	}
+
+	batch.audio = audio;
+	batch.mixers = mixers;
+	batch.channels = channels;
+	batch.sample_rate = sample_rate;
+	batch.audio_size = audio_size;
+	batch.start_ts = start_ts;
+
+	max_level = calc_render_levels(audio);
+
+	for (size_t level = 0; level <= max_level; level++) {
+		da_resize(audio->render_tasks, 0);
+
+		for (size_t i = 0; i < audio->render_order.num; i++) {
+			obs_source_t *source = audio->render_order.array[i];
+			if (source->audio_render_level == level &&
+			    render_audio_in_parallel(source))
+				da_push_back(audio->render_tasks, &source);
+		}
+
+		worker_pool_run(audio->render_pool, audio->render_tasks.num,
+				render_audio_task, &batch);
+
+		for (size_t i = 0; i < audio->render_order.num; i++) {
+			obs_source_t *source = audio->render_order.array[i];
+			if (source->audio_render_level == level &&
+			    !render_audio_in_parallel(source))
+				render_audio_source(audio, source, mixers,
+						    channels, sample_rate,
+						    audio_size, start_ts);
+		}
+	}
+}
+
 static inline void release_audio_sources(struct obs_core_audio *audio)
 {
 	for (size_t i = 0; i < audio->render_order.num; i++)
 		obs_source_release(audio->render_order.array[i]);
+	for (size_t i = 0; i < audio->render_edges.num; i++)
+		obs_source_release(audio->render_edges.array[i].parent);
 }
 
 bool audio_callback(void *param, uint64_t start_ts_in, uint64_t end_ts_in,
@@ -456,6 +632,7 @@ bool audio_callback(void *param, uint64_t start_ts_in, uint64_t end_ts_in,
 
 	da_resize(audio->render_order, 0);
 	da_resize(audio->root_nodes, 0);
+	da_resize(audio->render_edges, 0);
 
 	circlebuf_push_back(&audio->buffered_timestamps, &ts, sizeof(ts));
 	circlebuf_peek_front(&audio->buffered_timestamps, &ts, sizeof(ts));
@@ -493,43 +670,8 @@ bool audio_callback(void *param, uint64_t start_ts_in, uint64_t end_ts_in,
 
 	/* ------------------------------------------------ */
 	/* render audio data */
-	for (size_t i = 0; i < audio->render_order.num; i++) {
-		obs_source_t *source = audio->render_order.array[i];
-		obs_source_audio_render(source, mixers, channels, sample_rate,
-					audio_size);
-
-		/* if a source has gone backward in time and we can no
-		 * longer buffer, drop some or all of its audio */
-		if (audio->total_buffering_ticks == MAX_BUFFERING_TICKS &&
-		    source->audio_ts < ts.start) {
-			if (source->info.audio_render) {
-				blog(LOG_DEBUG,
-				     "render audio source %s timestamp has "
-				     "gone backwards",
-				     obs_source_get_name(source));
-
-				/* just avoid further damage */
-				source->audio_pending = true;
-#if DEBUG_AUDIO == 1
-				/* this should really be fixed */
-				assert(false);
-#endif
-			} else {
-				pthread_mutex_lock(&source->audio_buf_mutex);
-				bool rerender = ignore_audio(source, channels,
-							     sample_rate,
-							     ts.start);
-				pthread_mutex_unlock(&source->audio_buf_mutex);
-
-				/* if we (potentially) recovered, re-render */
-				if (rerender)
-					obs_source_audio_render(source, mixers,
-								channels,
-								sample_rate,
-								audio_size);
-			}
-		}
-	}
+	render_audio_sources(audio, mixers, channels, sample_rate, audio_size,
+			     ts.start);
 
 	/* ------------------------------------------------ */
 	/* get minimum audio timestamp */
@@ -545,7 +687,7 @@ bool audio_callback(void *param, uint64_t start_ts_in, uint64_t end_ts_in,
 
 	/* ------------------------------------------------ */
 	/* mix audio */
-	if (!audio->buffering_wait_ticks) {
+	if (!audio->buffering_wait_ticks && mixers) {
 		for (size_t i = 0; i < audio->root_nodes.num; i++) {
 			obs_source_t *source = audio->root_nodes.array[i];
 
@@ -555,8 +697,8 @@ bool audio_callback(void *param, uint64_t start_ts_in, uint64_t end_ts_in,
 			pthread_mutex_lock(&source->audio_buf_mutex);
 
 			if (source->audio_output_buf[0][0] && source->audio_ts)
-				mix_audio(mixes, source, channels, sample_rate,
-					  &ts);
+				mix_audio(mixes, source, mixers, channels,
+					  sample_rate, &ts);
 
 			pthread_mutex_unlock(&source->audio_buf_mutex);
 		}
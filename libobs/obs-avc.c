@@ -17,6 +17,7 @@
 
 #include "obs.h"
 #include "obs-avc.h"
+#include "obs-internal.h"
 #include "util/array-serializer.h"
 
 bool obs_avc_keyframe(const uint8_t *data, size_t size)
@@ -99,11 +100,14 @@ static inline int get_drop_priority(int priority)
 	return priority;
 }
 
-static void serialize_avc_data(struct serializer *s, const uint8_t *data,
+/* replaces the start codes with 4-byte NAL sizes.  with a NULL output, only
+ * returns the size of the converted data. */
+static size_t convert_avc_data(uint8_t *output, const uint8_t *data,
 			       size_t size, bool *is_keyframe, int *priority)
 {
 	const uint8_t *nal_start, *nal_end;
 	const uint8_t *end = data + size;
+	size_t out_size = 0;
 	int type;
 
 	nal_start = obs_avc_find_startcode(data, end);
@@ -124,28 +128,38 @@ static void serialize_avc_data(struct serializer *s, const uint8_t *data,
 		}
 
 		nal_end = obs_avc_find_startcode(nal_start, end);
-		s_wb32(s, (uint32_t)(nal_end - nal_start));
-		s_write(s, nal_start, nal_end - nal_start);
+
+		if (output) {
+			uint32_t nal_size = (uint32_t)(nal_end - nal_start);
+			uint8_t *out = output + out_size;
+
+			out[0] = (uint8_t)(nal_size >> 24);
+			out[1] = (uint8_t)(nal_size >> 16);
+			out[2] = (uint8_t)(nal_size >> 8);
+			out[3] = (uint8_t)nal_size;
+			memcpy(out + 4, nal_start, nal_size);
+		}
+
+		out_size += 4 + (nal_end - nal_start);
 		nal_start = nal_end;
 	}
+
+	return out_size;
 }
 
+/* the parsed packet is ref-counted like any other encoder packet, so its
+ * data has to come from the packet pool */
 void obs_parse_avc_packet(struct encoder_packet *avc_packet,
 			  const struct encoder_packet *src)
 {
-	struct array_output_data output;
-	struct serializer s;
-	long ref = 1;
+	size_t size = convert_avc_data(NULL, src->data, src->size, NULL, NULL);
 
-	array_output_serializer_init(&s, &output);
 	*avc_packet = *src;
+	avc_packet->data = obs_packet_pool_alloc(size);
+	avc_packet->size = size;
 
-	serialize(&s, &ref, sizeof(ref));
-	serialize_avc_data(&s, src->data, src->size, &avc_packet->keyframe,
-			   &avc_packet->priority);
-
-	avc_packet->data = output.bytes.array + sizeof(ref);
-	avc_packet->size = output.bytes.num - sizeof(ref);
+	convert_avc_data(avc_packet->data, src->data, src->size,
+			 &avc_packet->keyframe, &avc_packet->priority);
 	avc_packet->drop_priority = get_drop_priority(avc_packet->priority);
 }
 
@@ -18,6 +18,7 @@
 #include "obs.h"
 #include "obs-internal.h"
 #include "util/util_uint64.h"
+#include "util/trace.h"
 
 #define encoder_active(encoder) os_atomic_load_bool(&encoder->active)
 #define set_encoder_active(encoder, val) \
@@ -196,14 +197,49 @@ static inline bool gpu_encode_available(const struct obs_encoder *encoder)
 	       obs->video.using_nv12_tex;
 }
 
+static bool find_active_audio_encoder(void *param, obs_encoder_t *encoder)
+{
+	struct obs_encoder **p_encoder = param;
+	struct obs_encoder *new_encoder = *p_encoder;
+
+	if (encoder != new_encoder && encoder->info.type == OBS_ENCODER_AUDIO &&
+	    encoder->media == new_encoder->media && encoder_active(encoder)) {
+		*p_encoder = NULL;
+		return false;
+	}
+
+	return true;
+}
+
+/* the first audio encoder of an audio output encodes on the audio thread.
+ * any further ones get a worker thread of their own on multi-core systems,
+ * so the audio thread doesn't wait on every encoder in turn */
+static bool audio_encoder_needs_thread(struct obs_encoder *encoder)
+{
+	struct obs_encoder *found = encoder;
+
+	if (os_get_logical_cores() < 2)
+		return false;
+
+	obs_enum_encoders(find_active_audio_encoder, &found);
+	return !found;
+}
+
 static void add_connection(struct obs_encoder *encoder)
 {
 	if (encoder->info.type == OBS_ENCODER_AUDIO) {
 		struct audio_convert_info audio_info = {0};
 		get_audio_info(encoder, &audio_info);
 
-		audio_output_connect(encoder->media, encoder->mixer_idx,
-				     &audio_info, receive_audio, encoder);
+		if (audio_encoder_needs_thread(encoder))
+			audio_output_connect_threaded(encoder->media,
+						      encoder->mixer_idx,
+						      &audio_info,
+						      receive_audio, encoder);
+		else
+			audio_output_connect(encoder->media,
+					     encoder->mixer_idx, &audio_info,
+					     receive_audio, encoder);
 	} else {
 		struct video_scale_info info = {0};
 		get_video_info(encoder, &info);
@@ -856,7 +892,6 @@ static void send_first_video_packet(struct obs_encoder *encoder,
 				    struct encoder_packet *packet)
 {
 	struct encoder_packet first_packet;
-	DARRAY(uint8_t) data;
 	uint8_t *sei;
 	size_t size;
 
@@ -864,25 +899,26 @@ static void send_first_video_packet(struct obs_encoder *encoder,
 	if (!packet->keyframe)
 		return;
 
-	da_init(data);
-
 	if (!get_sei(encoder, &sei, &size) || !sei || !size) {
 		cb->new_packet(cb->param, packet);
 		cb->sent_first_packet = true;
 		return;
 	}
 
-	da_push_back_array(data, sei, size);
-	da_push_back_array(data, packet->data, packet->size);
-
+	/* callbacks may keep a reference, so this needs to be ref-counted
+	 * like every other packet that gets sent out */
 	first_packet = *packet;
-	first_packet.data = data.array;
-	first_packet.size = data.num;
+	first_packet.size = size + packet->size;
+	first_packet.data = obs_packet_pool_alloc(first_packet.size);
+
+	memcpy(first_packet.data, sei, size);
+	memcpy(first_packet.data + size, packet->data, packet->size);
+	encoder->copied_bytes += first_packet.size;
 
 	cb->new_packet(cb->param, &first_packet);
 	cb->sent_first_packet = true;
 
-	da_free(data);
+	obs_encoder_packet_release(&first_packet);
 }
 
 static inline void send_packet(struct obs_encoder *encoder,
@@ -930,6 +966,8 @@ void send_off_encoder_packet(obs_encoder_t *encoder, bool success,
 	}
 
 	if (received) {
+		struct encoder_packet out;
+
 		if (!encoder->first_received) {
 			encoder->offset_usec = packet_dts_usec(pkt);
 			encoder->first_received = true;
@@ -947,13 +985,27 @@ void send_off_encoder_packet(obs_encoder_t *encoder, bool success,
 
 		pthread_mutex_lock(&encoder->callbacks_mutex);
 
+		if (!encoder->callbacks.num) {
+			pthread_mutex_unlock(&encoder->callbacks_mutex);
+			return;
+		}
+
+		/* the packet data belongs to the encoder and is only valid
+		 * until the next encode call, so copy it once here and share
+		 * the ref-counted copy with every output instead of having
+		 * each output make its own copy */
+		obs_encoder_packet_create_instance(&out, pkt);
+		encoder->copied_bytes += out.size;
+
 		for (size_t i = encoder->callbacks.num; i > 0; i--) {
 			struct encoder_callback *cb;
 			cb = encoder->callbacks.array + (i - 1);
-			send_packet(encoder, cb, pkt);
+			send_packet(encoder, cb, &out);
 		}
 
 		pthread_mutex_unlock(&encoder->callbacks_mutex);
+
+		obs_encoder_packet_release(&out);
 	}
 }
 
@@ -1056,7 +1108,13 @@ static void receive_video(void *param, struct video_data *frame)
 	enc_frame.pts = encoder->cur_pts;
 
 	if (really_do_encode) {
-		if (do_encode(encoder, &enc_frame)) {
+		uint64_t trace_ts = trace_begin();
+		bool success = do_encode(encoder, &enc_frame);
+
+		/* do_encode has stored the encoder's name by now */
+		trace_end(encoder->profile_encoder_encode_name,
+			  frame->timestamp, trace_ts);
+		if (success) {
 			encoder->cur_pts += encoder->timebase_num;
 		}
 	} else {
@@ -1325,12 +1383,8 @@ void obs_encoder_remove_output(struct obs_encoder *encoder,
 void obs_encoder_packet_create_instance(struct encoder_packet *dst,
 					const struct encoder_packet *src)
 {
-	long *p_refs;
-
 	*dst = *src;
-	p_refs = bmalloc(src->size + sizeof(long));
-	dst->data = (void *)(p_refs + 1);
-	*p_refs = 1;
+	dst->data = obs_packet_pool_alloc(src->size);
 	memcpy(dst->data, src->data, src->size);
 }
 
@@ -1368,7 +1422,11 @@ void obs_encoder_packet_release(struct encoder_packet *pkt)
 
 	if (pkt->data) {
 		long *p_refs = ((long *)pkt->data) - 1;
-		if (os_atomic_dec_long(p_refs) == 0)
+		long refs = os_atomic_dec_long(p_refs);
+
+		if (refs == PACKET_POOL_REF_FLAG)
+			obs_packet_pool_release(pkt->data);
+		else if (refs == 0)
 			bfree(p_refs);
 	}
 
@@ -1510,6 +1568,20 @@ const char *obs_encoder_get_last_error(obs_encoder_t *encoder)
 	return encoder->last_error_message;
 }
 
+uint64_t obs_encoder_get_total_bytes_copied(obs_encoder_t *encoder)
+{
+	uint64_t copied_bytes;
+
+	if (!obs_encoder_valid(encoder, "obs_encoder_get_total_bytes_copied"))
+		return 0;
+
+	pthread_mutex_lock(&encoder->callbacks_mutex);
+	copied_bytes = encoder->copied_bytes;
+	pthread_mutex_unlock(&encoder->callbacks_mutex);
+
+	return copied_bytes;
+}
+
 void obs_encoder_set_last_error(obs_encoder_t *encoder, const char *message)
 {
 	if (!obs_encoder_valid(encoder, "obs_encoder_set_last_error"))
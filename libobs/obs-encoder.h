@@ -42,7 +42,12 @@ enum obs_encoder_type {
 
 /** Encoder output packet */
 struct encoder_packet {
-	uint8_t *data; /**< Packet data */
+	/**
+	 * Packet data.  Once the packet leaves the encoder, the payload is
+	 * shared by every output using the encoder, so outputs must treat it
+	 * as read-only and copy it before changing it.
+	 */
+	uint8_t *data;
 	size_t size;   /**< Packet size */
 
 	int64_t pts; /**< Presentation timestamp */
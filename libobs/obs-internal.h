@@ -24,6 +24,7 @@
 #include "util/threading.h"
 #include "util/platform.h"
 #include "util/profiler.h"
+#include "util/worker-pool.h"
 #include "callback/signal.h"
 #include "callback/proc.h"
 
@@ -243,6 +244,26 @@ struct obs_task_info {
 	void *param;
 };
 
+#define MAX_TICK_THREADS 4
+
+struct tick_profile_name {
+	char *id;
+	const char *name;
+};
+
+/* ticks sources flagged OBS_SOURCE_PARALLEL_TICK on a worker pool */
+struct source_tick_pool {
+	worker_pool_t *workers;
+
+	/* current tick, only changed while the workers are idle */
+	DARRAY(struct obs_source *) sources;
+	DARRAY(struct obs_source *) tasks;
+	float seconds;
+
+	/* profiler names of the source types, graphics thread only */
+	DARRAY(struct tick_profile_name) profile_names;
+};
+
 struct obs_core_video {
 	graphics_t *graphics;
 	gs_stagesurf_t *copy_surfaces[NUM_TEXTURES][NUM_CHANNELS];
@@ -318,16 +339,31 @@ struct obs_core_video {
 
 	pthread_mutex_t task_mutex;
 	struct circlebuf tasks;
+
+	struct source_tick_pool tick_pool;
 };
 
 struct audio_monitor;
 
+#define MAX_AUDIO_RENDER_THREADS 4
+
+/* a parent that mixes the audio of child, holds a reference to parent */
+struct audio_tree_edge {
+	struct obs_source *parent;
+	struct obs_source *child;
+};
+
 struct obs_core_audio {
 	audio_t *audio;
 
 	DARRAY(struct obs_source *) render_order;
 	DARRAY(struct obs_source *) root_nodes;
 
+	/* renders independent parts of the audio tree in parallel */
+	worker_pool_t *render_pool;
+	DARRAY(struct audio_tree_edge) render_edges;
+	DARRAY(struct obs_source *) render_tasks;
+
 	uint64_t buffered_ts;
 	struct circlebuf buffered_timestamps;
 	int buffering_wait_ticks;
@@ -360,6 +396,11 @@ struct obs_core_data {
 	DARRAY(struct draw_callback) draw_callbacks;
 	DARRAY(struct tick_callback) tick_callbacks;
 
+	/* sources that are shown, active or otherwise need their video tick.
+	 * filters are ticked along with their parent. */
+	pthread_mutex_t ticked_sources_mutex;
+	DARRAY(struct obs_source *) ticked_sources;
+
 	struct obs_view main_view;
 
 	long long unnamed_index;
@@ -404,6 +445,31 @@ struct obs_core_hotkeys {
 	char *sceneitem_hide;
 };
 
+/* size classes for encoded packet buffers, see obs-packet-pool.c */
+#define PACKET_POOL_CLASSES 30
+
+/* set in the ref count of pooled packets.  packets built elsewhere with a
+ * plain ref count in front of the data never have it, and are still freed
+ * with bfree */
+#define PACKET_POOL_REF_FLAG (1L << 30)
+
+struct obs_packet_pool {
+	pthread_mutex_t mutex;
+	DARRAY(uint8_t *) free_blocks[PACKET_POOL_CLASSES];
+	size_t bytes_retained;
+	uint64_t hits;
+	uint64_t misses;
+	bool initialized;
+};
+
+extern bool obs_packet_pool_init(struct obs_packet_pool *pool);
+extern void obs_packet_pool_free(struct obs_packet_pool *pool);
+
+/* returns packet data with a ref count of 1 (and PACKET_POOL_REF_FLAG) in
+ * front of it */
+extern uint8_t *obs_packet_pool_alloc(size_t size);
+extern void obs_packet_pool_release(uint8_t *data);
+
 struct obs_core {
 	struct obs_module *first_module;
 	DARRAY(struct obs_module_path) module_paths;
@@ -432,6 +498,7 @@ struct obs_core {
 	struct obs_core_audio audio;
 	struct obs_core_data data;
 	struct obs_core_hotkeys hotkeys;
+	struct obs_packet_pool packet_pool;
 
 	obs_task_handler_t ui_task_handler;
 };
@@ -563,6 +630,13 @@ struct async_frame {
 	bool used;
 };
 
+struct async_borrowed {
+	struct obs_source_frame *frame;
+	obs_source_frame_release_t release;
+	void *param;
+	bool queued;
+};
+
 enum audio_action_type {
 	AUDIO_ACTION_VOL,
 	AUDIO_ACTION_MUTE,
@@ -616,6 +690,10 @@ struct obs_source {
 	/* ensures activate/deactivate are only called once */
 	volatile long activate_refs;
 
+	/* in obs->data.ticked_sources, protected by its mutex */
+	bool tick_listed;
+	const char *tick_profile_name;
+
 	/* used to indicate that the source has been removed and all
 	 * references to it should be released (not exactly how I would prefer
 	 * to handle things but it's the best option) */
@@ -627,6 +705,11 @@ struct obs_source {
 	bool active;
 	bool showing;
 
+	/* show/activate state last passed on to the filters, graphics thread
+	 * only */
+	bool filters_active;
+	bool filters_showing;
+
 	/* used to temporarily disable sources if needed */
 	bool enabled;
 
@@ -651,6 +734,7 @@ struct obs_source {
 	struct obs_source *next_audio_source;
 	struct obs_source **prev_next_audio_source;
 	uint64_t audio_ts;
+	size_t audio_render_level; /* audio thread only */
 	struct circlebuf audio_input_buf[MAX_AUDIO_CHANNELS];
 	size_t last_audio_input_buf_size;
 	DARRAY(struct audio_action) audio_actions;
@@ -692,8 +776,11 @@ struct obs_source {
 	bool async_decoupled;
 	struct obs_source_frame *async_preload_frame;
 	DARRAY(struct async_frame) async_cache;
+	DARRAY(struct async_borrowed) async_borrowed;
 	DARRAY(struct obs_source_frame *) async_frames;
 	pthread_mutex_t async_mutex;
+	volatile long async_dropped_frames;
+	volatile long async_frame_allocs;
 	uint32_t async_width;
 	uint32_t async_height;
 	uint32_t async_cache_width;
@@ -850,6 +937,11 @@ convert_video_format(enum video_format format)
 extern void obs_source_activate(obs_source_t *source, enum view_type type);
 extern void obs_source_deactivate(obs_source_t *source, enum view_type type);
 extern void obs_source_video_tick(obs_source_t *source, float seconds);
+extern void obs_source_video_tick_state(obs_source_t *source, float seconds);
+extern void obs_source_video_tick_callback(obs_source_t *source,
+					   float seconds);
+extern void obs_source_tick_list_add(obs_source_t *source);
+extern void obs_source_tick_list_prune(obs_source_t *source);
 extern float obs_source_get_target_volume(obs_source_t *source,
 					  obs_source_t *target);
 
@@ -1114,6 +1206,10 @@ struct obs_encoder {
 	struct pause_data pause;
 	const char *profile_encoder_encode_name;
 	char *last_error_message;
+
+	/* total packet payload bytes copied out of the encoder, protected by
+	 * callbacks_mutex */
+	uint64_t copied_bytes;
 };
 
 extern struct obs_encoder_info *find_encoder(const char *id);
@@ -948,6 +948,39 @@ int obs_output_get_frames_dropped(const obs_output_t *output)
 	return output->info.get_dropped_frames(output->context.data);
 }
 
+uint64_t obs_output_get_total_bytes_copied(const obs_output_t *output)
+{
+	uint64_t total = 0;
+
+	if (!obs_output_valid(output, "obs_output_get_total_bytes_copied"))
+		return 0;
+
+	if (output->video_encoder)
+		total += obs_encoder_get_total_bytes_copied(
+			output->video_encoder);
+
+	for (size_t i = 0; i < MAX_AUDIO_MIXES; i++) {
+		obs_encoder_t *encoder = output->audio_encoders[i];
+		bool counted = false;
+
+		if (!encoder)
+			continue;
+
+		/* one encoder can feed several tracks */
+		for (size_t j = 0; j < i; j++) {
+			if (output->audio_encoders[j] == encoder) {
+				counted = true;
+				break;
+			}
+		}
+
+		if (!counted)
+			total += obs_encoder_get_total_bytes_copied(encoder);
+	}
+
+	return total;
+}
+
 int obs_output_get_total_frames(const obs_output_t *output)
 {
 	return obs_output_valid(output, "obs_output_get_total_frames")
@@ -1211,20 +1244,14 @@ static bool add_caption(struct obs_output *output, struct encoder_packet *out)
 	struct encoder_packet backup = *out;
 	sei_t sei;
 	uint8_t *data;
+	uint8_t *out_data;
 	size_t size;
-	long ref = 1;
-
-	DARRAY(uint8_t) out_data;
 
 	if (out->priority > 1)
 		return false;
 
 	sei_init(&sei, 0.0);
 
-	da_init(out_data);
-	da_push_back_array(out_data, &ref, sizeof(ref));
-	da_push_back_array(out_data, out->data, out->size);
-
 	if (output->caption_data.size > 0) {
 
 		cea708_t cea708;
@@ -1284,16 +1311,22 @@ static bool add_caption(struct obs_output *output, struct encoder_packet *out)
 
 	data = malloc(sei_render_size(&sei));
 	size = sei_render(&sei, data);
+
+	/* the new packet is released like any other, so it has to come from
+	 * the packet pool */
+	out_data = obs_packet_pool_alloc(out->size + sizeof(nal_start) + size);
+
 	/* TODO SEI should come after AUD/SPS/PPS, but before any VCL */
-	da_push_back_array(out_data, nal_start, 4);
-	da_push_back_array(out_data, data, size);
+	memcpy(out_data, out->data, out->size);
+	memcpy(out_data + out->size, nal_start, sizeof(nal_start));
+	memcpy(out_data + out->size + sizeof(nal_start), data, size);
 	free(data);
 
 	obs_encoder_packet_release(out);
 
 	*out = backup;
-	out->data = (uint8_t *)out_data.array + sizeof(ref);
-	out->size = out_data.num - sizeof(ref);
+	out->data = out_data;
+	out->size = backup.size + sizeof(nal_start) + size;
 
 	sei_free(&sei);
 
@@ -1630,35 +1663,97 @@ static bool initialize_interleaved_packets(struct obs_output *output)
 	return true;
 }
 
+static inline bool interleave_before(const struct encoder_packet *packet,
+				     const struct encoder_packet *cur)
+{
+	/* video goes before audio on equal timestamps */
+	return packet->type == OBS_ENCODER_VIDEO
+		       ? packet->dts_usec <= cur->dts_usec
+		       : packet->dts_usec < cur->dts_usec;
+}
+
 static inline void insert_interleaved_packet(struct obs_output *output,
 					     struct encoder_packet *out)
 {
-	size_t idx;
-	for (idx = 0; idx < output->interleaved_packets.num; idx++) {
-		struct encoder_packet *cur_packet;
-		cur_packet = output->interleaved_packets.array + idx;
+	size_t lo = 0;
+	size_t hi = output->interleaved_packets.num;
 
-		if (out->dts_usec == cur_packet->dts_usec &&
-		    out->type == OBS_ENCODER_VIDEO) {
-			break;
-		} else if (out->dts_usec < cur_packet->dts_usec) {
-			break;
-		}
+	/* interleaved packets are always sorted by dts, so binary search
+	 * for the first packet that this one needs to go before */
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+
+		if (interleave_before(out,
+				      output->interleaved_packets.array + mid))
+			hi = mid;
+		else
+			lo = mid + 1;
 	}
 
-	da_insert(output->interleaved_packets, idx, out);
+	da_insert(output->interleaved_packets, lo, out);
+}
+
+/* stream 0 is video, stream 1 + n is audio track n */
+static inline size_t get_interleave_stream(const struct encoder_packet *packet)
+{
+	return packet->type == OBS_ENCODER_VIDEO ? 0 : 1 + packet->track_idx;
+}
+
+static size_t next_stream_packet_idx(const struct encoder_packet *packets,
+				     size_t num, size_t stream, size_t idx)
+{
+	while (idx < num && get_interleave_stream(&packets[idx]) != stream)
+		idx++;
+	return idx;
 }
 
+/* applying new offsets keeps each stream in order, but not the streams
+ * relative to each other, so merge the per-stream runs back together */
 static void resort_interleaved_packets(struct obs_output *output)
 {
 	DARRAY(struct encoder_packet) old_array;
+	size_t cursors[1 + MAX_AUDIO_MIXES];
+	size_t num;
 
 	old_array.da = output->interleaved_packets.da;
+	num = old_array.num;
+
 	memset(&output->interleaved_packets, 0,
 	       sizeof(output->interleaved_packets));
+	da_reserve(output->interleaved_packets, num);
 
-	for (size_t i = 0; i < old_array.num; i++)
-		insert_interleaved_packet(output, &old_array.array[i]);
+	for (size_t i = 0; i < 1 + MAX_AUDIO_MIXES; i++)
+		cursors[i] = next_stream_packet_idx(old_array.array, num, i, 0);
+
+	for (;;) {
+		struct encoder_packet *next = NULL;
+		size_t next_stream = 0;
+
+		for (size_t i = 0; i < 1 + MAX_AUDIO_MIXES; i++) {
+			struct encoder_packet *cur;
+
+			if (cursors[i] == num)
+				continue;
+
+			/* on equal audio timestamps the packet that came
+			 * first stays first, same as when inserting */
+			cur = &old_array.array[cursors[i]];
+			if (!next || interleave_before(cur, next) ||
+			    (cur->dts_usec == next->dts_usec &&
+			     cur->type == next->type && cur < next)) {
+				next = cur;
+				next_stream = i;
+			}
+		}
+
+		if (!next)
+			break;
+
+		da_push_back(output->interleaved_packets, next);
+		cursors[next_stream] = next_stream_packet_idx(
+			old_array.array, num, next_stream,
+			cursors[next_stream] + 1);
+	}
 
 	da_free(old_array);
 }
@@ -1710,7 +1805,7 @@ static void interleave_packets(void *data, struct encoder_packet *packet)
 	if (output->active_delay_ns)
 		out = *packet;
 	else
-		obs_encoder_packet_create_instance(&out, packet);
+		obs_encoder_packet_ref(&out, packet);
 
 	if (was_started)
 		apply_interleaved_packet_offset(output, &out);
@@ -48,6 +48,7 @@ struct obs_output_info {
 	void (*raw_video)(void *data, struct video_data *frame);
 	void (*raw_audio)(void *data, struct audio_data *frames);
 
+	/* packet data is shared between outputs and must not be modified */
 	void (*encoded_packet)(void *data, struct encoder_packet *packet);
 
 	/* optional */
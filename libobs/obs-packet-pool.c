@@ -0,0 +1,160 @@
+#include <inttypes.h>
+#include "obs-internal.h"
+
+/*
+ * Encoded packet buffers are recycled through size classes rather than going
+ * back to the system allocator each time, since packets are usually
+ * allocated on the encoder thread and freed on an output thread, which
+ * fragments malloc arenas badly over long sessions.
+ *
+ * Block layout:  [capacity (size_t)] ... [refs (long)] [data ...]
+ *                 ^ block               ^ data - sizeof(long)
+ *
+ * The ref count always sits right before the packet data, as it did before
+ * the pool existed, and carries PACKET_POOL_REF_FLAG so that release can
+ * tell pooled blocks from ref-counted packets that plugins allocate
+ * themselves.  A capacity of 0 marks an unpooled (oversized) block.
+ */
+
+#define PACKET_HEADER_SIZE 16
+#define PACKET_MIN_CLASS_SIZE 256
+
+/* max amount of free memory kept around for reuse */
+#define PACKET_POOL_MAX_RETAINED (64 * 1024 * 1024)
+
+/* classes go 256, 384, 512, 768, 1024, ... so at most a third of a block is
+ * wasted */
+static inline size_t class_size(size_t idx)
+{
+	size_t base = (size_t)PACKET_MIN_CLASS_SIZE << (idx / 2);
+	return (idx & 1) ? base + base / 2 : base;
+}
+
+static inline size_t find_class(size_t size)
+{
+	for (size_t i = 0; i < PACKET_POOL_CLASSES; i++) {
+		if (size <= class_size(i))
+			return i;
+	}
+
+	return PACKET_POOL_CLASSES;
+}
+
+static inline long *get_refs(uint8_t *data)
+{
+	return ((long *)data) - 1;
+}
+
+bool obs_packet_pool_init(struct obs_packet_pool *pool)
+{
+	pthread_mutex_init_value(&pool->mutex);
+	if (pthread_mutex_init(&pool->mutex, NULL) != 0)
+		return false;
+
+	pool->initialized = true;
+	return true;
+}
+
+void obs_packet_pool_free(struct obs_packet_pool *pool)
+{
+	if (!pool->initialized)
+		return;
+
+	blog(LOG_INFO,
+	     "Packet pool: %" PRIu64 " hits, %" PRIu64 " misses, "
+	     "%" PRIu64 " bytes retained",
+	     pool->hits, pool->misses, (uint64_t)pool->bytes_retained);
+
+	for (size_t i = 0; i < PACKET_POOL_CLASSES; i++) {
+		for (size_t j = 0; j < pool->free_blocks[i].num; j++)
+			bfree(pool->free_blocks[i].array[j]);
+		da_free(pool->free_blocks[i]);
+	}
+
+	pthread_mutex_destroy(&pool->mutex);
+	memset(pool, 0, sizeof(*pool));
+}
+
+static inline struct obs_packet_pool *get_pool(void)
+{
+	return (obs && obs->packet_pool.initialized) ? &obs->packet_pool
+						     : NULL;
+}
+
+uint8_t *obs_packet_pool_alloc(size_t size)
+{
+	struct obs_packet_pool *pool = get_pool();
+	size_t idx = find_class(size);
+	size_t capacity = idx < PACKET_POOL_CLASSES ? class_size(idx) : 0;
+	uint8_t *block = NULL;
+	uint8_t *data;
+
+	if (pool) {
+		pthread_mutex_lock(&pool->mutex);
+
+		if (capacity && pool->free_blocks[idx].num) {
+			size_t last = pool->free_blocks[idx].num - 1;
+			block = pool->free_blocks[idx].array[last];
+			da_pop_back(pool->free_blocks[idx]);
+
+			pool->bytes_retained -= capacity;
+			pool->hits++;
+		} else {
+			pool->misses++;
+		}
+
+		pthread_mutex_unlock(&pool->mutex);
+	}
+
+	if (!block)
+		block = bmalloc(PACKET_HEADER_SIZE + (capacity ? capacity : size));
+
+	*(size_t *)block = capacity;
+
+	data = block + PACKET_HEADER_SIZE;
+	*get_refs(data) = 1 | PACKET_POOL_REF_FLAG;
+	return data;
+}
+
+void obs_packet_pool_release(uint8_t *data)
+{
+	struct obs_packet_pool *pool = get_pool();
+	uint8_t *block = data - PACKET_HEADER_SIZE;
+	size_t capacity = *(size_t *)block;
+	bool kept = false;
+
+	if (pool && capacity) {
+		pthread_mutex_lock(&pool->mutex);
+
+		if (pool->bytes_retained + capacity <=
+		    PACKET_POOL_MAX_RETAINED) {
+			da_push_back(pool->free_blocks[find_class(capacity)],
+				     &block);
+			pool->bytes_retained += capacity;
+			kept = true;
+		}
+
+		pthread_mutex_unlock(&pool->mutex);
+	}
+
+	if (!kept)
+		bfree(block);
+}
+
+void obs_get_packet_pool_stats(struct obs_packet_pool_stats *stats)
+{
+	struct obs_packet_pool *pool = get_pool();
+
+	if (!obs_ptr_valid(stats, "obs_get_packet_pool_stats"))
+		return;
+
+	memset(stats, 0, sizeof(*stats));
+	if (!pool)
+		return;
+
+	pthread_mutex_lock(&pool->mutex);
+	stats->hits = pool->hits;
+	stats->misses = pool->misses;
+	stats->bytes_retained = (uint64_t)pool->bytes_retained;
+	pthread_mutex_unlock(&pool->mutex);
+}
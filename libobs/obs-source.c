@@ -21,6 +21,7 @@
 #include "media-io/format-conversion.h"
 #include "media-io/video-frame.h"
 #include "media-io/audio-io.h"
+#include "media-io/audio-kernels.h"
 #include "util/threading.h"
 #include "util/platform.h"
 #include "util/util_uint64.h"
@@ -241,6 +242,8 @@ static void obs_source_init_finalize(struct obs_source *source)
 
 	obs_context_data_insert(&source->context, &obs->data.sources_mutex,
 				&obs->data.first_source);
+
+	obs_source_tick_list_add(source);
 }
 
 static bool obs_source_hotkey_mute(void *data, obs_hotkey_pair_id id,
@@ -609,8 +612,54 @@ static inline void obs_source_frame_decref(struct obs_source_frame *frame)
 		obs_source_frame_destroy(frame);
 }
 
+static inline size_t find_borrowed_frame(obs_source_t *source,
+					 const struct obs_source_frame *frame)
+{
+	for (size_t i = 0; i < source->async_borrowed.num; i++) {
+		if (source->async_borrowed.array[i].frame == frame)
+			return i;
+	}
+
+	return DARRAY_INVALID;
+}
+
+/* hands the buffer back to the source that lent it */
+static void release_borrowed_frame(obs_source_t *source, size_t idx)
+{
+	struct async_borrowed *borrowed = &source->async_borrowed.array[idx];
+
+	borrowed->release(borrowed->param);
+	bfree(borrowed->frame);
+	da_erase(source->async_borrowed, idx);
+}
+
+/* drops the reference the frame holds while it is queued or displayed */
+static void unqueue_borrowed_frame(obs_source_t *source, size_t idx)
+{
+	struct async_borrowed *borrowed = &source->async_borrowed.array[idx];
+
+	if (!borrowed->queued)
+		return;
+
+	borrowed->queued = false;
+	if (os_atomic_dec_long(&borrowed->frame->refs) == 0)
+		release_borrowed_frame(source, idx);
+}
+
+static void destroy_async_frame(obs_source_t *source,
+				struct obs_source_frame *frame)
+{
+	size_t idx = find_borrowed_frame(source, frame);
+
+	if (idx != DARRAY_INVALID)
+		release_borrowed_frame(source, idx);
+	else
+		obs_source_frame_destroy(frame);
+}
+
 static bool obs_source_filter_remove_refless(obs_source_t *source,
 					     obs_source_t *filter);
+static void obs_source_tick_list_remove(obs_source_t *source);
 
 void obs_source_destroy(struct obs_source *source)
 {
@@ -638,6 +687,7 @@ void obs_source_destroy(struct obs_source *source)
 		obs_source_filter_remove(source, source->filters.array[0]);
 
 	obs_context_data_remove(&source->context);
+	obs_source_tick_list_remove(source);
 
 	blog(LOG_DEBUG, "%ssource '%s' destroyed",
 	     source->context.private ? "private " : "", source->context.name);
@@ -655,8 +705,18 @@ void obs_source_destroy(struct obs_source *source)
 	obs_hotkey_unregister(source->push_to_mute_key);
 	obs_hotkey_pair_unregister(source->mute_unmute_key);
 
+	if (os_atomic_load_long(&source->async_dropped_frames))
+		blog(LOG_INFO,
+		     "source '%s': %ld async frames dropped, "
+		     "%ld async frames allocated",
+		     source->context.name,
+		     os_atomic_load_long(&source->async_dropped_frames),
+		     os_atomic_load_long(&source->async_frame_allocs));
+
 	for (i = 0; i < source->async_cache.num; i++)
 		obs_source_frame_decref(source->async_cache.array[i].frame);
+	for (i = source->async_borrowed.num; i > 0; i--)
+		release_borrowed_frame(source, i - 1);
 
 	gs_enter_context(obs->video.graphics);
 	if (source->async_texrender)
@@ -688,6 +748,7 @@ void obs_source_destroy(struct obs_source *source)
 	da_free(source->audio_cb_list);
 	da_free(source->caption_cb_list);
 	da_free(source->async_cache);
+	da_free(source->async_borrowed);
 	da_free(source->async_frames);
 	da_free(source->filters);
 	pthread_mutex_destroy(&source->filter_mutex);
@@ -935,6 +996,7 @@ void obs_source_update(obs_source_t *source, obs_data_t *settings)
 
 	if (source->info.output_flags & OBS_SOURCE_VIDEO) {
 		os_atomic_inc_long(&source->defer_update_count);
+		obs_source_tick_list_add(source);
 	} else if (source->context.data && source->info.update) {
 		source->info.update(source->context.data,
 				    source->context.settings);
@@ -1058,10 +1120,72 @@ static void hide_source(obs_source_t *source)
 	obs_source_dosignal(source, "source_hide", "hide");
 }
 
+/* sources are ticked every frame unless their type sets
+ * OBS_SOURCE_SKIP_HIDDEN_TICK, in which case they can skip the video tick
+ * while they aren't shown anywhere and have nothing pending.  async sources
+ * keep draining their frame queue and transitions keep their timing even
+ * while hidden, and filters are ticked along with their parent. */
+static inline bool source_needs_tick(obs_source_t *source)
+{
+	uint32_t flags = source->info.output_flags;
+
+	if (source->info.type == OBS_SOURCE_TYPE_FILTER)
+		return false;
+	if ((flags & OBS_SOURCE_SKIP_HIDDEN_TICK) == 0 ||
+	    (flags & OBS_SOURCE_ASYNC) != 0 ||
+	    source->info.type == OBS_SOURCE_TYPE_TRANSITION)
+		return true;
+
+	return os_atomic_load_long(&source->show_refs) > 0 ||
+	       os_atomic_load_long(&source->activate_refs) > 0 ||
+	       os_atomic_load_long(&source->defer_update_count) > 0 ||
+	       source->showing || source->active;
+}
+
+void obs_source_tick_list_add(obs_source_t *source)
+{
+	struct obs_core_data *data = &obs->data;
+
+	pthread_mutex_lock(&data->ticked_sources_mutex);
+	if (!source->tick_listed && source_needs_tick(source)) {
+		da_push_back(data->ticked_sources, &source);
+		source->tick_listed = true;
+	}
+	pthread_mutex_unlock(&data->ticked_sources_mutex);
+}
+
+/* called by the graphics thread after ticking, once any hide/deactivate
+ * has been processed.  checked under the list mutex so a source activated
+ * at the same time is never dropped. */
+void obs_source_tick_list_prune(obs_source_t *source)
+{
+	struct obs_core_data *data = &obs->data;
+
+	pthread_mutex_lock(&data->ticked_sources_mutex);
+	if (source->tick_listed && !source_needs_tick(source)) {
+		da_erase_item(data->ticked_sources, &source);
+		source->tick_listed = false;
+	}
+	pthread_mutex_unlock(&data->ticked_sources_mutex);
+}
+
+static void obs_source_tick_list_remove(obs_source_t *source)
+{
+	struct obs_core_data *data = &obs->data;
+
+	pthread_mutex_lock(&data->ticked_sources_mutex);
+	if (source->tick_listed) {
+		da_erase_item(data->ticked_sources, &source);
+		source->tick_listed = false;
+	}
+	pthread_mutex_unlock(&data->ticked_sources_mutex);
+}
+
 static void activate_tree(obs_source_t *parent, obs_source_t *child,
 			  void *param)
 {
 	os_atomic_inc_long(&child->activate_refs);
+	obs_source_tick_list_add(child);
 
 	UNUSED_PARAMETER(parent);
 	UNUSED_PARAMETER(param);
@@ -1079,6 +1203,7 @@ static void deactivate_tree(obs_source_t *parent, obs_source_t *child,
 static void show_tree(obs_source_t *parent, obs_source_t *child, void *param)
 {
 	os_atomic_inc_long(&child->show_refs);
+	obs_source_tick_list_add(child);
 
 	UNUSED_PARAMETER(parent);
 	UNUSED_PARAMETER(param);
@@ -1104,6 +1229,8 @@ void obs_source_activate(obs_source_t *source, enum view_type type)
 		os_atomic_inc_long(&source->activate_refs);
 		obs_source_enum_active_tree(source, activate_tree, NULL);
 	}
+
+	obs_source_tick_list_add(source);
 }
 
 void obs_source_deactivate(obs_source_t *source, enum view_type type)
@@ -1155,13 +1282,54 @@ static void async_tick(obs_source_t *source)
 			set_async_texture_size(source, source->cur_async_frame);
 }
 
-void obs_source_video_tick(obs_source_t *source, float seconds)
+/* passes a change of the show (or activate) state of a source on to its
+ * filters.  the filters are called outside of filter_mutex, so that their
+ * callbacks and signal handlers can add or remove filters. */
+static void update_filters_state(obs_source_t *source, bool showing)
 {
-	bool now_showing, now_active;
+	bool *filters_state = showing ? &source->filters_showing
+				      : &source->filters_active;
+	bool state = showing ? source->showing : source->active;
+	DARRAY(obs_source_t *) filters;
 
-	if (!obs_source_valid(source, "obs_source_video_tick"))
+	if (*filters_state == state)
 		return;
 
+	*filters_state = state;
+
+	da_init(filters);
+
+	pthread_mutex_lock(&source->filter_mutex);
+	for (size_t i = source->filters.num; i > 0; i--) {
+		obs_source_t *filter =
+			obs_source_get_ref(source->filters.array[i - 1]);
+		if (filter)
+			da_push_back(filters, &filter);
+	}
+	pthread_mutex_unlock(&source->filter_mutex);
+
+	for (size_t i = 0; i < filters.num; i++) {
+		obs_source_t *filter = filters.array[i];
+
+		if (showing && state)
+			show_source(filter);
+		else if (showing)
+			hide_source(filter);
+		else if (state)
+			activate_source(filter);
+		else
+			deactivate_source(filter);
+
+		obs_source_release(filter);
+	}
+
+	da_free(filters);
+}
+
+static void source_video_tick_state(obs_source_t *source, float seconds)
+{
+	bool now_showing, now_active;
+
 	if (source->info.type == OBS_SOURCE_TYPE_TRANSITION)
 		obs_transition_tick(source, seconds);
 
@@ -1184,21 +1352,11 @@ void obs_source_video_tick(obs_source_t *source, float seconds)
 			hide_source(source);
 		}
 
-		if (source->filters.num) {
-			for (size_t i = source->filters.num; i > 0; i--) {
-				obs_source_t *filter =
-					source->filters.array[i - 1];
-				if (now_showing) {
-					show_source(filter);
-				} else {
-					hide_source(filter);
-				}
-			}
-		}
-
 		source->showing = now_showing;
 	}
 
+	update_filters_state(source, true);
+
 	/* call activate/deactivate if the reference changed */
 	now_active = !!source->activate_refs;
 	if (now_active != source->active) {
@@ -1208,21 +1366,14 @@ void obs_source_video_tick(obs_source_t *source, float seconds)
 			deactivate_source(source);
 		}
 
-		if (source->filters.num) {
-			for (size_t i = source->filters.num; i > 0; i--) {
-				obs_source_t *filter =
-					source->filters.array[i - 1];
-				if (now_active) {
-					activate_source(filter);
-				} else {
-					deactivate_source(filter);
-				}
-			}
-		}
-
 		source->active = now_active;
 	}
 
+	update_filters_state(source, false);
+}
+
+static void source_video_tick_callback(obs_source_t *source, float seconds)
+{
 	if (source->context.data && source->info.video_tick)
 		source->info.video_tick(source->context.data, seconds);
 
@@ -1230,6 +1381,30 @@ void obs_source_video_tick(obs_source_t *source, float seconds)
 	source->deinterlace_rendered = false;
 }
 
+void obs_source_video_tick(obs_source_t *source, float seconds)
+{
+	if (!obs_source_valid(source, "obs_source_video_tick"))
+		return;
+
+	source_video_tick_state(source, seconds);
+	source_video_tick_callback(source, seconds);
+}
+
+/* runs the transition, async, deferred update and show/activate part of the
+ * tick.  must be called on the graphics thread. */
+void obs_source_video_tick_state(obs_source_t *source, float seconds)
+{
+	source_video_tick_state(source, seconds);
+}
+
+/* runs only the video_tick callback, so it can be called off the graphics
+ * thread for sources flagged OBS_SOURCE_PARALLEL_TICK once
+ * obs_source_video_tick_state has been called for this frame. */
+void obs_source_video_tick_callback(obs_source_t *source, float seconds)
+{
+	source_video_tick_callback(source, seconds);
+}
+
 /* unless the value is 3+ hours worth of frames, this won't overflow */
 static inline uint64_t conv_frames_to_time(const size_t sample_rate,
 					   const size_t frames)
@@ -2806,6 +2981,8 @@ static inline void free_async_cache(struct obs_source *source)
 {
 	for (size_t i = 0; i < source->async_cache.num; i++)
 		obs_source_frame_decref(source->async_cache.array[i].frame);
+	for (size_t i = source->async_borrowed.num; i > 0; i--)
+		unqueue_borrowed_frame(source, i - 1);
 
 	da_resize(source->async_cache, 0);
 	da_resize(source->async_frames, 0);
@@ -2830,21 +3007,49 @@ static void clean_cache(obs_source_t *source)
 	}
 }
 
-#define MAX_ASYNC_FRAMES 30
-//if return value is not null then do (os_atomic_dec_long(&output->refs) == 0) && obs_source_frame_destroy(output)
-static inline struct obs_source_frame *
-cache_video(struct obs_source *source, const struct obs_source_frame *frame)
+/* lent buffers have to go back to the source as soon as it stops outputting,
+ * so they are taken out of the queue instead of waiting for the next tick */
+static void flush_borrowed_frames(obs_source_t *source)
 {
-	struct obs_source_frame *new_frame = NULL;
+	for (size_t i = source->async_borrowed.num; i > 0; i--) {
+		struct obs_source_frame *frame =
+			source->async_borrowed.array[i - 1].frame;
 
-	pthread_mutex_lock(&source->async_mutex);
+		da_erase_item(source->async_frames, &frame);
+		if (source->cur_async_frame == frame)
+			source->cur_async_frame = NULL;
+		if (source->prev_async_frame == frame)
+			source->prev_async_frame = NULL;
 
-	if (source->async_frames.num >= MAX_ASYNC_FRAMES) {
-		free_async_cache(source);
-		source->last_frame_ts = 0;
-		pthread_mutex_unlock(&source->async_mutex);
-		return NULL;
+		unqueue_borrowed_frame(source, i - 1);
 	}
+}
+
+#define MAX_ASYNC_FRAMES 30
+
+/* if the graphics thread stalls, the queue fills up.  rather than throwing
+ * the whole cache away, the oldest frames are dropped and their allocations
+ * go back to the cache for the next frames. */
+static void drop_oldest_async_frames(struct obs_source *source)
+{
+	while (source->async_frames.num >= MAX_ASYNC_FRAMES) {
+		struct obs_source_frame *frame = source->async_frames.array[0];
+
+		da_erase(source->async_frames, 0);
+		remove_async_frame(source, frame);
+		os_atomic_inc_long(&source->async_dropped_frames);
+	}
+
+	/* resync to the oldest frame still queued */
+	source->last_frame_ts = 0;
+}
+
+/* async_mutex must be held */
+static void prepare_async_queue(struct obs_source *source,
+				const struct obs_source_frame *frame)
+{
+	if (source->async_frames.num >= MAX_ASYNC_FRAMES)
+		drop_oldest_async_frames(source);
 
 	if (async_texture_changed(source, frame)) {
 		free_async_cache(source);
@@ -2852,9 +3057,21 @@ cache_video(struct obs_source *source, const struct obs_source_frame *frame)
 		source->async_cache_height = frame->height;
 	}
 
-	const enum video_format format = frame->format;
-	source->async_cache_format = format;
+	source->async_cache_format = frame->format;
 	source->async_cache_full_range = frame->full_range;
+}
+
+//if return value is not null then do (os_atomic_dec_long(&output->refs) == 0) && obs_source_frame_destroy(output)
+static inline struct obs_source_frame *
+cache_video(struct obs_source *source, const struct obs_source_frame *frame)
+{
+	struct obs_source_frame *new_frame = NULL;
+
+	pthread_mutex_lock(&source->async_mutex);
+
+	prepare_async_queue(source, frame);
+
+	const enum video_format format = frame->format;
 
 	for (size_t i = 0; i < source->async_cache.num; i++) {
 		struct async_frame *af = &source->async_cache.array[i];
@@ -2880,6 +3097,7 @@ cache_video(struct obs_source *source, const struct obs_source_frame *frame)
 		new_frame->refs = 1;
 
 		da_push_back(source->async_cache, &new_af);
+		os_atomic_inc_long(&source->async_frame_allocs);
 	}
 
 	os_atomic_inc_long(&new_frame->refs);
@@ -2899,6 +3117,9 @@ obs_source_output_video_internal(obs_source_t *source,
 		return;
 
 	if (!frame) {
+		pthread_mutex_lock(&source->async_mutex);
+		flush_borrowed_frames(source);
+		pthread_mutex_unlock(&source->async_mutex);
 		source->async_active = false;
 		return;
 	}
@@ -2969,6 +3190,43 @@ void obs_source_output_video2(obs_source_t *source,
 	obs_source_output_video_internal(source, &new_frame);
 }
 
+void obs_source_output_video_borrowed(obs_source_t *source,
+				      const struct obs_source_frame *frame,
+				      obs_source_frame_release_t release,
+				      void *param)
+{
+	if (!obs_source_valid(source, "obs_source_output_video_borrowed"))
+		return;
+
+	if (!frame || !release) {
+		obs_source_output_video(source, frame);
+		return;
+	}
+
+	struct obs_source_frame *new_frame = bmalloc(sizeof(*new_frame));
+	*new_frame = *frame;
+	new_frame->full_range =
+		format_is_yuv(frame->format) ? frame->full_range : true;
+	new_frame->refs = 1;
+	new_frame->prev_frame = false;
+
+	pthread_mutex_lock(&source->async_mutex);
+
+	prepare_async_queue(source, new_frame);
+
+	struct async_borrowed *borrowed = da_push_back_new(
+		source->async_borrowed);
+	borrowed->frame = new_frame;
+	borrowed->release = release;
+	borrowed->param = param;
+	borrowed->queued = true;
+
+	da_push_back(source->async_frames, &new_frame);
+	source->async_active = true;
+
+	pthread_mutex_unlock(&source->async_mutex);
+}
+
 void obs_source_set_async_rotation(obs_source_t *source, long rotation)
 {
 	if (source)
@@ -3424,9 +3682,13 @@ void remove_async_frame(obs_source_t *source, struct obs_source_frame *frame)
 
 		if (f->frame == frame) {
 			f->used = false;
-			break;
+			return;
 		}
 	}
+
+	size_t idx = find_borrowed_frame(source, frame);
+	if (idx != DARRAY_INVALID)
+		unqueue_borrowed_frame(source, idx);
 }
 
 /* #define DEBUG_ASYNC_FRAMES 1 */
@@ -3579,7 +3841,7 @@ void obs_source_release_frame(obs_source_t *source,
 		pthread_mutex_lock(&source->async_mutex);
 
 		if (os_atomic_dec_long(&frame->refs) == 0)
-			obs_source_frame_destroy(frame);
+			destroy_async_frame(source, frame);
 		else
 			remove_async_frame(source, frame);
 
@@ -4625,24 +4887,16 @@ static float get_source_volume(obs_source_t *source, uint64_t os_time)
 static inline void multiply_output_audio(obs_source_t *source, size_t mix,
 					 size_t channels, float vol)
 {
-	register float *out = source->audio_output_buf[mix][0];
-	register float *end = out + AUDIO_OUTPUT_FRAMES * channels;
-
-	while (out < end)
-		*(out++) *= vol;
+	audio_scale_floats(source->audio_output_buf[mix][0], vol,
+			   AUDIO_OUTPUT_FRAMES * channels);
 }
 
 static inline void multiply_vol_data(obs_source_t *source, size_t mix,
 				     size_t channels, float *vol_data)
 {
-	for (size_t ch = 0; ch < channels; ch++) {
-		register float *out = source->audio_output_buf[mix][ch];
-		register float *end = out + AUDIO_OUTPUT_FRAMES;
-		register float *vol = vol_data;
-
-		while (out < end)
-			*(out++) *= *(vol++);
-	}
+	for (size_t ch = 0; ch < channels; ch++)
+		audio_multiply_floats(source->audio_output_buf[mix][ch],
+				      vol_data, AUDIO_OUTPUT_FRAMES);
 }
 
 static inline void apply_audio_action(obs_source_t *source,
@@ -4664,8 +4918,8 @@ static inline void apply_audio_action(obs_source_t *source,
 	}
 }
 
-static void apply_audio_actions(obs_source_t *source, size_t channels,
-				size_t sample_rate)
+static void apply_audio_actions(obs_source_t *source, uint32_t mixers,
+				size_t channels, size_t sample_rate)
 {
 	float vol_data[AUDIO_OUTPUT_FRAMES];
 	float cur_vol = get_source_volume(source, source->audio_ts);
@@ -4705,7 +4959,9 @@ static void apply_audio_actions(obs_source_t *source, size_t channels,
 	pthread_mutex_unlock(&source->audio_actions_mutex);
 
 	for (size_t mix = 0; mix < MAX_AUDIO_MIXES; mix++) {
-		if ((source->audio_mixers & (1 << mix)) != 0)
+		uint32_t mix_and_val = (1 << mix);
+		if ((source->audio_mixers & mix_and_val) != 0 &&
+		    (mixers & mix_and_val) != 0)
 			multiply_vol_data(source, mix, channels, vol_data);
 	}
 }
@@ -4730,26 +4986,27 @@ static void apply_audio_volume(obs_source_t *source, uint32_t mixers,
 			conv_frames_to_time(sample_rate, AUDIO_OUTPUT_FRAMES);
 
 		if (action.timestamp < (source->audio_ts + duration)) {
-			apply_audio_actions(source, channels, sample_rate);
+			apply_audio_actions(source, mixers, channels,
+					    sample_rate);
 			return;
 		}
 	}
 
 	vol = get_source_volume(source, source->audio_ts);
-	if (vol == 1.0f)
-		return;
-
-	if (vol == 0.0f || mixers == 0) {
-		memset(source->audio_output_buf[0][0], 0,
-		       AUDIO_OUTPUT_FRAMES * sizeof(float) *
-			       MAX_AUDIO_CHANNELS * MAX_AUDIO_MIXES);
+	if (vol == 1.0f || mixers == 0)
 		return;
-	}
 
+	/* only the active mixes are ever read back */
 	for (size_t mix = 0; mix < MAX_AUDIO_MIXES; mix++) {
 		uint32_t mix_and_val = (1 << mix);
-		if ((source->audio_mixers & mix_and_val) != 0 &&
-		    (mixers & mix_and_val) != 0)
+		if ((source->audio_mixers & mix_and_val) == 0 ||
+		    (mixers & mix_and_val) == 0)
+			continue;
+
+		if (vol == 0.0f)
+			memset(source->audio_output_buf[mix][0], 0,
+			       AUDIO_OUTPUT_FRAMES * sizeof(float) * channels);
+		else
 			multiply_output_audio(source, mix, channels, vol);
 	}
 }
@@ -4861,8 +5118,11 @@ static inline void process_audio_source_tick(obs_source_t *source,
 			mix_and_val = 1;
 		}
 
-		if ((source->audio_mixers & mix_and_val) == 0 ||
-		    (mixers & mix_and_val) == 0) {
+		/* inactive mixes are never read, leave them alone */
+		if ((mixers & mix_and_val) == 0)
+			continue;
+
+		if ((source->audio_mixers & mix_and_val) == 0) {
 			memset(source->audio_output_buf[mix][0], 0,
 			       size * channels);
 			continue;
@@ -4878,7 +5138,7 @@ static inline void process_audio_source_tick(obs_source_t *source,
 		return;
 	}
 
-	if ((source->audio_mixers & 1) == 0 || (mixers & 1) == 0)
+	if ((source->audio_mixers & 1) == 0 && (mixers & 1) != 0)
 		memset(source->audio_output_buf[0][0], 0, size * channels);
 
 	apply_audio_volume(source, mixers, channels, sample_rate);
@@ -5024,6 +5284,22 @@ bool obs_source_async_unbuffered(const obs_source_t *source)
 		       : false;
 }
 
+uint32_t obs_source_get_async_dropped_frames(const obs_source_t *source)
+{
+	return obs_source_valid(source, "obs_source_get_async_dropped_frames")
+		       ? (uint32_t)os_atomic_load_long(
+				 &source->async_dropped_frames)
+		       : 0;
+}
+
+uint32_t obs_source_get_async_frame_allocs(const obs_source_t *source)
+{
+	return obs_source_valid(source, "obs_source_get_async_frame_allocs")
+		       ? (uint32_t)os_atomic_load_long(
+				 &source->async_frame_allocs)
+		       : 0;
+}
+
 obs_data_t *obs_source_get_private_settings(obs_source_t *source)
 {
 	if (!obs_ptr_valid(source, "obs_source_get_private_settings"))
@@ -196,6 +196,32 @@ enum obs_media_state {
  */
 #define OBS_SOURCE_SRGB (1 << 15)
 
+/**
+ * Source video_tick can be called on a helper thread, in parallel with other
+ * sources that have this flag.  The video_tick callback must only touch the
+ * source's own data, and must not call into other sources.  Graphics calls
+ * are fine as long as they are wrapped in obs_enter_graphics/
+ * obs_leave_graphics.  Updates, show/hide and activate/deactivate are still
+ * called on the graphics thread, as are the callbacks of its filters.
+ */
+#define OBS_SOURCE_PARALLEL_TICK (1 << 16)
+
+/**
+ * Source does not need video_tick while it is neither showing nor active,
+ * so it can be skipped while hidden.  It is still ticked once after being
+ * hidden or deactivated, and while an update is pending.
+ */
+#define OBS_SOURCE_SKIP_HIDDEN_TICK (1 << 17)
+
+/**
+ * Source audio_render (or audio_mix for submix sources) can be called on a
+ * helper thread, in parallel with other sources that have this flag.  The
+ * callback must only change the source's own data; reading the audio of its
+ * children is fine.  Sources without this flag are rendered on the audio
+ * thread.
+ */
+#define OBS_SOURCE_PARALLEL_AUDIO (1 << 18)
+
 /** @} */
 
 typedef void (*obs_source_enum_proc_t)(obs_source_t *parent,
@@ -23,18 +23,165 @@
 #include "graphics/vec4.h"
 #include "media-io/format-conversion.h"
 #include "media-io/video-frame.h"
+#include "util/trace.h"
 
 #ifdef _WIN32
 #define WIN32_MEAN_AND_LEAN
 #include <windows.h>
 #endif
 
+/* ------------------------------------------------------------------------- */
+/* parallel source ticking
+ *
+ * Sources flagged OBS_SOURCE_PARALLEL_TICK only touch their own data in
+ * their video_tick callback.  Their deferred update and show/activate state
+ * are handled on the graphics thread first, then only their video_tick
+ * callbacks are run on the worker pool.  Everything else, including all
+ * filters, is ticked on the graphics thread in list order. */
+
+static const char *tick_thread_name = "obs_tick_thread";
+
+static const char *get_tick_profile_name(struct source_tick_pool *pool,
+					 const char *id)
+{
+	struct tick_profile_name *entry;
+
+	for (size_t i = 0; i < pool->profile_names.num; i++) {
+		entry = &pool->profile_names.array[i];
+		if (strcmp(entry->id, id) == 0)
+			return entry->name;
+	}
+
+	entry = da_push_back_new(pool->profile_names);
+	entry->id = bstrdup(id);
+	entry->name = profile_store_name(obs_get_profiler_name_store(), "%s",
+					 id);
+	return entry->name;
+}
+
+static inline void tick_source(obs_source_t *source, float seconds)
+{
+	profile_start(source->tick_profile_name);
+	obs_source_video_tick(source, seconds);
+	profile_end(source->tick_profile_name);
+}
+
+static void tick_parallel_task(void *param, size_t idx)
+{
+	struct source_tick_pool *pool = param;
+	obs_source_t *source = pool->tasks.array[idx];
+
+	profile_start(source->tick_profile_name);
+	obs_source_video_tick_callback(source, pool->seconds);
+	profile_end(source->tick_profile_name);
+}
+
+static void source_tick_pool_init(struct source_tick_pool *pool)
+{
+	pool->workers = worker_pool_create("libobs: source tick thread",
+					   tick_thread_name, MAX_TICK_THREADS);
+}
+
+static void source_tick_pool_free(struct source_tick_pool *pool)
+{
+	worker_pool_destroy(pool->workers);
+
+	for (size_t i = 0; i < pool->profile_names.num; i++)
+		bfree(pool->profile_names.array[i].id);
+
+	da_free(pool->profile_names);
+	da_free(pool->sources);
+	da_free(pool->tasks);
+	memset(pool, 0, sizeof(*pool));
+}
+
+static inline void push_tick_source(struct source_tick_pool *pool,
+				    obs_source_t *source)
+{
+	if (!source->tick_profile_name)
+		source->tick_profile_name =
+			get_tick_profile_name(pool, source->info.id);
+
+	da_push_back(pool->sources, &source);
+}
+
+/* takes a reference to every listed source and its filters */
+static void collect_tick_sources(struct obs_core_data *data,
+				 struct source_tick_pool *pool)
+{
+	size_t num;
+
+	da_resize(pool->sources, 0);
+
+	pthread_mutex_lock(&data->ticked_sources_mutex);
+	for (size_t i = 0; i < data->ticked_sources.num; i++) {
+		obs_source_t *source =
+			obs_source_get_ref(data->ticked_sources.array[i]);
+		if (source)
+			push_tick_source(pool, source);
+	}
+	pthread_mutex_unlock(&data->ticked_sources_mutex);
+
+	/* filters are added outside of the list mutex, which is taken while
+	 * sources activate */
+	num = pool->sources.num;
+	for (size_t i = 0; i < num; i++) {
+		obs_source_t *parent = pool->sources.array[i];
+
+		if (!parent->filters.num)
+			continue;
+
+		pthread_mutex_lock(&parent->filter_mutex);
+		for (size_t j = 0; j < parent->filters.num; j++) {
+			obs_source_t *filter =
+				obs_source_get_ref(parent->filters.array[j]);
+			if (filter)
+				push_tick_source(pool, filter);
+		}
+		pthread_mutex_unlock(&parent->filter_mutex);
+	}
+}
+
+static inline bool can_tick_in_parallel(obs_source_t *source)
+{
+	return source->info.type != OBS_SOURCE_TYPE_FILTER &&
+	       (source->info.output_flags & OBS_SOURCE_PARALLEL_TICK) != 0;
+}
+
+static void tick_parallel_sources(struct source_tick_pool *pool,
+				  float seconds)
+{
+	da_resize(pool->tasks, 0);
+
+	if (!worker_pool_num_threads(pool->workers))
+		return;
+
+	for (size_t i = 0; i < pool->sources.num; i++) {
+		obs_source_t *source = pool->sources.array[i];
+		if (can_tick_in_parallel(source))
+			da_push_back(pool->tasks, &source);
+	}
+
+	if (pool->tasks.num < 2) {
+		da_resize(pool->tasks, 0);
+		return;
+	}
+
+	for (size_t i = 0; i < pool->tasks.num; i++)
+		obs_source_video_tick_state(pool->tasks.array[i], seconds);
+
+	pool->seconds = seconds;
+	worker_pool_run(pool->workers, pool->tasks.num, tick_parallel_task,
+			pool);
+}
+
 static uint64_t tick_sources(uint64_t cur_time, uint64_t last_time)
 {
 	struct obs_core_data *data = &obs->data;
-	struct obs_source *source;
+	struct source_tick_pool *pool = &obs->video.tick_pool;
 	uint64_t delta_time;
 	float seconds;
+	bool parallel;
 
 	if (!last_time)
 		last_time = cur_time -
@@ -59,20 +206,22 @@ static uint64_t tick_sources(uint64_t cur_time, uint64_t last_time)
 	/* ------------------------------------- */
 	/* call the tick function of each source */
 
-	pthread_mutex_lock(&data->sources_mutex);
-
-	source = data->first_source;
-	while (source) {
-		struct obs_source *cur_source = obs_source_get_ref(source);
-		source = (struct obs_source *)source->context.next;
+	collect_tick_sources(data, pool);
+	tick_parallel_sources(pool, seconds);
+	parallel = pool->tasks.num > 0;
 
-		if (cur_source) {
-			obs_source_video_tick(cur_source, seconds);
-			obs_source_release(cur_source);
-		}
+	for (size_t i = 0; i < pool->sources.num; i++) {
+		obs_source_t *source = pool->sources.array[i];
+		if (!parallel || !can_tick_in_parallel(source))
+			tick_source(source, seconds);
 	}
 
-	pthread_mutex_unlock(&data->sources_mutex);
+	/* drop sources that were hidden or deactivated this tick */
+	for (size_t i = 0; i < pool->sources.num; i++) {
+		obs_source_t *source = pool->sources.array[i];
+		obs_source_tick_list_prune(source);
+		obs_source_release(source);
+	}
 
 	return cur_time;
 }
@@ -709,6 +858,7 @@ static inline void output_video_data(struct obs_core_video *video,
 	}
 }
 
+static const char *lagged_frame_name = "lagged_frame";
 static inline void video_sleep(struct obs_core_video *video, bool raw_active,
 			       const bool gpu_active, uint64_t *p_time,
 			       uint64_t interval_ns)
@@ -729,6 +879,9 @@ static inline void video_sleep(struct obs_core_video *video, bool raw_active,
 	video->total_frames += count;
 	video->lagged_frames += count - 1;
 
+	if (count > 1)
+		trace_instant(lagged_frame_name, cur_time);
+
 	vframe_info.timestamp = cur_time;
 	vframe_info.count = count;
 
@@ -753,6 +906,9 @@ static inline void output_frame(bool raw_active, const bool gpu_active)
 					    : cur_texture - 1;
 	struct video_data frame;
 	bool frame_ready = 0;
+	uint64_t download_start = 0;
+	uint64_t download_end = 0;
+	uint64_t trace_ts;
 
 	memset(&frame, 0, sizeof(struct video_data));
 
@@ -762,13 +918,20 @@ static inline void output_frame(bool raw_active, const bool gpu_active)
 	profile_start(output_frame_render_video_name);
 	GS_DEBUG_MARKER_BEGIN(GS_DEBUG_COLOR_RENDER_VIDEO,
 			      output_frame_render_video_name);
+	trace_ts = trace_begin();
 	render_video(video, raw_active, gpu_active, cur_texture);
+	trace_end(output_frame_render_video_name, video->video_time, trace_ts);
 	GS_DEBUG_MARKER_END();
 	profile_end(output_frame_render_video_name);
 
+	/* the downloaded frame is an older one, its id is only known once its
+	 * frame info has been popped below */
 	if (raw_active) {
 		profile_start(output_frame_download_frame_name);
+		download_start = trace_begin();
 		frame_ready = download_frame(video, prev_texture, &frame);
+		if (download_start)
+			download_end = os_gettime_ns();
 		profile_end(output_frame_download_frame_name);
 	}
 
@@ -785,8 +948,14 @@ static inline void output_frame(bool raw_active, const bool gpu_active)
 				    sizeof(vframe_info));
 
 		frame.timestamp = vframe_info.timestamp;
+		trace_event(output_frame_download_frame_name, frame.timestamp,
+			    download_start, download_end);
+
 		profile_start(output_frame_output_video_data_name);
+		trace_ts = trace_begin();
 		output_video_data(video, &frame, vframe_info.count);
+		trace_end(output_frame_output_video_data_name, frame.timestamp,
+			  trace_ts);
 		profile_end(output_frame_output_video_data_name);
 	}
 
@@ -923,6 +1092,7 @@ static void uninit_winrt_state(struct winrt_state *winrt)
 static const char *tick_sources_name = "tick_sources";
 static const char *render_displays_name = "render_displays";
 static const char *output_frame_name = "output_frame";
+static const char *graphics_frame_name = "graphics_frame";
 bool obs_graphics_thread_loop(struct obs_graphics_context *context)
 {
 	/* defer loop break to clean up sources */
@@ -930,6 +1100,11 @@ bool obs_graphics_thread_loop(struct obs_graphics_context *context)
 
 	uint64_t frame_start = os_gettime_ns();
 	uint64_t frame_time_ns;
+
+	/* the video time of this iteration identifies the frame in traces */
+	const uint64_t frame_id = obs->video.video_time;
+	const uint64_t trace_frame = trace_enabled() ? frame_start : 0;
+	uint64_t trace_ts;
 	bool raw_active = obs->video.raw_active > 0;
 #ifdef _WIN32
 	const bool gpu_active = obs->video.gpu_encoder_active > 0;
@@ -959,8 +1134,10 @@ bool obs_graphics_thread_loop(struct obs_graphics_context *context)
 	gs_leave_context();
 
 	profile_start(tick_sources_name);
+	trace_ts = trace_begin();
 	context->last_time =
 		tick_sources(obs->video.video_time, context->last_time);
+	trace_end(tick_sources_name, frame_id, trace_ts);
 	profile_end(tick_sources_name);
 
 	execute_graphics_tasks();
@@ -978,10 +1155,14 @@ bool obs_graphics_thread_loop(struct obs_graphics_context *context)
 	profile_end(output_frame_name);
 
 	profile_start(render_displays_name);
+	trace_ts = trace_begin();
 	render_displays();
+	trace_end(render_displays_name, frame_id, trace_ts);
 	profile_end(render_displays_name);
 
 	frame_time_ns = os_gettime_ns() - frame_start;
+	trace_event(graphics_frame_name, frame_id, trace_frame,
+		    frame_start + frame_time_ns);
 
 	profile_end(context->video_thread_name);
 
@@ -1025,6 +1206,7 @@ void *obs_graphics_thread(void *param)
 	obs->video.video_frame_interval_ns = interval;
 
 	os_set_thread_name("libobs: graphics thread");
+	trace_set_thread_name("libobs: graphics thread");
 
 	const char *video_thread_name = profile_store_name(
 		obs_get_profiler_name_store(),
@@ -1046,6 +1228,8 @@ void *obs_graphics_thread(void *param)
 	context.was_active = false;
 	context.video_thread_name = video_thread_name;
 
+	source_tick_pool_init(&obs->video.tick_pool);
+
 #ifdef __APPLE__
 	while (obs_graphics_thread_loop_autorelease(&context))
 #else
@@ -1053,6 +1237,8 @@ void *obs_graphics_thread(void *param)
 #endif
 		;
 
+	source_tick_pool_free(&obs->video.tick_pool);
+
 #ifdef _WIN32
 	uninit_winrt_state(&winrt);
 #endif
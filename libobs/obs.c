@@ -19,6 +19,7 @@
 
 #include "graphics/matrix4.h"
 #include "callback/calldata.h"
+#include "util/trace.h"
 
 #include "obs.h"
 #include "obs-internal.h"
@@ -411,6 +412,10 @@ static int obs_init_video(struct obs_video_info *ovi)
 		return OBS_VIDEO_FAIL;
 	}
 
+	/* keep a lagging encoder from holding up the other raw outputs */
+	video_output_set_parallel_inputs(video->video,
+					 os_get_logical_cores() > 1);
+
 	gs_enter_context(video->graphics);
 
 	if (ovi->gpu_conversion && !obs_init_gpu_conversion(ovi))
@@ -586,6 +591,14 @@ static bool obs_init_audio(struct audio_output_info *ai)
 	audio->monitoring_device_name = bstrdup("Default");
 	audio->monitoring_device_id = bstrdup("default");
 
+	audio->render_pool = worker_pool_create("libobs: audio render thread",
+						NULL, MAX_AUDIO_RENDER_THREADS);
+	if (!audio->render_pool)
+		return false;
+	if (worker_pool_num_threads(audio->render_pool))
+		blog(LOG_INFO, "Audio sources are rendered on up to %d threads",
+		     (int)worker_pool_num_threads(audio->render_pool) + 1);
+
 	errorcode = audio_output_open(&audio->audio, ai);
 	if (errorcode == AUDIO_OUTPUT_SUCCESS)
 		return true;
@@ -603,9 +616,13 @@ static void obs_free_audio(void)
 	if (audio->audio)
 		audio_output_close(audio->audio);
 
+	worker_pool_destroy(audio->render_pool);
+
 	circlebuf_free(&audio->buffered_timestamps);
 	da_free(audio->render_order);
 	da_free(audio->root_nodes);
+	da_free(audio->render_edges);
+	da_free(audio->render_tasks);
 
 	da_free(audio->monitors);
 	bfree(audio->monitoring_device_name);
@@ -624,6 +641,7 @@ static bool obs_init_data(void)
 
 	pthread_mutex_init_value(&obs->data.displays_mutex);
 	pthread_mutex_init_value(&obs->data.draw_callbacks_mutex);
+	pthread_mutex_init_value(&obs->data.ticked_sources_mutex);
 
 	if (pthread_mutexattr_init(&attr) != 0)
 		return false;
@@ -643,6 +661,8 @@ static bool obs_init_data(void)
 		goto fail;
 	if (pthread_mutex_init(&obs->data.draw_callbacks_mutex, &attr) != 0)
 		goto fail;
+	if (pthread_mutex_init(&data->ticked_sources_mutex, NULL) != 0)
+		goto fail;
 	if (!obs_view_init(&data->main_view))
 		goto fail;
 
@@ -701,8 +721,10 @@ static void obs_free_data(void)
 	pthread_mutex_destroy(&data->encoders_mutex);
 	pthread_mutex_destroy(&data->services_mutex);
 	pthread_mutex_destroy(&data->draw_callbacks_mutex);
+	pthread_mutex_destroy(&data->ticked_sources_mutex);
 	da_free(data->draw_callbacks);
 	da_free(data->tick_callbacks);
+	da_free(data->ticked_sources);
 	obs_data_release(data->private_data);
 }
 
@@ -863,6 +885,8 @@ static bool obs_init(const char *locale, const char *module_config_path,
 
 	log_system_info();
 
+	if (!obs_packet_pool_init(&obs->packet_pool))
+		return false;
 	if (!obs_init_data())
 		return false;
 	if (!obs_init_handlers())
@@ -1050,9 +1074,15 @@ void obs_shutdown(void)
 		free_module_path(obs->module_paths.array + i);
 	da_free(obs->module_paths);
 
+	/* every libobs thread has been stopped, so the trace rings can go */
+	trace_stop();
+	trace_free();
+
 	if (obs->name_store_owned)
 		profiler_name_store_free(obs->name_store);
 
+	obs_packet_pool_free(&obs->packet_pool);
+
 	bfree(obs->module_config_path);
 	bfree(obs->locale);
 	bfree(obs);
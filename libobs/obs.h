@@ -1262,6 +1262,23 @@ EXPORT void obs_source_output_video(obs_source_t *source,
 EXPORT void obs_source_output_video2(obs_source_t *source,
 				     const struct obs_source_frame2 *frame);
 
+typedef void (*obs_source_frame_release_t)(void *param);
+
+/**
+ * Outputs asynchronous video data without copying it.  The frame's planes
+ * must stay valid until libobs calls release, which happens once the frame
+ * has been uploaded or dropped.  Outputting NULL with obs_source_output_video
+ * releases every queued frame that has not been picked up yet.
+ *
+ * NOTE: release may be called from any thread with internal locks held, and
+ * must not call back into the source.
+ */
+EXPORT void
+obs_source_output_video_borrowed(obs_source_t *source,
+				 const struct obs_source_frame *frame,
+				 obs_source_frame_release_t release,
+				 void *param);
+
 EXPORT void obs_source_set_async_rotation(obs_source_t *source, long rotation);
 
 EXPORT void obs_source_output_cea708(obs_source_t *source,
@@ -1410,6 +1427,14 @@ EXPORT void obs_source_set_async_unbuffered(obs_source_t *source,
 					    bool unbuffered);
 EXPORT bool obs_source_async_unbuffered(const obs_source_t *source);
 
+/** Number of async frames dropped because too many were queued */
+EXPORT uint32_t
+obs_source_get_async_dropped_frames(const obs_source_t *source);
+
+/** Number of async frame buffers allocated, including reallocations after
+ * the frame size or format changed */
+EXPORT uint32_t obs_source_get_async_frame_allocs(const obs_source_t *source);
+
 /** Used to decouple audio from video so that audio doesn't attempt to sync up
  * with video.  I.E. Audio acts independently.  Only works when in unbuffered
  * mode. */
@@ -1986,6 +2011,8 @@ EXPORT void obs_output_set_reconnect_settings(obs_output_t *output,
 
 EXPORT uint64_t obs_output_get_total_bytes(const obs_output_t *output);
 EXPORT int obs_output_get_frames_dropped(const obs_output_t *output);
+EXPORT uint64_t
+obs_output_get_total_bytes_copied(const obs_output_t *output);
 EXPORT int obs_output_get_total_frames(const obs_output_t *output);
 
 /**
@@ -2261,6 +2288,15 @@ EXPORT void obs_encoder_packet_ref(struct encoder_packet *dst,
 				   struct encoder_packet *src);
 EXPORT void obs_encoder_packet_release(struct encoder_packet *packet);
 
+struct obs_packet_pool_stats {
+	uint64_t hits;
+	uint64_t misses;
+	uint64_t bytes_retained;
+};
+
+/** Gets statistics of the encoded packet buffer pool */
+EXPORT void obs_get_packet_pool_stats(struct obs_packet_pool_stats *stats);
+
 EXPORT void *obs_encoder_create_rerouted(obs_encoder_t *encoder,
 					 const char *reroute_id);
 
@@ -2271,6 +2307,13 @@ EXPORT const char *obs_encoder_get_last_error(obs_encoder_t *encoder);
 EXPORT void obs_encoder_set_last_error(obs_encoder_t *encoder,
 				       const char *message);
 
+/**
+ * Returns the total encoded bytes copied out of the encoder.  Each packet is
+ * copied once and shared by every output using the encoder, so this is a
+ * per-encoder statistic.
+ */
+EXPORT uint64_t obs_encoder_get_total_bytes_copied(obs_encoder_t *encoder);
+
 /* ------------------------------------------------------------------------- */
 /* Stream Services */
 
@@ -15,6 +15,9 @@
  */
 
 #include <stdio.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/uio.h>
 #include <sys/wait.h>
 
 #include "bmem.h"
@@ -102,3 +105,62 @@ size_t os_process_pipe_write(os_process_pipe_t *pp, const uint8_t *data,
 	}
 	return written;
 }
+
+#define MAX_WRITEV_BUFFERS 64
+
+size_t os_process_pipe_writev(os_process_pipe_t *pp,
+			      const struct os_pipe_buffer *bufs, size_t count)
+{
+	struct iovec iov[MAX_WRITEV_BUFFERS];
+	size_t written = 0;
+	size_t offset = 0;
+	size_t idx = 0;
+	int fd;
+
+	if (!pp) {
+		return 0;
+	}
+	if (pp->read_pipe) {
+		return 0;
+	}
+
+	/* anything written with os_process_pipe_write must go out first */
+	if (fflush(pp->file) != 0) {
+		return 0;
+	}
+
+	fd = fileno(pp->file);
+
+	while (idx < count) {
+		int num = 0;
+		ssize_t ret;
+
+		for (size_t i = idx; i < count && num < MAX_WRITEV_BUFFERS;
+		     i++) {
+			size_t skip = i == idx ? offset : 0;
+			iov[num].iov_base = (void *)(bufs[i].data + skip);
+			iov[num].iov_len = bufs[i].len - skip;
+			num++;
+		}
+
+		ret = writev(fd, iov, num);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+
+		written += (size_t)ret;
+
+		/* advance past what was written, which may end mid-buffer */
+		size_t left = (size_t)ret;
+		while (idx < count && left >= bufs[idx].len - offset) {
+			left -= bufs[idx].len - offset;
+			offset = 0;
+			idx++;
+		}
+		offset += left;
+	}
+
+	return written;
+}
@@ -222,3 +222,27 @@ size_t os_process_pipe_write(os_process_pipe_t *pp, const uint8_t *data,
 
 	return 0;
 }
+
+size_t os_process_pipe_writev(os_process_pipe_t *pp,
+			      const struct os_pipe_buffer *bufs, size_t count)
+{
+	size_t written = 0;
+
+	/* there is no gathered write for anonymous pipes */
+	for (size_t i = 0; i < count; i++) {
+		size_t buf_written = 0;
+
+		while (buf_written < bufs[i].len) {
+			size_t ret = os_process_pipe_write(
+				pp, bufs[i].data + buf_written,
+				bufs[i].len - buf_written);
+			if (!ret)
+				return written + buf_written;
+			buf_written += ret;
+		}
+
+		written += buf_written;
+	}
+
+	return written;
+}
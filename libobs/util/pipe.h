@@ -31,3 +31,14 @@ EXPORT size_t os_process_pipe_read_err(os_process_pipe_t *pp, uint8_t *data,
 				       size_t len);
 EXPORT size_t os_process_pipe_write(os_process_pipe_t *pp, const uint8_t *data,
 				    size_t len);
+
+struct os_pipe_buffer {
+	const uint8_t *data;
+	size_t len;
+};
+
+/* writes several buffers in as few system calls as the platform allows,
+ * returns the total number of bytes written */
+EXPORT size_t os_process_pipe_writev(os_process_pipe_t *pp,
+				     const struct os_pipe_buffer *bufs,
+				     size_t count);
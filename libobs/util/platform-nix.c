@@ -19,6 +19,8 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/statvfs.h>
+#include <sys/mman.h>
+#include <fcntl.h>
 #include <dirent.h>
 #include <stdlib.h>
 #include <limits.h>
@@ -1020,3 +1022,63 @@ uint64_t os_get_free_disk_space(const char *dir)
 
 	return (uint64_t)info.f_frsize * (uint64_t)info.f_bavail;
 }
+
+struct os_mapped_file {
+	int fd;
+	void *data;
+	size_t size;
+};
+
+os_mapped_file_t *os_mapped_file_create(const char *path, uint64_t size)
+{
+	struct os_mapped_file *file;
+	void *data;
+	int fd;
+
+	if (!path || !size || size > SIZE_MAX)
+		return NULL;
+
+	fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0600);
+	if (fd == -1)
+		return NULL;
+
+#if defined(__APPLE__)
+	if (ftruncate(fd, (off_t)size) != 0)
+		goto fail;
+#else
+	/* actually reserve the space, so running out of disk later cannot
+	 * fault on a write to the mapping */
+	if (posix_fallocate(fd, 0, (off_t)size) != 0)
+		goto fail;
+#endif
+
+	data = mmap(NULL, (size_t)size, PROT_READ | PROT_WRITE, MAP_SHARED, fd,
+		    0);
+	if (data == MAP_FAILED)
+		goto fail;
+
+	file = bmalloc(sizeof(*file));
+	file->fd = fd;
+	file->data = data;
+	file->size = (size_t)size;
+	return file;
+
+fail:
+	close(fd);
+	return NULL;
+}
+
+void *os_mapped_file_get_data(os_mapped_file_t *file)
+{
+	return file ? file->data : NULL;
+}
+
+void os_mapped_file_destroy(os_mapped_file_t *file)
+{
+	if (!file)
+		return;
+
+	munmap(file->data, file->size);
+	close(file->fd);
+	bfree(file);
+}
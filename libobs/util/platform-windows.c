@@ -1313,3 +1313,67 @@ uint64_t os_get_free_disk_space(const char *dir)
 
 	return success ? free.QuadPart : 0;
 }
+
+struct os_mapped_file {
+	HANDLE file;
+	HANDLE mapping;
+	void *data;
+};
+
+os_mapped_file_t *os_mapped_file_create(const char *path, uint64_t size)
+{
+	struct os_mapped_file *file;
+	wchar_t *wpath = NULL;
+	HANDLE handle;
+	HANDLE mapping;
+	void *data;
+
+	if (!path || !size || size > SIZE_MAX)
+		return NULL;
+	if (!os_utf8_to_wcs_ptr(path, 0, &wpath))
+		return NULL;
+
+	handle = CreateFileW(wpath, GENERIC_READ | GENERIC_WRITE, 0, NULL,
+			     CREATE_ALWAYS, FILE_ATTRIBUTE_TEMPORARY, NULL);
+	bfree(wpath);
+
+	if (handle == INVALID_HANDLE_VALUE)
+		return NULL;
+
+	/* a mapping larger than the file extends the file */
+	mapping = CreateFileMappingW(handle, NULL, PAGE_READWRITE,
+				     (DWORD)(size >> 32), (DWORD)size, NULL);
+	if (!mapping) {
+		CloseHandle(handle);
+		return NULL;
+	}
+
+	data = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, (SIZE_T)size);
+	if (!data) {
+		CloseHandle(mapping);
+		CloseHandle(handle);
+		return NULL;
+	}
+
+	file = bmalloc(sizeof(*file));
+	file->file = handle;
+	file->mapping = mapping;
+	file->data = data;
+	return file;
+}
+
+void *os_mapped_file_get_data(os_mapped_file_t *file)
+{
+	return file ? file->data : NULL;
+}
+
+void os_mapped_file_destroy(os_mapped_file_t *file)
+{
+	if (!file)
+		return;
+
+	UnmapViewOfFile(file->data);
+	CloseHandle(file->mapping);
+	CloseHandle(file->file);
+	bfree(file);
+}
@@ -159,6 +159,16 @@ EXPORT int os_chdir(const char *path);
 
 EXPORT uint64_t os_get_free_disk_space(const char *dir);
 
+struct os_mapped_file;
+typedef struct os_mapped_file os_mapped_file_t;
+
+/* creates (or truncates) a file with all of its space allocated, and maps it
+ * for reading and writing.  the file is left on disk when it is unmapped. */
+EXPORT os_mapped_file_t *os_mapped_file_create(const char *path,
+					       uint64_t size);
+EXPORT void *os_mapped_file_get_data(os_mapped_file_t *file);
+EXPORT void os_mapped_file_destroy(os_mapped_file_t *file);
+
 #define MKDIR_EXISTS 1
 #define MKDIR_SUCCESS 0
 #define MKDIR_ERROR -1
@@ -864,6 +864,10 @@ void profiler_name_store_free(profiler_name_store_t *store)
 const char *profile_store_name(profiler_name_store_t *store, const char *format,
 			       ...)
 {
+	/* media-io can run without obs core, and with it without a store */
+	if (!store)
+		return NULL;
+
 	va_list args;
 	va_start(args, format);
 
@@ -0,0 +1,68 @@
+#pragma once
+
+#include "c99defs.h"
+
+/*
+ * Intrinsics and CPU checks for code with an SSE2 baseline plus AVX/AVX2
+ * versions picked at runtime.  x86 uses the native intrinsics and defines
+ * SIMD_HAVE_AVX; other architectures get SSE2 through simde and only have
+ * the baseline.  Functions using AVX/AVX2 must be marked with AVX_TARGET or
+ * AVX2_TARGET, and only be called after the matching check succeeded.
+ */
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || \
+	defined(__x86_64__)
+#define SIMD_HAVE_AVX
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define AVX_TARGET
+#define AVX2_TARGET
+#else
+#define AVX_TARGET __attribute__((target("avx")))
+#define AVX2_TARGET __attribute__((target("avx2")))
+#endif
+#else
+#include "sse-intrin.h"
+#endif
+
+#ifdef SIMD_HAVE_AVX
+#ifdef _MSC_VER
+/* AVX and OSXSAVE, then check the OS saves the YMM registers */
+static inline bool simd_msvc_os_avx(void)
+{
+	int info[4];
+	__cpuid(info, 1);
+
+	if ((info[2] & (1 << 28)) == 0 || (info[2] & (1 << 27)) == 0)
+		return false;
+	return (_xgetbv(0) & 6) == 6;
+}
+#endif
+
+static inline bool simd_cpu_has_avx(void)
+{
+#ifdef _MSC_VER
+	return simd_msvc_os_avx();
+#else
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx");
+#endif
+}
+
+static inline bool simd_cpu_has_avx2(void)
+{
+#ifdef _MSC_VER
+	int info[4];
+
+	if (!simd_msvc_os_avx())
+		return false;
+
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#else
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2");
+#endif
+}
+#endif
@@ -0,0 +1,163 @@
+#pragma once
+
+#include "c99defs.h"
+#include <string.h>
+
+#include "bmem.h"
+#include "threading.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Bounded single-producer/single-consumer ring of fixed-size elements.
+ *
+ * Exactly one thread may push (the producer) and exactly one thread may pop,
+ * peek or compact (the consumer); no locking is needed between the two.
+ * head/tail are free-running counters, so the capacity is rounded up to a
+ * power of two and the slot index is the counter masked by capacity - 1.
+ */
+
+struct spsc_ring {
+	uint8_t *data;
+	size_t elem_size;
+	size_t capacity;
+
+	volatile long head; /* written by the consumer only */
+	volatile long tail; /* written by the producer only */
+};
+
+static inline void spsc_ring_init(struct spsc_ring *ring, size_t elem_size,
+				  size_t capacity)
+{
+	size_t cap = 1;
+	while (cap < capacity)
+		cap <<= 1;
+
+	memset(ring, 0, sizeof(struct spsc_ring));
+	ring->data = (uint8_t *)bmalloc(elem_size * cap);
+	ring->elem_size = elem_size;
+	ring->capacity = cap;
+}
+
+static inline void spsc_ring_free(struct spsc_ring *ring)
+{
+	bfree(ring->data);
+	memset(ring, 0, sizeof(struct spsc_ring));
+}
+
+static inline void *spsc_ring_slot(const struct spsc_ring *ring,
+				   unsigned long idx)
+{
+	return ring->data + (idx & (ring->capacity - 1)) * ring->elem_size;
+}
+
+/* safe from either side; the result may be stale by the time it is used */
+static inline size_t spsc_ring_size(const struct spsc_ring *ring)
+{
+	unsigned long head = (unsigned long)os_atomic_load_long(&ring->head);
+	unsigned long tail = (unsigned long)os_atomic_load_long(&ring->tail);
+	return (size_t)(tail - head);
+}
+
+/* ------------------------------------------------------------------------- */
+/* producer */
+
+static inline bool spsc_ring_push_back(struct spsc_ring *ring,
+				       const void *elem)
+{
+	unsigned long tail = (unsigned long)ring->tail;
+	unsigned long head = (unsigned long)os_atomic_load_long(&ring->head);
+
+	if (!ring->capacity || (size_t)(tail - head) >= ring->capacity)
+		return false;
+
+	memcpy(spsc_ring_slot(ring, tail), elem, ring->elem_size);
+	os_atomic_store_long(&ring->tail, (long)(tail + 1));
+	return true;
+}
+
+/* ------------------------------------------------------------------------- */
+/* consumer */
+
+/* pops up to max_count elements into out, returns the number popped */
+static inline size_t spsc_ring_pop_front_batch(struct spsc_ring *ring,
+					       void *out, size_t max_count)
+{
+	unsigned long head = (unsigned long)ring->head;
+	unsigned long tail = (unsigned long)os_atomic_load_long(&ring->tail);
+	size_t count = (size_t)(tail - head);
+	size_t start, first;
+
+	if (count > max_count)
+		count = max_count;
+	if (!count)
+		return 0;
+
+	start = head & (ring->capacity - 1);
+	first = ring->capacity - start;
+	if (first > count)
+		first = count;
+
+	memcpy(out, ring->data + start * ring->elem_size,
+	       first * ring->elem_size);
+	if (first < count)
+		memcpy((uint8_t *)out + first * ring->elem_size, ring->data,
+		       (count - first) * ring->elem_size);
+
+	os_atomic_store_long(&ring->head, (long)(head + count));
+	return count;
+}
+
+static inline bool spsc_ring_pop_front(struct spsc_ring *ring, void *out)
+{
+	return spsc_ring_pop_front_batch(ring, out, 1) == 1;
+}
+
+/* returns the idx-th queued element (0 is the front), or NULL.  only valid
+ * until the consumer pops or compacts. */
+static inline void *spsc_ring_data(struct spsc_ring *ring, size_t idx)
+{
+	unsigned long head = (unsigned long)ring->head;
+	unsigned long tail = (unsigned long)os_atomic_load_long(&ring->tail);
+
+	if (idx >= (size_t)(tail - head))
+		return NULL;
+	return spsc_ring_slot(ring, head + (unsigned long)idx);
+}
+
+typedef bool (*spsc_ring_keep_t)(void *param, void *elem);
+
+/*
+ * Removes every queued element for which keep() returns false, preserving the
+ * order of the remaining ones.  Elements are visited newest first; elements
+ * pushed while compacting are left untouched.  Kept elements are moved
+ * towards the tail, so the producer (which only writes past the tail) never
+ * observes a partially moved slot.  Returns the number of removed elements.
+ */
+static inline size_t spsc_ring_compact(struct spsc_ring *ring,
+				       spsc_ring_keep_t keep, void *param)
+{
+	unsigned long head = (unsigned long)ring->head;
+	unsigned long tail = (unsigned long)os_atomic_load_long(&ring->tail);
+	unsigned long dst = tail;
+	unsigned long src = tail;
+
+	while (src != head) {
+		void *elem = spsc_ring_slot(ring, --src);
+
+		if (keep(param, elem)) {
+			if (--dst != src)
+				memcpy(spsc_ring_slot(ring, dst), elem,
+				       ring->elem_size);
+		}
+	}
+
+	os_atomic_store_long(&ring->head, (long)dst);
+	return (size_t)(dst - head);
+}
+
+#ifdef __cplusplus
+}
+#endif
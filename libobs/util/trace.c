@@ -0,0 +1,337 @@
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include "trace.h"
+
+#include "bmem.h"
+#include "darray.h"
+#include "dstr.h"
+#include "platform.h"
+#include "threading.h"
+
+/* events per thread, must be a power of two */
+#define TRACE_RING_SIZE 8192
+
+/* rings of threads that have exited are reused, so this only limits the
+ * number of threads that trace at the same time */
+#define TRACE_MAX_THREADS 256
+
+struct trace_event {
+	const char *name;
+	uint64_t frame_id;
+	uint64_t start;
+	uint64_t end;
+	bool instant;
+};
+
+/* head is a free-running counter, written by the owning thread only.  tail
+ * is where the events start after a trace_clear.  owner identifies the
+ * thread using the ring, and is NULL while the ring is free for reuse. */
+struct trace_ring {
+	long tid;
+	const char *thread_name;
+	volatile long head;
+	volatile long tail;
+	void *owner;
+	struct trace_event events[TRACE_RING_SIZE];
+};
+
+static volatile bool enabled = false;
+static volatile long generation = 0;
+static pthread_mutex_t rings_mutex = PTHREAD_MUTEX_INITIALIZER;
+static DARRAY(struct trace_ring *) rings;
+static long next_tid = 1;
+
+static pthread_once_t ring_key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t ring_key;
+static bool ring_key_valid = false;
+
+static THREAD_LOCAL struct trace_ring *thread_ring = NULL;
+static THREAD_LOCAL long thread_generation = -1;
+static THREAD_LOCAL const char *thread_name = NULL;
+
+void trace_start(void)
+{
+	os_atomic_set_bool(&enabled, true);
+}
+
+void trace_stop(void)
+{
+	os_atomic_set_bool(&enabled, false);
+}
+
+bool trace_enabled(void)
+{
+	return os_atomic_load_bool(&enabled);
+}
+
+/* called when a thread with a ring exits.  the ring may have been freed by
+ * trace_free since, so it is only touched if it is still registered and
+ * owned by this thread. */
+static void release_thread_ring(void *param)
+{
+	struct trace_ring *ring = param;
+
+	pthread_mutex_lock(&rings_mutex);
+	for (size_t i = 0; i < rings.num; i++) {
+		if (rings.array[i] == ring && ring->owner == &thread_ring) {
+			ring->owner = NULL;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&rings_mutex);
+}
+
+static void init_ring_key(void)
+{
+	ring_key_valid = pthread_key_create(&ring_key, release_thread_ring) ==
+			 0;
+}
+
+static struct trace_ring *find_free_ring(void)
+{
+	for (size_t i = 0; i < rings.num; i++) {
+		struct trace_ring *ring = rings.array[i];
+		if (!ring->owner)
+			return ring;
+	}
+
+	if (rings.num < TRACE_MAX_THREADS) {
+		struct trace_ring *ring = bzalloc(sizeof(struct trace_ring));
+		da_push_back(rings, &ring);
+		return ring;
+	}
+
+	return NULL;
+}
+
+/* rings are registered once per thread, and again after trace_free.  the
+ * ring of a thread that has exited is reused, starting from its head. */
+static struct trace_ring *get_thread_ring(void)
+{
+	long gen = os_atomic_load_long(&generation);
+	struct trace_ring *ring;
+
+	if (thread_generation == gen)
+		return thread_ring;
+
+	thread_ring = NULL;
+	thread_generation = gen;
+
+	pthread_once(&ring_key_once, init_ring_key);
+
+	pthread_mutex_lock(&rings_mutex);
+	ring = find_free_ring();
+	if (ring) {
+		ring->tid = next_tid++;
+		ring->thread_name = thread_name;
+		ring->owner = &thread_ring;
+		os_atomic_store_long(&ring->tail,
+				     os_atomic_load_long(&ring->head));
+		thread_ring = ring;
+	}
+	pthread_mutex_unlock(&rings_mutex);
+
+	if (ring && ring_key_valid)
+		pthread_setspecific(ring_key, ring);
+
+	return thread_ring;
+}
+
+static void push_event(const char *name, uint64_t frame_id, uint64_t start,
+		       uint64_t end, bool instant)
+{
+	struct trace_ring *ring = get_thread_ring();
+	struct trace_event *event;
+	unsigned long head;
+
+	if (!ring)
+		return;
+
+	head = (unsigned long)ring->head;
+	event = &ring->events[head & (TRACE_RING_SIZE - 1)];
+	event->name = name;
+	event->frame_id = frame_id;
+	event->start = start;
+	event->end = end;
+	event->instant = instant;
+
+	os_atomic_store_long(&ring->head, (long)(head + 1));
+}
+
+void trace_set_thread_name(const char *name)
+{
+	thread_name = name;
+
+	/* don't register a ring just for the name */
+	if (thread_ring &&
+	    thread_generation == os_atomic_load_long(&generation))
+		thread_ring->thread_name = name;
+}
+
+uint64_t trace_begin(void)
+{
+	return os_atomic_load_bool(&enabled) ? os_gettime_ns() : 0;
+}
+
+void trace_end(const char *name, uint64_t frame_id, uint64_t start_ns)
+{
+	if (start_ns)
+		push_event(name, frame_id, start_ns, os_gettime_ns(), false);
+}
+
+void trace_event(const char *name, uint64_t frame_id, uint64_t start_ns,
+		 uint64_t end_ns)
+{
+	if (start_ns)
+		push_event(name, frame_id, start_ns, end_ns, false);
+}
+
+void trace_instant(const char *name, uint64_t frame_id)
+{
+	if (os_atomic_load_bool(&enabled)) {
+		uint64_t ts = os_gettime_ns();
+		push_event(name, frame_id, ts, ts, true);
+	}
+}
+
+/* ------------------------------------------------------------------------- */
+/* Chrome trace output */
+
+/* copies the events that are still intact, oldest first.  the owning thread
+ * keeps writing meanwhile, so anything it may have overwritten during the
+ * copy is dropped afterwards. */
+static size_t copy_ring_events(struct trace_ring *ring,
+			       struct trace_event *events)
+{
+	unsigned long head = (unsigned long)os_atomic_load_long(&ring->head);
+	unsigned long tail = (unsigned long)os_atomic_load_long(&ring->tail);
+	unsigned long count = head - tail < TRACE_RING_SIZE ? head - tail
+							    : TRACE_RING_SIZE;
+	unsigned long first = head - count;
+	long cur = (long)head;
+	unsigned long new_head;
+	unsigned long skip = 0;
+
+	for (unsigned long i = 0; i < count; i++)
+		events[i] = ring->events[(first + i) & (TRACE_RING_SIZE - 1)];
+
+	/* a no-op compare exchange acts as a full barrier, so the copy above
+	 * is done before the head is read again */
+	os_atomic_compare_exchange_long(&ring->head, &cur, cur);
+	new_head = (unsigned long)cur;
+
+	while (skip < count && new_head - (first + skip) >= TRACE_RING_SIZE)
+		skip++;
+
+	memmove(events, events + skip,
+		(count - skip) * sizeof(struct trace_event));
+	return count - skip;
+}
+
+static void json_escape(struct dstr *buffer, const char *str)
+{
+	for (; str && *str; str++) {
+		char ch = *str;
+
+		if (ch == '"' || ch == '\\')
+			dstr_catf(buffer, "\\%c", ch);
+		else if ((unsigned char)ch < 0x20)
+			dstr_catf(buffer, "\\u%04x", (unsigned char)ch);
+		else
+			dstr_cat_ch(buffer, ch);
+	}
+}
+
+static inline void dump_ts(struct dstr *buffer, const char *key, uint64_t ns)
+{
+	dstr_catf(buffer, ",\"%s\":%" PRIu64 ".%03u", key, ns / 1000,
+		  (unsigned)(ns % 1000));
+}
+
+static void dump_ring(FILE *f, struct dstr *buffer, struct trace_ring *ring,
+		      struct trace_event *events, bool *first)
+{
+	size_t count = copy_ring_events(ring, events);
+
+	dstr_printf(buffer,
+		    "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+		    "\"tid\":%ld,\"args\":{\"name\":\"",
+		    *first ? "" : ",", ring->tid);
+	if (ring->thread_name)
+		json_escape(buffer, ring->thread_name);
+	else
+		dstr_catf(buffer, "thread %ld", ring->tid);
+	dstr_cat(buffer, "\"}}");
+	fwrite(buffer->array, 1, buffer->len, f);
+	*first = false;
+
+	for (size_t i = 0; i < count; i++) {
+		struct trace_event *event = &events[i];
+
+		dstr_copy(buffer, ",\n{\"name\":\"");
+		json_escape(buffer, event->name);
+		dstr_catf(buffer, "\",\"ph\":\"%s\",\"pid\":1,\"tid\":%ld",
+			  event->instant ? "i" : "X", ring->tid);
+		dump_ts(buffer, "ts", event->start);
+		if (event->instant)
+			dstr_cat(buffer, ",\"s\":\"t\"");
+		else
+			dump_ts(buffer, "dur", event->end - event->start);
+		dstr_catf(buffer, ",\"args\":{\"frame\":%" PRIu64 "}}",
+			  event->frame_id);
+		fwrite(buffer->array, 1, buffer->len, f);
+	}
+}
+
+bool trace_dump_chrome_json(const char *filename)
+{
+	struct trace_event *events;
+	struct dstr buffer = {0};
+	bool first = true;
+	FILE *f;
+
+	f = os_fopen(filename, "wb");
+	if (!f)
+		return false;
+
+	events = bmalloc(sizeof(struct trace_event) * TRACE_RING_SIZE);
+
+	fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[", f);
+
+	pthread_mutex_lock(&rings_mutex);
+	for (size_t i = 0; i < rings.num; i++)
+		dump_ring(f, &buffer, rings.array[i], events, &first);
+	pthread_mutex_unlock(&rings_mutex);
+
+	fputs("\n]}\n", f);
+
+	dstr_free(&buffer);
+	bfree(events);
+	fclose(f);
+	return true;
+}
+
+/* the rings stay allocated, as their owners may be writing to them.  events
+ * written during the clear may or may not be dropped. */
+void trace_clear(void)
+{
+	pthread_mutex_lock(&rings_mutex);
+	for (size_t i = 0; i < rings.num; i++) {
+		struct trace_ring *ring = rings.array[i];
+		os_atomic_store_long(&ring->tail,
+				     os_atomic_load_long(&ring->head));
+	}
+	pthread_mutex_unlock(&rings_mutex);
+}
+
+void trace_free(void)
+{
+	pthread_mutex_lock(&rings_mutex);
+	os_atomic_inc_long(&generation);
+
+	for (size_t i = 0; i < rings.num; i++)
+		bfree(rings.array[i]);
+	da_free(rings);
+	pthread_mutex_unlock(&rings_mutex);
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include "c99defs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Per-frame event tracing
+ *
+ * The profiler only keeps aggregate times per name.  The tracer instead
+ * records every single event along with the id of the frame it belongs to,
+ * so a specific lagged or dropped frame can be followed through the
+ * pipeline afterwards.  libobs uses the frame's video timestamp as its id.
+ *
+ * Each thread writes to its own fixed-size ring without taking any locks.
+ * Once a ring is full, its oldest events are overwritten.  The rings can be
+ * dumped as Chrome trace JSON (chrome://tracing, Perfetto) at any time.
+ *
+ * Only the name pointers are stored, so names must stay valid until the
+ * tracer is freed (string literals or profiler name store strings).
+ */
+
+/* ------------------------------------------------------------------------- */
+/* Tracer control */
+
+EXPORT void trace_start(void);
+EXPORT void trace_stop(void);
+EXPORT bool trace_enabled(void);
+
+/* writes the events of all threads, oldest first per thread */
+EXPORT bool trace_dump_chrome_json(const char *filename);
+
+/* drops all recorded events, can be called while tracing */
+EXPORT void trace_clear(void);
+
+/* frees all events, called by obs_shutdown.  no other thread may be inside
+ * one of the tracing functions below, or call them afterwards. */
+EXPORT void trace_free(void);
+
+/* ------------------------------------------------------------------------- */
+/* Tracing */
+
+/* names the calling thread in the dump */
+EXPORT void trace_set_thread_name(const char *name);
+
+/* returns the start time to pass to trace_end, or 0 if tracing is off */
+EXPORT uint64_t trace_begin(void);
+EXPORT void trace_end(const char *name, uint64_t frame_id, uint64_t start_ns);
+
+/* records an event that has already been timed, start_ns 0 is ignored */
+EXPORT void trace_event(const char *name, uint64_t frame_id, uint64_t start_ns,
+			uint64_t end_ns);
+
+/* records a point in time, such as a dropped frame */
+EXPORT void trace_instant(const char *name, uint64_t frame_id);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,150 @@
+#include "worker-pool.h"
+#include "threading.h"
+#include "platform.h"
+#include "profiler.h"
+#include "bmem.h"
+
+struct worker_pool {
+	char *thread_name;
+	const char *profile_name;
+
+	pthread_t *threads;
+	size_t num_threads;
+	os_sem_t *start_sem;
+	os_sem_t *done_sem;
+	volatile bool stop;
+
+	/* current batch, only changed while the helpers are idle */
+	worker_pool_task_t task;
+	void *param;
+	size_t count;
+	volatile long next_task;
+};
+
+static void run_tasks(struct worker_pool *pool)
+{
+	for (;;) {
+		long idx = os_atomic_inc_long(&pool->next_task) - 1;
+		if ((size_t)idx >= pool->count)
+			break;
+
+		pool->task(pool->param, (size_t)idx);
+	}
+}
+
+static void *worker_thread(void *param)
+{
+	struct worker_pool *pool = param;
+
+	os_set_thread_name(pool->thread_name);
+
+	while (os_sem_wait(pool->start_sem) == 0) {
+		if (os_atomic_load_bool(&pool->stop))
+			break;
+
+		if (pool->profile_name) {
+			profile_start(pool->profile_name);
+			run_tasks(pool);
+			profile_end(pool->profile_name);
+			profile_reenable_thread();
+		} else {
+			run_tasks(pool);
+		}
+
+		os_sem_post(pool->done_sem);
+	}
+
+	return NULL;
+}
+
+worker_pool_t *worker_pool_create(const char *thread_name,
+				  const char *profile_name,
+				  size_t max_threads)
+{
+	struct worker_pool *pool = bzalloc(sizeof(struct worker_pool));
+	int cores = os_get_logical_cores();
+	size_t num_threads;
+
+	pool->thread_name = bstrdup(thread_name);
+	pool->profile_name = profile_name;
+
+	/* the calling thread works as well */
+	num_threads = cores > 2 ? (size_t)(cores - 2) : 0;
+	if (num_threads > max_threads)
+		num_threads = max_threads;
+
+	if (!num_threads)
+		return pool;
+
+	if (os_sem_init(&pool->start_sem, 0) != 0)
+		goto fail;
+	if (os_sem_init(&pool->done_sem, 0) != 0)
+		goto fail;
+
+	pool->threads = bzalloc(sizeof(pthread_t) * num_threads);
+
+	for (size_t i = 0; i < num_threads; i++) {
+		if (pthread_create(&pool->threads[i], NULL, worker_thread,
+				   pool) != 0)
+			break;
+		pool->num_threads++;
+	}
+
+	return pool;
+
+fail:
+	worker_pool_destroy(pool);
+	return NULL;
+}
+
+void worker_pool_destroy(worker_pool_t *pool)
+{
+	if (!pool)
+		return;
+
+	os_atomic_set_bool(&pool->stop, true);
+	for (size_t i = 0; i < pool->num_threads; i++)
+		os_sem_post(pool->start_sem);
+	for (size_t i = 0; i < pool->num_threads; i++)
+		pthread_join(pool->threads[i], NULL);
+
+	os_sem_destroy(pool->start_sem);
+	os_sem_destroy(pool->done_sem);
+	bfree(pool->threads);
+	bfree(pool->thread_name);
+	bfree(pool);
+}
+
+size_t worker_pool_num_threads(const worker_pool_t *pool)
+{
+	return pool ? pool->num_threads : 0;
+}
+
+void worker_pool_run(worker_pool_t *pool, size_t count,
+		     worker_pool_task_t task, void *param)
+{
+	size_t helpers;
+
+	if (!pool || !pool->num_threads || count < 2) {
+		for (size_t i = 0; i < count; i++)
+			task(param, i);
+		return;
+	}
+
+	pool->task = task;
+	pool->param = param;
+	pool->count = count;
+	os_atomic_set_long(&pool->next_task, 0);
+
+	helpers = count - 1;
+	if (helpers > pool->num_threads)
+		helpers = pool->num_threads;
+
+	for (size_t i = 0; i < helpers; i++)
+		os_sem_post(pool->start_sem);
+
+	run_tasks(pool);
+
+	for (size_t i = 0; i < helpers; i++)
+		os_sem_wait(pool->done_sem);
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "c99defs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Worker pool
+ *
+ * A small set of helper threads for splitting one batch of independent
+ * tasks across cores.  The calling thread works on the batch as well, and
+ * worker_pool_run only returns once every task has finished.  Tasks are
+ * handed out through a shared atomic index, so whichever thread is free
+ * takes the next one.
+ *
+ * The pool has the logical core count minus two threads, capped at
+ * max_threads.  With no threads (two cores or fewer) every task simply runs
+ * on the calling thread.  Only one thread may run a batch at a time.
+ */
+
+struct worker_pool;
+typedef struct worker_pool worker_pool_t;
+
+/* called once for every idx in [0, count) */
+typedef void (*worker_pool_task_t)(void *param, size_t idx);
+
+/* profile_name, if not NULL, is used as the profiler root of each batch on
+ * the helper threads, and must stay valid for the lifetime of the pool */
+EXPORT worker_pool_t *worker_pool_create(const char *thread_name,
+					 const char *profile_name,
+					 size_t max_threads);
+EXPORT void worker_pool_destroy(worker_pool_t *pool);
+
+/* number of helper threads, not counting the calling thread */
+EXPORT size_t worker_pool_num_threads(const worker_pool_t *pool);
+
+EXPORT void worker_pool_run(worker_pool_t *pool, size_t count,
+			    worker_pool_task_t task, void *param);
+
+#ifdef __cplusplus
+}
+#endif
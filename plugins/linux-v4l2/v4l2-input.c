@@ -62,6 +62,38 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #define blog(level, msg, ...) blog(level, "v4l2-input: " msg, ##__VA_ARGS__)
 
+/* how long to wait for libobs to give lent buffers back */
+#define V4L2_RECLAIM_TIMEOUT_MS 2000
+
+struct v4l2_data;
+struct v4l2_lent_pool;
+
+/**
+ * A mapped buffer lent to libobs, requeued once libobs releases it
+ */
+struct v4l2_lent_buffer {
+	struct v4l2_lent_pool *pool;
+	uint32_t index;
+};
+
+/**
+ * The buffers of a capture that can be lent to libobs
+ *
+ * If libobs doesn't give all buffers back in time when the capture stops,
+ * the pool is orphaned: it takes over the mapping, stops requeueing the
+ * buffers, and unmaps and frees itself once the last one comes back.
+ */
+struct v4l2_lent_pool {
+	pthread_mutex_t mutex;
+	int_fast32_t dev;
+	long lent_count;
+	bool copy_only;
+	bool orphaned;
+	struct v4l2_buffer_data buffers;
+	uint_fast32_t count;
+	struct v4l2_lent_buffer *lent;
+};
+
 /**
  * Data structure for the v4l2 source
  */
@@ -149,6 +181,146 @@ static void v4l2_prep_obs_frame(struct v4l2_data *data,
 	}
 }
 
+static struct v4l2_lent_pool *v4l2_lent_pool_create(struct v4l2_data *data)
+{
+	struct v4l2_lent_pool *pool = bzalloc(sizeof(struct v4l2_lent_pool));
+
+	pthread_mutex_init_value(&pool->mutex);
+	if (pthread_mutex_init(&pool->mutex, NULL) != 0) {
+		bfree(pool);
+		return NULL;
+	}
+
+	pool->dev = data->dev;
+	pool->count = data->buffers.count;
+	pool->lent = bzalloc(sizeof(struct v4l2_lent_buffer) * pool->count);
+	for (uint_fast32_t i = 0; i < pool->count; ++i) {
+		pool->lent[i].pool = pool;
+		pool->lent[i].index = i;
+	}
+
+	return pool;
+}
+
+static void v4l2_lent_pool_free(struct v4l2_lent_pool *pool)
+{
+	v4l2_destroy_mmap(&pool->buffers);
+	pthread_mutex_destroy(&pool->mutex);
+	bfree(pool->lent);
+	bfree(pool);
+}
+
+static void v4l2_requeue_buffer(int_fast32_t dev, uint32_t index)
+{
+	struct v4l2_buffer buf;
+
+	memset(&buf, 0, sizeof(buf));
+	buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	buf.memory = V4L2_MEMORY_MMAP;
+	buf.index = index;
+
+	if (v4l2_ioctl(dev, VIDIOC_QBUF, &buf) < 0)
+		blog(LOG_ERROR, "failed to enqueue buffer");
+}
+
+/*
+ * Called by libobs once it is done with a lent buffer
+ */
+static void v4l2_release_buffer(void *param)
+{
+	struct v4l2_lent_buffer *lent = param;
+	struct v4l2_lent_pool *pool = lent->pool;
+	bool free_pool;
+
+	pthread_mutex_lock(&pool->mutex);
+	if (!pool->orphaned)
+		v4l2_requeue_buffer(pool->dev, lent->index);
+	free_pool = --pool->lent_count == 0 && pool->orphaned;
+	pthread_mutex_unlock(&pool->mutex);
+
+	if (free_pool)
+		v4l2_lent_pool_free(pool);
+}
+
+/*
+ * Try to lend a buffer to libobs
+ *
+ * The driver is always left with at least one buffer to fill, so a stalled
+ * graphics thread can't stall the capture.  Frames are copied instead while
+ * that many buffers are out.
+ */
+static bool v4l2_lend_buffer(struct v4l2_lent_pool *pool)
+{
+	bool lend;
+
+	pthread_mutex_lock(&pool->mutex);
+	lend = !pool->copy_only && pool->lent_count + 1 < (long)pool->count;
+	if (lend)
+		pool->lent_count++;
+	pthread_mutex_unlock(&pool->mutex);
+
+	return lend;
+}
+
+static long v4l2_lent_count(struct v4l2_lent_pool *pool)
+{
+	long count;
+
+	pthread_mutex_lock(&pool->mutex);
+	count = pool->lent_count;
+	pthread_mutex_unlock(&pool->mutex);
+
+	return count;
+}
+
+/*
+ * Get all lent buffers back from libobs
+ *
+ * This has to happen before the capture is stopped or reset, and before the
+ * buffers are unmapped.  Queued frames are released right away, only a frame
+ * that is being uploaded at the moment needs to be waited for.  If that takes
+ * too long, the pool falls back to copying frames and false is returned.
+ */
+static bool v4l2_reclaim_buffers(struct v4l2_data *data,
+				 struct v4l2_lent_pool *pool)
+{
+	obs_source_output_video(data->source, NULL);
+
+	for (int i = 0; i < V4L2_RECLAIM_TIMEOUT_MS; i++) {
+		if (v4l2_lent_count(pool) == 0)
+			return true;
+		os_sleep_ms(1);
+	}
+
+	pthread_mutex_lock(&pool->mutex);
+	pool->copy_only = true;
+	pthread_mutex_unlock(&pool->mutex);
+
+	blog(LOG_WARNING, "%s: libobs did not release its buffers in time",
+	     data->device_id);
+	return v4l2_lent_count(pool) == 0;
+}
+
+/*
+ * Hand the mapping over to the pool while libobs still holds some of the
+ * buffers, so it stays alive until the last one is released
+ */
+static void v4l2_lent_pool_orphan(struct v4l2_data *data,
+				  struct v4l2_lent_pool *pool)
+{
+	bool free_pool;
+
+	pthread_mutex_lock(&pool->mutex);
+	pool->orphaned = true;
+	pool->buffers = data->buffers;
+	memset(&data->buffers, 0, sizeof(data->buffers));
+	free_pool = pool->lent_count == 0;
+	pthread_mutex_unlock(&pool->mutex);
+
+	if (free_pool)
+		v4l2_lent_pool_free(pool);
+}
+
 /*
  * Worker thread to get video data
  */
@@ -163,6 +335,7 @@ static void *v4l2_thread(void *vptr)
 	struct timeval tv;
 	struct v4l2_buffer buf;
 	struct obs_source_frame out;
+	struct v4l2_lent_pool *pool;
 	size_t plane_offsets[MAX_AV_PLANES];
 	int fps_num, fps_denom;
 	float ffps;
@@ -180,6 +353,10 @@ static void *v4l2_thread(void *vptr)
 	blog(LOG_INFO, "%s: select timeout set to %ldus (%dx frame periods)",
 	     data->device_id, timeout_usec, data->timeout_frames);
 
+	pool = v4l2_lent_pool_create(data);
+	if (!pool)
+		return NULL;
+
 	if (v4l2_start_capture(data->dev, &data->buffers) < 0)
 		goto exit;
 
@@ -218,7 +395,13 @@ static void *v4l2_thread(void *vptr)
 				     data->device_id);
 			}
 
-			if (data->auto_reset) {
+			/* a reset requeues every buffer, so it has to wait
+			 * until libobs has given all of them back */
+			if (data->auto_reset &&
+			    !v4l2_reclaim_buffers(data, pool)) {
+				blog(LOG_ERROR, "%s: skipping reset",
+				     data->device_id);
+			} else if (data->auto_reset) {
 				if (v4l2_reset_capture(data->dev,
 						       &data->buffers) == 0)
 					blog(LOG_INFO,
@@ -227,6 +410,11 @@ static void *v4l2_thread(void *vptr)
 				else
 					blog(LOG_ERROR, "%s: failed to reset",
 					     data->device_id);
+
+				v4l2_lent_pool_free(pool);
+				pool = v4l2_lent_pool_create(data);
+				if (!pool)
+					break;
 			}
 
 			continue;
@@ -259,12 +447,17 @@ static void *v4l2_thread(void *vptr)
 		start = (uint8_t *)data->buffers.info[buf.index].start;
 		for (uint_fast32_t i = 0; i < MAX_AV_PLANES; ++i)
 			out.data[i] = start + plane_offsets[i];
-		obs_source_output_video(data->source, &out);
 
-		if (v4l2_ioctl(data->dev, VIDIOC_QBUF, &buf) < 0) {
-			blog(LOG_ERROR, "%s: failed to enqueue buffer",
-			     data->device_id);
-			break;
+		/* the buffer is requeued once libobs is done with it.  there
+		 * are only a few mmap buffers (usually 4), so once all but one
+		 * are out, frames are copied and requeued right away. */
+		if (v4l2_lend_buffer(pool)) {
+			obs_source_output_video_borrowed(
+				data->source, &out, v4l2_release_buffer,
+				&pool->lent[buf.index]);
+		} else {
+			obs_source_output_video(data->source, &out);
+			v4l2_requeue_buffer(data->dev, buf.index);
 		}
 
 		frames++;
@@ -274,6 +467,12 @@ static void *v4l2_thread(void *vptr)
 	     data->device_id, frames);
 
 exit:
+	if (pool) {
+		if (v4l2_reclaim_buffers(data, pool))
+			v4l2_lent_pool_free(pool);
+		else
+			v4l2_lent_pool_orphan(data, pool);
+	}
 	v4l2_stop_capture(data->dev);
 	return NULL;
 }
@@ -1147,7 +1346,8 @@ static void *v4l2_create(obs_data_t *settings, obs_source_t *source)
 struct obs_source_info v4l2_input = {
 	.id = "v4l2_input",
 	.type = OBS_SOURCE_TYPE_INPUT,
-	.output_flags = OBS_SOURCE_ASYNC_VIDEO | OBS_SOURCE_DO_NOT_DUPLICATE,
+	.output_flags = OBS_SOURCE_ASYNC_VIDEO | OBS_SOURCE_DO_NOT_DUPLICATE |
+			OBS_SOURCE_PARALLEL_TICK,
 	.get_name = v4l2_getname,
 	.create = v4l2_create,
 	.destroy = v4l2_destroy,
@@ -0,0 +1,531 @@
+/*
+ * Copyright (c) 2015 Hugh Bailey <obs.jim@gmail.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include "ffmpeg-mux-core.h"
+
+#include <util/base.h>
+
+#if LIBAVCODEC_VERSION_MAJOR >= 58
+#define CODEC_FLAG_GLOBAL_H AV_CODEC_FLAG_GLOBAL_HEADER
+#else
+#define CODEC_FLAG_GLOBAL_H CODEC_FLAG_GLOBAL_HEADER
+#endif
+
+/* ------------------------------------------------------------------------- */
+
+static void set_error(struct ffmpeg_mux *ffm, const char *format, ...)
+{
+	va_list args;
+
+	va_start(args, format);
+	vsnprintf(ffm->error, sizeof(ffm->error), format, args);
+	va_end(args);
+
+	blog(LOG_ERROR, "%s", ffm->error);
+}
+
+static void header_free(struct header *header)
+{
+	free(header->data);
+}
+
+/* returns the result of closing the file, which is where protocols such as
+ * HTTP report whether the upload went through */
+static int free_avformat(struct ffmpeg_mux *ffm)
+{
+	int ret = 0;
+
+	if (ffm->output) {
+#if LIBAVCODEC_VERSION_INT >= AV_VERSION_INT(57, 48, 101)
+		avcodec_free_context(&ffm->video_ctx);
+#endif
+
+		if ((ffm->output->oformat->flags & AVFMT_NOFILE) == 0 &&
+		    ffm->output->pb) {
+			int close_ret;
+
+			avio_flush(ffm->output->pb);
+			ret = ffm->output->pb->error;
+			close_ret = avio_closep(&ffm->output->pb);
+			if (ret >= 0)
+				ret = close_ret;
+		}
+
+		avformat_free_context(ffm->output);
+		ffm->output = NULL;
+	}
+
+	if (ffm->audio_infos) {
+#if LIBAVCODEC_VERSION_INT >= AV_VERSION_INT(57, 48, 101)
+		for (int i = 0; i < ffm->num_audio_streams; ++i)
+			avcodec_free_context(&ffm->audio_infos[i].ctx);
+#endif
+		free(ffm->audio_infos);
+	}
+
+	ffm->video_stream = NULL;
+	ffm->audio_infos = NULL;
+	ffm->num_audio_streams = 0;
+	return ret;
+}
+
+int ffmpeg_mux_free(struct ffmpeg_mux *ffm)
+{
+	int ret = 0;
+	int close_ret;
+
+	if (ffm->initialized) {
+		ret = av_write_trailer(ffm->output);
+	}
+
+	close_ret = free_avformat(ffm);
+	if (ret >= 0)
+		ret = close_ret;
+
+	header_free(&ffm->video_header);
+
+	if (ffm->audio_header) {
+		for (int i = 0; i < ffm->params.tracks; i++) {
+			header_free(&ffm->audio_header[i]);
+		}
+
+		free(ffm->audio_header);
+	}
+
+	if (ffm->audio) {
+		free(ffm->audio);
+	}
+
+	dstr_free(&ffm->params.printable_file);
+
+	memset(ffm, 0, sizeof(*ffm));
+	return ret;
+}
+
+static bool new_stream(struct ffmpeg_mux *ffm, AVStream **stream,
+		       const char *name, AVCodec **codec)
+{
+	const AVCodecDescriptor *desc = avcodec_descriptor_get_by_name(name);
+
+	if (!desc) {
+		set_error(ffm, "Couldn't find encoder '%s'", name);
+		return false;
+	}
+
+	*codec = avcodec_find_encoder(desc->id);
+	if (!*codec) {
+		set_error(ffm, "Couldn't create encoder");
+		return false;
+	}
+
+	*stream = avformat_new_stream(ffm->output, *codec);
+	if (!*stream) {
+		set_error(ffm, "Couldn't create stream for encoder '%s'",
+			  name);
+		return false;
+	}
+
+	(*stream)->id = ffm->output->nb_streams - 1;
+	return true;
+}
+
+static void create_video_stream(struct ffmpeg_mux *ffm)
+{
+	AVCodec *codec;
+	AVCodecContext *context;
+	void *extradata = NULL;
+
+	if (!new_stream(ffm, &ffm->video_stream, ffm->params.vcodec, &codec))
+		return;
+
+	if (ffm->video_header.size) {
+		extradata = av_memdup(ffm->video_header.data,
+				      ffm->video_header.size);
+	}
+
+#if LIBAVCODEC_VERSION_INT >= AV_VERSION_INT(57, 48, 101)
+	context = avcodec_alloc_context3(codec);
+#else
+	context = ffm->video_stream->codec;
+#endif
+	context->bit_rate = (int64_t)ffm->params.vbitrate * 1000;
+	context->width = ffm->params.width;
+	context->height = ffm->params.height;
+	context->coded_width = ffm->params.width;
+	context->coded_height = ffm->params.height;
+	context->color_primaries = ffm->params.color_primaries;
+	context->color_trc = ffm->params.color_trc;
+	context->colorspace = ffm->params.colorspace;
+	context->color_range = ffm->params.color_range;
+	context->extradata = extradata;
+	context->extradata_size = ffm->video_header.size;
+	context->time_base =
+		(AVRational){ffm->params.fps_den, ffm->params.fps_num};
+
+	ffm->video_stream->time_base = context->time_base;
+#if LIBAVFORMAT_VERSION_MAJOR < 59
+	// codec->time_base may still be used if LIBAVFORMAT_VERSION_MAJOR < 59
+	ffm->video_stream->codec->time_base = context->time_base;
+#endif
+	ffm->video_stream->avg_frame_rate = av_inv_q(context->time_base);
+
+	if (ffm->output->oformat->flags & AVFMT_GLOBALHEADER)
+		context->flags |= CODEC_FLAG_GLOBAL_H;
+
+#if LIBAVCODEC_VERSION_INT >= AV_VERSION_INT(57, 48, 101)
+	avcodec_parameters_from_context(ffm->video_stream->codecpar, context);
+#endif
+
+	ffm->video_ctx = context;
+}
+
+static void create_audio_stream(struct ffmpeg_mux *ffm, int idx)
+{
+	AVCodec *codec;
+	AVCodecContext *context;
+	AVStream *stream;
+	void *extradata = NULL;
+
+	if (!new_stream(ffm, &stream, ffm->params.acodec, &codec))
+		return;
+
+	av_dict_set(&stream->metadata, "title", ffm->audio[idx].name, 0);
+
+	stream->time_base = (AVRational){1, ffm->audio[idx].sample_rate};
+
+	if (ffm->audio_header[idx].size) {
+		extradata = av_memdup(ffm->audio_header[idx].data,
+				      ffm->audio_header[idx].size);
+	}
+
+#if LIBAVCODEC_VERSION_INT >= AV_VERSION_INT(57, 48, 101)
+	context = avcodec_alloc_context3(codec);
+#else
+	context = stream->codec;
+#endif
+	context->bit_rate = (int64_t)ffm->audio[idx].abitrate * 1000;
+	context->channels = ffm->audio[idx].channels;
+	context->sample_rate = ffm->audio[idx].sample_rate;
+	context->sample_fmt = AV_SAMPLE_FMT_S16;
+	context->time_base = stream->time_base;
+	context->extradata = extradata;
+	context->extradata_size = ffm->audio_header[idx].size;
+	context->channel_layout =
+		av_get_default_channel_layout(context->channels);
+	//AVlib default channel layout for 4 channels is 4.0 ; fix for quad
+	if (context->channels == 4)
+		context->channel_layout = av_get_channel_layout("quad");
+	//AVlib default channel layout for 5 channels is 5.0 ; fix for 4.1
+	if (context->channels == 5)
+		context->channel_layout = av_get_channel_layout("4.1");
+	if (ffm->output->oformat->flags & AVFMT_GLOBALHEADER)
+		context->flags |= CODEC_FLAG_GLOBAL_H;
+
+#if LIBAVCODEC_VERSION_INT >= AV_VERSION_INT(57, 48, 101)
+	avcodec_parameters_from_context(stream->codecpar, context);
+#endif
+
+	ffm->audio_infos[ffm->num_audio_streams].stream = stream;
+	ffm->audio_infos[ffm->num_audio_streams].ctx = context;
+	ffm->num_audio_streams++;
+}
+
+static bool init_streams(struct ffmpeg_mux *ffm)
+{
+	if (ffm->params.has_video)
+		create_video_stream(ffm);
+
+	if (ffm->params.tracks) {
+		ffm->audio_infos =
+			calloc(ffm->params.tracks, sizeof(*ffm->audio_infos));
+
+		for (int i = 0; i < ffm->params.tracks; i++)
+			create_audio_stream(ffm, i);
+	}
+
+	if (!ffm->video_stream && !ffm->num_audio_streams)
+		return false;
+
+	return true;
+}
+
+static void set_header(struct header *header, const uint8_t *data,
+		       size_t size)
+{
+	header->size = (int)size;
+	header->data = malloc(size);
+	memcpy(header->data, data, size);
+}
+
+void ffmpeg_mux_header(struct ffmpeg_mux *ffm, const uint8_t *data,
+		       const struct ffm_packet_info *info)
+{
+	if (info->type == FFM_PACKET_VIDEO) {
+		set_header(&ffm->video_header, data, (size_t)info->size);
+	} else if ((int)info->index < ffm->params.tracks) {
+		set_header(&ffm->audio_header[info->index], data,
+			   (size_t)info->size);
+	}
+}
+
+#ifdef _MSC_VER
+#pragma warning(disable : 4996)
+#endif
+
+static inline int open_output_file(struct ffmpeg_mux *ffm)
+{
+	AVOutputFormat *format = ffm->output->oformat;
+	int ret;
+
+	if ((format->flags & AVFMT_NOFILE) == 0) {
+		AVDictionary *opts = NULL;
+
+		if (ffm->params.protocol_settings)
+			av_dict_parse_string(&opts,
+					     ffm->params.protocol_settings,
+					     "=", " ", 0);
+
+		ret = avio_open2(&ffm->output->pb, ffm->params.file,
+				 AVIO_FLAG_WRITE, NULL, &opts);
+		av_dict_free(&opts);
+
+		if (ret < 0) {
+			set_error(ffm, "Couldn't open '%s', %s",
+				  ffm->params.printable_file.array,
+				  av_err2str(ret));
+			return FFM_ERROR;
+		}
+	}
+
+	AVDictionary *dict = NULL;
+	if ((ret = av_dict_parse_string(&dict, ffm->params.muxer_settings, "=",
+					" ", 0))) {
+		blog(LOG_WARNING, "Failed to parse muxer settings: %s\n%s",
+		     av_err2str(ret), ffm->params.muxer_settings);
+
+		av_dict_free(&dict);
+	}
+
+	if (av_dict_count(dict) > 0) {
+		struct dstr str = {0};
+
+		AVDictionaryEntry *entry = NULL;
+		while ((entry = av_dict_get(dict, "", entry,
+					    AV_DICT_IGNORE_SUFFIX)))
+			dstr_catf(&str, "\n\t%s=%s", entry->key, entry->value);
+
+		blog(LOG_DEBUG, "Using muxer settings:%s", str.array);
+		dstr_free(&str);
+	}
+
+	ret = avformat_write_header(ffm->output, &dict);
+	if (ret < 0) {
+		set_error(ffm, "Error opening '%s': %s",
+			  ffm->params.printable_file.array, av_err2str(ret));
+
+		av_dict_free(&dict);
+
+		return ret == -22 ? FFM_UNSUPPORTED : FFM_ERROR;
+	}
+
+	av_dict_free(&dict);
+
+	return FFM_SUCCESS;
+}
+
+#define SRT_PROTO "srt"
+#define UDP_PROTO "udp"
+#define TCP_PROTO "tcp"
+#define HTTP_PROTO "http"
+
+static bool ffmpeg_mux_is_network(struct ffmpeg_mux *ffm)
+{
+	return !strncmp(ffm->params.file, SRT_PROTO, sizeof(SRT_PROTO) - 1) ||
+	       !strncmp(ffm->params.file, UDP_PROTO, sizeof(UDP_PROTO) - 1) ||
+	       !strncmp(ffm->params.file, TCP_PROTO, sizeof(TCP_PROTO) - 1) ||
+	       !strncmp(ffm->params.file, HTTP_PROTO, sizeof(HTTP_PROTO) - 1);
+}
+
+static int ffmpeg_mux_init_context(struct ffmpeg_mux *ffm)
+{
+	AVOutputFormat *output_format;
+	int ret;
+	bool is_http = false;
+	is_http = (strncmp(ffm->params.file, HTTP_PROTO,
+			   sizeof(HTTP_PROTO) - 1) == 0);
+
+	bool is_network = ffmpeg_mux_is_network(ffm);
+
+	if (is_network) {
+		avformat_network_init();
+	}
+
+	if (is_network && !is_http)
+		output_format = av_guess_format("mpegts", NULL, "video/M2PT");
+	else
+		output_format = av_guess_format(NULL, ffm->params.file, NULL);
+
+	if (output_format == NULL) {
+		set_error(ffm, "Couldn't find an appropriate muxer for '%s'",
+			  ffm->params.printable_file.array);
+		return FFM_ERROR;
+	}
+	blog(LOG_INFO, "Output format name and long_name: %s, %s",
+	     output_format->name ? output_format->name : "unknown",
+	     output_format->long_name ? output_format->long_name : "unknown");
+
+	ret = avformat_alloc_output_context2(&ffm->output, output_format, NULL,
+					     ffm->params.file);
+	if (ret < 0) {
+		set_error(ffm, "Couldn't initialize output context: %s",
+			  av_err2str(ret));
+		return FFM_ERROR;
+	}
+
+	ffm->output->oformat->video_codec = AV_CODEC_ID_NONE;
+	ffm->output->oformat->audio_codec = AV_CODEC_ID_NONE;
+
+	if (!init_streams(ffm)) {
+		free_avformat(ffm);
+		return FFM_ERROR;
+	}
+
+	ret = open_output_file(ffm);
+	if (ret != FFM_SUCCESS) {
+		free_avformat(ffm);
+		return ret;
+	}
+
+	return FFM_SUCCESS;
+}
+
+void ffmpeg_mux_init(struct ffmpeg_mux *ffm)
+{
+	if (ffm->params.tracks) {
+		ffm->audio_header =
+			calloc(ffm->params.tracks, sizeof(*ffm->audio_header));
+	}
+
+	if (dstr_is_empty(&ffm->params.printable_file))
+		dstr_copy(&ffm->params.printable_file, ffm->params.file);
+
+#if LIBAVCODEC_VERSION_INT < AV_VERSION_INT(58, 9, 100)
+	av_register_all();
+#endif
+}
+
+int ffmpeg_mux_open(struct ffmpeg_mux *ffm)
+{
+	/* ffmpeg does not have a way of telling what's supported
+	 * for a given output format, so we try each possibility */
+	int ret = ffmpeg_mux_init_context(ffm);
+	if (ret == FFM_SUCCESS)
+		ffm->initialized = true;
+	return ret;
+}
+
+static inline int get_index(struct ffmpeg_mux *ffm,
+			    const struct ffm_packet_info *info)
+{
+	if (info->type == FFM_PACKET_VIDEO) {
+		if (ffm->video_stream) {
+			return ffm->video_stream->id;
+		}
+	} else {
+		if ((int)info->index < ffm->num_audio_streams) {
+			return ffm->audio_infos[info->index].stream->id;
+		}
+	}
+
+	return -1;
+}
+
+static AVCodecContext *get_codec_context(struct ffmpeg_mux *ffm,
+					 const struct ffm_packet_info *info)
+{
+	if (info->type == FFM_PACKET_VIDEO) {
+		if (ffm->video_stream) {
+			return ffm->video_ctx;
+		}
+	} else {
+		if ((int)info->index < ffm->num_audio_streams) {
+			return ffm->audio_infos[info->index].ctx;
+		}
+	}
+
+	return NULL;
+}
+
+static inline AVStream *get_stream(struct ffmpeg_mux *ffm, int idx)
+{
+	return ffm->output->streams[idx];
+}
+
+static inline int64_t rescale_ts(struct ffmpeg_mux *ffm,
+				 AVRational codec_time_base, int64_t val,
+				 int idx)
+{
+	AVStream *stream = get_stream(ffm, idx);
+
+	return av_rescale_q_rnd(val / codec_time_base.num, codec_time_base,
+				stream->time_base,
+				AV_ROUND_NEAR_INF | AV_ROUND_PASS_MINMAX);
+}
+
+bool ffmpeg_mux_packet(struct ffmpeg_mux *ffm, uint8_t *buf,
+		       const struct ffm_packet_info *info)
+{
+	int idx = get_index(ffm, info);
+	AVPacket packet = {0};
+
+	/* The muxer might not support video/audio, or multiple audio tracks */
+	if (idx == -1) {
+		return true;
+	}
+
+	const AVRational codec_time_base =
+		get_codec_context(ffm, info)->time_base;
+
+	av_init_packet(&packet);
+
+	packet.data = buf;
+	packet.size = (int)info->size;
+	packet.stream_index = idx;
+	packet.pts = rescale_ts(ffm, codec_time_base, info->pts, idx);
+	packet.dts = rescale_ts(ffm, codec_time_base, info->dts, idx);
+
+	if (info->keyframe)
+		packet.flags = AV_PKT_FLAG_KEY;
+
+	int ret = av_interleaved_write_frame(ffm->output, &packet);
+
+	if (ret < 0) {
+		set_error(ffm, "av_interleaved_write_frame failed: %d: %s", ret,
+			  av_err2str(ret));
+	}
+
+	/* Treat "Invalid data found when processing input" and "Invalid argument" as non-fatal */
+	if (ret == AVERROR_INVALIDDATA || ret == -EINVAL) {
+		return true;
+	}
+
+	return ret >= 0;
+}
+
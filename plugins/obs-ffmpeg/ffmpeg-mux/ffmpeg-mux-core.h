@@ -0,0 +1,80 @@
+#pragma once
+
+#include "ffmpeg-mux.h"
+
+#include <util/dstr.h>
+#include <libavformat/avformat.h>
+
+/*
+ * libavformat muxing shared by the obs-ffmpeg-mux helper process and the
+ * in-process mode of the ffmpeg_muxer output.
+ *
+ * Usage: fill in params/audio, call ffmpeg_mux_init, pass one header per
+ * stream (video first, then each audio track) to ffmpeg_mux_header, then
+ * call ffmpeg_mux_open and write packets with ffmpeg_mux_packet.  Messages
+ * are logged with blog; the last error is also kept in ffmpeg_mux::error.
+ */
+
+struct main_params {
+	const char *file;
+	/* printable_file is file with any stream key information removed */
+	struct dstr printable_file;
+	int has_video;
+	int tracks;
+	const char *vcodec;
+	int vbitrate;
+	int gop;
+	int width;
+	int height;
+	int fps_num;
+	int fps_den;
+	int color_primaries;
+	int color_trc;
+	int colorspace;
+	int color_range;
+	const char *acodec;
+	const char *muxer_settings;
+	/* options for opening the file, e.g. the HTTP method, may be NULL */
+	const char *protocol_settings;
+};
+
+struct audio_params {
+	const char *name;
+	int abitrate;
+	int sample_rate;
+	int channels;
+};
+
+struct header {
+	uint8_t *data;
+	int size;
+};
+
+struct audio_info {
+	AVStream *stream;
+	AVCodecContext *ctx;
+};
+
+struct ffmpeg_mux {
+	AVFormatContext *output;
+	AVStream *video_stream;
+	AVCodecContext *video_ctx;
+	struct audio_info *audio_infos;
+	struct main_params params;
+	/* allocated with malloc/calloc, freed by ffmpeg_mux_free */
+	struct audio_params *audio;
+	struct header video_header;
+	struct header *audio_header;
+	int num_audio_streams;
+	bool initialized;
+	char error[4096];
+};
+
+extern void ffmpeg_mux_init(struct ffmpeg_mux *ffm);
+extern void ffmpeg_mux_header(struct ffmpeg_mux *ffm, const uint8_t *data,
+			      const struct ffm_packet_info *info);
+extern int ffmpeg_mux_open(struct ffmpeg_mux *ffm);
+extern bool ffmpeg_mux_packet(struct ffmpeg_mux *ffm, uint8_t *buf,
+			      const struct ffm_packet_info *info);
+/* returns a negative AVERROR if writing the trailer or closing failed */
+extern int ffmpeg_mux_free(struct ffmpeg_mux *ffm);
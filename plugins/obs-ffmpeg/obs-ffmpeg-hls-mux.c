@@ -19,6 +19,65 @@ int hls_stream_dropped_frames(void *data)
 	return stream->dropped_frames;
 }
 
+static void get_segment_stats(struct ffmpeg_muxer *stream,
+			      struct hls_segment_stats *stats)
+{
+	pthread_mutex_lock(&stream->write_mutex);
+	if (stream->segments)
+		hls_segment_pool_get_stats(stream->segments, stats);
+	else
+		*stats = stream->segment_stats;
+	pthread_mutex_unlock(&stream->write_mutex);
+}
+
+/* how long the last segment took to write compared to its duration */
+static float hls_stream_congestion(void *data)
+{
+	struct ffmpeg_muxer *stream = data;
+	struct hls_segment_stats stats;
+	float congestion;
+
+	get_segment_stats(stream, &stats);
+	if (!stats.target_ns)
+		return 0.0f;
+
+	congestion = (float)stats.last_write_ns / (float)stats.target_ns;
+	return congestion > 1.0f ? 1.0f : congestion;
+}
+
+static void get_segment_stats_proc(void *data, calldata_t *cd)
+{
+	struct ffmpeg_muxer *stream = data;
+	struct hls_segment_stats stats;
+
+	get_segment_stats(stream, &stats);
+	calldata_set_int(cd, "segments", (long long)stats.segments);
+	calldata_set_int(cd, "failed", (long long)stats.failed);
+	calldata_set_int(cd, "dropped", (long long)stats.dropped);
+	calldata_set_int(cd, "last_write_ms", stats.last_write_ns / 1000000);
+	calldata_set_int(cd, "avg_write_ms", stats.avg_write_ns / 1000000);
+	calldata_set_int(cd, "max_write_ms", stats.max_write_ns / 1000000);
+}
+
+/* called from deactivate */
+void hls_stop_segments(struct ffmpeg_muxer *stream)
+{
+	struct hls_segment_pool *pool = stream->segments;
+
+	if (!pool)
+		return;
+
+	/* the writers finish the remaining segments and the playlist */
+	hls_segment_pool_stop(pool);
+
+	pthread_mutex_lock(&stream->write_mutex);
+	hls_segment_pool_get_stats(pool, &stream->segment_stats);
+	stream->segments = NULL;
+	pthread_mutex_unlock(&stream->write_mutex);
+
+	hls_segment_pool_destroy(pool);
+}
+
 void ffmpeg_hls_mux_destroy(void *data)
 {
 	struct ffmpeg_muxer *stream = data;
@@ -30,7 +89,6 @@ void ffmpeg_hls_mux_destroy(void *data)
 		os_sem_destroy(stream->write_sem);
 		os_event_destroy(stream->stop_event);
 
-		da_free(stream->mux_packets);
 		circlebuf_free(&stream->packets);
 
 		os_process_pipe_destroy(stream->pipe);
@@ -56,6 +114,14 @@ void *ffmpeg_hls_mux_create(obs_data_t *settings, obs_output_t *output)
 	if (os_sem_init(&stream->write_sem, 0) != 0)
 		goto fail;
 
+	proc_handler_t *ph = obs_output_get_proc_handler(output);
+	proc_handler_add(ph,
+			 "void get_segment_stats(out int segments, "
+			 "out int failed, out int dropped, "
+			 "out int last_write_ms, out int avg_write_ms, "
+			 "out int max_write_ms)",
+			 get_segment_stats_proc, stream);
+
 	UNUSED_PARAMETER(settings);
 	return stream;
 
@@ -113,6 +179,8 @@ bool ffmpeg_hls_mux_start(void *data)
 	obs_encoder_t *vencoder;
 	obs_data_t *settings;
 	int keyint_sec;
+	int segment_writers;
+	int playlist_size;
 
 	if (!obs_output_can_begin_data_capture(stream->output, 0))
 		return false;
@@ -142,19 +210,38 @@ bool ffmpeg_hls_mux_start(void *data)
 
 	obs_data_release(settings);
 
-	start_pipe(stream, path.array);
-	dstr_free(&path);
+	settings = obs_output_get_settings(stream->output);
+	segment_writers = (int)obs_data_get_int(settings, "segment_writers");
+	playlist_size = (int)obs_data_get_int(settings, "playlist_size");
+	obs_data_release(settings);
 
-	if (!stream->pipe) {
-		obs_output_set_last_error(
-			stream->output, obs_module_text("HelperProcessFailed"));
-		warn("Failed to create process pipe");
-		return false;
+	if (segment_writers > 0) {
+		memset(&stream->segment_stats, 0,
+		       sizeof(stream->segment_stats));
+		stream->segments = hls_segment_pool_create(
+			stream, path.array, segment_writers,
+			keyint_sec ? keyint_sec : 2, playlist_size);
+		dstr_free(&path);
+
+		if (!stream->segments)
+			return false;
+	} else {
+		start_pipe(stream, path.array);
+		dstr_free(&path);
+
+		if (!stream->pipe) {
+			obs_output_set_last_error(
+				stream->output,
+				obs_module_text("HelperProcessFailed"));
+			warn("Failed to create process pipe");
+			return false;
+		}
+		stream->mux_thread_joinable =
+			pthread_create(&stream->mux_thread, NULL, write_thread,
+				       stream) == 0;
+		if (!stream->mux_thread_joinable)
+			return false;
 	}
-	stream->mux_thread_joinable = pthread_create(&stream->mux_thread, NULL,
-						     write_thread, stream) == 0;
-	if (!stream->mux_thread_joinable)
-		return false;
 
 	/* write headers and start capture */
 	os_atomic_set_bool(&stream->active, true);
@@ -278,7 +365,7 @@ void ffmpeg_hls_mux_data(void *data, struct encoder_packet *packet)
 		return;
 	}
 
-	if (!stream->sent_headers) {
+	if (!stream->sent_headers && !stream->segments) {
 		if (!send_headers(stream))
 			return;
 		stream->sent_headers = true;
@@ -291,6 +378,12 @@ void ffmpeg_hls_mux_data(void *data, struct encoder_packet *packet)
 		}
 	}
 
+	/* segment writers drop whole segments when they fall behind */
+	if (stream->segments) {
+		hls_segment_pool_push(stream->segments, packet);
+		return;
+	}
+
 	if (packet->type == OBS_ENCODER_VIDEO) {
 		obs_parse_avc_packet(&tmp_packet, packet);
 		packet->drop_priority = tmp_packet.priority;
@@ -329,4 +422,5 @@ struct obs_output_info ffmpeg_hls_muxer = {
 	.encoded_packet = ffmpeg_hls_mux_data,
 	.get_total_bytes = ffmpeg_mux_total_bytes,
 	.get_dropped_frames = hls_stream_dropped_frames,
+	.get_congestion = hls_stream_congestion,
 };
@@ -0,0 +1,110 @@
+#include <inttypes.h>
+#include <math.h>
+
+#include "obs-ffmpeg-hls-playlist.h"
+
+static inline size_t window_count(struct hls_playlist *playlist)
+{
+	return playlist->window.size / sizeof(struct hls_playlist_entry);
+}
+
+static void publish_finished(struct hls_playlist *playlist)
+{
+	for (;;) {
+		struct hls_playlist_entry entry;
+		size_t idx = DARRAY_INVALID;
+
+		for (size_t i = 0; i < playlist->finished.num; i++) {
+			if (playlist->finished.array[i].index ==
+			    playlist->next_index) {
+				idx = i;
+				break;
+			}
+		}
+
+		if (idx == DARRAY_INVALID)
+			break;
+
+		entry = playlist->finished.array[idx];
+		da_erase(playlist->finished, idx);
+		playlist->next_index++;
+
+		if (entry.skipped) {
+			playlist->discontinuity = true;
+			continue;
+		}
+
+		entry.discontinuity = playlist->discontinuity;
+		playlist->discontinuity = false;
+
+		circlebuf_push_back(&playlist->window, &entry, sizeof(entry));
+		if (window_count(playlist) > playlist->size)
+			circlebuf_pop_front(&playlist->window, NULL,
+					    sizeof(entry));
+	}
+}
+
+void hls_playlist_free(struct hls_playlist *playlist)
+{
+	da_free(playlist->finished);
+	circlebuf_free(&playlist->window);
+}
+
+void hls_playlist_add(struct hls_playlist *playlist, uint64_t index,
+		      int64_t duration_usec, bool skipped)
+{
+	struct hls_playlist_entry entry = {
+		.index = index,
+		.duration_usec = duration_usec,
+		.skipped = skipped,
+	};
+
+	da_push_back(playlist->finished, &entry);
+	publish_finished(playlist);
+}
+
+void hls_playlist_end(struct hls_playlist *playlist)
+{
+	playlist->ended = true;
+	publish_finished(playlist);
+}
+
+bool hls_playlist_build(struct hls_playlist *playlist, struct dstr *m3u8)
+{
+	size_t count = window_count(playlist);
+	struct hls_playlist_entry *first;
+	int64_t max_duration = 0;
+
+	if (!count)
+		return false;
+
+	for (size_t i = 0; i < count; i++) {
+		struct hls_playlist_entry *entry =
+			circlebuf_data(&playlist->window, i * sizeof(*entry));
+		if (entry->duration_usec > max_duration)
+			max_duration = entry->duration_usec;
+	}
+
+	first = circlebuf_data(&playlist->window, 0);
+
+	dstr_copy(m3u8, "#EXTM3U\n#EXT-X-VERSION:3\n");
+	dstr_catf(m3u8, "#EXT-X-TARGETDURATION:%d\n",
+		  (int)ceil((double)max_duration / 1000000.0));
+	dstr_catf(m3u8, "#EXT-X-MEDIA-SEQUENCE:%" PRIu64 "\n", first->index);
+
+	for (size_t i = 0; i < count; i++) {
+		struct hls_playlist_entry *entry =
+			circlebuf_data(&playlist->window, i * sizeof(*entry));
+
+		if (entry->discontinuity)
+			dstr_cat(m3u8, "#EXT-X-DISCONTINUITY\n");
+
+		dstr_catf(m3u8, "#EXTINF:%.3f,\n%s%" PRIu64 ".ts\n",
+			  (double)entry->duration_usec / 1000000.0,
+			  playlist->segment_name, entry->index);
+	}
+
+	if (playlist->ended)
+		dstr_cat(m3u8, "#EXT-X-ENDLIST\n");
+	return true;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <util/circlebuf.h>
+#include <util/darray.h>
+#include <util/dstr.h>
+
+/*
+ * Sliding-window media playlist of the segment-parallel HLS output.
+ *
+ * Segments can finish in any order, but are only listed once every earlier
+ * segment is done.  Segments that were dropped or failed to upload are left
+ * out, and the next listed segment is marked as a discontinuity.
+ *
+ * Not thread safe, the segment pool guards it with its mutex.
+ */
+
+struct hls_playlist_entry {
+	uint64_t index;
+	int64_t duration_usec;
+	bool discontinuity;
+	bool skipped;
+};
+
+struct hls_playlist {
+	/* segment file name without the index and extension */
+	const char *segment_name;
+	size_t size;
+
+	/* finished segments waiting for earlier ones */
+	DARRAY(struct hls_playlist_entry) finished;
+	struct circlebuf window;
+	uint64_t next_index;
+	bool discontinuity;
+	bool ended;
+};
+
+extern void hls_playlist_free(struct hls_playlist *playlist);
+
+/* skipped segments are never listed, but end up as a discontinuity */
+extern void hls_playlist_add(struct hls_playlist *playlist, uint64_t index,
+			     int64_t duration_usec, bool skipped);
+extern void hls_playlist_end(struct hls_playlist *playlist);
+
+/* builds the m3u8, returns false if no segment can be listed yet */
+extern bool hls_playlist_build(struct hls_playlist *playlist,
+			       struct dstr *m3u8);
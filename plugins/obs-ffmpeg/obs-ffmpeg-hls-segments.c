@@ -0,0 +1,456 @@
+#include <inttypes.h>
+#include <libavformat/avformat.h>
+#include <util/circlebuf.h>
+#include <util/darray.h>
+#include <util/dstr.h>
+#include <util/platform.h>
+#include <util/threading.h>
+
+#include "obs-ffmpeg-mux.h"
+#include "obs-ffmpeg-hls-playlist.h"
+#include "ffmpeg-mux/ffmpeg-mux-core.h"
+
+#define do_log(level, format, ...)                           \
+	blog(level, "[ffmpeg hls segments: '%s'] " format,  \
+	     obs_output_get_name(pool->stream->output), ##__VA_ARGS__)
+
+#define warn(format, ...) do_log(LOG_WARNING, format, ##__VA_ARGS__)
+#define info(format, ...) do_log(LOG_INFO, format, ##__VA_ARGS__)
+
+/* segments still waiting for a writer beyond this are dropped, oldest first */
+#define MAX_QUEUED_SEGMENTS 4
+
+struct hls_segment {
+	uint64_t index;
+	int64_t start_dts_usec;
+	int64_t duration_usec;
+	int video_frames;
+	struct dstr url;
+	DARRAY(struct encoder_packet) packets;
+};
+
+struct hls_segment_pool {
+	struct ffmpeg_muxer *stream;
+	struct dstr playlist_url;
+	/* playlist url without the extension, segments append their index */
+	struct dstr segment_url;
+	struct dstr protocol_settings;
+	int64_t target_usec;
+
+	pthread_t *threads;
+	size_t num_threads;
+	os_sem_t *sem;
+	volatile bool stopping;
+
+	/* encoder thread only */
+	struct hls_segment *cur;
+	uint64_t next_index;
+	int64_t last_dts_usec;
+
+	/* guards everything below */
+	pthread_mutex_t mutex;
+	struct circlebuf queue;
+	struct hls_playlist playlist;
+	struct hls_segment_stats stats;
+	int64_t total_write_ns;
+
+	/* keeps playlist uploads in order */
+	pthread_mutex_t playlist_mutex;
+};
+
+/* ------------------------------------------------------------------------- */
+/* segments */
+
+static struct hls_segment *segment_create(struct hls_segment_pool *pool,
+					  int64_t start_dts_usec)
+{
+	struct hls_segment *seg = bzalloc(sizeof(*seg));
+	seg->index = pool->next_index++;
+	seg->start_dts_usec = start_dts_usec;
+	dstr_printf(&seg->url, "%s%" PRIu64 ".ts", pool->segment_url.array,
+		    seg->index);
+	return seg;
+}
+
+static void segment_destroy(struct hls_segment *seg)
+{
+	for (size_t i = 0; i < seg->packets.num; i++)
+		obs_encoder_packet_release(&seg->packets.array[i]);
+	da_free(seg->packets);
+	dstr_free(&seg->url);
+	bfree(seg);
+}
+
+static void send_segment_headers(struct hls_segment_pool *pool,
+				 struct ffmpeg_mux *ffm)
+{
+	obs_output_t *output = pool->stream->output;
+	struct ffm_packet_info info = {0};
+	uint8_t *data;
+	size_t size;
+
+	if (ffm->params.has_video) {
+		obs_encoder_t *vencoder = obs_output_get_video_encoder(output);
+		obs_encoder_get_extra_data(vencoder, &data, &size);
+
+		info.type = FFM_PACKET_VIDEO;
+		info.size = (uint32_t)size;
+		ffmpeg_mux_header(ffm, data, &info);
+	}
+
+	for (int i = 0; i < ffm->params.tracks; i++) {
+		obs_encoder_t *aencoder =
+			obs_output_get_audio_encoder(output, (size_t)i);
+		obs_encoder_get_extra_data(aencoder, &data, &size);
+
+		info.type = FFM_PACKET_AUDIO;
+		info.index = i;
+		info.size = (uint32_t)size;
+		ffmpeg_mux_header(ffm, data, &info);
+	}
+}
+
+/* muxes and uploads one segment, adding the payload size to bytes */
+static bool mux_segment(struct hls_segment_pool *pool,
+			struct hls_segment *seg, uint64_t *bytes)
+{
+	struct ffmpeg_mux *ffm;
+	bool success = true;
+
+	ffm = create_mux(pool->stream, seg->url.array, NULL,
+			 pool->protocol_settings.array);
+	send_segment_headers(pool, ffm);
+
+	if (ffmpeg_mux_open(ffm) != FFM_SUCCESS) {
+		success = false;
+		goto done;
+	}
+
+	for (size_t i = 0; i < seg->packets.num; i++) {
+		struct encoder_packet *packet = &seg->packets.array[i];
+		struct ffm_packet_info info;
+
+		get_packet_info(packet, &info);
+		if (!ffmpeg_mux_packet(ffm, packet->data, &info)) {
+			success = false;
+			break;
+		}
+
+		*bytes += packet->size;
+	}
+
+done:
+	/* writes the trailer and closes the upload, which is where a failed
+	 * HTTP PUT shows up */
+	if (ffmpeg_mux_free(ffm) < 0)
+		success = false;
+	bfree(ffm);
+	return success;
+}
+
+/* ------------------------------------------------------------------------- */
+/* playlist */
+
+static bool put_file(struct hls_segment_pool *pool, const char *url,
+		     const char *data, size_t size)
+{
+	AVIOContext *io = NULL;
+	AVDictionary *opts = NULL;
+	int ret;
+
+	if (!dstr_is_empty(&pool->protocol_settings))
+		av_dict_parse_string(&opts, pool->protocol_settings.array, "=",
+				     " ", 0);
+
+	ret = avio_open2(&io, url, AVIO_FLAG_WRITE, NULL, &opts);
+	av_dict_free(&opts);
+	if (ret < 0)
+		return false;
+
+	avio_write(io, (const unsigned char *)data, (int)size);
+	avio_flush(io);
+	ret = io->error;
+
+	if (avio_closep(&io) < 0)
+		return false;
+	return ret >= 0;
+}
+
+static void upload_playlist(struct hls_segment_pool *pool)
+{
+	struct dstr m3u8 = {0};
+
+	pthread_mutex_lock(&pool->playlist_mutex);
+
+	pthread_mutex_lock(&pool->mutex);
+	hls_playlist_build(&pool->playlist, &m3u8);
+	pthread_mutex_unlock(&pool->mutex);
+
+	if (!dstr_is_empty(&m3u8) &&
+	    !put_file(pool, pool->playlist_url.array, m3u8.array, m3u8.len))
+		warn("Failed to upload playlist");
+
+	pthread_mutex_unlock(&pool->playlist_mutex);
+
+	dstr_free(&m3u8);
+}
+
+/* ------------------------------------------------------------------------- */
+/* writers */
+
+static void write_segment(struct hls_segment_pool *pool,
+			  struct hls_segment *seg)
+{
+	uint64_t start = os_gettime_ns();
+	uint64_t bytes = 0;
+	bool success;
+	int64_t elapsed;
+
+	success = mux_segment(pool, seg, &bytes);
+	elapsed = (int64_t)(os_gettime_ns() - start);
+
+	if (!success)
+		warn("Failed to write segment %" PRIu64, seg->index);
+
+	pthread_mutex_lock(&pool->mutex);
+
+	pool->stats.segments++;
+	if (!success)
+		pool->stats.failed++;
+	pool->stats.last_write_ns = elapsed;
+	if (elapsed > pool->stats.max_write_ns)
+		pool->stats.max_write_ns = elapsed;
+	pool->total_write_ns += elapsed;
+	pool->stats.avg_write_ns =
+		pool->total_write_ns / (int64_t)pool->stats.segments;
+	pool->stream->total_bytes += bytes;
+
+	/* a failed segment is left out like a dropped one, so the playlist
+	 * marks the gap as a discontinuity */
+	hls_playlist_add(&pool->playlist, seg->index, seg->duration_usec,
+			 !success);
+
+	pthread_mutex_unlock(&pool->mutex);
+
+	upload_playlist(pool);
+	segment_destroy(seg);
+}
+
+static void *segment_writer_thread(void *data)
+{
+	struct hls_segment_pool *pool = data;
+
+	os_set_thread_name("ffmpeg-hls: segment writer");
+
+	while (os_sem_wait(pool->sem) == 0) {
+		struct hls_segment *seg = NULL;
+
+		pthread_mutex_lock(&pool->mutex);
+		if (pool->queue.size)
+			circlebuf_pop_front(&pool->queue, &seg, sizeof(seg));
+		pthread_mutex_unlock(&pool->mutex);
+
+		if (seg)
+			write_segment(pool, seg);
+		else if (os_atomic_load_bool(&pool->stopping))
+			break;
+	}
+
+	return NULL;
+}
+
+static void queue_segment(struct hls_segment_pool *pool,
+			  struct hls_segment *seg)
+{
+	struct hls_segment *dropped = NULL;
+
+	pthread_mutex_lock(&pool->mutex);
+
+	/* writers can't keep up, skip the oldest waiting segment.  segments
+	 * start on a keyframe, so the stream stays decodable. */
+	if (pool->queue.size / sizeof(seg) >= MAX_QUEUED_SEGMENTS) {
+		circlebuf_pop_front(&pool->queue, &dropped, sizeof(dropped));
+		hls_playlist_add(&pool->playlist, dropped->index, 0, true);
+
+		pool->stats.dropped++;
+		pool->stream->dropped_frames += dropped->video_frames;
+	}
+
+	circlebuf_push_back(&pool->queue, &seg, sizeof(seg));
+
+	pthread_mutex_unlock(&pool->mutex);
+
+	if (dropped) {
+		warn("Dropped segment %" PRIu64 ", writers are falling behind",
+		     dropped->index);
+		segment_destroy(dropped);
+	} else {
+		os_sem_post(pool->sem);
+	}
+}
+
+void hls_segment_pool_push(struct hls_segment_pool *pool,
+			   struct encoder_packet *packet)
+{
+	bool keyframe = packet->type == OBS_ENCODER_VIDEO && packet->keyframe;
+	struct encoder_packet ref;
+
+	if (keyframe && pool->cur) {
+		int64_t duration = packet->dts_usec - pool->cur->start_dts_usec;
+		if (duration >= pool->target_usec) {
+			pool->cur->duration_usec = duration;
+			queue_segment(pool, pool->cur);
+			pool->cur = NULL;
+		}
+	}
+
+	if (!pool->cur) {
+		/* segments have to start with a keyframe */
+		if (!keyframe)
+			return;
+
+		pool->cur = segment_create(pool, packet->dts_usec);
+	}
+
+	if (packet->type == OBS_ENCODER_VIDEO) {
+		pool->cur->video_frames++;
+		pool->last_dts_usec = packet->dts_usec;
+	}
+
+	obs_encoder_packet_ref(&ref, packet);
+	da_push_back(pool->cur->packets, &ref);
+}
+
+/* ------------------------------------------------------------------------- */
+
+struct hls_segment_pool *
+hls_segment_pool_create(struct ffmpeg_muxer *stream, const char *url,
+			int num_writers, int segment_sec, int playlist_size)
+{
+	struct hls_segment_pool *pool = bzalloc(sizeof(*pool));
+	const char *slash;
+	const char *ext;
+
+	pool->stream = stream;
+	pool->target_usec = (int64_t)segment_sec * 1000000;
+	pool->playlist.size = playlist_size > 0 ? (size_t)playlist_size : 5;
+	pool->stats.target_ns = pool->target_usec * 1000;
+
+	pthread_mutex_init_value(&pool->mutex);
+	pthread_mutex_init_value(&pool->playlist_mutex);
+	if (pthread_mutex_init(&pool->mutex, NULL) != 0)
+		goto fail;
+	if (pthread_mutex_init(&pool->playlist_mutex, NULL) != 0)
+		goto fail;
+	if (os_sem_init(&pool->sem, 0) != 0)
+		goto fail;
+
+	dstr_copy(&pool->playlist_url, url);
+
+	slash = strrchr(url, '/');
+	ext = strrchr(slash ? slash : url, '.');
+	if (ext)
+		dstr_ncopy(&pool->segment_url, url, (size_t)(ext - url));
+	else
+		dstr_copy(&pool->segment_url, url);
+
+	slash = strrchr(pool->segment_url.array, '/');
+	pool->playlist.segment_name = slash ? slash + 1
+					    : pool->segment_url.array;
+
+	if (strncmp(url, "http", 4) == 0) {
+		avformat_network_init();
+		dstr_printf(&pool->protocol_settings,
+			    "method=PUT user_agent=libobs/%s", OBS_VERSION);
+	}
+
+	pool->threads = bzalloc(sizeof(pthread_t) * (size_t)num_writers);
+	for (int i = 0; i < num_writers; i++) {
+		if (pthread_create(&pool->threads[i], NULL,
+				   segment_writer_thread, pool) != 0)
+			break;
+		pool->num_threads++;
+	}
+
+	if (!pool->num_threads)
+		goto fail;
+
+	info("Writing %d second segments with %d writers", segment_sec,
+	     (int)pool->num_threads);
+	return pool;
+
+fail:
+	warn("Failed to create segment writers");
+	hls_segment_pool_destroy(pool);
+	return NULL;
+}
+
+void hls_segment_pool_stop(struct hls_segment_pool *pool)
+{
+	if (pool->stopping)
+		return;
+
+	if (pool->cur) {
+		pool->cur->duration_usec =
+			pool->last_dts_usec - pool->cur->start_dts_usec;
+		if (pool->num_threads)
+			queue_segment(pool, pool->cur);
+		else
+			segment_destroy(pool->cur);
+		pool->cur = NULL;
+	}
+
+	os_atomic_set_bool(&pool->stopping, true);
+	for (size_t i = 0; i < pool->num_threads; i++)
+		os_sem_post(pool->sem);
+	for (size_t i = 0; i < pool->num_threads; i++)
+		pthread_join(pool->threads[i], NULL);
+
+	if (pool->num_threads) {
+		pthread_mutex_lock(&pool->mutex);
+		hls_playlist_end(&pool->playlist);
+		pthread_mutex_unlock(&pool->mutex);
+
+		upload_playlist(pool);
+
+		info("Wrote %" PRIu64 " segments (%" PRIu64 " failed, %" PRIu64
+		     " dropped), write time avg %" PRId64 " ms, max %" PRId64
+		     " ms",
+		     pool->stats.segments, pool->stats.failed,
+		     pool->stats.dropped, pool->stats.avg_write_ns / 1000000,
+		     pool->stats.max_write_ns / 1000000);
+	}
+}
+
+void hls_segment_pool_destroy(struct hls_segment_pool *pool)
+{
+	if (!pool)
+		return;
+
+	hls_segment_pool_stop(pool);
+
+	while (pool->queue.size) {
+		struct hls_segment *seg;
+		circlebuf_pop_front(&pool->queue, &seg, sizeof(seg));
+		segment_destroy(seg);
+	}
+
+	circlebuf_free(&pool->queue);
+	hls_playlist_free(&pool->playlist);
+	dstr_free(&pool->playlist_url);
+	dstr_free(&pool->segment_url);
+	dstr_free(&pool->protocol_settings);
+	bfree(pool->threads);
+	os_sem_destroy(pool->sem);
+	pthread_mutex_destroy(&pool->playlist_mutex);
+	pthread_mutex_destroy(&pool->mutex);
+	bfree(pool);
+}
+
+void hls_segment_pool_get_stats(struct hls_segment_pool *pool,
+				struct hls_segment_stats *stats)
+{
+	pthread_mutex_lock(&pool->mutex);
+	*stats = pool->stats;
+	pthread_mutex_unlock(&pool->mutex);
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <obs-module.h>
+
+/*
+ * Segment-parallel HLS output, used by the HLS muxer instead of the helper
+ * process when it is given segment writers.
+ *
+ * Packets are cut into segments at video keyframes on the encoder thread.
+ * Each finished segment is muxed to MPEG-TS and uploaded by one of a small
+ * pool of writer threads, so a slow upload no longer holds up the ones after
+ * it.  The playlist is only updated once all earlier segments are done, so
+ * it never lists a segment before the ones preceding it.
+ *
+ * Segments and the playlist are written through libavformat I/O: http(s)
+ * URLs are uploaded with PUT, anything else is treated as a local path,
+ * which makes a plain directory a stand-in for the server when testing.
+ */
+
+struct ffmpeg_muxer;
+struct hls_segment_pool;
+
+struct hls_segment_stats {
+	uint64_t segments;
+	uint64_t failed;
+	uint64_t dropped;
+	int64_t last_write_ns;
+	int64_t max_write_ns;
+	int64_t avg_write_ns;
+	int64_t target_ns;
+};
+
+struct hls_segment_pool *
+hls_segment_pool_create(struct ffmpeg_muxer *stream, const char *url,
+			int num_writers, int segment_sec, int playlist_size);
+
+/* writes out the last segment and the final playlist, then waits for the
+ * writers to finish.  the stats stay available until the pool is
+ * destroyed. */
+void hls_segment_pool_stop(struct hls_segment_pool *pool);
+void hls_segment_pool_destroy(struct hls_segment_pool *pool);
+
+/* encoder thread only, takes its own reference to the packet */
+void hls_segment_pool_push(struct hls_segment_pool *pool,
+			   struct encoder_packet *packet);
+
+void hls_segment_pool_get_stats(struct hls_segment_pool *pool,
+				struct hls_segment_stats *stats);
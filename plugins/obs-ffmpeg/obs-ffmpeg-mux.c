@@ -14,7 +14,7 @@
     You should have received a copy of the GNU General Public License
     along with this program.  If not, see <http://www.gnu.org/licenses/>.
 ******************************************************************************/
-#include "ffmpeg-mux/ffmpeg-mux.h"
+#include "ffmpeg-mux/ffmpeg-mux-core.h"
 #include "obs-ffmpeg-mux.h"
 
 #ifdef _WIN32
@@ -30,6 +30,17 @@
 #define warn(format, ...) do_log(LOG_WARNING, format, ##__VA_ARGS__)
 #define info(format, ...) do_log(LOG_INFO, format, ##__VA_ARGS__)
 
+/* max packets written to the pipe with a single call */
+#define FFM_WRITE_BATCH 64
+
+/* max packets queued for the write thread before the encoder thread has to
+ * wait for it, like it would on a full pipe */
+#define FFM_MAX_QUEUED_PACKETS 1024
+
+static bool start_write_thread(struct ffmpeg_muxer *stream);
+static void stop_write_thread(struct ffmpeg_muxer *stream);
+static int close_output(struct ffmpeg_muxer *stream);
+
 static const char *ffmpeg_mux_getname(void *type)
 {
 	UNUSED_PARAMETER(type);
@@ -45,35 +56,39 @@ static const char *ffmpeg_mpegts_mux_getname(void *type)
 static inline void replay_buffer_clear(struct ffmpeg_muxer *stream)
 {
 	while (stream->packets.size > 0) {
-		struct encoder_packet pkt;
-		circlebuf_pop_front(&stream->packets, &pkt, sizeof(pkt));
-		obs_encoder_packet_release(&pkt);
+		struct replay_packet rp;
+		circlebuf_pop_front(&stream->packets, &rp, sizeof(rp));
+		if (!stream->disk_buffer)
+			obs_encoder_packet_release(&rp.packet);
+		stream->first_seq++;
 	}
 
 	circlebuf_free(&stream->packets);
+	circlebuf_free(&stream->gops);
+	stream->front_bytes = stream->bytes_in;
 	stream->cur_size = 0;
 	stream->cur_time = 0;
 	stream->max_size = 0;
 	stream->max_time = 0;
 	stream->save_ts = 0;
-	stream->keyframes = 0;
+	stream->save_duration = 0;
 }
 
 static void ffmpeg_mux_destroy(void *data)
 {
 	struct ffmpeg_muxer *stream = data;
 
-	replay_buffer_clear(stream);
+	stop_write_thread(stream);
 	if (stream->mux_thread_joinable)
 		pthread_join(stream->mux_thread, NULL);
-	da_free(stream->mux_packets);
 	circlebuf_free(&stream->packets);
 
-	os_process_pipe_destroy(stream->pipe);
+	close_output(stream);
 	dstr_free(&stream->path);
 	dstr_free(&stream->printable_path);
 	dstr_free(&stream->stream_key);
 	dstr_free(&stream->muxer_settings);
+	dstr_free(&stream->mux_settings);
 	bfree(stream);
 }
 
@@ -112,8 +127,9 @@ bool active(struct ffmpeg_muxer *stream)
 
 /* TODO: allow codecs other than h264 whenever we start using them */
 
-static void add_video_encoder_params(struct ffmpeg_muxer *stream,
-				     struct dstr *cmd, obs_encoder_t *vencoder)
+static void get_video_params(struct ffmpeg_muxer *stream,
+			     obs_encoder_t *vencoder,
+			     struct main_params *params)
 {
 	obs_data_t *settings = obs_encoder_get_settings(vencoder);
 	int bitrate = (int)obs_data_get_int(settings, "bitrate");
@@ -148,28 +164,80 @@ static void add_video_encoder_params(struct ffmpeg_muxer *stream,
 						? AVCOL_RANGE_JPEG
 						: AVCOL_RANGE_MPEG;
 
-	dstr_catf(cmd, "%s %d %d %d %d %d %d %d %d %d ",
-		  obs_encoder_get_codec(vencoder), bitrate,
-		  obs_output_get_width(stream->output),
-		  obs_output_get_height(stream->output), (int)pri, (int)trc,
-		  (int)spc, (int)range, (int)info->fps_num, (int)info->fps_den);
+	params->has_video = 1;
+	params->vcodec = obs_encoder_get_codec(vencoder);
+	params->vbitrate = bitrate;
+	params->width = (int)obs_output_get_width(stream->output);
+	params->height = (int)obs_output_get_height(stream->output);
+	params->color_primaries = (int)pri;
+	params->color_trc = (int)trc;
+	params->colorspace = (int)spc;
+	params->color_range = (int)range;
+	params->fps_num = (int)info->fps_num;
+	params->fps_den = (int)info->fps_den;
 }
 
-static void add_audio_encoder_params(struct dstr *cmd, obs_encoder_t *aencoder)
+static void get_audio_params(obs_encoder_t *aencoder,
+			     struct audio_params *audio)
 {
 	obs_data_t *settings = obs_encoder_get_settings(aencoder);
-	int bitrate = (int)obs_data_get_int(settings, "bitrate");
-	audio_t *audio = obs_get_audio();
-	struct dstr name = {0};
+
+	audio->name = obs_encoder_get_name(aencoder);
+	audio->abitrate = (int)obs_data_get_int(settings, "bitrate");
+	audio->sample_rate = (int)obs_encoder_get_sample_rate(aencoder);
+	audio->channels = (int)audio_output_get_channels(obs_get_audio());
 
 	obs_data_release(settings);
+}
+
+/* returns the number of audio tracks */
+static int get_mux_params(struct ffmpeg_muxer *stream,
+			  struct main_params *params,
+			  struct audio_params *audio)
+{
+	obs_encoder_t *vencoder = obs_output_get_video_encoder(stream->output);
+	int num_tracks = 0;
+
+	if (vencoder)
+		get_video_params(stream, vencoder, params);
+
+	for (;;) {
+		obs_encoder_t *aencoder = obs_output_get_audio_encoder(
+			stream->output, num_tracks);
+		if (!aencoder)
+			break;
+
+		get_audio_params(aencoder, &audio[num_tracks]);
+		num_tracks++;
+	}
+
+	params->tracks = num_tracks;
+	if (num_tracks)
+		params->acodec = "aac";
+
+	return num_tracks;
+}
+
+static void add_video_encoder_params(struct dstr *cmd,
+				     const struct main_params *params)
+{
+	dstr_catf(cmd, "%s %d %d %d %d %d %d %d %d %d ", params->vcodec,
+		  params->vbitrate, params->width, params->height,
+		  params->color_primaries, params->color_trc,
+		  params->colorspace, params->color_range, params->fps_num,
+		  params->fps_den);
+}
+
+static void add_audio_encoder_params(struct dstr *cmd,
+				     const struct audio_params *audio)
+{
+	struct dstr name = {0};
 
-	dstr_copy(&name, obs_encoder_get_name(aencoder));
+	dstr_copy(&name, audio->name);
 	dstr_replace(&name, "\"", "\"\"");
 
-	dstr_catf(cmd, "\"%s\" %d %d %d ", name.array, bitrate,
-		  (int)obs_encoder_get_sample_rate(aencoder),
-		  (int)audio_output_get_channels(audio));
+	dstr_catf(cmd, "\"%s\" %d %d %d ", name.array, audio->abitrate,
+		  audio->sample_rate, audio->channels);
 
 	dstr_free(&name);
 }
@@ -210,20 +278,24 @@ static void add_stream_key(struct dstr *cmd, struct ffmpeg_muxer *stream)
 			  : stream->stream_key.array);
 }
 
-static void add_muxer_params(struct dstr *cmd, struct ffmpeg_muxer *stream)
+static void get_muxer_settings(struct ffmpeg_muxer *stream, struct dstr *mux)
 {
-	struct dstr mux = {0};
-
 	if (dstr_is_empty(&stream->muxer_settings)) {
 		obs_data_t *settings = obs_output_get_settings(stream->output);
-		dstr_copy(&mux,
-			  obs_data_get_string(settings, "muxer_settings"));
+		dstr_copy(mux, obs_data_get_string(settings, "muxer_settings"));
 		obs_data_release(settings);
 	} else {
-		dstr_copy(&mux, stream->muxer_settings.array);
+		dstr_copy(mux, stream->muxer_settings.array);
 	}
 
-	log_muxer_params(stream, mux.array);
+	log_muxer_params(stream, mux->array);
+}
+
+static void add_muxer_params(struct dstr *cmd, struct ffmpeg_muxer *stream)
+{
+	struct dstr mux = {0};
+
+	get_muxer_settings(stream, &mux);
 
 	dstr_replace(&mux, "\"", "\\\"");
 
@@ -235,19 +307,9 @@ static void add_muxer_params(struct dstr *cmd, struct ffmpeg_muxer *stream)
 static void build_command_line(struct ffmpeg_muxer *stream, struct dstr *cmd,
 			       const char *path)
 {
-	obs_encoder_t *vencoder = obs_output_get_video_encoder(stream->output);
-	obs_encoder_t *aencoders[MAX_AUDIO_MIXES];
-	int num_tracks = 0;
-
-	for (;;) {
-		obs_encoder_t *aencoder = obs_output_get_audio_encoder(
-			stream->output, num_tracks);
-		if (!aencoder)
-			break;
-
-		aencoders[num_tracks] = aencoder;
-		num_tracks++;
-	}
+	struct main_params params = {0};
+	struct audio_params audio[MAX_AUDIO_MIXES];
+	int num_tracks = get_mux_params(stream, &params, audio);
 
 	dstr_init_move_array(cmd, os_get_executable_path_ptr(FFMPEG_MUX));
 	dstr_insert_ch(cmd, 0, '\"');
@@ -257,16 +319,16 @@ static void build_command_line(struct ffmpeg_muxer *stream, struct dstr *cmd,
 	dstr_replace(&stream->path, "\"", "\"\"");
 	dstr_cat_dstr(cmd, &stream->path);
 
-	dstr_catf(cmd, "\" %d %d ", vencoder ? 1 : 0, num_tracks);
+	dstr_catf(cmd, "\" %d %d ", params.has_video, num_tracks);
 
-	if (vencoder)
-		add_video_encoder_params(stream, cmd, vencoder);
+	if (params.has_video)
+		add_video_encoder_params(cmd, &params);
 
 	if (num_tracks) {
 		dstr_cat(cmd, "aac ");
 
 		for (int i = 0; i < num_tracks; i++) {
-			add_audio_encoder_params(cmd, aencoders[i]);
+			add_audio_encoder_params(cmd, &audio[i]);
 		}
 	}
 
@@ -282,6 +344,125 @@ void start_pipe(struct ffmpeg_muxer *stream, const char *path)
 	dstr_free(&cmd);
 }
 
+void get_packet_info(const struct encoder_packet *packet,
+		     struct ffm_packet_info *info)
+{
+	bool is_video = packet->type == OBS_ENCODER_VIDEO;
+
+	info->pts = packet->pts;
+	info->dts = packet->dts;
+	info->size = (uint32_t)packet->size;
+	info->index = (int)packet->track_idx;
+	info->type = is_video ? FFM_PACKET_VIDEO : FFM_PACKET_AUDIO;
+	info->keyframe = packet->keyframe;
+}
+
+/* ------------------------------------------------------------------------ */
+/* in-process muxing
+ *
+ * Runs the same libavformat code as the obs-ffmpeg-mux helper directly in
+ * this process, so packets are not copied through a pipe.  The headers are
+ * passed in the same order as on the pipe, and the file is opened once the
+ * last one has arrived.  libavformat does the file I/O from whichever
+ * thread writes the packets, which for recordings is the write thread. */
+
+struct ffmpeg_mux *create_mux(struct ffmpeg_muxer *stream, const char *file,
+			      const char *muxer_settings,
+			      const char *protocol_settings)
+{
+	struct ffmpeg_mux *ffm = bzalloc(sizeof(*ffm));
+	struct audio_params audio[MAX_AUDIO_MIXES];
+	int num_tracks;
+
+	num_tracks = get_mux_params(stream, &ffm->params, audio);
+	ffm->params.file = file;
+	ffm->params.muxer_settings = muxer_settings ? muxer_settings : "";
+	ffm->params.protocol_settings = protocol_settings;
+
+	if (num_tracks) {
+		/* owned and freed by the muxer */
+		ffm->audio = calloc(num_tracks, sizeof(*ffm->audio));
+		memcpy(ffm->audio, audio, num_tracks * sizeof(*ffm->audio));
+	}
+
+	if (!dstr_is_empty(&stream->stream_key)) {
+		dstr_copy(&ffm->params.printable_file, file);
+		dstr_replace(&ffm->params.printable_file,
+			     stream->stream_key.array, "{stream_key}");
+	}
+
+	ffmpeg_mux_init(ffm);
+	return ffm;
+}
+
+static void start_in_process_mux(struct ffmpeg_muxer *stream,
+				 const char *path)
+{
+	dstr_copy(&stream->path, path);
+	get_muxer_settings(stream, &stream->mux_settings);
+
+	stream->mux = create_mux(stream, stream->path.array,
+				 stream->mux_settings.array, NULL);
+	stream->mux_headers = 0;
+	stream->mux_ret = FFM_SUCCESS;
+}
+
+static bool in_process_write_packets(struct ffmpeg_muxer *stream,
+				     struct encoder_packet *packets,
+				     size_t count)
+{
+	struct ffmpeg_mux *ffm = stream->mux;
+	int num_headers = ffm->params.has_video + ffm->params.tracks;
+
+	for (size_t i = 0; i < count; i++) {
+		struct encoder_packet *packet = &packets[i];
+		struct ffm_packet_info info;
+
+		get_packet_info(packet, &info);
+
+		if (stream->mux_headers < num_headers) {
+			if (info.type == FFM_PACKET_VIDEO &&
+			    !ffm->params.has_video)
+				continue;
+
+			ffmpeg_mux_header(ffm, packet->data, &info);
+
+			if (++stream->mux_headers == num_headers) {
+				stream->mux_ret = ffmpeg_mux_open(ffm);
+				if (stream->mux_ret != FFM_SUCCESS)
+					return false;
+			}
+			continue;
+		}
+
+		if (!ffmpeg_mux_packet(ffm, packet->data, &info))
+			return false;
+
+		stream->total_bytes += packet->size;
+	}
+
+	return true;
+}
+
+/* returns the same kind of code as the helper process exit code */
+static int close_output(struct ffmpeg_muxer *stream)
+{
+	int ret;
+
+	if (stream->mux) {
+		ret = stream->mux_ret;
+		if (ffmpeg_mux_free(stream->mux) < 0 && ret == FFM_SUCCESS)
+			ret = FFM_ERROR;
+		bfree(stream->mux);
+		stream->mux = NULL;
+		return ret;
+	}
+
+	ret = os_process_pipe_destroy(stream->pipe);
+	stream->pipe = NULL;
+	return ret;
+}
+
 static void set_file_not_readable_error(struct ffmpeg_muxer *stream,
 					obs_data_t *settings, const char *path)
 {
@@ -341,16 +522,26 @@ static bool ffmpeg_mux_start(void *data)
 		os_unlink(path);
 	}
 
-	start_pipe(stream, path);
+	stream->in_process = obs_data_get_bool(settings, "in_process");
+	if (stream->in_process)
+		start_in_process_mux(stream, path);
+	else
+		start_pipe(stream, path);
 	obs_data_release(settings);
 
-	if (!stream->pipe) {
+	if (!stream->in_process && !stream->pipe) {
 		obs_output_set_last_error(
 			stream->output, obs_module_text("HelperProcessFailed"));
 		warn("Failed to create process pipe");
 		return false;
 	}
 
+	if (!start_write_thread(stream)) {
+		warn("Failed to create write thread");
+		close_output(stream);
+		return false;
+	}
+
 	/* write headers and start capture */
 	os_atomic_set_bool(&stream->active, true);
 	os_atomic_set_bool(&stream->capturing, true);
@@ -372,11 +563,15 @@ int deactivate(struct ffmpeg_muxer *stream, int code)
 			pthread_join(stream->mux_thread, NULL);
 			stream->mux_thread_joinable = false;
 		}
+
+		hls_stop_segments(stream);
 	}
 
+	/* flushes anything still queued */
+	stop_write_thread(stream);
+
 	if (active(stream)) {
-		ret = os_process_pipe_destroy(stream->pipe);
-		stream->pipe = NULL;
+		ret = close_output(stream);
 
 		os_atomic_set_bool(&stream->active, false);
 		os_atomic_set_bool(&stream->sent_headers, false);
@@ -429,13 +624,20 @@ static void signal_failure(struct ffmpeg_muxer *stream)
 
 	size_t len;
 
-	len = os_process_pipe_read_err(stream->pipe, (uint8_t *)error,
-				       sizeof(error) - 1);
+	if (stream->mux) {
+		/* already logged by the muxer */
+		if (*stream->mux->error)
+			obs_output_set_last_error(stream->output,
+						  stream->mux->error);
+	} else {
+		len = os_process_pipe_read_err(stream->pipe, (uint8_t *)error,
+					       sizeof(error) - 1);
 
-	if (len > 0) {
-		error[len] = 0;
-		warn("ffmpeg-mux: %s", error);
-		obs_output_set_last_error(stream->output, error);
+		if (len > 0) {
+			error[len] = 0;
+			warn("ffmpeg-mux: %s", error);
+			obs_output_set_last_error(stream->output, error);
+		}
 	}
 
 	ret = deactivate(stream, 0);
@@ -456,38 +658,220 @@ static void signal_failure(struct ffmpeg_muxer *stream)
 	os_atomic_set_bool(&stream->capturing, false);
 }
 
-bool write_packet(struct ffmpeg_muxer *stream, struct encoder_packet *packet)
+static bool pipe_write_packets(struct ffmpeg_muxer *stream,
+			       struct encoder_packet *packets, size_t count)
 {
-	bool is_video = packet->type == OBS_ENCODER_VIDEO;
-	size_t ret;
-
-	struct ffm_packet_info info = {.pts = packet->pts,
-				       .dts = packet->dts,
-				       .size = (uint32_t)packet->size,
-				       .index = (int)packet->track_idx,
-				       .type = is_video ? FFM_PACKET_VIDEO
-							: FFM_PACKET_AUDIO,
-				       .keyframe = packet->keyframe};
-
-	ret = os_process_pipe_write(stream->pipe, (const uint8_t *)&info,
-				    sizeof(info));
-	if (ret != sizeof(info)) {
-		warn("os_process_pipe_write for info structure failed");
-		signal_failure(stream);
-		return false;
+	struct ffm_packet_info info[FFM_WRITE_BATCH];
+	struct os_pipe_buffer bufs[FFM_WRITE_BATCH * 2];
+
+	while (count) {
+		size_t num = count > FFM_WRITE_BATCH ? FFM_WRITE_BATCH : count;
+		size_t payload_size = 0;
+		size_t total = 0;
+
+		for (size_t i = 0; i < num; i++) {
+			struct encoder_packet *packet = &packets[i];
+
+			get_packet_info(packet, &info[i]);
+
+			bufs[i * 2].data = (const uint8_t *)&info[i];
+			bufs[i * 2].len = sizeof(info[i]);
+			bufs[i * 2 + 1].data = packet->data;
+			bufs[i * 2 + 1].len = packet->size;
+
+			payload_size += packet->size;
+		}
+
+		total = payload_size + num * sizeof(info[0]);
+		if (os_process_pipe_writev(stream->pipe, bufs, num * 2) !=
+		    total)
+			return false;
+
+		stream->total_bytes += payload_size;
+		packets += num;
+		count -= num;
 	}
 
-	ret = os_process_pipe_write(stream->pipe, packet->data, packet->size);
-	if (ret != packet->size) {
-		warn("os_process_pipe_write for packet data failed");
+	return true;
+}
+
+static inline bool output_write_packets(struct ffmpeg_muxer *stream,
+					struct encoder_packet *packets,
+					size_t count)
+{
+	return stream->mux ? in_process_write_packets(stream, packets, count)
+			   : pipe_write_packets(stream, packets, count);
+}
+
+static void warn_write_failed(struct ffmpeg_muxer *stream)
+{
+	if (stream->mux)
+		warn("Failed to mux packets");
+	else
+		warn("os_process_pipe_writev for packets failed");
+}
+
+bool write_packets(struct ffmpeg_muxer *stream, struct encoder_packet *packets,
+		   size_t count)
+{
+	if (!output_write_packets(stream, packets, count)) {
+		warn_write_failed(stream);
 		signal_failure(stream);
 		return false;
 	}
 
-	stream->total_bytes += packet->size;
 	return true;
 }
 
+bool write_packet(struct ffmpeg_muxer *stream, struct encoder_packet *packet)
+{
+	return write_packets(stream, packet, 1);
+}
+
+/* ------------------------------------------------------------------------ */
+/* recording write thread
+ *
+ * Packets are queued by the encoder thread and written to the pipe in
+ * batches, so that pipe I/O stays off the encode path and each batch of
+ * headers and payloads goes out with one gathered write.  When muxing
+ * in-process, this is also the thread that does the file I/O. */
+
+static size_t pop_write_batch(struct ffmpeg_muxer *stream,
+			      struct encoder_packet *batch)
+{
+	size_t count;
+
+	pthread_mutex_lock(&stream->write_mutex);
+
+	count = stream->packets.size / sizeof(*batch);
+	if (count > FFM_WRITE_BATCH)
+		count = FFM_WRITE_BATCH;
+	if (count)
+		circlebuf_pop_front(&stream->packets, batch,
+				    count * sizeof(*batch));
+
+	pthread_mutex_unlock(&stream->write_mutex);
+
+	for (size_t i = 0; i < count; i++)
+		os_sem_post(stream->write_space_sem);
+
+	return count;
+}
+
+static void *ffmpeg_mux_write_thread(void *data)
+{
+	struct ffmpeg_muxer *stream = data;
+	struct encoder_packet batch[FFM_WRITE_BATCH];
+	bool stop = false;
+
+	os_set_thread_name("ffmpeg-mux: write thread");
+
+	while (!stop && os_sem_wait(stream->write_sem) == 0) {
+		size_t count;
+
+		/* still write out whatever is queued when stopping */
+		stop = os_event_try(stream->stop_event) == 0;
+
+		while ((count = pop_write_batch(stream, batch)) > 0) {
+			bool success =
+				output_write_packets(stream, batch, count);
+
+			for (size_t i = 0; i < count; i++)
+				obs_encoder_packet_release(&batch[i]);
+
+			if (!success) {
+				/* reported from the encoder thread, which
+				 * may be waiting for space in the queue */
+				os_atomic_set_bool(&stream->write_failed, true);
+				os_sem_post(stream->write_space_sem);
+				return NULL;
+			}
+		}
+	}
+
+	return NULL;
+}
+
+static bool start_write_thread(struct ffmpeg_muxer *stream)
+{
+	pthread_mutex_init_value(&stream->write_mutex);
+
+	if (pthread_mutex_init(&stream->write_mutex, NULL) != 0)
+		return false;
+
+	stream->threaded_writes = true;
+	os_atomic_set_bool(&stream->write_failed, false);
+
+	if (os_sem_init(&stream->write_sem, 0) != 0)
+		goto fail;
+	if (os_sem_init(&stream->write_space_sem, FFM_MAX_QUEUED_PACKETS) != 0)
+		goto fail;
+	if (os_event_init(&stream->stop_event, OS_EVENT_TYPE_AUTO) != 0)
+		goto fail;
+
+	stream->mux_thread_joinable =
+		pthread_create(&stream->mux_thread, NULL,
+			       ffmpeg_mux_write_thread, stream) == 0;
+	if (!stream->mux_thread_joinable)
+		goto fail;
+
+	return true;
+
+fail:
+	stop_write_thread(stream);
+	return false;
+}
+
+static void stop_write_thread(struct ffmpeg_muxer *stream)
+{
+	if (!stream->threaded_writes)
+		return;
+
+	if (stream->mux_thread_joinable) {
+		os_event_signal(stream->stop_event);
+		os_sem_post(stream->write_sem);
+		pthread_join(stream->mux_thread, NULL);
+		stream->mux_thread_joinable = false;
+	}
+
+	while (stream->packets.size) {
+		struct encoder_packet packet;
+		circlebuf_pop_front(&stream->packets, &packet, sizeof(packet));
+		obs_encoder_packet_release(&packet);
+	}
+
+	pthread_mutex_destroy(&stream->write_mutex);
+	os_sem_destroy(stream->write_sem);
+	os_sem_destroy(stream->write_space_sem);
+	os_event_destroy(stream->stop_event);
+	stream->write_sem = NULL;
+	stream->write_space_sem = NULL;
+	stream->stop_event = NULL;
+	stream->threaded_writes = false;
+}
+
+static void queue_packet(struct ffmpeg_muxer *stream,
+			 struct encoder_packet *packet)
+{
+	struct encoder_packet ref;
+
+	os_sem_wait(stream->write_space_sem);
+
+	if (os_atomic_load_bool(&stream->write_failed)) {
+		warn_write_failed(stream);
+		signal_failure(stream);
+		return;
+	}
+
+	obs_encoder_packet_ref(&ref, packet);
+
+	pthread_mutex_lock(&stream->write_mutex);
+	circlebuf_push_back(&stream->packets, &ref, sizeof(ref));
+	pthread_mutex_unlock(&stream->write_mutex);
+
+	os_sem_post(stream->write_sem);
+}
+
 static bool send_audio_headers(struct ffmpeg_muxer *stream,
 			       obs_encoder_t *aencoder, size_t idx)
 {
@@ -557,7 +941,7 @@ static void ffmpeg_mux_data(void *data, struct encoder_packet *packet)
 		}
 	}
 
-	write_packet(stream, packet);
+	queue_packet(stream, packet);
 }
 
 static obs_properties_t *ffmpeg_mux_properties(void *unused)
@@ -568,6 +952,8 @@ static obs_properties_t *ffmpeg_mux_properties(void *unused)
 
 	obs_properties_add_text(props, "path", obs_module_text("FilePath"),
 				OBS_TEXT_DEFAULT);
+	obs_properties_add_bool(props, "in_process",
+				obs_module_text("InProcessMux"));
 	return props;
 }
 
@@ -650,6 +1036,31 @@ static void replay_buffer_hotkey(void *data, obs_hotkey_id id,
 			return;
 		}
 
+		stream->save_duration = 0;
+		stream->save_ts = os_gettime_ns() / 1000LL;
+	}
+}
+
+/* saves at least the last N seconds, starting from a keyframe */
+static void save_replay_seconds_proc(void *data, calldata_t *cd)
+{
+	struct ffmpeg_muxer *stream = data;
+	long long seconds = calldata_int(cd, "seconds");
+
+	if (seconds <= 0) {
+		replay_buffer_hotkey(data, 0, NULL, true);
+		return;
+	}
+
+	if (os_atomic_load_bool(&stream->active)) {
+		obs_encoder_t *vencoder =
+			obs_output_get_video_encoder(stream->output);
+		if (obs_encoder_paused(vencoder)) {
+			info("Could not save buffer because encoders paused");
+			return;
+		}
+
+		stream->save_duration = seconds * 1000000LL;
 		stream->save_ts = os_gettime_ns() / 1000LL;
 	}
 }
@@ -673,6 +1084,12 @@ static void *replay_buffer_create(obs_data_t *settings, obs_output_t *output)
 	struct ffmpeg_muxer *stream = bzalloc(sizeof(*stream));
 	stream->output = output;
 
+	pthread_mutex_init_value(&stream->packets_mutex);
+	if (pthread_mutex_init(&stream->packets_mutex, NULL) != 0) {
+		bfree(stream);
+		return NULL;
+	}
+
 	stream->hotkey =
 		obs_hotkey_register_output(output, "ReplayBuffer.Save",
 					   obs_module_text("ReplayBuffer.Save"),
@@ -680,6 +1097,8 @@ static void *replay_buffer_create(obs_data_t *settings, obs_output_t *output)
 
 	proc_handler_t *ph = obs_output_get_proc_handler(output);
 	proc_handler_add(ph, "void save()", save_replay_proc, stream);
+	proc_handler_add(ph, "void save_seconds(int seconds)",
+			 save_replay_seconds_proc, stream);
 	proc_handler_add(ph, "void get_last_replay(out string path)",
 			 get_last_replay, stream);
 
@@ -689,14 +1108,70 @@ static void *replay_buffer_create(obs_data_t *settings, obs_output_t *output)
 	return stream;
 }
 
+/* waits for any save still running, then drops what it left behind */
+static void replay_buffer_reset(struct ffmpeg_muxer *stream)
+{
+	if (stream->mux_thread_joinable) {
+		pthread_join(stream->mux_thread, NULL);
+		stream->mux_thread_joinable = false;
+	}
+
+	replay_buffer_clear(stream);
+	replay_ring_free(&stream->ring);
+	stream->clear_after_save = false;
+}
+
 static void replay_buffer_destroy(void *data)
 {
 	struct ffmpeg_muxer *stream = data;
 	if (stream->hotkey)
 		obs_hotkey_unregister(stream->hotkey);
+	replay_buffer_reset(stream);
+	pthread_mutex_destroy(&stream->packets_mutex);
 	ffmpeg_mux_destroy(data);
 }
 
+/* spare room in the ring file beyond max_size, so a save can still read the
+ * oldest packets while new ones keep coming in */
+#define RING_SLACK_DIVISOR 4
+
+static bool replay_buffer_init_ring(struct ffmpeg_muxer *stream,
+				    obs_data_t *settings)
+{
+	const char *dir = obs_data_get_string(settings, "disk_buffer_dir");
+	uint64_t capacity;
+	struct dstr path = {0};
+	char *filename;
+	bool success;
+
+	if (!stream->max_size) {
+		warn("A disk buffer needs a maximum size");
+		return false;
+	}
+
+	if (!dir || !*dir)
+		dir = obs_data_get_string(settings, "directory");
+
+	filename = os_generate_formatted_filename(
+		"tmp", false, "replay-buffer-%CCYY-%MM-%DD-%hh-%mm-%ss");
+	dstr_copy(&path, dir);
+	dstr_replace(&path, "\\", "/");
+	if (dstr_end(&path) != '/')
+		dstr_cat_ch(&path, '/');
+	dstr_cat(&path, filename);
+	bfree(filename);
+
+	capacity = (uint64_t)stream->max_size;
+	capacity += capacity / RING_SLACK_DIVISOR;
+
+	success = replay_ring_init(&stream->ring, path.array, capacity);
+	if (success)
+		info("Buffering replay packets in '%s'", path.array);
+
+	dstr_free(&path);
+	return success;
+}
+
 static bool replay_buffer_start(void *data)
 {
 	struct ffmpeg_muxer *stream = data;
@@ -706,9 +1181,19 @@ static bool replay_buffer_start(void *data)
 	if (!obs_output_initialize_encoders(stream->output, 0))
 		return false;
 
+	replay_buffer_reset(stream);
+
 	obs_data_t *s = obs_output_get_settings(stream->output);
 	stream->max_time = obs_data_get_int(s, "max_time_sec") * 1000000LL;
 	stream->max_size = obs_data_get_int(s, "max_size_mb") * (1024 * 1024);
+	stream->in_process = obs_data_get_bool(s, "in_process");
+	stream->disk_buffer = obs_data_get_bool(s, "disk_buffer");
+
+	if (stream->disk_buffer && !replay_buffer_init_ring(stream, s)) {
+		obs_data_release(s);
+		return false;
+	}
+
 	obs_data_release(s);
 
 	os_atomic_set_bool(&stream->active, true);
@@ -719,106 +1204,229 @@ static bool replay_buffer_start(void *data)
 	return true;
 }
 
-static bool purge_front(struct ffmpeg_muxer *stream)
+static inline size_t num_gops(struct ffmpeg_muxer *stream)
+{
+	return stream->gops.size / sizeof(struct replay_gop);
+}
+
+static inline struct replay_gop *get_gop(struct ffmpeg_muxer *stream,
+					 size_t idx)
+{
+	return circlebuf_data(&stream->gops, idx * sizeof(struct replay_gop));
+}
+
+/* drops the first count packets, front_bytes is the byte count at the new
+ * front */
+static void drop_packets(struct ffmpeg_muxer *stream, size_t count,
+			 uint64_t front_bytes)
 {
-	struct encoder_packet pkt;
-	bool keyframe;
+	const size_t size = sizeof(struct replay_packet);
 
-	circlebuf_pop_front(&stream->packets, &pkt, sizeof(pkt));
+	if (!stream->disk_buffer) {
+		for (size_t i = 0; i < count; i++) {
+			struct replay_packet *rp =
+				circlebuf_data(&stream->packets, i * size);
+			obs_encoder_packet_release(&rp->packet);
+		}
+	}
 
-	keyframe = pkt.type == OBS_ENCODER_VIDEO && pkt.keyframe;
+	circlebuf_pop_front(&stream->packets, NULL, count * size);
+	stream->first_seq += count;
+	stream->front_bytes = front_bytes;
 
-	if (keyframe)
-		stream->keyframes--;
+	while (num_gops(stream) && get_gop(stream, 0)->seq < stream->first_seq)
+		circlebuf_pop_front(&stream->gops, NULL,
+				    sizeof(struct replay_gop));
 
 	if (!stream->packets.size) {
 		stream->cur_size = 0;
 		stream->cur_time = 0;
 	} else {
-		struct encoder_packet first;
-		circlebuf_peek_front(&stream->packets, &first, sizeof(first));
-		stream->cur_time = first.dts_usec;
-		stream->cur_size -= (int64_t)pkt.size;
+		struct replay_packet *first =
+			circlebuf_data(&stream->packets, 0);
+		stream->cur_time = first->packet.dts_usec;
+		stream->cur_size =
+			(int64_t)(stream->bytes_in - stream->front_bytes);
 	}
-
-	obs_encoder_packet_release(&pkt);
-	return keyframe;
 }
 
-static inline void purge(struct ffmpeg_muxer *stream)
+/* drops the oldest GOP (or the packets before the first keyframe) at once.
+ * returns false if there is no later keyframe to purge up to, or if a save
+ * still needs the packets. */
+static bool purge(struct ffmpeg_muxer *stream)
 {
-	if (purge_front(stream)) {
-		struct encoder_packet pkt;
+	struct replay_gop *next;
+	size_t idx;
 
-		for (;;) {
-			circlebuf_peek_front(&stream->packets, &pkt,
-					     sizeof(pkt));
-			if (pkt.type == OBS_ENCODER_VIDEO && pkt.keyframe)
-				return;
+	if (!num_gops(stream))
+		return false;
 
-			purge_front(stream);
-		}
-	}
+	idx = get_gop(stream, 0)->seq == stream->first_seq ? 1 : 0;
+	if (idx >= num_gops(stream))
+		return false;
+
+	next = get_gop(stream, idx);
+	if (stream->pinned && next->seq > stream->pin_seq)
+		return false;
+
+	drop_packets(stream, (size_t)(next->seq - stream->first_seq),
+		     next->start_bytes);
+	return true;
 }
 
+/* always keeps at least two GOPs */
 static inline void replay_buffer_purge(struct ffmpeg_muxer *stream,
 				       struct encoder_packet *pkt)
 {
 	if (stream->max_size) {
-		if (!stream->packets.size || stream->keyframes <= 2)
+		while (num_gops(stream) > 2 &&
+		       (stream->cur_size + (int64_t)pkt->size) >
+			       stream->max_size) {
+			if (!purge(stream))
+				return;
+		}
+	}
+
+	while (num_gops(stream) > 2 &&
+	       (pkt->dts_usec - stream->cur_time) > stream->max_time) {
+		if (!purge(stream))
 			return;
+	}
+}
 
-		while ((stream->cur_size + (int64_t)pkt->size) >
-		       stream->max_size)
-			purge(stream);
+/* drops packets the ring file has already wrapped over, which only happens
+ * if the ring is too small for the bitrate */
+static inline void purge_overwritten(struct ffmpeg_muxer *stream)
+{
+	while (stream->packets.size) {
+		struct replay_packet *rp = circlebuf_data(&stream->packets, 0);
+		if (replay_ring_valid(&stream->ring, rp->pos))
+			break;
+		if (stream->pinned && stream->first_seq >= stream->pin_seq)
+			break;
+
+		drop_packets(stream, 1, stream->front_bytes + rp->packet.size);
 	}
+}
 
-	if (!stream->packets.size || stream->keyframes <= 2)
-		return;
+/* ------------------------------------------------------------------------- */
+/* saving
+ *
+ * A save pins the packets buffered at the time it was requested and streams
+ * them from the mux thread, rather than copying the whole buffer first.
+ * Each stream (video, then each audio track) has a cursor to its next packet;
+ * the packets are written in dts order by always picking the cursor with the
+ * lowest dts.  As cursors move on, the pin moves with them, so the encoder
+ * thread can purge what has already been written. */
+
+#define REPLAY_STREAMS (1 + MAX_AUDIO_MIXES)
+
+struct replay_cursor {
+	uint64_t seq;
+	bool has_packet;
+	uint64_t packet_seq;
+	struct replay_packet rp;
+
+	bool found;
+	int64_t offset;
+	int64_t dts_offset;
+};
 
-	while ((pkt->dts_usec - stream->cur_time) > stream->max_time)
-		purge(stream);
+static inline bool is_replay_stream(struct encoder_packet *pkt, size_t idx)
+{
+	if (idx == 0)
+		return pkt->type == OBS_ENCODER_VIDEO;
+	return pkt->type == OBS_ENCODER_AUDIO && pkt->track_idx == idx - 1;
 }
 
-static void insert_packet(struct darray *array, struct encoder_packet *packet,
-			  int64_t video_offset, int64_t *audio_offsets,
-			  int64_t video_dts_offset, int64_t *audio_dts_offsets)
+static void advance_cursor(struct ffmpeg_muxer *stream,
+			   struct replay_cursor *cursor, size_t idx)
 {
-	struct encoder_packet pkt;
-	DARRAY(struct encoder_packet) packets;
-	packets.da = *array;
-	size_t idx;
+	const size_t size = sizeof(struct replay_packet);
+	struct encoder_packet *pkt = &cursor->rp.packet;
 
-	obs_encoder_packet_ref(&pkt, packet);
+	cursor->has_packet = false;
 
-	if (pkt.type == OBS_ENCODER_VIDEO) {
-		pkt.dts_usec -= video_offset;
-		pkt.dts -= video_dts_offset;
-		pkt.pts -= video_dts_offset;
-	} else {
-		pkt.dts_usec -= audio_offsets[pkt.track_idx];
-		pkt.dts -= audio_dts_offsets[pkt.track_idx];
-		pkt.pts -= audio_dts_offsets[pkt.track_idx];
-	}
+	pthread_mutex_lock(&stream->packets_mutex);
+
+	for (; cursor->seq < stream->save_end_seq; cursor->seq++) {
+		size_t offset = (size_t)(cursor->seq - stream->first_seq);
+		struct replay_packet *rp =
+			circlebuf_data(&stream->packets, offset * size);
 
-	for (idx = packets.num; idx > 0; idx--) {
-		struct encoder_packet *p = packets.array + (idx - 1);
-		if (p->dts_usec < pkt.dts_usec)
+		if (is_replay_stream(&rp->packet, idx)) {
+			cursor->rp = *rp;
+			cursor->packet_seq = cursor->seq++;
+			cursor->has_packet = true;
 			break;
+		}
+	}
+
+	pthread_mutex_unlock(&stream->packets_mutex);
+
+	if (!cursor->has_packet)
+		return;
+
+	if (!cursor->found) {
+		cursor->offset = pkt->dts_usec;
+		cursor->dts_offset = pkt->dts;
+		cursor->found = true;
+	}
+
+	pkt->dts_usec -= cursor->offset;
+	pkt->dts -= cursor->dts_offset;
+	pkt->pts -= cursor->dts_offset;
+}
+
+static struct replay_cursor *next_cursor(struct replay_cursor *cursors)
+{
+	struct replay_cursor *next = NULL;
+
+	for (size_t i = 0; i < REPLAY_STREAMS; i++) {
+		struct replay_cursor *cursor = &cursors[i];
+		if (!cursor->has_packet)
+			continue;
+
+		if (!next ||
+		    cursor->rp.packet.dts_usec < next->rp.packet.dts_usec ||
+		    (cursor->rp.packet.dts_usec == next->rp.packet.dts_usec &&
+		     cursor->packet_seq < next->packet_seq))
+			next = cursor;
+	}
+
+	return next;
+}
+
+static void update_pin(struct ffmpeg_muxer *stream,
+		       struct replay_cursor *cursors)
+{
+	uint64_t pin = stream->save_end_seq;
+
+	for (size_t i = 0; i < REPLAY_STREAMS; i++) {
+		if (cursors[i].has_packet && cursors[i].packet_seq < pin)
+			pin = cursors[i].packet_seq;
 	}
 
-	da_insert(packets, idx, &pkt);
-	*array = packets.da;
+	pthread_mutex_lock(&stream->packets_mutex);
+	stream->pin_seq = pin;
+	pthread_mutex_unlock(&stream->packets_mutex);
 }
 
 static void *replay_buffer_mux_thread(void *data)
 {
 	struct ffmpeg_muxer *stream = data;
+	struct replay_cursor cursors[REPLAY_STREAMS] = {0};
+	struct replay_cursor *cursor;
+	uint8_t *buf = NULL;
+	size_t buf_size = 0;
 	bool error = false;
 
-	start_pipe(stream, stream->path.array);
+	if (stream->in_process)
+		start_in_process_mux(stream, stream->path.array);
+	else
+		start_pipe(stream, stream->path.array);
 
-	if (!stream->pipe) {
+	if (!stream->in_process && !stream->pipe) {
 		warn("Failed to create process pipe");
 		error = true;
 		goto error;
@@ -831,18 +1439,56 @@ static void *replay_buffer_mux_thread(void *data)
 		goto error;
 	}
 
-	for (size_t i = 0; i < stream->mux_packets.num; i++) {
-		struct encoder_packet *pkt = &stream->mux_packets.array[i];
-		write_packet(stream, pkt);
-		obs_encoder_packet_release(pkt);
+	for (size_t i = 0; i < REPLAY_STREAMS; i++) {
+		cursors[i].seq = stream->pin_seq;
+		advance_cursor(stream, &cursors[i], i);
+	}
+
+	while ((cursor = next_cursor(cursors)) != NULL) {
+		struct encoder_packet *pkt = &cursor->rp.packet;
+
+		if (stream->disk_buffer) {
+			if (buf_size < pkt->size) {
+				buf_size = pkt->size;
+				buf = brealloc(buf, buf_size);
+			}
+
+			if (!replay_ring_read(&stream->ring, cursor->rp.pos,
+					      buf, pkt->size)) {
+				warn("Replay buffer was overwritten while "
+				     "saving '%s'",
+				     stream->path.array);
+				error = true;
+				goto error;
+			}
+
+			pkt->data = buf;
+		}
+
+		if (!write_packet(stream, pkt)) {
+			error = true;
+			goto error;
+		}
+
+		advance_cursor(stream, cursor, (size_t)(cursor - cursors));
+		update_pin(stream, cursors);
 	}
 
 	info("Wrote replay buffer to '%s'", stream->path.array);
 
 error:
-	os_process_pipe_destroy(stream->pipe);
-	stream->pipe = NULL;
-	da_free(stream->mux_packets);
+	close_output(stream);
+	bfree(buf);
+
+	pthread_mutex_lock(&stream->packets_mutex);
+	stream->pinned = false;
+	if (stream->clear_after_save) {
+		replay_buffer_clear(stream);
+		replay_ring_free(&stream->ring);
+		stream->clear_after_save = false;
+	}
+	pthread_mutex_unlock(&stream->packets_mutex);
+
 	os_atomic_set_bool(&stream->muxing, false);
 
 	if (!error) {
@@ -855,45 +1501,37 @@ error:
 	return NULL;
 }
 
-static void replay_buffer_save(struct ffmpeg_muxer *stream)
+/* finds the latest keyframe at least save_duration before the newest packet
+ * with a binary search of the GOP index, or the front if the buffer is not
+ * that long */
+static uint64_t find_save_start(struct ffmpeg_muxer *stream)
 {
-	const size_t size = sizeof(struct encoder_packet);
-	size_t num_packets = stream->packets.size / size;
-
-	da_reserve(stream->mux_packets, num_packets);
+	const size_t size = sizeof(struct replay_packet);
+	struct replay_packet *last;
+	size_t lo = 0;
+	size_t hi = num_gops(stream);
+	int64_t start;
+
+	if (!stream->save_duration || !hi || !stream->packets.size)
+		return stream->first_seq;
+
+	last = circlebuf_data(&stream->packets, stream->packets.size - size);
+	start = last->packet.dts_usec - stream->save_duration;
+
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		if (get_gop(stream, mid)->dts_usec <= start)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
 
-	/* ---------------------------- */
-	/* reorder packets */
-
-	bool found_video = false;
-	bool found_audio[MAX_AUDIO_MIXES] = {0};
-	int64_t video_offset = 0;
-	int64_t video_dts_offset = 0;
-	int64_t audio_offsets[MAX_AUDIO_MIXES] = {0};
-	int64_t audio_dts_offsets[MAX_AUDIO_MIXES] = {0};
-
-	for (size_t i = 0; i < num_packets; i++) {
-		struct encoder_packet *pkt;
-		pkt = circlebuf_data(&stream->packets, i * size);
-
-		if (pkt->type == OBS_ENCODER_VIDEO) {
-			if (!found_video) {
-				video_offset = pkt->dts_usec;
-				video_dts_offset = pkt->dts;
-				found_video = true;
-			}
-		} else {
-			if (!found_audio[pkt->track_idx]) {
-				found_audio[pkt->track_idx] = true;
-				audio_offsets[pkt->track_idx] = pkt->dts_usec;
-				audio_dts_offsets[pkt->track_idx] = pkt->dts;
-			}
-		}
+	return lo ? get_gop(stream, lo - 1)->seq : stream->first_seq;
+}
 
-		insert_packet(&stream->mux_packets.da, pkt, video_offset,
-			      audio_offsets, video_dts_offset,
-			      audio_dts_offsets);
-	}
+static void replay_buffer_save(struct ffmpeg_muxer *stream)
+{
+	const size_t size = sizeof(struct replay_packet);
 
 	/* ---------------------------- */
 	/* generate filename */
@@ -924,10 +1562,24 @@ static void replay_buffer_save(struct ffmpeg_muxer *stream)
 
 	/* ---------------------------- */
 
+	pthread_mutex_lock(&stream->packets_mutex);
+	stream->pin_seq = find_save_start(stream);
+	stream->save_end_seq = stream->first_seq + stream->packets.size / size;
+	stream->pinned = true;
+	pthread_mutex_unlock(&stream->packets_mutex);
+
 	os_atomic_set_bool(&stream->muxing, true);
 	stream->mux_thread_joinable = pthread_create(&stream->mux_thread, NULL,
 						     replay_buffer_mux_thread,
 						     stream) == 0;
+
+	if (!stream->mux_thread_joinable) {
+		warn("Failed to create replay buffer mux thread");
+		pthread_mutex_lock(&stream->packets_mutex);
+		stream->pinned = false;
+		pthread_mutex_unlock(&stream->packets_mutex);
+		os_atomic_set_bool(&stream->muxing, false);
+	}
 }
 
 static void deactivate_replay_buffer(struct ffmpeg_muxer *stream, int code)
@@ -941,13 +1593,24 @@ static void deactivate_replay_buffer(struct ffmpeg_muxer *stream, int code)
 	os_atomic_set_bool(&stream->active, false);
 	os_atomic_set_bool(&stream->sent_headers, false);
 	os_atomic_set_bool(&stream->stopping, false);
-	replay_buffer_clear(stream);
+
+	pthread_mutex_lock(&stream->packets_mutex);
+	if (stream->pinned) {
+		/* a save is still reading the packets, it clears them once
+		 * it is done */
+		stream->clear_after_save = true;
+	} else {
+		replay_buffer_clear(stream);
+		replay_ring_free(&stream->ring);
+	}
+	pthread_mutex_unlock(&stream->packets_mutex);
 }
 
 static void replay_buffer_data(void *data, struct encoder_packet *packet)
 {
 	struct ffmpeg_muxer *stream = data;
-	struct encoder_packet pkt;
+	struct replay_packet rp = {0};
+	struct encoder_packet *pkt = &rp.packet;
 
 	if (!active(stream))
 		return;
@@ -965,17 +1628,45 @@ static void replay_buffer_data(void *data, struct encoder_packet *packet)
 		}
 	}
 
-	obs_encoder_packet_ref(&pkt, packet);
-	replay_buffer_purge(stream, &pkt);
+	if (stream->disk_buffer) {
+		*pkt = *packet;
+		pkt->data = NULL;
+
+		if (!replay_ring_write(&stream->ring, packet->data,
+				       packet->size, &rp.pos)) {
+			warn("Packet too large for the replay buffer file");
+			deactivate_replay_buffer(stream,
+						 OBS_OUTPUT_ENCODE_ERROR);
+			return;
+		}
+	} else {
+		obs_encoder_packet_ref(pkt, packet);
+	}
+
+	pthread_mutex_lock(&stream->packets_mutex);
+
+	replay_buffer_purge(stream, pkt);
+	if (stream->disk_buffer)
+		purge_overwritten(stream);
+
+	if (packet->type == OBS_ENCODER_VIDEO && packet->keyframe) {
+		struct replay_gop gop = {
+			.seq = stream->first_seq +
+			       stream->packets.size / sizeof(rp),
+			.dts_usec = pkt->dts_usec,
+			.start_bytes = stream->bytes_in,
+		};
+		circlebuf_push_back(&stream->gops, &gop, sizeof(gop));
+	}
 
 	if (!stream->packets.size)
-		stream->cur_time = pkt.dts_usec;
-	stream->cur_size += pkt.size;
+		stream->cur_time = pkt->dts_usec;
+	stream->cur_size += pkt->size;
+	stream->bytes_in += pkt->size;
 
-	circlebuf_push_back(&stream->packets, packet, sizeof(*packet));
+	circlebuf_push_back(&stream->packets, &rp, sizeof(rp));
 
-	if (packet->type == OBS_ENCODER_VIDEO && packet->keyframe)
-		stream->keyframes++;
+	pthread_mutex_unlock(&stream->packets_mutex);
 
 	if (stream->save_ts && packet->sys_dts_usec >= stream->save_ts) {
 		if (os_atomic_load_bool(&stream->muxing))
@@ -998,6 +1689,7 @@ static void replay_buffer_defaults(obs_data_t *s)
 	obs_data_set_default_string(s, "format", "%CCYY-%MM-%DD %hh-%mm-%ss");
 	obs_data_set_default_string(s, "extension", "mp4");
 	obs_data_set_default_bool(s, "allow_spaces", true);
+	obs_data_set_default_bool(s, "disk_buffer", false);
 }
 
 struct obs_output_info replay_buffer = {
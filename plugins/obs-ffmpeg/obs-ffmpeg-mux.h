@@ -10,6 +10,27 @@
 #include <util/platform.h>
 #include <util/threading.h>
 
+#include "obs-ffmpeg-hls-segments.h"
+#include "obs-ffmpeg-replay-ring.h"
+
+struct ffmpeg_mux;
+struct ffm_packet_info;
+
+/* a buffered replay packet.  with a disk buffer, packet.data is NULL and the
+ * payload is in the ring at pos. */
+struct replay_packet {
+	struct encoder_packet packet;
+	uint64_t pos;
+};
+
+/* replay buffer GOP index entry, one per buffered video keyframe.
+ * start_bytes is the number of bytes buffered before the keyframe. */
+struct replay_gop {
+	uint64_t seq;
+	int64_t dts_usec;
+	uint64_t start_bytes;
+};
+
 struct ffmpeg_muxer {
 	obs_output_t *output;
 	os_process_pipe_t *pipe;
@@ -30,25 +51,60 @@ struct ffmpeg_muxer {
 	int64_t max_size;
 	int64_t max_time;
 	int64_t save_ts;
-	int keyframes;
+	int64_t save_duration;
 	obs_hotkey_id hotkey;
 	volatile bool muxing;
-	DARRAY(struct encoder_packet) mux_packets;
+	bool disk_buffer;
+	struct replay_ring ring;
+
+	/* packets is filled and purged by the encoder thread while a save
+	 * reads it from the mux thread.  packets_mutex guards packets and the
+	 * fields below.  first_seq numbers the front packet; while pinned,
+	 * packets from pin_seq on are still needed by the save and must not
+	 * be purged.  gops indexes the keyframes in packets, bytes_in and
+	 * front_bytes count the bytes ever buffered and ever purged. */
+	pthread_mutex_t packets_mutex;
+	struct circlebuf gops;
+	uint64_t bytes_in;
+	uint64_t front_bytes;
+	uint64_t first_seq;
+	uint64_t pin_seq;
+	uint64_t save_end_seq;
+	bool pinned;
+	bool clear_after_save;
 
-	/* these are accessed both by replay buffer and by HLS */
+	/* these are accessed by replay buffer, HLS and the recording write
+	 * thread.  the replay buffer stores struct replay_packet in packets,
+	 * the others struct encoder_packet. */
 	pthread_t mux_thread;
 	bool mux_thread_joinable;
 	struct circlebuf packets;
 
-	/* HLS only */
-	int keyint_sec;
+	/* HLS and the recording write thread */
 	pthread_mutex_t write_mutex;
 	os_sem_t *write_sem;
 	os_event_t *stop_event;
+
+	/* recording write thread only */
+	bool threaded_writes;
+	os_sem_t *write_space_sem;
+	volatile bool write_failed;
+
+	/* in-process muxing, used instead of the helper process */
+	bool in_process;
+	struct ffmpeg_mux *mux;
+	struct dstr mux_settings;
+	int mux_headers;
+	int mux_ret;
+
+	/* HLS only */
+	int keyint_sec;
 	bool is_hls;
 	int dropped_frames;
 	int min_priority;
 	int64_t last_dts_usec;
+	struct hls_segment_pool *segments;
+	struct hls_segment_stats segment_stats;
 
 	bool is_network;
 };
@@ -56,8 +112,16 @@ struct ffmpeg_muxer {
 bool stopping(struct ffmpeg_muxer *stream);
 bool active(struct ffmpeg_muxer *stream);
 void start_pipe(struct ffmpeg_muxer *stream, const char *path);
+struct ffmpeg_mux *create_mux(struct ffmpeg_muxer *stream, const char *file,
+			      const char *muxer_settings,
+			      const char *protocol_settings);
+void get_packet_info(const struct encoder_packet *packet,
+		     struct ffm_packet_info *info);
 bool write_packet(struct ffmpeg_muxer *stream, struct encoder_packet *packet);
+bool write_packets(struct ffmpeg_muxer *stream, struct encoder_packet *packets,
+		   size_t count);
 bool send_headers(struct ffmpeg_muxer *stream);
 int deactivate(struct ffmpeg_muxer *stream, int code);
+void hls_stop_segments(struct ffmpeg_muxer *stream);
 void ffmpeg_mux_stop(void *data, uint64_t ts);
 uint64_t ffmpeg_mux_total_bytes(void *data);
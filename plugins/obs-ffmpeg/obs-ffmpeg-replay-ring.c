@@ -0,0 +1,85 @@
+#include <inttypes.h>
+#include "obs-ffmpeg-replay-ring.h"
+
+#include <obs-module.h>
+
+bool replay_ring_init(struct replay_ring *ring, const char *path,
+		      uint64_t capacity)
+{
+	memset(ring, 0, sizeof(*ring));
+
+	pthread_mutex_init_value(&ring->mutex);
+	if (pthread_mutex_init(&ring->mutex, NULL) != 0)
+		return false;
+
+	ring->file = os_mapped_file_create(path, capacity);
+	if (!ring->file) {
+		blog(LOG_WARNING,
+		     "replay_ring_init: Failed to create %" PRIu64
+		     " byte file '%s'",
+		     capacity, path);
+		pthread_mutex_destroy(&ring->mutex);
+		return false;
+	}
+
+	ring->data = os_mapped_file_get_data(ring->file);
+	ring->capacity = capacity;
+	dstr_copy(&ring->path, path);
+	return true;
+}
+
+void replay_ring_free(struct replay_ring *ring)
+{
+	if (!ring->file)
+		return;
+
+	os_mapped_file_destroy(ring->file);
+	os_unlink(ring->path.array);
+	dstr_free(&ring->path);
+	pthread_mutex_destroy(&ring->mutex);
+	memset(ring, 0, sizeof(*ring));
+}
+
+bool replay_ring_write(struct replay_ring *ring, const uint8_t *data,
+		       size_t size, uint64_t *pos)
+{
+	uint64_t start = ring->tail;
+
+	if (size > ring->capacity)
+		return false;
+
+	/* skip to the start of the file rather than splitting the payload */
+	if (start % ring->capacity + size > ring->capacity)
+		start += ring->capacity - start % ring->capacity;
+
+	/* published before writing, so that a reader checking afterwards
+	 * sees that its data was overwritten */
+	pthread_mutex_lock(&ring->mutex);
+	ring->tail = start + size;
+	pthread_mutex_unlock(&ring->mutex);
+
+	memcpy(replay_ring_ptr(ring, start), data, size);
+	*pos = start;
+	return true;
+}
+
+bool replay_ring_valid(struct replay_ring *ring, uint64_t pos)
+{
+	bool valid;
+
+	pthread_mutex_lock(&ring->mutex);
+	valid = ring->tail <= pos + ring->capacity;
+	pthread_mutex_unlock(&ring->mutex);
+
+	return valid;
+}
+
+bool replay_ring_read(struct replay_ring *ring, uint64_t pos, uint8_t *dst,
+		      size_t size)
+{
+	if (!replay_ring_valid(ring, pos))
+		return false;
+
+	memcpy(dst, replay_ring_ptr(ring, pos), size);
+	return replay_ring_valid(ring, pos);
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <util/dstr.h>
+#include <util/platform.h>
+#include <util/threading.h>
+
+/*
+ * Byte ring in a preallocated, memory-mapped file, used by the replay buffer
+ * to keep packet payloads on disk instead of in memory.
+ *
+ * Positions are logical (they only ever grow); a payload never wraps around
+ * the end of the file.  The ring is written by one thread and may be read by
+ * others: the data at a position is valid until the writer laps it, which
+ * readers detect with replay_ring_read.
+ */
+
+struct replay_ring {
+	os_mapped_file_t *file;
+	uint8_t *data;
+	uint64_t capacity;
+	struct dstr path;
+
+	/* end of the most recent write, guarded by mutex */
+	pthread_mutex_t mutex;
+	uint64_t tail;
+};
+
+bool replay_ring_init(struct replay_ring *ring, const char *path,
+		      uint64_t capacity);
+void replay_ring_free(struct replay_ring *ring);
+
+/* writer only */
+bool replay_ring_write(struct replay_ring *ring, const uint8_t *data,
+		       size_t size, uint64_t *pos);
+
+/* true if the data written at pos has not been overwritten yet */
+bool replay_ring_valid(struct replay_ring *ring, uint64_t pos);
+
+static inline uint8_t *replay_ring_ptr(struct replay_ring *ring, uint64_t pos)
+{
+	return ring->data + (pos % ring->capacity);
+}
+
+/* copies the payload out, returns false if the writer lapped it */
+bool replay_ring_read(struct replay_ring *ring, uint64_t pos, uint8_t *dst,
+		      size_t size);
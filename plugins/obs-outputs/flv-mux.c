@@ -169,15 +169,12 @@ void flv_meta_data(obs_output_t *context, uint8_t **output, size_t *size,
 static int32_t last_time = 0;
 #endif
 
-static void flv_video(struct serializer *s, int32_t dts_offset,
-		      struct encoder_packet *packet, bool is_header)
+static void flv_video_header(struct serializer *s, int32_t dts_offset,
+			     struct encoder_packet *packet, bool is_header)
 {
 	int64_t offset = packet->pts - packet->dts;
 	int32_t time_ms = get_ms_time(packet, packet->dts) - dts_offset;
 
-	if (!packet->data || !packet->size)
-		return;
-
 	s_w8(s, RTMP_PACKET_TYPE_VIDEO);
 
 #ifdef DEBUG_TIMESTAMPS
@@ -198,20 +195,26 @@ static void flv_video(struct serializer *s, int32_t dts_offset,
 	s_w8(s, packet->keyframe ? 0x17 : 0x27);
 	s_w8(s, is_header ? 0 : 1);
 	s_wb24(s, get_ms_time(packet, offset));
+}
+
+static void flv_video(struct serializer *s, int32_t dts_offset,
+		      struct encoder_packet *packet, bool is_header)
+{
+	if (!packet->data || !packet->size)
+		return;
+
+	flv_video_header(s, dts_offset, packet, is_header);
 	s_write(s, packet->data, packet->size);
 
 	/* write tag size (starting byte doesn't count) */
 	s_wb32(s, (uint32_t)serializer_get_pos(s) - 1);
 }
 
-static void flv_audio(struct serializer *s, int32_t dts_offset,
-		      struct encoder_packet *packet, bool is_header)
+static void flv_audio_header(struct serializer *s, int32_t dts_offset,
+			     struct encoder_packet *packet, bool is_header)
 {
 	int32_t time_ms = get_ms_time(packet, packet->dts) - dts_offset;
 
-	if (!packet->data || !packet->size)
-		return;
-
 	s_w8(s, RTMP_PACKET_TYPE_AUDIO);
 
 #ifdef DEBUG_TIMESTAMPS
@@ -231,6 +234,15 @@ static void flv_audio(struct serializer *s, int32_t dts_offset,
 	/* these are the two extra bytes mentioned above */
 	s_w8(s, 0xaf);
 	s_w8(s, is_header ? 0 : 1);
+}
+
+static void flv_audio(struct serializer *s, int32_t dts_offset,
+		      struct encoder_packet *packet, bool is_header)
+{
+	if (!packet->data || !packet->size)
+		return;
+
+	flv_audio_header(s, dts_offset, packet, is_header);
 	s_write(s, packet->data, packet->size);
 
 	/* write tag size (starting byte doesn't count) */
@@ -254,6 +266,48 @@ void flv_packet_mux(struct encoder_packet *packet, int32_t dts_offset,
 	*size = data.bytes.num;
 }
 
+struct tag_header_output {
+	uint8_t *data;
+	size_t size;
+};
+
+static size_t tag_header_write(void *param, const void *data, size_t size)
+{
+	struct tag_header_output *out = param;
+
+	if (out->size + size > FLV_TAG_HEADER_MAX_SIZE)
+		return 0;
+
+	memcpy(out->data + out->size, data, size);
+	out->size += size;
+	return size;
+}
+
+static int64_t tag_header_get_pos(void *param)
+{
+	struct tag_header_output *out = param;
+	return (int64_t)out->size;
+}
+
+size_t flv_packet_header(struct encoder_packet *packet, int32_t dts_offset,
+			 uint8_t *header, bool is_header)
+{
+	struct tag_header_output out = {header, 0};
+	struct serializer s = {.data = &out,
+			       .write = tag_header_write,
+			       .get_pos = tag_header_get_pos};
+
+	if (!packet->data || !packet->size)
+		return 0;
+
+	if (packet->type == OBS_ENCODER_VIDEO)
+		flv_video_header(&s, dts_offset, packet, is_header);
+	else
+		flv_audio_header(&s, dts_offset, packet, is_header);
+
+	return out.size;
+}
+
 /* ------------------------------------------------------------------------- */
 /* stuff for additional media streams                                        */
 
@@ -21,6 +21,9 @@
 
 #define MILLISECOND_DEN 1000
 
+/* 11 byte tag header plus up to 5 bytes of video/audio data header */
+#define FLV_TAG_HEADER_MAX_SIZE 16
+
 static int32_t get_ms_time(struct encoder_packet *packet, int64_t val)
 {
 	return (int32_t)(val * MILLISECOND_DEN / packet->timebase_den);
@@ -34,6 +37,14 @@ extern void flv_additional_meta_data(obs_output_t *context, uint8_t **output,
 				     size_t *size);
 extern void flv_packet_mux(struct encoder_packet *packet, int32_t dts_offset,
 			   uint8_t **output, size_t *size, bool is_header);
+
+/* writes just the tag header of the packet, including the codec specific
+ * bytes, into header, which must have room for FLV_TAG_HEADER_MAX_SIZE
+ * bytes.  the packet data follows it, then the 4 byte tag size.  returns 0
+ * if the packet has no data. */
+extern size_t flv_packet_header(struct encoder_packet *packet,
+				int32_t dts_offset, uint8_t *header,
+				bool is_header);
 extern void flv_additional_packet_mux(struct encoder_packet *packet,
 				      int32_t dts_offset, uint8_t **output,
 				      size_t *size, bool is_header,
@@ -164,6 +164,7 @@ static void HandleClientBW(RTMP *r, const RTMPPacket *packet);
 
 static int ReadN(RTMP *r, char *buffer, int n);
 static int WriteN(RTMP *r, const char *buffer, int n);
+static int WriteNV(RTMP *r, RTMPIOVec *iov, int iovcnt);
 
 static void DecodeTEA(AVal *key, AVal *text);
 
@@ -1616,6 +1617,96 @@ WriteN(RTMP *r, const char *buffer, int n)
     return n == 0;
 }
 
+static int
+WriteNV(RTMP *r, RTMPIOVec *iov, int iovcnt)
+{
+    int direct = !r->m_bCustomSend || !r->m_customSendFunc;
+    char stackbuf[RTMP_BUFFER_CACHE_SIZE], *buf, *ptr;
+    int i, total = 0, ret;
+
+#ifdef CRYPTO
+    if (r->Link.rc4keyOut)
+        direct = FALSE;
+#if !defined(NO_SSL)
+    if (r->m_sb.sb_ssl)
+        direct = FALSE;
+#endif
+#endif
+
+    if (direct)
+    {
+        while (iovcnt > 0)
+        {
+            int nBytes = RTMPSockBuf_SendV(&r->m_sb, iov, iovcnt);
+
+            if (nBytes < 0)
+            {
+                int sockerr = GetSockError();
+                RTMP_Log(RTMP_LOGERROR, "%s, RTMP send error %d", __FUNCTION__,
+                         sockerr);
+
+                if (sockerr == EINTR && !RTMP_ctrlC)
+                    continue;
+
+                r->last_error_code = sockerr;
+
+                RTMP_Close(r);
+                return FALSE;
+            }
+
+            if (nBytes == 0)
+                return FALSE;
+
+            /* skip past whatever was sent */
+            while (iovcnt > 0 && nBytes >= iov->len)
+            {
+                nBytes -= iov->len;
+                iov++;
+                iovcnt--;
+            }
+            if (iovcnt > 0)
+            {
+                iov->buf += nBytes;
+                iov->len -= nBytes;
+            }
+        }
+
+        return TRUE;
+    }
+
+    /* the custom send function only queues the data */
+    if (r->m_bCustomSend && r->m_customSendFunc)
+    {
+        for (i = 0; i < iovcnt; i++)
+        {
+            if (iov[i].len && !WriteN(r, iov[i].buf, iov[i].len))
+                return FALSE;
+        }
+
+        return TRUE;
+    }
+
+    /* encrypted connections get it in one piece */
+    for (i = 0; i < iovcnt; i++)
+        total += iov[i].len;
+
+    buf = total > (int)sizeof(stackbuf) ? malloc(total) : stackbuf;
+    if (!buf)
+        return FALSE;
+
+    ptr = buf;
+    for (i = 0; i < iovcnt; i++)
+    {
+        memcpy(ptr, iov[i].buf, iov[i].len);
+        ptr += iov[i].len;
+    }
+
+    ret = WriteN(r, buf, total);
+    if (buf != stackbuf)
+        free(buf);
+    return ret;
+}
+
 #define SAVC(x)	static const AVal av_##x = AVC(#x)
 
 SAVC(app);
@@ -4063,18 +4154,18 @@ RTMP_SendChunk(RTMP *r, RTMPChunk *chunk)
     return wrote;
 }
 
-int
-RTMP_SendPacket(RTMP *r, RTMPPacket *packet, int queue)
+/* encodes the first chunk header of the packet, either right in front of the
+ * body or, without a body, into hbuf */
+static int
+EncodePacketHeader(RTMP *r, RTMPPacket *packet, char *hbuf, char **pheader,
+                   int *phSize, int *pcSize, char *pc)
 {
     const RTMPPacket *prevPacket;
     uint32_t last = 0;
     int nSize;
     int hSize, cSize;
-    char *header, *hptr, *hend, hbuf[RTMP_MAX_HEADER_SIZE], c;
+    char *header, *hptr, *hend, c;
     uint32_t t;
-    char *buffer, *tbuf = NULL, *toff = NULL;
-    int nChunkSize;
-    int tlen;
 
     if (packet->m_nChannel >= r->m_channelsAllocatedOut)
     {
@@ -4127,7 +4218,7 @@ RTMP_SendPacket(RTMP *r, RTMPPacket *packet, int queue)
     else
     {
         header = hbuf + 6;
-        hend = hbuf + sizeof(hbuf);
+        hend = hbuf + RTMP_MAX_HEADER_SIZE;
     }
 
     if (packet->m_nChannel > 319)
@@ -4185,6 +4276,34 @@ RTMP_SendPacket(RTMP *r, RTMPPacket *packet, int queue)
     if (nSize > 1 && t >= 0xffffff)
         hptr = AMF_EncodeInt32(hptr, hend, t);
 
+    *pheader = header;
+    *phSize = hSize;
+    *pcSize = cSize;
+    *pc = c;
+    return TRUE;
+}
+
+static void
+RememberPacket(RTMP *r, const RTMPPacket *packet)
+{
+    if (!r->m_vecChannelsOut[packet->m_nChannel])
+        r->m_vecChannelsOut[packet->m_nChannel] = malloc(sizeof(RTMPPacket));
+    memcpy(r->m_vecChannelsOut[packet->m_nChannel], packet, sizeof(RTMPPacket));
+}
+
+int
+RTMP_SendPacket(RTMP *r, RTMPPacket *packet, int queue)
+{
+    int nSize;
+    int hSize, cSize;
+    char *header, hbuf[RTMP_MAX_HEADER_SIZE], c;
+    char *buffer, *tbuf = NULL, *toff = NULL;
+    int nChunkSize;
+    int tlen;
+
+    if (!EncodePacketHeader(r, packet, hbuf, &header, &hSize, &cSize, &c))
+        return FALSE;
+
     nSize = packet->m_nBodySize;
     buffer = packet->m_body;
     nChunkSize = r->m_outChunkSize;
@@ -4274,9 +4393,92 @@ RTMP_SendPacket(RTMP *r, RTMPPacket *packet, int queue)
         }
     }
 
-    if (!r->m_vecChannelsOut[packet->m_nChannel])
-        r->m_vecChannelsOut[packet->m_nChannel] = malloc(sizeof(RTMPPacket));
-    memcpy(r->m_vecChannelsOut[packet->m_nChannel], packet, sizeof(RTMPPacket));
+    RememberPacket(r, packet);
+    return TRUE;
+}
+
+/* like RTMP_SendPacket, but with the body passed as a list of buffers that
+ * are sent as they are instead of being copied into the packet first */
+static int
+SendPacketV(RTMP *r, RTMPPacket *packet, const RTMPIOVec *body, int bodycnt)
+{
+    RTMPIOVec out[RTMP_MAX_IOV];
+    char cheaders[RTMP_MAX_IOV][3];
+    char *header, hbuf[RTMP_MAX_HEADER_SIZE], c;
+    int hSize, cSize, nSize, nChunkSize;
+    int n = 0, nh = 0, b = 0, boff = 0;
+
+    packet->m_body = NULL;
+    if (!EncodePacketHeader(r, packet, hbuf, &header, &hSize, &cSize, &c))
+        return FALSE;
+
+    out[n].buf = header;
+    out[n++].len = hSize;
+
+    nSize = packet->m_nBodySize;
+    nChunkSize = r->m_outChunkSize;
+
+    while (nSize > 0)
+    {
+        int chunk = nSize < nChunkSize ? nSize : nChunkSize;
+        nSize -= chunk;
+
+        while (chunk > 0 && b < bodycnt)
+        {
+            int len = body[b].len - boff;
+            if (len > chunk)
+                len = chunk;
+
+            if (len > 0)
+            {
+                out[n].buf = body[b].buf + boff;
+                out[n++].len = len;
+            }
+
+            boff += len;
+            chunk -= len;
+            if (boff == body[b].len)
+            {
+                b++;
+                boff = 0;
+            }
+
+            if (n == RTMP_MAX_IOV)
+            {
+                if (!WriteNV(r, out, n))
+                    return FALSE;
+                n = nh = 0;
+            }
+        }
+
+        if (nSize > 0)
+        {
+            char *ch = cheaders[nh++];
+            ch[0] = (0xc0 | c);
+            if (cSize)
+            {
+                int tmp = packet->m_nChannel - 64;
+                ch[1] = tmp & 0xff;
+                if (cSize == 2)
+                    ch[2] = tmp >> 8;
+            }
+
+            out[n].buf = ch;
+            out[n++].len = 1 + cSize;
+
+            if (n == RTMP_MAX_IOV)
+            {
+                if (!WriteNV(r, out, n))
+                    return FALSE;
+                n = nh = 0;
+            }
+        }
+    }
+
+    if (n && !WriteNV(r, out, n))
+        return FALSE;
+
+    RememberPacket(r, packet);
     return TRUE;
 }
 
@@ -4509,6 +4711,56 @@ RTMPSockBuf_Send(RTMPSockBuf *sb, const char *buf, int len)
     return rc;
 }
 
+/* plain sockets only, encrypted data goes through RTMPSockBuf_Send */
+int
+RTMPSockBuf_SendV(RTMPSockBuf *sb, const RTMPIOVec *iov, int iovcnt)
+{
+    int i;
+#ifdef _WIN32
+    WSABUF bufs[RTMP_MAX_IOV];
+    DWORD sent = 0;
+
+    if (iovcnt > RTMP_MAX_IOV)
+        iovcnt = RTMP_MAX_IOV;
+
+    for (i = 0; i < iovcnt; i++)
+    {
+        bufs[i].buf = (CHAR *)iov[i].buf;
+        bufs[i].len = (ULONG)iov[i].len;
+    }
+
+#if defined(RTMP_NETSTACK_DUMP)
+    for (i = 0; i < iovcnt; i++)
+        fwrite(iov[i].buf, 1, iov[i].len, netstackdump);
+#endif
+
+    if (WSASend(sb->sb_socket, bufs, (DWORD)iovcnt, &sent, 0, NULL, NULL) != 0)
+        return -1;
+    return (int)sent;
+#else
+    struct iovec bufs[RTMP_MAX_IOV];
+    struct msghdr msg = {0};
+
+    if (iovcnt > RTMP_MAX_IOV)
+        iovcnt = RTMP_MAX_IOV;
+
+    for (i = 0; i < iovcnt; i++)
+    {
+        bufs[i].iov_base = (void *)iov[i].buf;
+        bufs[i].iov_len = (size_t)iov[i].len;
+    }
+
+#if defined(RTMP_NETSTACK_DUMP)
+    for (i = 0; i < iovcnt; i++)
+        fwrite(iov[i].buf, 1, iov[i].len, netstackdump);
+#endif
+
+    msg.msg_iov = bufs;
+    msg.msg_iovlen = iovcnt;
+    return (int)sendmsg(sb->sb_socket, &msg, MSG_NOSIGNAL);
+#endif
+}
+
 int
 RTMPSockBuf_Close(RTMPSockBuf *sb)
 {
@@ -5369,3 +5621,79 @@ RTMP_Write(RTMP *r, const char *buf, int size, int streamIdx)
     }
     return size+s2;
 }
+
+int
+RTMP_WriteV(RTMP *r, const RTMPIOVec *iov, int iovcnt, int streamIdx)
+{
+    RTMPPacket packet = {0};
+    RTMPIOVec body[RTMP_MAX_IOV];
+    const char *buf;
+    int i, size = 0, bodycnt = 0;
+
+    for (i = 0; i < iovcnt; i++)
+        size += iov[i].len;
+
+    /* RTMPT sends all chunks in one request, which RTMP_Write already
+     * handles */
+    if ((r->Link.protocol & RTMP_FEATURE_HTTP) || iovcnt > RTMP_MAX_IOV ||
+            r->m_write.m_nBytesRead)
+    {
+        char *flat = malloc(size), *ptr = flat;
+        int ret;
+
+        if (!flat)
+            return -1;
+
+        for (i = 0; i < iovcnt; i++)
+        {
+            memcpy(ptr, iov[i].buf, iov[i].len);
+            ptr += iov[i].len;
+        }
+
+        ret = RTMP_Write(r, flat, size, streamIdx);
+        free(flat);
+        return ret;
+    }
+
+    if (iovcnt < 1 || iov[0].len < 11)
+    {
+        /* FLV tag header must be in the first buffer */
+        return 0;
+    }
+
+    buf = iov[0].buf;
+    packet.m_nChannel = 0x04;	/* source channel */
+    packet.m_nInfoField2 = r->Link.streams[streamIdx].id;
+    packet.m_packetType = *buf++;
+    packet.m_nBodySize = AMF_DecodeInt24(buf);
+    buf += 3;
+    packet.m_nTimeStamp = AMF_DecodeInt24(buf);
+    buf += 3;
+    packet.m_nTimeStamp |= *buf++ << 24;
+
+    if (((packet.m_packetType == RTMP_PACKET_TYPE_AUDIO
+            || packet.m_packetType == RTMP_PACKET_TYPE_VIDEO) &&
+            !packet.m_nTimeStamp) || packet.m_packetType == RTMP_PACKET_TYPE_INFO)
+    {
+        packet.m_headerType = RTMP_PACKET_SIZE_LARGE;
+    }
+    else
+    {
+        packet.m_headerType = RTMP_PACKET_SIZE_MEDIUM;
+    }
+
+    if (size - 11 < (int)packet.m_nBodySize)
+    {
+        RTMP_Log(RTMP_LOGERROR, "%s, incomplete FLV tag", __FUNCTION__);
+        return 0;
+    }
+
+    body[bodycnt].buf = iov[0].buf + 11;
+    body[bodycnt++].len = iov[0].len - 11;
+    for (i = 1; i < iovcnt; i++)
+        body[bodycnt++] = iov[i];
+
+    if (!SendPacketV(r, &packet, body, bodycnt))
+        return -1;
+    return size;
+}
@@ -236,6 +236,15 @@ extern "C"
 
 #define RTMP_MAX_HEADER_SIZE 18
 
+    /* most buffers RTMP_WriteV and RTMPSockBuf_SendV take at a time */
+#define RTMP_MAX_IOV 64
+
+    typedef struct RTMPIOVec
+    {
+        const char *buf;
+        int len;
+    } RTMPIOVec;
+
 #define RTMP_PACKET_SIZE_LARGE    0
 #define RTMP_PACKET_SIZE_MEDIUM   1
 #define RTMP_PACKET_SIZE_SMALL    2
@@ -530,6 +539,7 @@ extern "C"
 
     int RTMPSockBuf_Fill(RTMPSockBuf *sb);
     int RTMPSockBuf_Send(RTMPSockBuf *sb, const char *buf, int len);
+    int RTMPSockBuf_SendV(RTMPSockBuf *sb, const RTMPIOVec *iov, int iovcnt);
     int RTMPSockBuf_Close(RTMPSockBuf *sb);
 
     int RTMP_SendCreateStream(RTMP *r);
@@ -540,6 +550,12 @@ extern "C"
     int RTMP_Read(RTMP *r, char *buf, int size);
     int RTMP_Write(RTMP *r, const char *buf, int size, int streamIdx);
 
+    /* sends one complete FLV tag gathered from several buffers without
+     * copying them first.  the 11 byte tag header has to be in the first
+     * buffer, and anything after the tag data is ignored. */
+    int RTMP_WriteV(RTMP *r, const RTMPIOVec *iov, int iovcnt,
+                    int streamIdx);
+
 #ifdef USE_HASHSWF
     /* hashswf.c */
     int RTMP_HashSWF(const char *url, unsigned int *size, unsigned char *hash,
@@ -0,0 +1,727 @@
+#include <obs-avc.h>
+#include <util/array-serializer.h>
+#include <util/util_uint64.h>
+#include "mp4-mux.h"
+
+#define SAMPLE_FLAGS_SYNC 0x02000000
+#define SAMPLE_FLAGS_NON_SYNC 0x01010000
+
+#define TRUN_DATA_OFFSET 0x000001
+#define TRUN_DURATION 0x000100
+#define TRUN_SIZE 0x000200
+#define TRUN_FLAGS 0x000400
+#define TRUN_CTS 0x000800
+
+#define TFHD_DEFAULT_BASE_IS_MOOF 0x020000
+
+/* ------------------------------------------------------------------------- */
+/* boxes are written to an array first so that their sizes can be filled in
+ * afterwards */
+
+static inline void s_wstr(struct serializer *s, const char *str)
+{
+	s_write(s, str, strlen(str));
+}
+
+static size_t box_begin(struct serializer *s, const char *type)
+{
+	size_t pos = (size_t)serializer_get_pos(s);
+	s_wb32(s, 0);
+	s_write(s, type, 4);
+	return pos;
+}
+
+static size_t full_box_begin(struct serializer *s, const char *type,
+			     uint8_t version, uint32_t flags)
+{
+	size_t pos = box_begin(s, type);
+	s_w8(s, version);
+	s_wb24(s, flags);
+	return pos;
+}
+
+static inline void write_be32(uint8_t *data, uint32_t val)
+{
+	data[0] = (uint8_t)(val >> 24);
+	data[1] = (uint8_t)(val >> 16);
+	data[2] = (uint8_t)(val >> 8);
+	data[3] = (uint8_t)val;
+}
+
+static void box_end(struct serializer *s, size_t pos)
+{
+	struct array_output_data *data = s->data;
+	write_be32(data->bytes.array + pos, (uint32_t)(data->bytes.num - pos));
+}
+
+static void write_matrix(struct serializer *s)
+{
+	static const uint32_t matrix[9] = {0x00010000, 0, 0, 0, 0x00010000,
+					   0,          0, 0, 0x40000000};
+
+	for (size_t i = 0; i < 9; i++)
+		s_wb32(s, matrix[i]);
+}
+
+/* MPEG-4 descriptor with a 4 byte length field */
+static size_t descriptor_begin(struct serializer *s, uint8_t tag)
+{
+	size_t pos;
+
+	s_w8(s, tag);
+	pos = (size_t)serializer_get_pos(s);
+	s_wb32(s, 0);
+	return pos;
+}
+
+static void descriptor_end(struct serializer *s, size_t pos)
+{
+	struct array_output_data *data = s->data;
+	uint32_t size = (uint32_t)(data->bytes.num - pos - 4);
+	uint8_t *len = data->bytes.array + pos;
+
+	len[0] = (uint8_t)(0x80 | ((size >> 21) & 0x7F));
+	len[1] = (uint8_t)(0x80 | ((size >> 14) & 0x7F));
+	len[2] = (uint8_t)(0x80 | ((size >> 7) & 0x7F));
+	len[3] = (uint8_t)(size & 0x7F);
+}
+
+/* ------------------------------------------------------------------------- */
+/* init segment */
+
+static void write_ftyp(struct serializer *s)
+{
+	size_t box = box_begin(s, "ftyp");
+	s_wstr(s, "isom");
+	s_wb32(s, 0x200);
+	s_wstr(s, "isom");
+	s_wstr(s, "iso6");
+	s_wstr(s, "iso2");
+	s_wstr(s, "avc1");
+	s_wstr(s, "mp41");
+	box_end(s, box);
+}
+
+static void write_mvhd(struct mp4_mux *mux, struct serializer *s)
+{
+	size_t box = full_box_begin(s, "mvhd", 0, 0);
+	s_wb32(s, 0);       /* creation time */
+	s_wb32(s, 0);       /* modification time */
+	s_wb32(s, 1000);    /* timescale */
+	s_wb32(s, 0);       /* duration, unknown with fragments */
+	s_wb32(s, 0x10000); /* rate */
+	s_wb16(s, 0x100);   /* volume */
+	s_wb16(s, 0);
+	s_wb32(s, 0);
+	s_wb32(s, 0);
+	write_matrix(s);
+	for (size_t i = 0; i < 6; i++)
+		s_wb32(s, 0);
+	s_wb32(s, (uint32_t)mux->num_tracks + 1);
+	box_end(s, box);
+}
+
+static void write_tkhd(struct mp4_track *track, struct serializer *s)
+{
+	bool audio = track->type == OBS_ENCODER_AUDIO;
+	size_t box = full_box_begin(s, "tkhd", 0, 0x3);
+
+	s_wb32(s, 0); /* creation time */
+	s_wb32(s, 0); /* modification time */
+	s_wb32(s, track->track_id);
+	s_wb32(s, 0);
+	s_wb32(s, 0); /* duration */
+	s_wb32(s, 0);
+	s_wb32(s, 0);
+	s_wb16(s, 0); /* layer */
+	s_wb16(s, 0); /* alternate group */
+	s_wb16(s, audio ? 0x100 : 0);
+	s_wb16(s, 0);
+	write_matrix(s);
+	s_wb32(s, track->width << 16);
+	s_wb32(s, track->height << 16);
+	box_end(s, box);
+}
+
+static void write_mdhd(struct mp4_track *track, struct serializer *s)
+{
+	size_t box = full_box_begin(s, "mdhd", 0, 0);
+	s_wb32(s, 0);
+	s_wb32(s, 0);
+	s_wb32(s, track->timescale);
+	s_wb32(s, 0);
+	s_wb16(s, 0x55C4); /* "und" */
+	s_wb16(s, 0);
+	box_end(s, box);
+}
+
+static void write_hdlr(struct mp4_track *track, struct serializer *s)
+{
+	bool audio = track->type == OBS_ENCODER_AUDIO;
+	const char *name = audio ? "SoundHandler" : "VideoHandler";
+	size_t box = full_box_begin(s, "hdlr", 0, 0);
+
+	s_wb32(s, 0);
+	s_wstr(s, audio ? "soun" : "vide");
+	s_wb32(s, 0);
+	s_wb32(s, 0);
+	s_wb32(s, 0);
+	s_write(s, name, strlen(name) + 1);
+	box_end(s, box);
+}
+
+static void write_dinf(struct serializer *s)
+{
+	size_t dinf = box_begin(s, "dinf");
+	size_t dref = full_box_begin(s, "dref", 0, 0);
+	size_t url;
+
+	s_wb32(s, 1);
+	url = full_box_begin(s, "url ", 0, 1); /* data is in this file */
+	box_end(s, url);
+	box_end(s, dref);
+	box_end(s, dinf);
+}
+
+static void write_avc1(struct mp4_track *track, struct serializer *s)
+{
+	size_t box = box_begin(s, "avc1");
+	size_t avcc;
+
+	for (size_t i = 0; i < 6; i++)
+		s_w8(s, 0);
+	s_wb16(s, 1); /* data reference index */
+	s_wb16(s, 0);
+	s_wb16(s, 0);
+	s_wb32(s, 0);
+	s_wb32(s, 0);
+	s_wb32(s, 0);
+	s_wb16(s, (uint16_t)track->width);
+	s_wb16(s, (uint16_t)track->height);
+	s_wb32(s, 0x00480000); /* 72 dpi */
+	s_wb32(s, 0x00480000);
+	s_wb32(s, 0);
+	s_wb16(s, 1); /* frame count */
+	for (size_t i = 0; i < 32; i++)
+		s_w8(s, 0); /* compressor name */
+	s_wb16(s, 0x18);
+	s_wb16(s, 0xFFFF);
+
+	avcc = box_begin(s, "avcC");
+	s_write(s, track->header, track->header_size);
+	box_end(s, avcc);
+
+	box_end(s, box);
+}
+
+static void write_esds(struct mp4_track *track, struct serializer *s)
+{
+	size_t box = full_box_begin(s, "esds", 0, 0);
+	size_t es, dc, dsi, sl;
+
+	es = descriptor_begin(s, 0x03);
+	s_wb16(s, (uint16_t)track->track_id);
+	s_w8(s, 0);
+
+	dc = descriptor_begin(s, 0x04);
+	s_w8(s, 0x40);            /* AAC */
+	s_w8(s, (0x05 << 2) | 1); /* audio stream */
+	s_wb24(s, 0);             /* buffer size */
+	s_wb32(s, track->bitrate);
+	s_wb32(s, track->bitrate);
+
+	dsi = descriptor_begin(s, 0x05);
+	s_write(s, track->header, track->header_size);
+	descriptor_end(s, dsi);
+	descriptor_end(s, dc);
+
+	sl = descriptor_begin(s, 0x06);
+	s_w8(s, 0x02);
+	descriptor_end(s, sl);
+
+	descriptor_end(s, es);
+	box_end(s, box);
+}
+
+static void write_mp4a(struct mp4_track *track, struct serializer *s)
+{
+	size_t box = box_begin(s, "mp4a");
+
+	for (size_t i = 0; i < 6; i++)
+		s_w8(s, 0);
+	s_wb16(s, 1); /* data reference index */
+	s_wb32(s, 0);
+	s_wb32(s, 0);
+	s_wb16(s, (uint16_t)track->channels);
+	s_wb16(s, 16); /* sample size */
+	s_wb16(s, 0);
+	s_wb16(s, 0);
+	s_wb32(s, track->timescale << 16);
+
+	write_esds(track, s);
+	box_end(s, box);
+}
+
+static void write_empty_table(struct serializer *s, const char *type)
+{
+	size_t box = full_box_begin(s, type, 0, 0);
+	s_wb32(s, 0);
+	box_end(s, box);
+}
+
+static void write_stbl(struct mp4_track *track, struct serializer *s)
+{
+	size_t stbl = box_begin(s, "stbl");
+	size_t stsd = full_box_begin(s, "stsd", 0, 0);
+	size_t stsz;
+
+	s_wb32(s, 1);
+	if (track->type == OBS_ENCODER_VIDEO)
+		write_avc1(track, s);
+	else
+		write_mp4a(track, s);
+	box_end(s, stsd);
+
+	/* samples are all in the fragments */
+	write_empty_table(s, "stts");
+	write_empty_table(s, "stsc");
+
+	stsz = full_box_begin(s, "stsz", 0, 0);
+	s_wb32(s, 0);
+	s_wb32(s, 0);
+	box_end(s, stsz);
+
+	write_empty_table(s, "stco");
+	box_end(s, stbl);
+}
+
+static void write_minf(struct mp4_track *track, struct serializer *s)
+{
+	size_t minf = box_begin(s, "minf");
+	size_t box;
+
+	if (track->type == OBS_ENCODER_VIDEO) {
+		box = full_box_begin(s, "vmhd", 0, 1);
+		s_wb16(s, 0);
+		s_wb16(s, 0);
+		s_wb16(s, 0);
+		s_wb16(s, 0);
+	} else {
+		box = full_box_begin(s, "smhd", 0, 0);
+		s_wb16(s, 0);
+		s_wb16(s, 0);
+	}
+	box_end(s, box);
+
+	write_dinf(s);
+	write_stbl(track, s);
+	box_end(s, minf);
+}
+
+static void write_trak(struct mp4_track *track, struct serializer *s)
+{
+	size_t trak = box_begin(s, "trak");
+	size_t mdia;
+
+	write_tkhd(track, s);
+
+	mdia = box_begin(s, "mdia");
+	write_mdhd(track, s);
+	write_hdlr(track, s);
+	write_minf(track, s);
+	box_end(s, mdia);
+
+	box_end(s, trak);
+}
+
+static void write_mvex(struct mp4_mux *mux, struct serializer *s)
+{
+	size_t mvex = box_begin(s, "mvex");
+
+	for (size_t i = 0; i < mux->num_tracks; i++) {
+		size_t trex = full_box_begin(s, "trex", 0, 0);
+		s_wb32(s, mux->tracks[i].track_id);
+		s_wb32(s, 1); /* sample description index */
+		s_wb32(s, 0);
+		s_wb32(s, 0);
+		s_wb32(s, 0);
+		box_end(s, trex);
+	}
+
+	box_end(s, mvex);
+}
+
+bool mp4_mux_write_init_segment(struct mp4_mux *mux, struct serializer *s)
+{
+	struct array_output_data data;
+	struct serializer a;
+	size_t moov;
+	bool success;
+
+	array_output_serializer_init(&a, &data);
+
+	write_ftyp(&a);
+
+	moov = box_begin(&a, "moov");
+	write_mvhd(mux, &a);
+	for (size_t i = 0; i < mux->num_tracks; i++)
+		write_trak(&mux->tracks[i], &a);
+	write_mvex(mux, &a);
+	box_end(&a, moov);
+
+	success = s_write(s, data.bytes.array, data.bytes.num) ==
+		  data.bytes.num;
+	array_output_serializer_free(&data);
+	return success;
+}
+
+/* ------------------------------------------------------------------------- */
+/* fragments */
+
+static inline uint64_t to_track_time(struct mp4_track *track,
+				     const struct encoder_packet *packet,
+				     int64_t val)
+{
+	return util_mul_div64((uint64_t)val * (uint64_t)packet->timebase_num,
+			      track->timescale,
+			      (uint64_t)packet->timebase_den);
+}
+
+/* decode time of a sample, relative to the first video keyframe */
+static inline uint64_t sample_time(struct mp4_track *track,
+				   const struct encoder_packet *packet)
+{
+	return track->base_time +
+	       to_track_time(track, packet, packet->dts - track->first_dts);
+}
+
+static void write_traf(struct mp4_track *track, struct serializer *s,
+		       const struct encoder_packet *next,
+		       size_t *data_offset_pos)
+{
+	bool video = track->type == OBS_ENCODER_VIDEO;
+	uint32_t flags = TRUN_DATA_OFFSET | TRUN_DURATION | TRUN_SIZE |
+			 TRUN_FLAGS;
+	size_t traf, box;
+
+	if (video)
+		flags |= TRUN_CTS;
+
+	traf = box_begin(s, "traf");
+
+	box = full_box_begin(s, "tfhd", 0, TFHD_DEFAULT_BASE_IS_MOOF);
+	s_wb32(s, track->track_id);
+	box_end(s, box);
+
+	box = full_box_begin(s, "tfdt", 1, 0);
+	s_wb64(s, sample_time(track, &track->samples.array[0]));
+	box_end(s, box);
+
+	box = full_box_begin(s, "trun", 1, flags);
+	s_wb32(s, (uint32_t)track->samples.num);
+	*data_offset_pos = (size_t)serializer_get_pos(s);
+	s_wb32(s, 0);
+
+	for (size_t i = 0; i < track->samples.num; i++) {
+		struct encoder_packet *packet = &track->samples.array[i];
+		const struct encoder_packet *following =
+			i + 1 < track->samples.num ? packet + 1
+						   : (video ? next : NULL);
+		uint64_t time = sample_time(track, packet);
+		uint32_t duration = track->last_duration;
+		uint32_t sample_flags = SAMPLE_FLAGS_SYNC;
+
+		if (following)
+			duration = (uint32_t)(sample_time(track, following) -
+					      time);
+		track->last_duration = duration;
+
+		if (video && !packet->keyframe)
+			sample_flags = SAMPLE_FLAGS_NON_SYNC;
+
+		s_wb32(s, duration);
+		s_wb32(s, (uint32_t)packet->size);
+		s_wb32(s, sample_flags);
+
+		if (video)
+			s_wb32(s, (uint32_t)(int32_t)to_track_time(
+					  track, packet,
+					  packet->pts - packet->dts));
+	}
+
+	box_end(s, box);
+	box_end(s, traf);
+}
+
+bool mp4_mux_write_fragment(struct mp4_mux *mux, struct serializer *s,
+			    const struct encoder_packet *next)
+{
+	size_t data_offset_pos[MP4_MAX_TRACKS];
+	struct array_output_data data;
+	struct serializer a;
+	uint64_t moof_offset = (uint64_t)serializer_get_pos(s);
+	uint32_t data_offset;
+	uint64_t mdat_size = 8;
+	size_t moof, box;
+	bool success;
+
+	array_output_serializer_init(&a, &data);
+
+	moof = box_begin(&a, "moof");
+
+	box = full_box_begin(&a, "mfhd", 0, 0);
+	s_wb32(&a, ++mux->sequence);
+	box_end(&a, box);
+
+	for (size_t i = 0; i < mux->num_tracks; i++) {
+		struct mp4_track *track = &mux->tracks[i];
+		if (!track->samples.num)
+			continue;
+
+		if (track->type == OBS_ENCODER_VIDEO) {
+			struct mp4_tfra_entry entry = {
+				sample_time(track, &track->samples.array[0]),
+				moof_offset};
+			da_push_back(track->index, &entry);
+		}
+
+		write_traf(track, &a, next, &data_offset_pos[i]);
+	}
+
+	box_end(&a, moof);
+
+	/* sample data starts right after the mdat header */
+	data_offset = (uint32_t)data.bytes.num + 8;
+
+	for (size_t i = 0; i < mux->num_tracks; i++) {
+		struct mp4_track *track = &mux->tracks[i];
+		if (!track->samples.num)
+			continue;
+
+		write_be32(data.bytes.array + data_offset_pos[i], data_offset);
+
+		for (size_t j = 0; j < track->samples.num; j++) {
+			data_offset += (uint32_t)track->samples.array[j].size;
+			mdat_size += track->samples.array[j].size;
+		}
+	}
+
+	s_wb32(&a, (uint32_t)mdat_size);
+	s_wstr(&a, "mdat");
+	success = s_write(s, data.bytes.array, data.bytes.num) ==
+		  data.bytes.num;
+	array_output_serializer_free(&data);
+
+	/* payloads go straight to the output.  the samples are released even
+	 * after a failed write, the file is unusable past that point anyway */
+	for (size_t i = 0; i < mux->num_tracks; i++) {
+		struct mp4_track *track = &mux->tracks[i];
+
+		for (size_t j = 0; j < track->samples.num; j++) {
+			struct encoder_packet *packet =
+				&track->samples.array[j];
+			if (success)
+				success = s_write(s, packet->data,
+						  packet->size) == packet->size;
+			obs_encoder_packet_release(packet);
+		}
+
+		da_resize(track->samples, 0);
+	}
+
+	return success;
+}
+
+bool mp4_mux_write_index(struct mp4_mux *mux, struct serializer *s)
+{
+	struct array_output_data data;
+	struct serializer a;
+	size_t mfra, box;
+	bool success;
+
+	array_output_serializer_init(&a, &data);
+
+	mfra = box_begin(&a, "mfra");
+
+	for (size_t i = 0; i < mux->num_tracks; i++) {
+		struct mp4_track *track = &mux->tracks[i];
+		if (!track->index.num)
+			continue;
+
+		box = full_box_begin(&a, "tfra", 1, 0);
+		s_wb32(&a, track->track_id);
+		s_wb32(&a, 0); /* 1 byte traf/trun/sample numbers */
+		s_wb32(&a, (uint32_t)track->index.num);
+
+		for (size_t j = 0; j < track->index.num; j++) {
+			s_wb64(&a, track->index.array[j].time);
+			s_wb64(&a, track->index.array[j].moof_offset);
+			s_w8(&a, 1);
+			s_w8(&a, 1);
+			s_w8(&a, 1);
+		}
+
+		box_end(&a, box);
+	}
+
+	box = full_box_begin(&a, "mfro", 0, 0);
+	s_wb32(&a, (uint32_t)(data.bytes.num - mfra + 4));
+	box_end(&a, box);
+
+	box_end(&a, mfra);
+
+	success = s_write(s, data.bytes.array, data.bytes.num) ==
+		  data.bytes.num;
+	array_output_serializer_free(&data);
+	return success;
+}
+
+/* ------------------------------------------------------------------------- */
+
+static inline struct mp4_track *get_track(struct mp4_mux *mux,
+					  const struct encoder_packet *packet)
+{
+	for (size_t i = 0; i < mux->num_tracks; i++) {
+		struct mp4_track *track = &mux->tracks[i];
+
+		if (track->type != packet->type)
+			continue;
+		if (track->type == OBS_ENCODER_VIDEO ||
+		    track->track_id - 2 == (uint32_t)packet->track_idx)
+			return track;
+	}
+
+	return NULL;
+}
+
+bool mp4_mux_needs_flush(struct mp4_mux *mux, struct encoder_packet *packet)
+{
+	if (packet && (packet->type != OBS_ENCODER_VIDEO || !packet->keyframe))
+		return false;
+
+	for (size_t i = 0; i < mux->num_tracks; i++) {
+		if (mux->tracks[i].samples.num)
+			return true;
+	}
+
+	return false;
+}
+
+void mp4_mux_add_packet(struct mp4_mux *mux, struct encoder_packet *packet)
+{
+	struct mp4_track *track = get_track(mux, packet);
+	struct encoder_packet sample;
+
+	if (!track)
+		return;
+
+	if (!mux->started) {
+		if (packet->type != OBS_ENCODER_VIDEO || !packet->keyframe)
+			return;
+
+		mux->start_dts_usec = packet->dts_usec;
+		mux->started = true;
+	}
+
+	if (!track->started) {
+		if (packet->dts_usec < mux->start_dts_usec)
+			return;
+
+		track->first_dts = packet->dts;
+		track->base_time = util_mul_div64(
+			(uint64_t)(packet->dts_usec - mux->start_dts_usec),
+			track->timescale, 1000000);
+		track->started = true;
+	}
+
+	if (track->type == OBS_ENCODER_VIDEO)
+		obs_parse_avc_packet(&sample, packet);
+	else
+		obs_encoder_packet_ref(&sample, packet);
+
+	da_push_back(track->samples, &sample);
+}
+
+static bool init_video_track(struct mp4_track *track, obs_output_t *output,
+			     obs_encoder_t *vencoder)
+{
+	video_t *video = obs_encoder_video(vencoder);
+	const struct video_output_info *voi = video_output_get_info(video);
+	uint8_t *header;
+	size_t size;
+
+	if (!obs_encoder_get_extra_data(vencoder, &header, &size))
+		return false;
+
+	track->type = OBS_ENCODER_VIDEO;
+	track->track_id = 1;
+	track->timescale = voi->fps_num;
+	track->width = obs_output_get_width(output);
+	track->height = obs_output_get_height(output);
+	track->header_size = obs_parse_avc_header(&track->header, header, size);
+	return true;
+}
+
+static bool init_audio_track(struct mp4_track *track, obs_encoder_t *aencoder,
+			     size_t idx)
+{
+	obs_data_t *settings = obs_encoder_get_settings(aencoder);
+	audio_t *audio = obs_encoder_audio(aencoder);
+	uint8_t *header;
+	size_t size;
+
+	track->bitrate = (uint32_t)obs_data_get_int(settings, "bitrate") * 1000;
+	obs_data_release(settings);
+
+	if (!obs_encoder_get_extra_data(aencoder, &header, &size))
+		return false;
+
+	track->type = OBS_ENCODER_AUDIO;
+	track->track_id = (uint32_t)idx + 2;
+	track->timescale = obs_encoder_get_sample_rate(aencoder);
+	track->channels = (uint32_t)audio_output_get_channels(audio);
+	track->header = bmemdup(header, size);
+	track->header_size = size;
+	return true;
+}
+
+bool mp4_mux_init(struct mp4_mux *mux, obs_output_t *output)
+{
+	obs_encoder_t *vencoder = obs_output_get_video_encoder(output);
+
+	memset(mux, 0, sizeof(*mux));
+
+	/* fragments are cut at video keyframes */
+	if (!vencoder || !init_video_track(&mux->tracks[0], output, vencoder))
+		return false;
+	mux->num_tracks++;
+
+	for (size_t i = 0; i < MAX_AUDIO_MIXES; i++) {
+		obs_encoder_t *aencoder = obs_output_get_audio_encoder(output, i);
+		if (!aencoder)
+			continue;
+
+		if (!init_audio_track(&mux->tracks[mux->num_tracks], aencoder,
+				      i))
+			return false;
+		mux->num_tracks++;
+	}
+
+	return true;
+}
+
+void mp4_mux_free(struct mp4_mux *mux)
+{
+	for (size_t i = 0; i < MP4_MAX_TRACKS; i++) {
+		struct mp4_track *track = &mux->tracks[i];
+
+		for (size_t j = 0; j < track->samples.num; j++)
+			obs_encoder_packet_release(&track->samples.array[j]);
+
+		da_free(track->samples);
+		da_free(track->index);
+		bfree(track->header);
+	}
+
+	memset(mux, 0, sizeof(*mux));
+}
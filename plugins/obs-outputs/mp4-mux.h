@@ -0,0 +1,85 @@
+#pragma once
+
+#include <obs.h>
+#include <util/darray.h>
+#include <util/serializer.h>
+
+/*
+ * Fragmented MP4 (CMAF-style) muxing of encoder packets.
+ *
+ * The file starts with an init segment (ftyp + moov without samples), and
+ * every GOP is then written as its own moof + mdat fragment.  Everything
+ * before the last complete fragment is playable even if the writer never
+ * gets to finish the file.  An mfra random access index can be appended at
+ * the end for faster seeking, but readers don't need it.
+ */
+
+#define MP4_MAX_TRACKS (1 + MAX_AUDIO_MIXES)
+
+struct mp4_tfra_entry {
+	uint64_t time;
+	uint64_t moof_offset;
+};
+
+struct mp4_track {
+	enum obs_encoder_type type;
+	uint32_t track_id;
+	uint32_t timescale;
+
+	/* AVCDecoderConfigurationRecord or AudioSpecificConfig */
+	uint8_t *header;
+	size_t header_size;
+
+	uint32_t width;
+	uint32_t height;
+	uint32_t channels;
+	uint32_t bitrate;
+
+	/* samples of the current fragment, video is length-prefixed */
+	DARRAY(struct encoder_packet) samples;
+	bool started;
+	int64_t first_dts;
+	uint64_t base_time;
+	uint32_t last_duration;
+
+	DARRAY(struct mp4_tfra_entry) index;
+};
+
+struct mp4_mux {
+	struct mp4_track tracks[MP4_MAX_TRACKS];
+	size_t num_tracks;
+
+	int64_t start_dts_usec;
+	bool started;
+	uint32_t sequence;
+};
+
+/* sets up the tracks from the output's encoders */
+extern bool mp4_mux_init(struct mp4_mux *mux, obs_output_t *output);
+extern void mp4_mux_free(struct mp4_mux *mux);
+
+/* the write functions return false if the serializer didn't take all of
+ * the data */
+
+/* ftyp + moov, written once at the start of the file */
+extern bool mp4_mux_write_init_segment(struct mp4_mux *mux,
+				       struct serializer *s);
+
+/* true if the packet starts a new GOP and the queued samples should be
+ * written as a fragment before adding it.  with a NULL packet, true if
+ * anything is queued at all. */
+extern bool mp4_mux_needs_flush(struct mp4_mux *mux,
+				struct encoder_packet *packet);
+
+/* queues a packet for the next fragment, dropping anything before the first
+ * video keyframe.  takes its own reference to the packet. */
+extern void mp4_mux_add_packet(struct mp4_mux *mux,
+			       struct encoder_packet *packet);
+
+/* writes the queued samples as one moof + mdat fragment.  next is the video
+ * packet starting the next GOP, or NULL at the end of the file. */
+extern bool mp4_mux_write_fragment(struct mp4_mux *mux, struct serializer *s,
+				   const struct encoder_packet *next);
+
+/* mfra random access index, written once at the end of the file */
+extern bool mp4_mux_write_index(struct mp4_mux *mux, struct serializer *s);
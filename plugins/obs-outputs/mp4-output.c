@@ -0,0 +1,251 @@
+#include <stdio.h>
+#include <errno.h>
+#include <obs-module.h>
+#include <util/platform.h>
+#include <util/dstr.h>
+#include <util/threading.h>
+#include "mp4-mux.h"
+
+#define do_log(level, format, ...)                 \
+	blog(level, "[fmp4 output: '%s'] " format, \
+	     obs_output_get_name(stream->output), ##__VA_ARGS__)
+
+#define warn(format, ...) do_log(LOG_WARNING, format, ##__VA_ARGS__)
+#define info(format, ...) do_log(LOG_INFO, format, ##__VA_ARGS__)
+
+struct fmp4_output {
+	obs_output_t *output;
+	struct dstr path;
+	FILE *file;
+	struct serializer s;
+	volatile bool active;
+	volatile bool stopping;
+	uint64_t stop_ts;
+	bool wrote_init;
+
+	pthread_mutex_t mutex;
+
+	struct mp4_mux mux;
+};
+
+static inline bool stopping(struct fmp4_output *stream)
+{
+	return os_atomic_load_bool(&stream->stopping);
+}
+
+static inline bool active(struct fmp4_output *stream)
+{
+	return os_atomic_load_bool(&stream->active);
+}
+
+static size_t file_write(void *file, const void *data, size_t size)
+{
+	return fwrite(data, 1, size, file);
+}
+
+static int64_t file_get_pos(void *file)
+{
+	return os_ftelli64(file);
+}
+
+static const char *fmp4_output_getname(void *unused)
+{
+	UNUSED_PARAMETER(unused);
+	return obs_module_text("FMP4Output");
+}
+
+static void fmp4_output_stop(void *data, uint64_t ts);
+
+static void fmp4_output_destroy(void *data)
+{
+	struct fmp4_output *stream = data;
+
+	mp4_mux_free(&stream->mux);
+	pthread_mutex_destroy(&stream->mutex);
+	dstr_free(&stream->path);
+	bfree(stream);
+}
+
+static void *fmp4_output_create(obs_data_t *settings, obs_output_t *output)
+{
+	struct fmp4_output *stream = bzalloc(sizeof(struct fmp4_output));
+	stream->output = output;
+	stream->s.write = file_write;
+	stream->s.get_pos = file_get_pos;
+	pthread_mutex_init(&stream->mutex, NULL);
+
+	UNUSED_PARAMETER(settings);
+	return stream;
+}
+
+static bool fmp4_output_start(void *data)
+{
+	struct fmp4_output *stream = data;
+	obs_data_t *settings;
+	const char *path;
+
+	if (!obs_output_can_begin_data_capture(stream->output, 0))
+		return false;
+	if (!obs_output_initialize_encoders(stream->output, 0))
+		return false;
+
+	stream->wrote_init = false;
+	os_atomic_set_bool(&stream->stopping, false);
+
+	mp4_mux_free(&stream->mux);
+	if (!mp4_mux_init(&stream->mux, stream->output)) {
+		warn("Unable to get encoder headers");
+		return false;
+	}
+
+	/* get path */
+	settings = obs_output_get_settings(stream->output);
+	path = obs_data_get_string(settings, "path");
+	dstr_copy(&stream->path, path);
+	obs_data_release(settings);
+
+	stream->file = os_fopen(stream->path.array, "wb");
+	if (!stream->file) {
+		warn("Unable to open MP4 file '%s'", stream->path.array);
+		return false;
+	}
+
+	stream->s.data = stream->file;
+
+	/* write headers and start capture */
+	os_atomic_set_bool(&stream->active, true);
+	obs_output_begin_data_capture(stream->output, 0);
+
+	info("Writing fragmented MP4 file '%s'...", stream->path.array);
+	return true;
+}
+
+static void fmp4_output_stop(void *data, uint64_t ts)
+{
+	struct fmp4_output *stream = data;
+	stream->stop_ts = ts / 1000;
+	os_atomic_set_bool(&stream->stopping, true);
+}
+
+static inline int write_error_code(void)
+{
+	return errno == ENOSPC ? OBS_OUTPUT_NO_SPACE : OBS_OUTPUT_ERROR;
+}
+
+static bool write_fragment(struct fmp4_output *stream,
+			   struct encoder_packet *next)
+{
+	if (!stream->wrote_init) {
+		if (!mp4_mux_write_init_segment(&stream->mux, &stream->s))
+			return false;
+		stream->wrote_init = true;
+	}
+
+	if (!mp4_mux_write_fragment(&stream->mux, &stream->s, next))
+		return false;
+
+	/* everything up to here stays playable if we never get to finish */
+	return fflush(stream->file) == 0;
+}
+
+static void fmp4_output_actual_stop(struct fmp4_output *stream, int code)
+{
+	os_atomic_set_bool(&stream->active, false);
+
+	if (stream->file) {
+		/* after a write error the file is left as far as it got */
+		if (!code) {
+			bool success = true;
+
+			if (mp4_mux_needs_flush(&stream->mux, NULL))
+				success = write_fragment(stream, NULL);
+			if (success && stream->wrote_init)
+				success = mp4_mux_write_index(&stream->mux,
+							      &stream->s);
+			if (!success) {
+				code = write_error_code();
+				warn("Failed to finish MP4 file '%s'",
+				     stream->path.array);
+			}
+		}
+
+		if (fclose(stream->file) != 0 && !code) {
+			code = write_error_code();
+			warn("Failed to close MP4 file '%s'",
+			     stream->path.array);
+		}
+		stream->file = NULL;
+	}
+
+	mp4_mux_free(&stream->mux);
+
+	if (code) {
+		obs_output_signal_stop(stream->output, code);
+	} else {
+		obs_output_end_data_capture(stream->output);
+	}
+
+	info("Fragmented MP4 file output complete");
+}
+
+static void fmp4_output_data(void *data, struct encoder_packet *packet)
+{
+	struct fmp4_output *stream = data;
+
+	pthread_mutex_lock(&stream->mutex);
+
+	if (!active(stream))
+		goto unlock;
+
+	if (!packet) {
+		fmp4_output_actual_stop(stream, OBS_OUTPUT_ENCODE_ERROR);
+		goto unlock;
+	}
+
+	if (stopping(stream)) {
+		if (packet->sys_dts_usec >= (int64_t)stream->stop_ts) {
+			fmp4_output_actual_stop(stream, 0);
+			goto unlock;
+		}
+	}
+
+	if (mp4_mux_needs_flush(&stream->mux, packet) &&
+	    !write_fragment(stream, packet)) {
+		int code = write_error_code();
+
+		warn("Failed to write to MP4 file '%s'", stream->path.array);
+		fmp4_output_actual_stop(stream, code);
+		goto unlock;
+	}
+
+	mp4_mux_add_packet(&stream->mux, packet);
+
+unlock:
+	pthread_mutex_unlock(&stream->mutex);
+}
+
+static obs_properties_t *fmp4_output_properties(void *unused)
+{
+	UNUSED_PARAMETER(unused);
+
+	obs_properties_t *props = obs_properties_create();
+
+	obs_properties_add_text(props, "path",
+				obs_module_text("FMP4Output.FilePath"),
+				OBS_TEXT_DEFAULT);
+	return props;
+}
+
+struct obs_output_info fmp4_output_info = {
+	.id = "fmp4_output",
+	.flags = OBS_OUTPUT_AV | OBS_OUTPUT_ENCODED | OBS_OUTPUT_MULTI_TRACK,
+	.encoded_video_codecs = "h264",
+	.encoded_audio_codecs = "aac",
+	.get_name = fmp4_output_getname,
+	.create = fmp4_output_create,
+	.destroy = fmp4_output_destroy,
+	.start = fmp4_output_start,
+	.stop = fmp4_output_stop,
+	.encoded_packet = fmp4_output_data,
+	.get_properties = fmp4_output_properties,
+};
@@ -50,23 +50,33 @@ static void log_rtmp(int level, const char *format, va_list args)
 }
 
 static inline size_t num_buffered_packets(struct rtmp_stream *stream);
+static void drop_queued_frames(struct rtmp_stream *stream, int priority);
 
+/* must not be called while the send thread is consuming packets */
 static inline void free_packets(struct rtmp_stream *stream)
 {
+	struct encoder_packet packet;
 	size_t num_packets;
 
-	pthread_mutex_lock(&stream->packets_mutex);
-
-	num_packets = num_buffered_packets(stream);
+	num_packets = num_buffered_packets(stream) +
+		      (stream->send_batch_num - stream->send_batch_pos);
 	if (num_packets)
 		info("Freeing %d remaining packets", (int)num_packets);
 
-	while (stream->packets.size) {
-		struct encoder_packet packet;
-		circlebuf_pop_front(&stream->packets, &packet, sizeof(packet));
+	while (stream->send_batch_pos < stream->send_batch_num)
+		obs_encoder_packet_release(
+			&stream->send_batch[stream->send_batch_pos++]);
+	stream->send_batch_pos = 0;
+	stream->send_batch_num = 0;
+
+	while (spsc_ring_pop_front(&stream->packets, &packet))
+		obs_encoder_packet_release(&packet);
+
+	while (stream->overflow.size) {
+		circlebuf_pop_front(&stream->overflow, &packet, sizeof(packet));
 		obs_encoder_packet_release(&packet);
 	}
-	pthread_mutex_unlock(&stream->packets_mutex);
+	os_atomic_set_bool(&stream->overflowed, false);
 }
 
 static inline bool stopping(struct rtmp_stream *stream)
@@ -120,8 +130,9 @@ static void rtmp_stream_destroy(void *data)
 	dstr_free(&stream->bind_ip);
 	os_event_destroy(stream->stop_event);
 	os_sem_destroy(stream->send_sem);
-	pthread_mutex_destroy(&stream->packets_mutex);
-	circlebuf_free(&stream->packets);
+	spsc_ring_free(&stream->packets);
+	circlebuf_free(&stream->overflow);
+	pthread_mutex_destroy(&stream->overflow_mutex);
 #ifdef TEST_FRAMEDROPS
 	circlebuf_free(&stream->droptest_info);
 #endif
@@ -143,14 +154,13 @@ static void *rtmp_stream_create(obs_data_t *settings, obs_output_t *output)
 {
 	struct rtmp_stream *stream = bzalloc(sizeof(struct rtmp_stream));
 	stream->output = output;
-	pthread_mutex_init_value(&stream->packets_mutex);
+	spsc_ring_init(&stream->packets, sizeof(struct encoder_packet),
+		       PACKET_QUEUE_SIZE);
 
 	RTMP_LogSetCallback(log_rtmp);
 	RTMP_Init(&stream->rtmp);
 	RTMP_LogSetLevel(RTMP_LOGWARNING);
 
-	if (pthread_mutex_init(&stream->packets_mutex, NULL) != 0)
-		goto fail;
 	if (os_event_init(&stream->stop_event, OS_EVENT_TYPE_MANUAL) != 0)
 		goto fail;
 
@@ -164,6 +174,11 @@ static void *rtmp_stream_create(obs_data_t *settings, obs_output_t *output)
 		goto fail;
 	}
 
+	if (pthread_mutex_init(&stream->overflow_mutex, NULL) != 0) {
+		warn("Failed to initialize overflow mutex");
+		goto fail;
+	}
+
 	if (os_event_init(&stream->buffer_space_available_event,
 			  OS_EVENT_TYPE_AUTO) != 0) {
 		warn("Failed to initialize write buffer event");
@@ -233,20 +248,52 @@ static inline void set_rtmp_dstr(AVal *val, struct dstr *str)
 	val->av_len = valid ? (int)str->len : 0;
 }
 
+/* while the overflow flag is set the encoder thread leaves the ring alone,
+ * so the send thread can move the overflowed packets back into it */
+static void refill_packets(struct rtmp_stream *stream)
+{
+	struct encoder_packet packet;
+
+	pthread_mutex_lock(&stream->overflow_mutex);
+	while (stream->overflow.size) {
+		circlebuf_peek_front(&stream->overflow, &packet,
+				     sizeof(packet));
+		if (!spsc_ring_push_back(&stream->packets, &packet))
+			break;
+		circlebuf_pop_front(&stream->overflow, NULL, sizeof(packet));
+	}
+	if (!stream->overflow.size)
+		os_atomic_set_bool(&stream->overflowed, false);
+	pthread_mutex_unlock(&stream->overflow_mutex);
+}
+
 static inline bool get_next_packet(struct rtmp_stream *stream,
 				   struct encoder_packet *packet)
 {
-	bool new_packet = false;
-
-	pthread_mutex_lock(&stream->packets_mutex);
-	if (stream->packets.size) {
-		circlebuf_pop_front(&stream->packets, packet,
-				    sizeof(struct encoder_packet));
-		new_packet = true;
+	if (stream->send_batch_pos == stream->send_batch_num) {
+		/* the encoder thread decides when to drop frames, but only
+		 * the send thread can compact the ring */
+		long drop_priority =
+			os_atomic_exchange_long(&stream->drop_priority, 0);
+		if (drop_priority)
+			drop_queued_frames(stream, (int)drop_priority);
+
+		if (os_atomic_load_bool(&stream->overflowed))
+			refill_packets(stream);
+
+		stream->send_batch_pos = 0;
+		stream->send_batch_num = spsc_ring_pop_front_batch(
+			&stream->packets, stream->send_batch, SEND_BATCH_SIZE);
+		if (!stream->send_batch_num)
+			return false;
 	}
-	pthread_mutex_unlock(&stream->packets_mutex);
 
-	return new_packet;
+	*packet = stream->send_batch[stream->send_batch_pos++];
+
+	if (packet->type == OBS_ENCODER_VIDEO)
+		os_atomic_store_long(&stream->sent_dts_msec,
+				     (long)(packet->dts_usec / 1000));
+	return true;
 }
 
 static bool discard_recv_data(struct rtmp_stream *stream, size_t size)
@@ -427,17 +474,39 @@ static int send_packet(struct rtmp_stream *stream,
 		flv_additional_packet_mux(
 			packet, is_header ? 0 : stream->start_dts_offset, &data,
 			&size, is_header, idx);
+
+#ifdef TEST_FRAMEDROPS
+		droptest_cap_data_rate(stream, size);
+#endif
+
+		ret = RTMP_Write(&stream->rtmp, (char *)data, (int)size, 0);
+		bfree(data);
 	} else {
-		flv_packet_mux(packet, is_header ? 0 : stream->start_dts_offset,
-			       &data, &size, is_header);
-	}
+		/* the packet data is sent straight from the packet, only the
+		 * tag header is built here */
+		uint8_t header[FLV_TAG_HEADER_MAX_SIZE];
+		RTMPIOVec iov[2];
+
+		size = flv_packet_header(packet,
+					 is_header ? 0
+						   : stream->start_dts_offset,
+					 header, is_header);
+		if (size) {
+			iov[0].buf = (const char *)header;
+			iov[0].len = (int)size;
+			iov[1].buf = (const char *)packet->data;
+			iov[1].len = (int)packet->size;
+
+			/* count the tag size too, like the full tag would */
+			size += packet->size + 4;
 
 #ifdef TEST_FRAMEDROPS
-	droptest_cap_data_rate(stream, size);
+			droptest_cap_data_rate(stream, size);
 #endif
 
-	ret = RTMP_Write(&stream->rtmp, (char *)data, (int)size, 0);
-	bfree(data);
+			ret = RTMP_WriteV(&stream->rtmp, iov, 2, 0);
+		}
+	}
 
 	if (is_header)
 		bfree(packet->data);
@@ -583,6 +652,10 @@ static void *send_thread(void *data)
 			break;
 		}
 
+		/* set by the encoder thread when the send queue is full */
+		if (disconnected(stream))
+			break;
+
 		if (!get_next_packet(stream, &packet))
 			continue;
 
@@ -1053,6 +1126,8 @@ static bool init_connect(struct rtmp_stream *stream)
 	stream->total_bytes_sent = 0;
 	stream->dropped_frames = 0;
 	stream->min_priority = 0;
+	stream->drop_priority = 0;
+	stream->drop_dts_usec = 0;
 	stream->got_first_video = false;
 
 	settings = obs_output_get_settings(stream->output);
@@ -1159,14 +1234,111 @@ static bool rtmp_stream_start(void *data)
 static inline bool add_packet(struct rtmp_stream *stream,
 			      struct encoder_packet *packet)
 {
-	circlebuf_push_back(&stream->packets, packet,
-			    sizeof(struct encoder_packet));
-	return true;
+	bool full;
+
+	if (!os_atomic_load_bool(&stream->overflowed) &&
+	    spsc_ring_push_back(&stream->packets, packet))
+		return true;
+
+	/* the ring is full: queue the packet behind it instead of dropping
+	 * it, it could be audio or a keyframe.  everything after it has to
+	 * go the same way to keep the packets in order, until the send
+	 * thread has moved the overflow back into the ring. */
+	pthread_mutex_lock(&stream->overflow_mutex);
+	full = stream->overflow.size / sizeof(*packet) >= PACKET_QUEUE_SIZE;
+	if (!full) {
+		if (!stream->overflow.size)
+			debug("Packet queue full, queueing packets in "
+			      "overflow");
+		circlebuf_push_back(&stream->overflow, packet,
+				    sizeof(*packet));
+		os_atomic_set_bool(&stream->overflowed, true);
+	}
+	pthread_mutex_unlock(&stream->overflow_mutex);
+
+	/* frame dropping trims the overflow as well, so it only fills up
+	 * with audio and keyframes when nothing gets through at all */
+	if (full) {
+		warn("Send queue full, disconnecting");
+		os_atomic_set_bool(&stream->disconnected, true);
+		os_sem_post(stream->send_sem);
+	}
+
+	return !full;
 }
 
 static inline size_t num_buffered_packets(struct rtmp_stream *stream)
 {
-	return stream->packets.size / sizeof(struct encoder_packet);
+	size_t num = spsc_ring_size(&stream->packets);
+
+	if (os_atomic_load_bool(&stream->overflowed)) {
+		pthread_mutex_lock(&stream->overflow_mutex);
+		num += stream->overflow.size / sizeof(struct encoder_packet);
+		pthread_mutex_unlock(&stream->overflow_mutex);
+	}
+
+	return num;
+}
+
+struct drop_frames_data {
+	struct rtmp_stream *stream;
+	int highest_priority;
+};
+
+static bool keep_undroppable_packet(void *param, void *elem)
+{
+	struct drop_frames_data *data = param;
+	struct encoder_packet *packet = elem;
+
+	/* do not drop audio data or video keyframes */
+	if (packet->type == OBS_ENCODER_AUDIO ||
+	    packet->drop_priority >= data->highest_priority)
+		return true;
+
+	os_atomic_inc_long(&data->stream->dropped_frames);
+	obs_encoder_packet_release(packet);
+	return false;
+}
+
+/* send thread: compacts the ring, which only the consumer may do */
+static void drop_queued_frames(struct rtmp_stream *stream, int priority)
+{
+	struct drop_frames_data data = {stream, priority};
+	size_t num_frames_dropped;
+
+	num_frames_dropped = spsc_ring_compact(&stream->packets,
+					       keep_undroppable_packet, &data);
+	if (num_frames_dropped)
+		debug("Dropped %d queued frames", (int)num_frames_dropped);
+}
+
+/* encoder thread: the overflow can be trimmed right away under its mutex */
+static void drop_overflow_frames(struct rtmp_stream *stream, int priority)
+{
+	struct drop_frames_data data = {stream, priority};
+	struct circlebuf new_buf = {0};
+
+	if (!os_atomic_load_bool(&stream->overflowed))
+		return;
+
+	pthread_mutex_lock(&stream->overflow_mutex);
+
+	circlebuf_reserve(&new_buf, stream->overflow.size);
+
+	while (stream->overflow.size) {
+		struct encoder_packet packet;
+		circlebuf_pop_front(&stream->overflow, &packet, sizeof(packet));
+
+		if (keep_undroppable_packet(&data, &packet))
+			circlebuf_push_back(&new_buf, &packet, sizeof(packet));
+	}
+
+	circlebuf_free(&stream->overflow);
+	stream->overflow = new_buf;
+	if (!stream->overflow.size)
+		os_atomic_set_bool(&stream->overflowed, false);
+
+	pthread_mutex_unlock(&stream->overflow_mutex);
 }
 
 static void drop_frames(struct rtmp_stream *stream, const char *name,
@@ -1174,62 +1346,41 @@ static void drop_frames(struct rtmp_stream *stream, const char *name,
 {
 	UNUSED_PARAMETER(pframes);
 
-	struct circlebuf new_buf = {0};
-	int num_frames_dropped = 0;
-
 #ifdef _DEBUG
 	int start_packets = (int)num_buffered_packets(stream);
 #else
 	UNUSED_PARAMETER(name);
 #endif
 
-	circlebuf_reserve(&new_buf, sizeof(struct encoder_packet) * 8);
-
-	while (stream->packets.size) {
-		struct encoder_packet packet;
-		circlebuf_pop_front(&stream->packets, &packet, sizeof(packet));
-
-		/* do not drop audio data or video keyframes */
-		if (packet.type == OBS_ENCODER_AUDIO ||
-		    packet.drop_priority >= highest_priority) {
-			circlebuf_push_back(&new_buf, &packet, sizeof(packet));
-
-		} else {
-			num_frames_dropped++;
-			obs_encoder_packet_release(&packet);
-		}
-	}
+	/* the send thread drops the queued frames before taking its next
+	 * batch, even while this thread keeps queueing new ones */
+	if (os_atomic_load_long(&stream->drop_priority) < highest_priority)
+		os_atomic_store_long(&stream->drop_priority, highest_priority);
+	drop_overflow_frames(stream, highest_priority);
 
-	circlebuf_free(&stream->packets);
-	stream->packets = new_buf;
+	/* everything queued up to here is dropped or undroppable */
+	stream->drop_dts_usec = stream->last_dts_usec;
 
-	if (stream->min_priority < highest_priority)
-		stream->min_priority = highest_priority;
-	if (!num_frames_dropped)
-		return;
+	if (os_atomic_load_long(&stream->min_priority) < highest_priority)
+		os_atomic_store_long(&stream->min_priority, highest_priority);
 
-	stream->dropped_frames += num_frames_dropped;
 #ifdef _DEBUG
-	debug("Dropped %s, prev packet count: %d, new packet count: %d", name,
-	      start_packets, (int)num_buffered_packets(stream));
+	debug("Dropping %s, packet count: %d", name, start_packets);
 #endif
 }
 
-static bool find_first_video_packet(struct rtmp_stream *stream,
-				    struct encoder_packet *first)
+/* dts of the oldest packet that can still be dropped.  the send thread
+ * publishes its position in milliseconds in a long, which may only be 32
+ * bits, so it is taken relative to the newest packet */
+static int64_t get_first_dts_usec(struct rtmp_stream *stream)
 {
-	size_t count = stream->packets.size / sizeof(*first);
-
-	for (size_t i = 0; i < count; i++) {
-		struct encoder_packet *cur =
-			circlebuf_data(&stream->packets, i * sizeof(*first));
-		if (cur->type == OBS_ENCODER_VIDEO && !cur->keyframe) {
-			*first = *cur;
-			return true;
-		}
-	}
+	unsigned long sent =
+		(unsigned long)os_atomic_load_long(&stream->sent_dts_msec);
+	unsigned long last = (unsigned long)(stream->last_dts_usec / 1000);
+	int64_t first = stream->last_dts_usec -
+			(int64_t)(long)(last - sent) * 1000;
 
-	return false;
+	return first < stream->drop_dts_usec ? stream->drop_dts_usec : first;
 }
 
 static bool dbr_bitrate_lowered(struct rtmp_stream *stream)
@@ -1324,7 +1475,6 @@ static void dbr_inc_bitrate(struct rtmp_stream *stream)
 
 static void check_to_drop_frames(struct rtmp_stream *stream, bool pframes)
 {
-	struct encoder_packet first;
 	int64_t buffer_duration_usec;
 	size_t num_packets = num_buffered_packets(stream);
 	const char *name = pframes ? "p-frames" : "b-frames";
@@ -1351,12 +1501,10 @@ static void check_to_drop_frames(struct rtmp_stream *stream, bool pframes)
 		return;
 	}
 
-	if (!find_first_video_packet(stream, &first))
-		return;
-
 	/* if the amount of time stored in the buffered packets waiting to be
 	 * sent is higher than threshold, drop frames */
-	buffer_duration_usec = stream->last_dts_usec - first.dts_usec;
+	buffer_duration_usec =
+		stream->last_dts_usec - get_first_dts_usec(stream);
 
 	if (!pframes) {
 		stream->congestion =
@@ -1397,16 +1545,22 @@ static void check_to_drop_frames(struct rtmp_stream *stream, bool pframes)
 static bool add_video_packet(struct rtmp_stream *stream,
 			     struct encoder_packet *packet)
 {
+	long min_priority;
+
+	/* the drop check runs here on the encoder thread, so that frames
+	 * are still dropped while the send thread is blocked on the socket */
 	check_to_drop_frames(stream, false);
 	check_to_drop_frames(stream, true);
 
+	min_priority = os_atomic_load_long(&stream->min_priority);
+
 	/* if currently dropping frames, drop packets until it reaches the
 	 * desired priority */
-	if (packet->drop_priority < stream->min_priority) {
-		stream->dropped_frames++;
+	if (packet->drop_priority < min_priority) {
+		os_atomic_inc_long(&stream->dropped_frames);
 		return false;
-	} else {
-		stream->min_priority = 0;
+	} else if (min_priority) {
+		os_atomic_store_long(&stream->min_priority, 0);
 	}
 
 	stream->last_dts_usec = packet->dts_usec;
@@ -1433,6 +1587,9 @@ static void rtmp_stream_data(void *data, struct encoder_packet *packet)
 		if (!stream->got_first_video) {
 			stream->start_dts_offset =
 				get_ms_time(packet, packet->dts);
+			stream->last_dts_usec = packet->dts_usec;
+			os_atomic_store_long(&stream->sent_dts_msec,
+					     (long)(packet->dts_usec / 1000));
 			stream->got_first_video = true;
 		}
 
@@ -1441,16 +1598,12 @@ static void rtmp_stream_data(void *data, struct encoder_packet *packet)
 		obs_encoder_packet_ref(&new_packet, packet);
 	}
 
-	pthread_mutex_lock(&stream->packets_mutex);
-
 	if (!disconnected(stream)) {
 		added_packet = (packet->type == OBS_ENCODER_VIDEO)
 				       ? add_video_packet(stream, &new_packet)
 				       : add_packet(stream, &new_packet);
 	}
 
-	pthread_mutex_unlock(&stream->packets_mutex);
-
 	if (added_packet)
 		os_sem_post(stream->send_sem);
 	else
@@ -1510,7 +1663,7 @@ static uint64_t rtmp_stream_total_bytes_sent(void *data)
 static int rtmp_stream_dropped_frames(void *data)
 {
 	struct rtmp_stream *stream = data;
-	return stream->dropped_frames;
+	return (int)os_atomic_load_long(&stream->dropped_frames);
 }
 
 static float rtmp_stream_congestion(void *data)
@@ -1521,7 +1674,9 @@ static float rtmp_stream_congestion(void *data)
 		return (float)stream->write_buf_len /
 		       (float)stream->write_buf_size;
 	else
-		return stream->min_priority > 0 ? 1.0f : stream->congestion;
+		return os_atomic_load_long(&stream->min_priority) > 0
+			       ? 1.0f
+			       : stream->congestion;
 }
 
 static int rtmp_stream_connect_time(void *data)
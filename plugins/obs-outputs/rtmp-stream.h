@@ -2,6 +2,7 @@
 #include <obs-avc.h>
 #include <util/platform.h>
 #include <util/circlebuf.h>
+#include <util/spsc-ring.h>
 #include <util/dstr.h>
 #include <util/threading.h>
 #include <inttypes.h>
@@ -33,6 +34,9 @@
 #define OPT_LOWLATENCY_ENABLED "low_latency_mode_enabled"
 #define OPT_METADATA_MULTITRACK "metadata_multitrack"
 
+#define PACKET_QUEUE_SIZE 4096
+#define SEND_BATCH_SIZE 16
+
 //#define TEST_FRAMEDROPS
 //#define TEST_FRAMEDROPS_WITH_BITRATE_SHORTCUTS
 
@@ -56,8 +60,17 @@ struct dbr_frame {
 struct rtmp_stream {
 	obs_output_t *output;
 
-	pthread_mutex_t packets_mutex;
-	struct circlebuf packets;
+	/* written by the encoder thread, read by the send thread */
+	struct spsc_ring packets;
+	struct encoder_packet send_batch[SEND_BATCH_SIZE];
+	size_t send_batch_pos;
+	size_t send_batch_num;
+
+	/* packets that did not fit in the ring, see add_packet */
+	pthread_mutex_t overflow_mutex;
+	struct circlebuf overflow;
+	volatile bool overflowed;
+
 	bool sent_headers;
 
 	bool got_first_video;
@@ -86,13 +99,19 @@ struct rtmp_stream {
 	/* frame drop variables */
 	int64_t drop_threshold_usec;
 	int64_t pframe_drop_threshold_usec;
-	int min_priority;
+	volatile long min_priority;
+	volatile long drop_priority;
 	float congestion;
 
+	/* the encoder thread decides when to drop, and needs to know how far
+	 * the send thread has got: dts of the last video packet sent, in
+	 * milliseconds so that it fits an atomic long */
+	volatile long sent_dts_msec;
 	int64_t last_dts_usec;
+	int64_t drop_dts_usec;
 
 	uint64_t total_bytes_sent;
-	int dropped_frames;
+	volatile long dropped_frames;
 
 #ifdef TEST_FRAMEDROPS
 	struct circlebuf droptest_info;
@@ -1,7 +1,9 @@
 #include <obs-module.h>
 #include <obs-avc.h>
 #include <util/platform.h>
+#include <util/darray.h>
 #include <util/circlebuf.h>
+#include <util/spsc-ring.h>
 #include <util/dstr.h>
 #include <util/threading.h>
 #include <inttypes.h>
@@ -21,6 +23,9 @@
 
 #define TIME_TO_CLEAR_CONGESTION_NS 5000000000
 #define STATS_QUERY_INTERVAL_NS 1000000000
+#define ADTS_HEADER_SIZE 7
+#define PACKET_QUEUE_SIZE 4096
+#define SEND_BATCH_SIZE 16
 
 unsigned int ZIXI_LATENCIES[] = {100,  200,   300,   500,   1000, 1500,
 				 2000, 2500,  3000,  4000,  5000, 6000,
@@ -97,8 +102,16 @@ struct zixi_stream_source_control {
 struct zixi_stream {
 	obs_output_t *output;
 
-	pthread_mutex_t packets_mutex;
-	struct circlebuf packets;
+	/* written by the encoder thread, read by the send thread */
+	struct spsc_ring packets;
+	struct encoder_packet send_batch[SEND_BATCH_SIZE];
+	size_t send_batch_pos;
+	size_t send_batch_num;
+
+	/* packets that did not fit in the ring, see add_packet */
+	pthread_mutex_t overflow_mutex;
+	struct circlebuf overflow;
+	volatile bool overflowed;
 
 	volatile bool connecting;
 	pthread_t connect_thread;
@@ -137,12 +150,18 @@ struct zixi_stream {
 	/* frame drop variables */
 	int64_t drop_threshold_usec;
 	int64_t min_drop_dts_usec;
-	int min_priority;
-
+	volatile long min_priority;
+	volatile bool drop_requested;
+
+	/* the encoder thread decides when to drop, and needs to know how far
+	 * the send thread has got: dts of the last packet sent, in
+	 * milliseconds so that it fits an atomic long */
+	volatile long sent_dts_msec;
+	bool got_first_packet;
 	int64_t last_dts_usec;
 	uint64_t total_bytes_sent;
 
-	int dropped_frames;
+	volatile long dropped_frames;
 
 	void *zixi_handle;
 
@@ -165,6 +184,9 @@ struct zixi_stream {
 	uint64_t now_dropped_packets;
 	uint64_t congested_start_ts;
 
+	/* audio framing scratch, reused by the send thread */
+	DARRAY(uint8_t) frame_buf;
+
 	struct ZixiFeederFunctions feeder_functions;
 };
 
@@ -173,14 +195,15 @@ static void fill_machine_id();
 
 static bool add_video_packet(struct zixi_stream *stream,
 			     struct encoder_packet *video_packet);
+static void drop_queued_frames(struct zixi_stream *stream);
 
 static bool zixi_encryption_changed(obs_properties_t *ppts, obs_property_t *p,
 				    obs_data_t *settings);
 static bool zixi_parse_url(struct dstr *url, char **host, short *port,
 			   char **channel_name);
-static void zixi_add_adts_headers(struct zixi_stream *stream,
-				  struct encoder_packet *out,
-				  struct encoder_packet *in);
+static void zixi_write_adts_header(struct zixi_stream *stream,
+				   uint8_t adts[ADTS_HEADER_SIZE],
+				   size_t payload_size);
 unsigned int zixi_convert_latency(int id)
 {
 	unsigned int ret = 2000;
@@ -220,7 +243,15 @@ static inline bool disconnected(struct zixi_stream *stream)
 
 static inline size_t num_buffered_packets(struct zixi_stream *stream)
 {
-	return stream->packets.size / sizeof(struct encoder_packet);
+	size_t num = spsc_ring_size(&stream->packets);
+
+	if (os_atomic_load_bool(&stream->overflowed)) {
+		pthread_mutex_lock(&stream->overflow_mutex);
+		num += stream->overflow.size / sizeof(struct encoder_packet);
+		pthread_mutex_unlock(&stream->overflow_mutex);
+	}
+
+	return num;
 }
 static inline bool reset_semaphore(struct zixi_stream *stream)
 {
@@ -283,38 +314,75 @@ static void zixi_encoder_feedback(int total_bps, bool force_iframe, void *param)
 	}
 }
 
+/* while the overflow flag is set the encoder thread leaves the ring alone,
+ * so the send thread can move the overflowed packets back into it */
+static void refill_packets(struct zixi_stream *stream)
+{
+	struct encoder_packet packet;
+
+	pthread_mutex_lock(&stream->overflow_mutex);
+	while (stream->overflow.size) {
+		circlebuf_peek_front(&stream->overflow, &packet,
+				     sizeof(packet));
+		if (!spsc_ring_push_back(&stream->packets, &packet))
+			break;
+		circlebuf_pop_front(&stream->overflow, NULL, sizeof(packet));
+	}
+	if (!stream->overflow.size)
+		os_atomic_set_bool(&stream->overflowed, false);
+	pthread_mutex_unlock(&stream->overflow_mutex);
+}
+
 static inline bool get_next_packet(struct zixi_stream *stream,
 				   struct encoder_packet *packet)
 {
-	bool new_packet = false;
-
-	pthread_mutex_lock(&stream->packets_mutex);
-	if (stream->packets.size) {
-		circlebuf_pop_front(&stream->packets, packet,
-				    sizeof(struct encoder_packet));
-		new_packet = true;
+	if (stream->send_batch_pos == stream->send_batch_num) {
+		/* the encoder thread decides when to drop frames, but only
+		 * the send thread can compact the ring */
+		if (os_atomic_exchange_bool(&stream->drop_requested, false))
+			drop_queued_frames(stream);
+
+		if (os_atomic_load_bool(&stream->overflowed))
+			refill_packets(stream);
+
+		stream->send_batch_pos = 0;
+		stream->send_batch_num = spsc_ring_pop_front_batch(
+			&stream->packets, stream->send_batch, SEND_BATCH_SIZE);
+		if (!stream->send_batch_num)
+			return false;
 	}
-	pthread_mutex_unlock(&stream->packets_mutex);
 
-	return new_packet;
+	*packet = stream->send_batch[stream->send_batch_pos++];
+	os_atomic_store_long(&stream->sent_dts_msec,
+			     (long)(packet->dts_usec / 1000));
+	return true;
 }
 
+/* must not be called while the send thread is consuming packets */
 static inline void free_packets(struct zixi_stream *stream)
 {
+	struct encoder_packet packet;
 	size_t num_packets;
 
-	pthread_mutex_lock(&stream->packets_mutex);
-
-	num_packets = num_buffered_packets(stream);
+	num_packets = num_buffered_packets(stream) +
+		      (stream->send_batch_num - stream->send_batch_pos);
 	if (num_packets)
 		info("Freeing %d remaining packets", (int)num_packets);
 
-	while (stream->packets.size) {
-		struct encoder_packet packet;
-		circlebuf_pop_front(&stream->packets, &packet, sizeof(packet));
+	while (stream->send_batch_pos < stream->send_batch_num)
+		obs_encoder_packet_release(
+			&stream->send_batch[stream->send_batch_pos++]);
+	stream->send_batch_pos = 0;
+	stream->send_batch_num = 0;
+
+	while (spsc_ring_pop_front(&stream->packets, &packet))
+		obs_encoder_packet_release(&packet);
+
+	while (stream->overflow.size) {
+		circlebuf_pop_front(&stream->overflow, &packet, sizeof(packet));
 		obs_encoder_packet_release(&packet);
 	}
-	pthread_mutex_unlock(&stream->packets_mutex);
+	os_atomic_set_bool(&stream->overflowed, false);
 }
 
 static uint64_t zixi_wrap_ts(uint64_t dts, int64_t num, int64_t den)
@@ -360,9 +428,27 @@ static int send_packet(struct zixi_stream *stream,
 	}
 
 	// info("zixi_send -> %s [%u / %u]", packet->type == OBS_ENCODER_VIDEO ? "video" : "audio", packet->pts, packet->dts);
-	ret = stream->feeder_functions.zixi_send_elementary_frame(
-		stream->zixi_handle, packet->data, packet->size,
-		packet->type == OBS_ENCODER_VIDEO, packet->pts, packet->dts);
+	if (packet->type == OBS_ENCODER_AUDIO) {
+		uint8_t *frame;
+
+		/* the feeder wants one contiguous ADTS frame; assemble it in
+		 * the reused scratch buffer rather than allocating a copy of
+		 * every packet on the encoder thread */
+		size += ADTS_HEADER_SIZE;
+		da_resize(stream->frame_buf, size);
+		frame = stream->frame_buf.array;
+
+		zixi_write_adts_header(stream, frame, packet->size);
+		memcpy(frame + ADTS_HEADER_SIZE, packet->data, packet->size);
+
+		ret = stream->feeder_functions.zixi_send_elementary_frame(
+			stream->zixi_handle, (char *)frame, (int)size, false,
+			packet->pts, packet->dts);
+	} else {
+		ret = stream->feeder_functions.zixi_send_elementary_frame(
+			stream->zixi_handle, packet->data, packet->size, true,
+			packet->pts, packet->dts);
+	}
 
 	if (ret != ZIXI_ERROR_OK && ret != ZIXI_ERROR_NOT_READY &&
 	    ret != ZIXI_WARNING_OVER_LIMIT) {
@@ -433,43 +519,73 @@ static bool send_remaining_packets(struct zixi_stream *stream)
 	return true;
 }
 
-static void drop_frames(struct zixi_stream *stream)
+static bool keep_undroppable_packet(void *param, void *elem)
+{
+	struct zixi_stream *stream = param;
+	struct encoder_packet *packet = elem;
+
+	/* do not drop audio data or video keyframes */
+	if (packet->type == OBS_ENCODER_AUDIO ||
+	    packet->drop_priority == OBS_NAL_PRIORITY_HIGHEST)
+		return true;
+
+	os_atomic_inc_long(&stream->dropped_frames);
+	obs_encoder_packet_release(packet);
+	return false;
+}
+
+/* send thread: compacts the ring, which only the consumer may do */
+static void drop_queued_frames(struct zixi_stream *stream)
+{
+	size_t num_frames_dropped;
+
+	num_frames_dropped = spsc_ring_compact(
+		&stream->packets, keep_undroppable_packet, stream);
+	if (num_frames_dropped)
+		debug("Dropped %d queued frames", (int)num_frames_dropped);
+}
+
+/* encoder thread: the overflow can be trimmed right away under its mutex */
+static void drop_overflow_frames(struct zixi_stream *stream)
 {
 	struct circlebuf new_buf = {0};
-	int drop_priority = 0;
-	uint64_t last_drop_dts_usec = 0;
-	int num_frames_dropped = 0;
 
-	debug("Previous packet count: %d", (int)num_buffered_packets(stream));
+	if (!os_atomic_load_bool(&stream->overflowed))
+		return;
 
-	circlebuf_reserve(&new_buf, sizeof(struct encoder_packet) * 8);
+	pthread_mutex_lock(&stream->overflow_mutex);
 
-	while (stream->packets.size) {
-		struct encoder_packet packet;
-		circlebuf_pop_front(&stream->packets, &packet, sizeof(packet));
+	circlebuf_reserve(&new_buf, stream->overflow.size);
 
-		last_drop_dts_usec = packet.dts_usec;
+	while (stream->overflow.size) {
+		struct encoder_packet packet;
+		circlebuf_pop_front(&stream->overflow, &packet, sizeof(packet));
 
-		/* do not drop audio data or video keyframes */
-		if (packet.type == OBS_ENCODER_AUDIO ||
-		    packet.drop_priority == OBS_NAL_PRIORITY_HIGHEST) {
+		if (keep_undroppable_packet(stream, &packet))
 			circlebuf_push_back(&new_buf, &packet, sizeof(packet));
+	}
 
-		} else {
-			if (drop_priority < packet.drop_priority)
-				drop_priority = packet.drop_priority;
+	circlebuf_free(&stream->overflow);
+	stream->overflow = new_buf;
+	if (!stream->overflow.size)
+		os_atomic_set_bool(&stream->overflowed, false);
 
-			num_frames_dropped++;
-			obs_encoder_packet_release(&packet);
-		}
-	}
+	pthread_mutex_unlock(&stream->overflow_mutex);
+}
+
+static void drop_frames(struct zixi_stream *stream)
+{
+	debug("Previous packet count: %d", (int)num_buffered_packets(stream));
 
-	circlebuf_free(&stream->packets);
-	stream->packets = new_buf;
-	stream->min_priority = drop_priority;
-	stream->min_drop_dts_usec = last_drop_dts_usec;
+	/* the send thread drops the queued frames before taking its next
+	 * batch, even while this thread keeps queueing new ones */
+	os_atomic_set_bool(&stream->drop_requested, true);
+	drop_overflow_frames(stream);
+
+	/* skip frames up to the next reference frame */
+	os_atomic_store_long(&stream->min_priority, OBS_NAL_PRIORITY_HIGH);
+	stream->min_drop_dts_usec = stream->last_dts_usec;
 
-	stream->dropped_frames += num_frames_dropped;
 	debug("New packet count: %d", (int)num_buffered_packets(stream));
 }
 
@@ -512,6 +628,8 @@ static bool init_connect(struct zixi_stream *stream)
 	stream->dropped_frames = 0;
 	stream->min_drop_dts_usec = 0;
 	stream->min_priority = 0;
+	stream->drop_requested = false;
+	stream->got_first_packet = false;
 	stream->encoder_control.total_raw_frames = 0;
 	stream->encoder_control.sent_to_encoder_frames = 0;
 	stream->encoder_control.decimation_factor = 1.0f;
@@ -532,6 +650,9 @@ static void *send_thread(void *data)
 
 		if (stopping(stream))
 			break;
+		/* set by the encoder thread when the send queue is full */
+		if (disconnected(stream))
+			break;
 		if (!get_next_packet(stream, &packet))
 			continue;
 
@@ -629,7 +750,7 @@ static bool zixi_input_control(void *p)
 		stream->encoder_control.sent_to_encoder_frames++;
 		ret = true;
 	} else {
-		stream->dropped_frames++;
+		os_atomic_inc_long(&stream->dropped_frames);
 	}
 
 	stream->encoder_control.total_raw_frames++;
@@ -936,8 +1057,10 @@ static void zixi_stream_destroy(void *data)
 		dstr_free(&stream->password);
 		os_event_destroy(stream->stop_event);
 		os_sem_destroy(stream->send_sem);
-		pthread_mutex_destroy(&stream->packets_mutex);
-		circlebuf_free(&stream->packets);
+		spsc_ring_free(&stream->packets);
+		circlebuf_free(&stream->overflow);
+		pthread_mutex_destroy(&stream->overflow_mutex);
+		da_free(stream->frame_buf);
 		pthread_mutex_destroy(&stream->encoder_control_mutex);
 #ifdef H264_DUMP
 		fclose(stream->file);
@@ -953,22 +1076,22 @@ static void *zixi_stream_create(obs_data_t *settings, obs_output_t *output)
 	stream->packet_alloc = 0;
 	stream->packet_free = 0;
 	stream->drop_threshold_usec = 1000000000;
-	pthread_mutex_init_value(&stream->packets_mutex);
+	spsc_ring_init(&stream->packets, sizeof(struct encoder_packet),
+		       PACKET_QUEUE_SIZE);
 	pthread_mutex_init_value(&stream->encoder_control_mutex);
+	pthread_mutex_init_value(&stream->overflow_mutex);
 	if (create_zixi_feeder_functions(&stream->feeder_functions, dll) != 0) {
 		goto fail;
 	}
 
 	stream->feeder_functions.zixi_configure_logging(
 		ZIXI_LOG_INFO, zixi_log_callback, NULL);
-	if (pthread_mutex_init(&stream->packets_mutex, NULL) != 0)
-		goto fail;
 	if (pthread_mutex_init(&stream->encoder_control_mutex, NULL) != 0)
 		goto fail;
-	if (os_event_init(&stream->stop_event, OS_EVENT_TYPE_MANUAL) != 0) {
-		pthread_mutex_destroy(&stream->packets_mutex);
+	if (pthread_mutex_init(&stream->overflow_mutex, NULL) != 0)
+		goto fail;
+	if (os_event_init(&stream->stop_event, OS_EVENT_TYPE_MANUAL) != 0)
 		goto fail;
-	}
 
 	info("zixi_stream_create -> OK");
 	//UNUSED_PARAMETER(settings);
@@ -1165,29 +1288,74 @@ static bool zixi_stream_start(void *data)
 static bool add_packet(struct zixi_stream *stream,
 		       struct encoder_packet *packet)
 {
-	circlebuf_push_back(&stream->packets, packet,
-			    sizeof(struct encoder_packet));
+	bool full;
+
+	if (!os_atomic_load_bool(&stream->overflowed) &&
+	    spsc_ring_push_back(&stream->packets, packet))
+		goto added;
+
+	/* the ring is full: queue the packet behind it instead of dropping
+	 * it, it could be audio or a keyframe.  everything after it has to
+	 * go the same way to keep the packets in order, until the send
+	 * thread has moved the overflow back into the ring. */
+	pthread_mutex_lock(&stream->overflow_mutex);
+	full = stream->overflow.size / sizeof(*packet) >= PACKET_QUEUE_SIZE;
+	if (!full) {
+		if (!stream->overflow.size)
+			debug("Packet queue full, queueing packets in "
+			      "overflow");
+		circlebuf_push_back(&stream->overflow, packet,
+				    sizeof(*packet));
+		os_atomic_set_bool(&stream->overflowed, true);
+	}
+	pthread_mutex_unlock(&stream->overflow_mutex);
+
+	/* frame dropping trims the overflow as well, so it only fills up
+	 * with audio and keyframes when nothing gets through at all */
+	if (full) {
+		warn("Send queue full, disconnecting");
+		os_atomic_set_bool(&stream->disconnected, true);
+		os_sem_post(stream->send_sem);
+		return false;
+	}
+
+added:
 	stream->last_dts_usec = packet->dts_usec;
 	return true;
 }
 
+/* dts of the oldest queued packet.  the send thread publishes its position
+ * in milliseconds in a long, which may only be 32 bits, so it is taken
+ * relative to the newest packet */
+static int64_t get_first_dts_usec(struct zixi_stream *stream)
+{
+	unsigned long sent =
+		(unsigned long)os_atomic_load_long(&stream->sent_dts_msec);
+	unsigned long last = (unsigned long)(stream->last_dts_usec / 1000);
+
+	return stream->last_dts_usec - (int64_t)(long)(last - sent) * 1000;
+}
+
+/* runs on the encoder thread, so that frames are still dropped while the
+ * send thread is blocked sending */
 static void check_drop_frames(struct zixi_stream *stream)
 {
-	struct encoder_packet first;
+	int64_t first_dts_usec;
 	int64_t buffer_duration_usec;
+	size_t num_packets = num_buffered_packets(stream);
 
-	if (num_buffered_packets(stream) < 5)
+	if (num_packets < 5)
 		return;
 
-	circlebuf_peek_front(&stream->packets, &first, sizeof(first));
+	first_dts_usec = get_first_dts_usec(stream);
 
 	/* do not drop frames if frames were just dropped within this time */
-	if (first.dts_usec < stream->min_drop_dts_usec)
+	if (first_dts_usec < stream->min_drop_dts_usec)
 		return;
 
 	/* if the amount of time stored in the buffered packets waiting to be
 	* sent is higher than threshold, drop frames */
-	buffer_duration_usec = stream->last_dts_usec - first.dts_usec;
+	buffer_duration_usec = stream->last_dts_usec - first_dts_usec;
 
 	if (buffer_duration_usec > stream->drop_threshold_usec) {
 		drop_frames(stream);
@@ -1199,13 +1367,17 @@ static void check_drop_frames(struct zixi_stream *stream)
 static bool add_video_packet(struct zixi_stream *stream,
 			     struct encoder_packet *video_packet)
 {
+	long min_priority;
+
 	check_drop_frames(stream);
 
-	if (video_packet->priority < stream->min_priority) {
-		stream->dropped_frames++;
+	min_priority = os_atomic_load_long(&stream->min_priority);
+	if (video_packet->priority < min_priority) {
+		os_atomic_inc_long(&stream->dropped_frames);
 		return false;
-	} else
-		stream->min_priority = 0;
+	} else if (min_priority) {
+		os_atomic_store_long(&stream->min_priority, 0);
+	}
 	return add_packet(stream, video_packet);
 }
 
@@ -1235,12 +1407,11 @@ static int freq_to_adts(unsigned int freq)
 	return r;
 }
 
-static void zixi_add_adts_headers(struct zixi_stream *stream,
-				  struct encoder_packet *out,
-				  struct encoder_packet *in)
+static void zixi_write_adts_header(struct zixi_stream *stream,
+				   uint8_t adts[ADTS_HEADER_SIZE],
+				   size_t payload_size)
 {
-	char adts[7];
-	size_t new_size = in->size + 7;
+	size_t new_size = payload_size + ADTS_HEADER_SIZE;
 	/* https://wiki.multimedia.cx/index.php/ADTS
 
 		AAAAAAAA AAAABCCD EEFFFFGH HHIJKLMM MMMMMMMM MMMOOOOO OOOOOOPP (QQQQQQQQ QQQQQQQQ)
@@ -1283,24 +1454,6 @@ static void zixi_add_adts_headers(struct zixi_stream *stream,
 	adts[4] = (new_size & 0x07FF) >> 3; 
 	adts[5] = ((new_size & 0x7) << 5) | 0x1F; 
 	adts[6] = 0xFC;
-	out->drop_priority = in->drop_priority;
-	out->dts = in->dts;
-	out->pts = in->pts;
-	out->dts_usec = in->dts_usec;
-	out->encoder = in->encoder;
-	out->keyframe = in->keyframe;
-	out->priority = in->priority;
-	out->timebase_den = in->timebase_den;
-	out->timebase_num = in->timebase_num;
-	out->track_idx = in->track_idx;
-	out->type = in->type;
-
-	out->size = new_size;
-	out->data = bzalloc(new_size + sizeof(long));
-	memcpy(out->data + sizeof(long), adts, 7);
-	memcpy(out->data + 7 + sizeof(long), in->data, in->size);
-	((long *)out->data)[0] = 1;
-	out->data = (long *)out->data + 1;
 }
 
 static void zixi_stream_data(void *data, struct encoder_packet *packet)
@@ -1312,20 +1465,23 @@ static void zixi_stream_data(void *data, struct encoder_packet *packet)
 	if (disconnected(stream))
 		return;
 
-	if (packet->type == OBS_ENCODER_VIDEO)
-		obs_encoder_packet_ref(&new_packet, packet);
-	else
-		zixi_add_adts_headers(stream, &new_packet, packet);
+	/* audio packets are queued as-is; the ADTS header is written by the
+	 * send thread (see send_packet) */
+	obs_encoder_packet_ref(&new_packet, packet);
+
+	if (!stream->got_first_packet) {
+		stream->last_dts_usec = packet->dts_usec;
+		os_atomic_store_long(&stream->sent_dts_msec,
+				     (long)(packet->dts_usec / 1000));
+		stream->got_first_packet = true;
+	}
 
 	stream->packet_alloc++;
-	pthread_mutex_lock(&stream->packets_mutex);
 	if (!disconnected(stream) && !stopping(stream))
 		added_packet = (packet->type == OBS_ENCODER_VIDEO)
 				       ? add_video_packet(stream, &new_packet)
 				       : add_packet(stream, &new_packet);
 
-	pthread_mutex_unlock(&stream->packets_mutex);
-
 	if (added_packet) {
 		os_sem_post(stream->send_sem);
 	} else {
@@ -1409,7 +1565,7 @@ static uint64_t zixi_stream_total_bytes_sent(void *data)
 static int zixi_stream_dropped_frames(void *data)
 {
 	struct zixi_stream *stream = data;
-	return stream->dropped_frames;
+	return (int)os_atomic_load_long(&stream->dropped_frames);
 }
 
 static float zixi_get_congestion(void *data)
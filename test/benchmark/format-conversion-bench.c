@@ -0,0 +1,192 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <media-io/format-conversion.h>
+#include <util/platform.h>
+#include <util/bmem.h>
+
+/*
+ * Prints the single-threaded throughput of every software format
+ * conversion for each implementation the CPU supports, in GB/s of data
+ * read and written.
+ *
+ * usage: format-conversion-bench [iterations]
+ */
+
+#define DEFAULT_ITERATIONS 40
+
+enum bench_conversion {
+	BENCH_UYVX_TO_I420,
+	BENCH_UYVX_TO_NV12,
+	BENCH_UYVX_TO_I444,
+	BENCH_I420_TO_PACKED,
+	BENCH_NV12_TO_PACKED,
+	BENCH_YUY2_TO_PACKED,
+	BENCH_COUNT,
+};
+
+static const char *conversion_names[BENCH_COUNT] = {
+	"uyvx->i420",   "uyvx->nv12",   "uyvx->i444",
+	"i420->packed", "nv12->packed", "yuy2->packed",
+};
+
+static const char *impl_names[] = {"sse2", "avx2"};
+
+struct bench_frame {
+	uint32_t width;
+	uint32_t height;
+	uint8_t *packed_in;
+	uint8_t *packed_out;
+	uint8_t *planes[3];
+};
+
+static void init_frame(struct bench_frame *frame, uint32_t width,
+		       uint32_t height)
+{
+	size_t size = (size_t)width * height;
+
+	frame->width = width;
+	frame->height = height;
+	frame->packed_in = bmalloc(size * 4);
+	frame->packed_out = bmalloc(size * 4);
+
+	for (size_t i = 0; i < size * 4; i++)
+		frame->packed_in[i] = (uint8_t)rand();
+	memset(frame->packed_out, 0, size * 4);
+
+	for (size_t i = 0; i < 3; i++) {
+		frame->planes[i] = bmalloc(size);
+		memset(frame->planes[i], 0x80, size);
+	}
+}
+
+static void free_frame(struct bench_frame *frame)
+{
+	bfree(frame->packed_in);
+	bfree(frame->packed_out);
+	for (size_t i = 0; i < 3; i++)
+		bfree(frame->planes[i]);
+}
+
+/* bytes read and written for one frame */
+static double frame_bytes(enum bench_conversion conversion, uint32_t width,
+			  uint32_t height)
+{
+	double pixels = (double)width * height;
+
+	switch (conversion) {
+	case BENCH_UYVX_TO_I420:
+	case BENCH_UYVX_TO_NV12:
+		return pixels * 4.0 + pixels * 1.5;
+	case BENCH_UYVX_TO_I444:
+		return pixels * 4.0 + pixels * 3.0;
+	case BENCH_I420_TO_PACKED:
+	case BENCH_NV12_TO_PACKED:
+		return pixels * 1.5 + pixels * 4.0;
+	case BENCH_YUY2_TO_PACKED:
+		return pixels * 2.0 + pixels * 4.0;
+	case BENCH_COUNT:
+		break;
+	}
+
+	return 0.0;
+}
+
+static void convert_frame(enum bench_conversion conversion,
+			  struct bench_frame *frame)
+{
+	uint32_t w = frame->width;
+	uint32_t h = frame->height;
+	uint32_t linesize_420[3] = {w, w / 2, w / 2};
+	uint32_t linesize_nv12[2] = {w, w};
+	uint32_t linesize_444[3] = {w, w, w};
+	const uint8_t *const planes[3] = {frame->planes[0], frame->planes[1],
+					  frame->planes[2]};
+
+	switch (conversion) {
+	case BENCH_UYVX_TO_I420:
+		compress_uyvx_to_i420(frame->packed_in, w * 4, 0, h,
+				      frame->planes, linesize_420);
+		break;
+	case BENCH_UYVX_TO_NV12:
+		compress_uyvx_to_nv12(frame->packed_in, w * 4, 0, h,
+				      frame->planes, linesize_nv12);
+		break;
+	case BENCH_UYVX_TO_I444:
+		convert_uyvx_to_i444(frame->packed_in, w * 4, 0, h,
+				     frame->planes, linesize_444);
+		break;
+	case BENCH_I420_TO_PACKED:
+		decompress_420(planes, linesize_420, 0, h, frame->packed_out,
+			       w * 4);
+		break;
+	case BENCH_NV12_TO_PACKED:
+		decompress_nv12(planes, linesize_nv12, 0, h,
+				frame->packed_out, w * 4);
+		break;
+	case BENCH_YUY2_TO_PACKED:
+		/* converts min(in_linesize, out_linesize) / 2 pixel pairs */
+		decompress_422(frame->packed_in, w, 0, h, frame->packed_out,
+			       w * 4, true);
+		break;
+	case BENCH_COUNT:
+		break;
+	}
+}
+
+static double run_bench(enum bench_conversion conversion,
+			struct bench_frame *frame, int iterations)
+{
+	uint64_t start;
+	double sec;
+
+	/* warm up the caches and the branch predictors */
+	convert_frame(conversion, frame);
+
+	start = os_gettime_ns();
+	for (int i = 0; i < iterations; i++)
+		convert_frame(conversion, frame);
+	sec = (double)(os_gettime_ns() - start) / 1000000000.0;
+
+	return frame_bytes(conversion, frame->width, frame->height) *
+	       iterations / sec / 1000000000.0;
+}
+
+int main(int argc, char *argv[])
+{
+	static const uint32_t sizes[][2] = {{1920, 1080}, {3840, 2160}};
+	int iterations = argc > 1 ? atoi(argv[1]) : DEFAULT_ITERATIONS;
+	enum format_conversion_impl best = format_conversion_get_impl();
+
+	if (iterations < 1) {
+		fprintf(stderr, "usage: %s [iterations]\n", argv[0]);
+		return 1;
+	}
+
+	for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+		struct bench_frame frame;
+
+		init_frame(&frame, sizes[s][0], sizes[s][1]);
+		printf("%ux%u\n", frame.width, frame.height);
+
+		for (int c = 0; c < BENCH_COUNT; c++) {
+			printf("  %-14s", conversion_names[c]);
+
+			for (int impl = 0; impl <= (int)best; impl++) {
+				if (!format_conversion_set_impl(impl))
+					continue;
+
+				printf(" %s %6.2f GB/s", impl_names[impl],
+				       run_bench(c, &frame, iterations));
+			}
+
+			printf("\n");
+		}
+
+		free_frame(&frame);
+	}
+
+	format_conversion_set_impl(best);
+	return 0;
+}
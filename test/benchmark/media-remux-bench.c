@@ -0,0 +1,220 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libavformat/avformat.h>
+#include <libavutil/channel_layout.h>
+
+#include <media-io/media-remux.h>
+#include <util/platform.h>
+#include <util/darray.h>
+#include <util/dstr.h>
+
+/*
+ * Times remuxing a set of large MKV files one after another against
+ * media_remux_batch_process.
+ *
+ * usage: media-remux-bench <work dir> [file count] [file size in MB]
+ *        media-remux-bench <work dir> <recording.mkv>...
+ *
+ * Without recordings it writes synthetic files into the work dir (three
+ * 2048 MB files by default).  The streams are 1 second PCM packets, which
+ * costs the remuxer the same as any other codec since the packets are
+ * copied, not decoded.
+ */
+
+#define DEFAULT_FILES 3
+#define DEFAULT_SIZE_MB 2048
+
+/* one second of 48khz 16-bit stereo */
+#define BENCH_RATE 48000
+#define BENCH_PACKET_SIZE (BENCH_RATE * 4)
+
+static bool write_bench_file(const char *path, int64_t size)
+{
+	AVFormatContext *ctx = NULL;
+	AVStream *stream;
+	int64_t packets = size / BENCH_PACKET_SIZE;
+	bool success = false;
+
+	if (avformat_alloc_output_context2(&ctx, NULL, "matroska", path) < 0)
+		return false;
+
+	stream = avformat_new_stream(ctx, NULL);
+	if (!stream)
+		goto fail;
+
+	stream->time_base = (AVRational){1, BENCH_RATE};
+	stream->codecpar->codec_type = AVMEDIA_TYPE_AUDIO;
+	stream->codecpar->codec_id = AV_CODEC_ID_PCM_S16LE;
+	stream->codecpar->sample_rate = BENCH_RATE;
+	stream->codecpar->channels = 2;
+	stream->codecpar->channel_layout = AV_CH_LAYOUT_STEREO;
+	stream->codecpar->bits_per_coded_sample = 16;
+	stream->codecpar->block_align = 4;
+
+	if (avio_open(&ctx->pb, path, AVIO_FLAG_WRITE) < 0)
+		goto fail;
+	if (avformat_write_header(ctx, NULL) < 0)
+		goto fail;
+
+	for (int64_t i = 0; i < packets; i++) {
+		AVPacket pkt = {0};
+
+		if (av_new_packet(&pkt, BENCH_PACKET_SIZE) < 0)
+			goto fail;
+
+		memset(pkt.data, (int)(i & 0xFF), BENCH_PACKET_SIZE);
+		pkt.pts = pkt.dts = av_rescale_q(i * BENCH_RATE,
+						 (AVRational){1, BENCH_RATE},
+						 stream->time_base);
+		pkt.duration = av_rescale_q(BENCH_RATE,
+					    (AVRational){1, BENCH_RATE},
+					    stream->time_base);
+
+		if (av_write_frame(ctx, &pkt) < 0) {
+			av_packet_unref(&pkt);
+			goto fail;
+		}
+		av_packet_unref(&pkt);
+	}
+
+	success = av_write_trailer(ctx) == 0;
+
+fail:
+	if (ctx->pb)
+		avio_closep(&ctx->pb);
+	avformat_free_context(ctx);
+	return success;
+}
+
+static void print_result(const char *name, uint64_t ns, int64_t bytes)
+{
+	double sec = (double)ns / 1000000000.0;
+	double mb = (double)bytes / (1024.0 * 1024.0);
+
+	printf("%-12s %8.2f s %10.1f MB/s\n", name, sec, mb / sec);
+}
+
+static void remove_files(char **files, size_t count)
+{
+	for (size_t i = 0; i < count; i++)
+		os_unlink(files[i]);
+}
+
+int main(int argc, char *argv[])
+{
+	DARRAY(char *) in_files;
+	DARRAY(char *) out_files;
+	const char *dir;
+	bool generated = false;
+	int64_t total = 0;
+	uint64_t start;
+	int ret = 1;
+
+	if (argc < 2) {
+		fprintf(stderr,
+			"usage: %s <work dir> [file count] [file size in MB]\n"
+			"       %s <work dir> <recording.mkv>...\n",
+			argv[0], argv[0]);
+		return 1;
+	}
+
+	av_register_all();
+
+	dir = argv[1];
+	da_init(in_files);
+	da_init(out_files);
+
+	if (argc > 2 && os_file_exists(argv[2])) {
+		for (int i = 2; i < argc; i++) {
+			char *path = bstrdup(argv[i]);
+			da_push_back(in_files, &path);
+		}
+	} else {
+		int count = argc > 2 ? atoi(argv[2]) : DEFAULT_FILES;
+		int64_t size = argc > 3 ? atoll(argv[3]) : DEFAULT_SIZE_MB;
+
+		if (count < 1 || size < 1) {
+			fprintf(stderr, "invalid file count or size\n");
+			goto exit;
+		}
+
+		generated = true;
+		os_mkdirs(dir);
+
+		for (int i = 0; i < count; i++) {
+			struct dstr path = {0};
+
+			dstr_printf(&path, "%s/bench%d.mkv", dir, i);
+			printf("writing %s (%lld MB)\n", path.array,
+			       (long long)size);
+
+			if (!write_bench_file(path.array,
+					      size * 1024 * 1024)) {
+				fprintf(stderr, "failed to write %s\n",
+					path.array);
+				dstr_free(&path);
+				goto exit;
+			}
+
+			da_push_back(in_files, &path.array);
+		}
+	}
+
+	for (size_t i = 0; i < in_files.num; i++) {
+		struct dstr path = {0};
+
+		dstr_printf(&path, "%s/bench-out%d.mov", dir, (int)i);
+		da_push_back(out_files, &path.array);
+		total += os_get_file_size(in_files.array[i]);
+	}
+
+	printf("remuxing %d files, %.1f MB\n", (int)in_files.num,
+	       (double)total / (1024.0 * 1024.0));
+
+	start = os_gettime_ns();
+	for (size_t i = 0; i < in_files.num; i++) {
+		media_remux_job_t job;
+		bool success = false;
+
+		if (media_remux_job_create(&job, in_files.array[i],
+					   out_files.array[i])) {
+			success = media_remux_job_process(job, NULL, NULL);
+			media_remux_job_destroy(job);
+		}
+
+		if (!success) {
+			fprintf(stderr, "failed to remux %s\n",
+				in_files.array[i]);
+			goto exit;
+		}
+	}
+	print_result("sequential", os_gettime_ns() - start, total);
+	remove_files(out_files.array, out_files.num);
+
+	start = os_gettime_ns();
+	if (!media_remux_batch_process((const char *const *)in_files.array,
+				       (const char *const *)out_files.array,
+				       in_files.num, NULL, NULL)) {
+		fprintf(stderr, "batch remux failed\n");
+		goto exit;
+	}
+	print_result("batch", os_gettime_ns() - start, total);
+
+	ret = 0;
+
+exit:
+	remove_files(out_files.array, out_files.num);
+	if (generated)
+		remove_files(in_files.array, in_files.num);
+
+	for (size_t i = 0; i < in_files.num; i++)
+		bfree(in_files.array[i]);
+	for (size_t i = 0; i < out_files.num; i++)
+		bfree(out_files.array[i]);
+
+	da_free(in_files);
+	da_free(out_files);
+	return ret;
+}
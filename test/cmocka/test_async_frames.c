@@ -0,0 +1,95 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include <string.h>
+
+#include <obs-internal.h>
+
+/* the async queue holds at most 30 frames */
+#define QUEUE_FRAMES 30
+#define EXTRA_FRAMES 25
+
+#define TEST_WIDTH 16
+#define TEST_HEIGHT 16
+
+/* only the async frame fields are set up, which is all that
+ * obs_source_output_video touches */
+static obs_source_t *create_async_source(void)
+{
+	obs_source_t *source = bzalloc(sizeof(*source));
+
+	pthread_mutex_init(&source->async_mutex, NULL);
+	return source;
+}
+
+static void destroy_async_source(obs_source_t *source)
+{
+	for (size_t i = 0; i < source->async_cache.num; i++)
+		obs_source_frame_destroy(source->async_cache.array[i].frame);
+
+	da_free(source->async_cache);
+	da_free(source->async_frames);
+	da_free(source->async_borrowed);
+	pthread_mutex_destroy(&source->async_mutex);
+	bfree(source);
+}
+
+static void output_frames(obs_source_t *source, size_t count,
+			  uint64_t *timestamp)
+{
+	uint8_t data[TEST_WIDTH * TEST_HEIGHT * 4] = {0};
+	struct obs_source_frame frame = {0};
+
+	frame.data[0] = data;
+	frame.linesize[0] = TEST_WIDTH * 4;
+	frame.width = TEST_WIDTH;
+	frame.height = TEST_HEIGHT;
+	frame.format = VIDEO_FORMAT_BGRA;
+
+	for (size_t i = 0; i < count; i++) {
+		frame.timestamp = *timestamp;
+		*timestamp += 33333333;
+
+		obs_source_output_video(source, &frame);
+	}
+}
+
+/* nothing consumes the queue, as when the graphics thread stalls.  once it
+ * is full the oldest frames are dropped one by one and their buffers are
+ * reused, so the allocation count stays where it was */
+static void overfill_test(void **state)
+{
+	obs_source_t *source = create_async_source();
+	struct obs_source_frame *newest;
+	uint64_t timestamp = 0;
+
+	output_frames(source, QUEUE_FRAMES, &timestamp);
+	assert_int_equal(source->async_frames.num, QUEUE_FRAMES);
+	assert_int_equal(obs_source_get_async_dropped_frames(source), 0);
+	assert_int_equal(obs_source_get_async_frame_allocs(source),
+			 QUEUE_FRAMES);
+
+	output_frames(source, EXTRA_FRAMES, &timestamp);
+	assert_int_equal(source->async_frames.num, QUEUE_FRAMES);
+	assert_int_equal(obs_source_get_async_dropped_frames(source),
+			 EXTRA_FRAMES);
+	assert_int_equal(obs_source_get_async_frame_allocs(source),
+			 QUEUE_FRAMES);
+
+	/* the newest frames are the ones kept */
+	newest = source->async_frames.array[QUEUE_FRAMES - 1];
+	assert_int_equal(newest->timestamp, timestamp - 33333333);
+
+	destroy_async_source(source);
+}
+
+int main()
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(overfill_test),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,153 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <media-io/audio-kernels.h>
+
+#define MAX_FLOATS 1031
+
+static const enum audio_kernels_impl impls[] = {
+	AUDIO_KERNELS_SSE2,
+	AUDIO_KERNELS_AVX,
+};
+
+static float rand_sample(void)
+{
+	/* mostly in range, some clipping */
+	return ((float)rand() / (float)RAND_MAX) * 3.0f - 1.5f;
+}
+
+static void fill(float *data, size_t count)
+{
+	for (size_t i = 0; i < count; i++)
+		data[i] = rand_sample();
+}
+
+static void fill_special(float *data)
+{
+	data[0] = NAN;
+	data[1] = INFINITY;
+	data[2] = -INFINITY;
+	data[3] = -0.0f;
+	data[4] = 1.0f;
+	data[5] = -1.0f;
+	data[6] = 1.0000001f;
+	data[7] = 1e-40f;
+}
+
+typedef void (*run_kernel_t)(float *data, const float *src, size_t count);
+
+static void run_mix(float *data, const float *src, size_t count)
+{
+	audio_mix_floats(data, src, count);
+}
+
+static void run_clamp(float *data, const float *src, size_t count)
+{
+	(void)src;
+	audio_clamp_floats(data, count);
+}
+
+static void run_scale(float *data, const float *src, size_t count)
+{
+	audio_scale_floats(data, src[0], count);
+}
+
+static void run_multiply(float *data, const float *src, size_t count)
+{
+	audio_multiply_floats(data, src, count);
+}
+
+/* runs the kernel on every length and a few misaligned offsets, and compares
+ * the output of each implementation against the scalar one bit for bit */
+static void check_kernel(run_kernel_t run)
+{
+	float src[MAX_FLOATS + 4];
+	float orig[MAX_FLOATS + 4];
+	float expected[MAX_FLOATS + 4];
+	float actual[MAX_FLOATS + 4];
+
+	srand(1234);
+
+	for (size_t count = 0; count <= MAX_FLOATS; count += 1 + count / 8) {
+		for (size_t offset = 0; offset < 4; offset++) {
+			fill(src, MAX_FLOATS + 4);
+			fill(orig, MAX_FLOATS + 4);
+			if (count >= 8)
+				fill_special(orig + offset);
+
+			memcpy(expected, orig, sizeof(orig));
+			assert_true(audio_kernels_set_impl(
+				AUDIO_KERNELS_SCALAR));
+			run(expected + offset, src + offset, count);
+
+			for (size_t i = 0; i < sizeof(impls) / sizeof(impls[0]);
+			     i++) {
+				if (!audio_kernels_set_impl(impls[i]))
+					continue;
+
+				memcpy(actual, orig, sizeof(orig));
+				run(actual + offset, src + offset, count);
+				assert_memory_equal(actual, expected,
+						    sizeof(actual));
+			}
+		}
+	}
+}
+
+static void mix_test(void **state)
+{
+	check_kernel(run_mix);
+}
+
+static void clamp_test(void **state)
+{
+	check_kernel(run_clamp);
+}
+
+static void scale_test(void **state)
+{
+	check_kernel(run_scale);
+}
+
+static void multiply_test(void **state)
+{
+	check_kernel(run_multiply);
+}
+
+static void clamp_range_test(void **state)
+{
+	float data[9] = {2.0f, -2.0f, 0.5f, -0.5f, 1.0f,
+			 -1.0f, INFINITY, -INFINITY, NAN};
+
+	assert_true(audio_kernels_set_impl(AUDIO_KERNELS_SSE2));
+	audio_clamp_floats(data, 9);
+
+	assert_true(data[0] == 1.0f);
+	assert_true(data[1] == -1.0f);
+	assert_true(data[2] == 0.5f);
+	assert_true(data[3] == -0.5f);
+	assert_true(data[4] == 1.0f);
+	assert_true(data[5] == -1.0f);
+	assert_true(data[6] == 1.0f);
+	assert_true(data[7] == -1.0f);
+	assert_true(isnan(data[8]));
+}
+
+int main()
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(mix_test),
+		cmocka_unit_test(clamp_test),
+		cmocka_unit_test(scale_test),
+		cmocka_unit_test(multiply_test),
+		cmocka_unit_test(clamp_range_test),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
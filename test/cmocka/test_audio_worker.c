@@ -0,0 +1,115 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include <media-io/audio-io.h>
+#include <util/threading.h>
+#include <util/platform.h>
+
+/* 1024 frames per millisecond, so the audio thread outputs one block per
+ * millisecond with exact nanosecond timestamps */
+#define TEST_SAMPLE_RATE 1024000
+
+/* the worker queues 256 blocks before it starts dropping */
+#define STALL_BLOCKS 400
+#define CHECK_BLOCKS 600
+
+struct worker_test {
+	volatile long blocks_mixed;
+	volatile long blocks_received;
+	os_event_t *resume;
+
+	uint64_t next_ts;
+	long discontinuities;
+	long silent_blocks;
+};
+
+static bool test_input(void *param, uint64_t start_ts, uint64_t end_ts,
+		       uint64_t *new_ts, uint32_t active_mixers,
+		       struct audio_output_data *mixes)
+{
+	struct worker_test *test = param;
+
+	for (size_t ch = 0; ch < 2; ch++)
+		for (size_t i = 0; i < AUDIO_OUTPUT_FRAMES; i++)
+			mixes[0].data[ch][i] = 0.5f;
+
+	*new_ts = start_ts;
+	os_atomic_inc_long(&test->blocks_mixed);
+
+	UNUSED_PARAMETER(end_ts);
+	UNUSED_PARAMETER(active_mixers);
+	return true;
+}
+
+/* stalls on the first block, like an encoder that can't keep up */
+static void test_output(void *param, size_t mix_idx, struct audio_data *data)
+{
+	struct worker_test *test = param;
+	const float *samples = (const float *)data->data[0];
+
+	if (!test->next_ts)
+		os_event_wait(test->resume);
+	else if (data->timestamp != test->next_ts)
+		test->discontinuities++;
+
+	if (samples[0] == 0.0f && samples[data->frames - 1] == 0.0f)
+		test->silent_blocks++;
+
+	test->next_ts = data->timestamp +
+			audio_frames_to_ns(TEST_SAMPLE_RATE, data->frames);
+	os_atomic_inc_long(&test->blocks_received);
+
+	UNUSED_PARAMETER(mix_idx);
+}
+
+static void wait_for(volatile long *count, long target)
+{
+	for (int i = 0; i < 10000 && os_atomic_load_long(count) < target; i++)
+		os_sleep_ms(1);
+}
+
+/* audio dropped while the callback lags must show up as silence, so that
+ * the callback keeps getting continuous timestamps */
+static void worker_overflow_test(void **state)
+{
+	struct worker_test test = {0};
+	struct audio_output_info info = {
+		.name = "test",
+		.samples_per_sec = TEST_SAMPLE_RATE,
+		.format = AUDIO_FORMAT_FLOAT_PLANAR,
+		.speakers = SPEAKERS_STEREO,
+		.input_callback = test_input,
+		.input_param = &test,
+	};
+	audio_t *audio;
+
+	assert_int_equal(os_event_init(&test.resume, OS_EVENT_TYPE_MANUAL), 0);
+	assert_int_equal(audio_output_open(&audio, &info),
+			 AUDIO_OUTPUT_SUCCESS);
+	assert_true(audio_output_connect_threaded(audio, 0, NULL, test_output,
+						  &test));
+
+	wait_for(&test.blocks_mixed, STALL_BLOCKS);
+	assert_true(os_atomic_load_long(&test.blocks_mixed) >= STALL_BLOCKS);
+	os_event_signal(test.resume);
+
+	wait_for(&test.blocks_received, CHECK_BLOCKS);
+	audio_output_disconnect(audio, 0, test_output, &test);
+	audio_output_close(audio);
+	os_event_destroy(test.resume);
+
+	assert_true(test.blocks_received >= CHECK_BLOCKS);
+	assert_true(test.silent_blocks > 0);
+	assert_int_equal(test.discontinuities, 0);
+}
+
+int main()
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(worker_overflow_test),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
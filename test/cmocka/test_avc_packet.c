@@ -0,0 +1,89 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include <string.h>
+
+#include <obs.h>
+#include <obs-avc.h>
+
+/* SPS, then an IDR slice behind a 3-byte start code */
+static const uint8_t annexb[] = {0x00, 0x00, 0x00, 0x01, 0x67, 0xAA, 0xBB,
+				 0x00, 0x00, 0x01, 0x65, 0xCC};
+
+static const uint8_t avcc[] = {0x00, 0x00, 0x00, 0x03, 0x67, 0xAA, 0xBB,
+			       0x00, 0x00, 0x00, 0x02, 0x65, 0xCC};
+
+static void parse_test(void **state)
+{
+	struct encoder_packet src = {0};
+	struct encoder_packet parsed;
+
+	src.type = OBS_ENCODER_VIDEO;
+	src.data = (uint8_t *)annexb;
+	src.size = sizeof(annexb);
+
+	obs_parse_avc_packet(&parsed, &src);
+
+	assert_int_equal(parsed.size, sizeof(avcc));
+	assert_memory_equal(parsed.data, avcc, sizeof(avcc));
+	assert_true(parsed.keyframe);
+	assert_int_equal(parsed.priority, OBS_NAL_PRIORITY_HIGHEST);
+
+	obs_encoder_packet_release(&parsed);
+	assert_null(parsed.data);
+}
+
+/* parsed packets are ref-counted like encoder packets, and the last release
+ * frees them */
+static void release_test(void **state)
+{
+	struct encoder_packet src = {0};
+	struct encoder_packet parsed;
+	struct encoder_packet ref;
+
+	src.type = OBS_ENCODER_VIDEO;
+	src.data = (uint8_t *)annexb;
+	src.size = sizeof(annexb);
+
+	obs_parse_avc_packet(&parsed, &src);
+	obs_encoder_packet_ref(&ref, &parsed);
+
+	obs_encoder_packet_release(&parsed);
+	assert_memory_equal(ref.data, avcc, sizeof(avcc));
+	obs_encoder_packet_release(&ref);
+}
+
+/* packets built outside of libobs with a bare ref count in front of the
+ * data are not pooled, and must still be freed by the last release */
+static void unpooled_release_test(void **state)
+{
+	long allocs = bnum_allocs();
+	long *refs = bmalloc(sizeof(long) + sizeof(avcc));
+	struct encoder_packet pkt = {0};
+	struct encoder_packet ref;
+
+	*refs = 1;
+	pkt.data = (uint8_t *)(refs + 1);
+	pkt.size = sizeof(avcc);
+	memcpy(pkt.data, avcc, sizeof(avcc));
+
+	obs_encoder_packet_ref(&ref, &pkt);
+	obs_encoder_packet_release(&pkt);
+	assert_int_equal(bnum_allocs(), allocs + 1);
+
+	obs_encoder_packet_release(&ref);
+	assert_int_equal(bnum_allocs(), allocs);
+}
+
+int main()
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(parse_test),
+		cmocka_unit_test(release_test),
+		cmocka_unit_test(unpooled_release_test),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
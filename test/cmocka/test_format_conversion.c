@@ -0,0 +1,359 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <util/bmem.h>
+#include <media-io/format-conversion.h>
+
+#define MAX_WIDTH 132
+#define HEIGHT 6
+#define START_Y 2
+#define UNTOUCHED 0xCD
+
+static const enum format_conversion_impl impls[] = {
+	FORMAT_CONVERSION_SSE2,
+	FORMAT_CONVERSION_AVX2,
+};
+
+#define NUM_IMPLS (sizeof(impls) / sizeof(impls[0]))
+
+static void fill(uint8_t *data, size_t size)
+{
+	for (size_t i = 0; i < size; i++)
+		data[i] = (uint8_t)rand();
+}
+
+/* ------------------------------------------------------------------------- */
+/* UYVX to planar */
+
+enum planar_format {
+	PLANAR_I420,
+	PLANAR_NV12,
+	PLANAR_I444,
+};
+
+static void compress(enum planar_format format, const uint8_t *input,
+		     uint32_t in_linesize, uint8_t *output[],
+		     const uint32_t out_linesize[])
+{
+	switch (format) {
+	case PLANAR_I420:
+		compress_uyvx_to_i420(input, in_linesize, START_Y, HEIGHT,
+				      output, out_linesize);
+		break;
+	case PLANAR_NV12:
+		compress_uyvx_to_nv12(input, in_linesize, START_Y, HEIGHT,
+				      output, out_linesize);
+		break;
+	case PLANAR_I444:
+		convert_uyvx_to_i444(input, in_linesize, START_Y, HEIGHT,
+				     output, out_linesize);
+		break;
+	}
+}
+
+static inline uint8_t uyvx(const uint8_t *input, uint32_t width, uint32_t x,
+			   uint32_t y, int channel)
+{
+	return input[(y * width + x) * 4 + channel];
+}
+
+/* 2x2 average, truncated like the conversion does */
+static inline uint8_t uyvx_avg(const uint8_t *input, uint32_t width,
+			       uint32_t x, uint32_t y, int channel)
+{
+	return (uint8_t)((uyvx(input, width, x, y, channel) +
+			  uyvx(input, width, x + 1, y, channel) +
+			  uyvx(input, width, x, y + 1, channel) +
+			  uyvx(input, width, x + 1, y + 1, channel)) >>
+			 2);
+}
+
+static void compress_reference(enum planar_format format,
+			       const uint8_t *input, uint32_t width,
+			       uint8_t *output[], const uint32_t out_linesize[])
+{
+	for (uint32_t y = START_Y; y < HEIGHT; y++) {
+		for (uint32_t x = 0; x < width; x++) {
+			output[0][y * out_linesize[0] + x] =
+				uyvx(input, width, x, y, 1);
+
+			if (format == PLANAR_I444) {
+				output[1][y * out_linesize[1] + x] =
+					uyvx(input, width, x, y, 0);
+				output[2][y * out_linesize[2] + x] =
+					uyvx(input, width, x, y, 2);
+			}
+		}
+	}
+
+	if (format == PLANAR_I444)
+		return;
+
+	for (uint32_t y = START_Y; y < HEIGHT; y += 2) {
+		for (uint32_t x = 0; x < width; x += 2) {
+			uint8_t u = uyvx_avg(input, width, x, y, 0);
+			uint8_t v = uyvx_avg(input, width, x, y, 2);
+			uint32_t pos = (y / 2) * out_linesize[1];
+
+			if (format == PLANAR_NV12) {
+				output[1][pos + x] = u;
+				output[1][pos + x + 1] = v;
+			} else {
+				output[1][pos + x / 2] = u;
+				output[2][pos + x / 2] = v;
+			}
+		}
+	}
+}
+
+/* converts every width with each implementation, and compares the planes
+ * against a plain per-pixel conversion.  rows before START_Y must be left
+ * alone. */
+static void check_compress(enum planar_format format)
+{
+	srand(1234);
+
+	for (uint32_t width = 4; width <= MAX_WIDTH; width += 4) {
+		uint32_t in_linesize = width * 4;
+		uint32_t out_linesize[3] = {width, width, width};
+		uint8_t *input = bmalloc(in_linesize * HEIGHT);
+		uint8_t *expected[3];
+		uint8_t *actual[3];
+		size_t plane_size = width * HEIGHT;
+
+		if (format == PLANAR_I420)
+			out_linesize[1] = out_linesize[2] = width / 2;
+
+		fill(input, in_linesize * HEIGHT);
+
+		for (size_t i = 0; i < 3; i++) {
+			expected[i] = bmalloc(plane_size);
+			actual[i] = bmalloc(plane_size);
+			memset(expected[i], UNTOUCHED, plane_size);
+		}
+
+		compress_reference(format, input, width, expected,
+				   out_linesize);
+
+		for (size_t i = 0; i < NUM_IMPLS; i++) {
+			if (!format_conversion_set_impl(impls[i]))
+				continue;
+
+			for (size_t j = 0; j < 3; j++)
+				memset(actual[j], UNTOUCHED, plane_size);
+
+			compress(format, input, in_linesize, actual,
+				 out_linesize);
+
+			for (size_t j = 0; j < 3; j++)
+				assert_memory_equal(actual[j], expected[j],
+						    plane_size);
+		}
+
+		for (size_t i = 0; i < 3; i++) {
+			bfree(expected[i]);
+			bfree(actual[i]);
+		}
+		bfree(input);
+	}
+}
+
+static void uyvx_to_i420_test(void **state)
+{
+	check_compress(PLANAR_I420);
+}
+
+static void uyvx_to_nv12_test(void **state)
+{
+	check_compress(PLANAR_NV12);
+}
+
+static void uyvx_to_i444_test(void **state)
+{
+	check_compress(PLANAR_I444);
+}
+
+/* ------------------------------------------------------------------------- */
+/* planar to packed */
+
+static void decompress_420_reference(const uint8_t *const input[],
+				     const uint32_t in_linesize[],
+				     uint32_t width, uint32_t *output)
+{
+	for (uint32_t y = START_Y; y < HEIGHT; y++) {
+		for (uint32_t x = 0; x < width; x++) {
+			uint32_t lum = input[0][y * in_linesize[0] + x];
+			uint32_t chroma0 =
+				input[1][(y / 2) * in_linesize[1] + x / 2];
+			uint32_t chroma1 =
+				input[2][(y / 2) * in_linesize[2] + x / 2];
+
+			output[y * width + x] =
+				(lum << 16) | (chroma0 << 8) | chroma1;
+		}
+	}
+}
+
+static void decompress_nv12_reference(const uint8_t *const input[],
+				      const uint32_t in_linesize[],
+				      uint32_t width, uint32_t *output)
+{
+	for (uint32_t y = START_Y; y < HEIGHT; y++) {
+		for (uint32_t x = 0; x < width; x++) {
+			const uint8_t *chroma = input[1] +
+						(y / 2) * in_linesize[1] +
+						(x / 2) * 2;
+			uint32_t lum = input[0][y * in_linesize[0] + x];
+
+			output[y * width + x] = lum | (chroma[0] << 8) |
+						(chroma[1] << 16);
+		}
+	}
+}
+
+static void check_decompress(bool nv12)
+{
+	srand(1234);
+
+	for (uint32_t width = 2; width <= MAX_WIDTH; width += 2) {
+		uint32_t in_linesize[3] = {width, nv12 ? width : width / 2,
+					   width / 2};
+		uint32_t out_linesize = width * 4;
+		size_t out_size = out_linesize * HEIGHT;
+		uint8_t *planes[3];
+		uint32_t *expected = bmalloc(out_size);
+		uint32_t *actual = bmalloc(out_size);
+
+		for (size_t i = 0; i < 3; i++) {
+			planes[i] = bmalloc(in_linesize[i] * HEIGHT);
+			fill(planes[i], in_linesize[i] * HEIGHT);
+		}
+
+		const uint8_t *const input[] = {planes[0], planes[1],
+						planes[2]};
+
+		memset(expected, UNTOUCHED, out_size);
+		if (nv12)
+			decompress_nv12_reference(input, in_linesize, width,
+						  expected);
+		else
+			decompress_420_reference(input, in_linesize, width,
+						 expected);
+
+		for (size_t i = 0; i < NUM_IMPLS; i++) {
+			if (!format_conversion_set_impl(impls[i]))
+				continue;
+
+			memset(actual, UNTOUCHED, out_size);
+			if (nv12)
+				decompress_nv12(input, in_linesize, START_Y,
+						HEIGHT, (uint8_t *)actual,
+						out_linesize);
+			else
+				decompress_420(input, in_linesize, START_Y,
+					       HEIGHT, (uint8_t *)actual,
+					       out_linesize);
+
+			assert_memory_equal(actual, expected, out_size);
+		}
+
+		for (size_t i = 0; i < 3; i++)
+			bfree(planes[i]);
+		bfree(expected);
+		bfree(actual);
+	}
+}
+
+static void decompress_420_test(void **state)
+{
+	check_decompress(false);
+}
+
+static void decompress_nv12_test(void **state)
+{
+	check_decompress(true);
+}
+
+/* decompress_422 converts min(in_linesize, out_linesize) / 2 pixel pairs
+ * per row, each pair being one 32-bit word of the input */
+static void check_decompress_422(bool leading_lum)
+{
+	srand(1234);
+
+	for (uint32_t pairs = 1; pairs <= MAX_WIDTH; pairs++) {
+		uint32_t in_linesize = pairs * 2;
+		uint32_t out_linesize = pairs * 8;
+		size_t in_size = in_linesize * HEIGHT + pairs * 4;
+		size_t out_size = out_linesize * HEIGHT;
+		uint8_t *input = bmalloc(in_size);
+		uint32_t *expected = bmalloc(out_size);
+		uint32_t *actual = bmalloc(out_size);
+
+		fill(input, in_size);
+		memset(expected, UNTOUCHED, out_size);
+
+		for (uint32_t y = START_Y; y < HEIGHT; y++) {
+			uint32_t *out = expected + y * pairs * 2;
+
+			for (uint32_t x = 0; x < pairs; x++) {
+				uint32_t dw;
+				memcpy(&dw, input + y * in_linesize + x * 4,
+				       sizeof(dw));
+
+				out[x * 2] = dw;
+				out[x * 2 + 1] =
+					leading_lum
+						? (dw & 0xFFFFFF00) |
+							  ((dw >> 16) & 0xFF)
+						: (dw & 0xFFFF00FF) |
+							  ((dw >> 16) & 0xFF00);
+			}
+		}
+
+		for (size_t i = 0; i < NUM_IMPLS; i++) {
+			if (!format_conversion_set_impl(impls[i]))
+				continue;
+
+			memset(actual, UNTOUCHED, out_size);
+			decompress_422(input, in_linesize, START_Y, HEIGHT,
+				       (uint8_t *)actual, out_linesize,
+				       leading_lum);
+
+			assert_memory_equal(actual, expected, out_size);
+		}
+
+		bfree(input);
+		bfree(expected);
+		bfree(actual);
+	}
+}
+
+static void decompress_yuy2_test(void **state)
+{
+	check_decompress_422(true);
+}
+
+static void decompress_uyvy_test(void **state)
+{
+	check_decompress_422(false);
+}
+
+int main()
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(uyvx_to_i420_test),
+		cmocka_unit_test(uyvx_to_nv12_test),
+		cmocka_unit_test(uyvx_to_i444_test),
+		cmocka_unit_test(decompress_420_test),
+		cmocka_unit_test(decompress_nv12_test),
+		cmocka_unit_test(decompress_yuy2_test),
+		cmocka_unit_test(decompress_uyvy_test),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,93 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <string.h>
+
+#include "obs-ffmpeg-hls-playlist.h"
+
+static void add_segments(struct hls_playlist *playlist, uint64_t first,
+			 uint64_t last)
+{
+	for (uint64_t i = first; i <= last; i++)
+		hls_playlist_add(playlist, i, 2000000, false);
+}
+
+/* segments finishing out of order are only listed once the earlier ones
+ * are done */
+static void playlist_order_test(void **state)
+{
+	struct hls_playlist playlist = {.segment_name = "stream", .size = 5};
+	struct dstr m3u8 = {0};
+
+	hls_playlist_add(&playlist, 1, 2000000, false);
+	assert_false(hls_playlist_build(&playlist, &m3u8));
+
+	hls_playlist_add(&playlist, 0, 2000000, false);
+	assert_true(hls_playlist_build(&playlist, &m3u8));
+	assert_string_equal(m3u8.array, "#EXTM3U\n"
+					"#EXT-X-VERSION:3\n"
+					"#EXT-X-TARGETDURATION:2\n"
+					"#EXT-X-MEDIA-SEQUENCE:0\n"
+					"#EXTINF:2.000,\nstream0.ts\n"
+					"#EXTINF:2.000,\nstream1.ts\n");
+
+	dstr_free(&m3u8);
+	hls_playlist_free(&playlist);
+}
+
+/* a segment that failed to upload is left out, and the segment after it
+ * starts a discontinuity */
+static void playlist_failed_segment_test(void **state)
+{
+	struct hls_playlist playlist = {.segment_name = "stream", .size = 5};
+	struct dstr m3u8 = {0};
+
+	add_segments(&playlist, 0, 1);
+	hls_playlist_add(&playlist, 2, 2000000, true);
+	add_segments(&playlist, 3, 4);
+	hls_playlist_end(&playlist);
+
+	assert_true(hls_playlist_build(&playlist, &m3u8));
+	assert_string_equal(m3u8.array, "#EXTM3U\n"
+					"#EXT-X-VERSION:3\n"
+					"#EXT-X-TARGETDURATION:2\n"
+					"#EXT-X-MEDIA-SEQUENCE:0\n"
+					"#EXTINF:2.000,\nstream0.ts\n"
+					"#EXTINF:2.000,\nstream1.ts\n"
+					"#EXT-X-DISCONTINUITY\n"
+					"#EXTINF:2.000,\nstream3.ts\n"
+					"#EXTINF:2.000,\nstream4.ts\n"
+					"#EXT-X-ENDLIST\n");
+
+	dstr_free(&m3u8);
+	hls_playlist_free(&playlist);
+}
+
+/* only the newest segments stay in the window */
+static void playlist_window_test(void **state)
+{
+	struct hls_playlist playlist = {.segment_name = "stream", .size = 3};
+	struct dstr m3u8 = {0};
+
+	add_segments(&playlist, 0, 9);
+
+	assert_true(hls_playlist_build(&playlist, &m3u8));
+	assert_non_null(strstr(m3u8.array, "#EXT-X-MEDIA-SEQUENCE:7\n"));
+	assert_null(strstr(m3u8.array, "stream6.ts"));
+	assert_non_null(strstr(m3u8.array, "stream9.ts"));
+
+	dstr_free(&m3u8);
+	hls_playlist_free(&playlist);
+}
+
+int main()
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(playlist_order_test),
+		cmocka_unit_test(playlist_failed_segment_test),
+		cmocka_unit_test(playlist_window_test),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,306 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include <libavformat/avformat.h>
+#include <libavutil/channel_layout.h>
+
+#include <media-io/media-remux.h>
+#include <util/platform.h>
+#include <util/dstr.h>
+
+#define TEST_FILES 3
+#define TEST_PACKETS 64
+#define TEST_PACKET_SIZE 4096
+
+/* 16-bit stereo, 4 bytes per frame */
+#define TEST_PACKET_FRAMES (TEST_PACKET_SIZE / 4)
+
+struct remux_test {
+	char *dir;
+	char *in_dir;
+	char *out_dir;
+};
+
+/* writes a short 48khz pcm matroska file */
+static bool write_test_file(const char *path)
+{
+	AVFormatContext *ctx = NULL;
+	AVStream *stream;
+	bool success = false;
+
+	if (avformat_alloc_output_context2(&ctx, NULL, "matroska", path) < 0)
+		return false;
+
+	stream = avformat_new_stream(ctx, NULL);
+	if (!stream)
+		goto fail;
+
+	stream->time_base = (AVRational){1, 48000};
+	stream->codecpar->codec_type = AVMEDIA_TYPE_AUDIO;
+	stream->codecpar->codec_id = AV_CODEC_ID_PCM_S16LE;
+	stream->codecpar->sample_rate = 48000;
+	stream->codecpar->channels = 2;
+	stream->codecpar->channel_layout = AV_CH_LAYOUT_STEREO;
+	stream->codecpar->bits_per_coded_sample = 16;
+	stream->codecpar->block_align = 4;
+
+	if (avio_open(&ctx->pb, path, AVIO_FLAG_WRITE) < 0)
+		goto fail;
+	if (avformat_write_header(ctx, NULL) < 0)
+		goto fail;
+
+	for (int i = 0; i < TEST_PACKETS; i++) {
+		AVPacket pkt = {0};
+		int64_t ts = (int64_t)i * TEST_PACKET_FRAMES;
+
+		if (av_new_packet(&pkt, TEST_PACKET_SIZE) < 0)
+			goto fail;
+
+		memset(pkt.data, i, TEST_PACKET_SIZE);
+		pkt.pts = pkt.dts = av_rescale_q(ts, (AVRational){1, 48000},
+						 stream->time_base);
+		pkt.duration = av_rescale_q(TEST_PACKET_FRAMES,
+					    (AVRational){1, 48000},
+					    stream->time_base);
+
+		if (av_write_frame(ctx, &pkt) < 0) {
+			av_packet_unref(&pkt);
+			goto fail;
+		}
+		av_packet_unref(&pkt);
+	}
+
+	success = av_write_trailer(ctx) == 0;
+
+fail:
+	if (ctx->pb)
+		avio_closep(&ctx->pb);
+	avformat_free_context(ctx);
+	return success;
+}
+
+static char *test_path(const char *dir, int idx, const char *ext)
+{
+	struct dstr path = {0};
+	dstr_printf(&path, "%s/file%d%s", dir, idx, ext);
+	return path.array;
+}
+
+static int setup(void **state)
+{
+	struct remux_test *test = bzalloc(sizeof(*test));
+	struct dstr dir = {0};
+
+	dstr_printf(&dir, "media_remux_test_%llu",
+		    (unsigned long long)os_gettime_ns());
+	test->dir = dir.array;
+
+	dstr_init(&dir);
+	dstr_printf(&dir, "%s/in", test->dir);
+	test->in_dir = dir.array;
+
+	dstr_init(&dir);
+	dstr_printf(&dir, "%s/out", test->dir);
+	test->out_dir = dir.array;
+
+	*state = test;
+
+	if (os_mkdir(test->dir) == MKDIR_ERROR ||
+	    os_mkdir(test->in_dir) == MKDIR_ERROR ||
+	    os_mkdir(test->out_dir) == MKDIR_ERROR)
+		return -1;
+
+	for (int i = 0; i < TEST_FILES; i++) {
+		char *path = test_path(test->in_dir, i, ".mkv");
+		bool written = write_test_file(path);
+		bfree(path);
+
+		if (!written)
+			return -1;
+	}
+
+	return 0;
+}
+
+static void remove_dir(const char *path)
+{
+	os_dir_t *dir = os_opendir(path);
+	struct os_dirent *ent;
+
+	if (!dir)
+		return;
+
+	while ((ent = os_readdir(dir)) != NULL) {
+		struct dstr file = {0};
+
+		if (ent->directory)
+			continue;
+
+		dstr_printf(&file, "%s/%s", path, ent->d_name);
+		os_unlink(file.array);
+		dstr_free(&file);
+	}
+
+	os_closedir(dir);
+	os_rmdir(path);
+}
+
+static int teardown(void **state)
+{
+	struct remux_test *test = *state;
+
+	remove_dir(test->in_dir);
+	remove_dir(test->out_dir);
+	os_rmdir(test->dir);
+
+	bfree(test->in_dir);
+	bfree(test->out_dir);
+	bfree(test->dir);
+	bfree(test);
+	return 0;
+}
+
+static bool track_progress(void *data, float percent)
+{
+	float *last = data;
+	if (percent > *last)
+		*last = percent;
+	return true;
+}
+
+static bool cancel_progress(void *data, float percent)
+{
+	UNUSED_PARAMETER(data);
+	UNUSED_PARAMETER(percent);
+	return false;
+}
+
+static void batch_test(void **state)
+{
+	struct remux_test *test = *state;
+	char *in[TEST_FILES];
+	char *out[TEST_FILES];
+	float progress = 0.f;
+
+	for (int i = 0; i < TEST_FILES; i++) {
+		in[i] = test_path(test->in_dir, i, ".mkv");
+		out[i] = test_path(test->out_dir, i, ".mov");
+	}
+
+	assert_true(media_remux_batch_process((const char *const *)in,
+					      (const char *const *)out,
+					      TEST_FILES, track_progress,
+					      &progress));
+	assert_true(progress >= 100.f);
+
+	for (int i = 0; i < TEST_FILES; i++) {
+		assert_true(os_file_exists(out[i]));
+		assert_true(os_get_file_size(out[i]) > 0);
+		bfree(in[i]);
+		bfree(out[i]);
+	}
+}
+
+/* one missing input fails the batch, but the other files still get done */
+static void batch_missing_input_test(void **state)
+{
+	struct remux_test *test = *state;
+	char *in[TEST_FILES];
+	char *out[TEST_FILES];
+
+	for (int i = 0; i < TEST_FILES; i++) {
+		in[i] = test_path(test->in_dir, i == 1 ? 100 : i, ".mkv");
+		out[i] = test_path(test->out_dir, i, ".mov");
+	}
+
+	assert_false(media_remux_batch_process((const char *const *)in,
+					       (const char *const *)out,
+					       TEST_FILES, NULL, NULL));
+
+	assert_true(os_file_exists(out[0]));
+	assert_false(os_file_exists(out[1]));
+	assert_true(os_file_exists(out[2]));
+
+	for (int i = 0; i < TEST_FILES; i++) {
+		bfree(in[i]);
+		bfree(out[i]);
+	}
+}
+
+static void batch_cancel_test(void **state)
+{
+	struct remux_test *test = *state;
+	char *in[TEST_FILES];
+	char *out[TEST_FILES];
+
+	for (int i = 0; i < TEST_FILES; i++) {
+		in[i] = test_path(test->in_dir, i, ".mkv");
+		out[i] = test_path(test->out_dir, i, ".mkv");
+	}
+
+	assert_false(media_remux_batch_process((const char *const *)in,
+					       (const char *const *)out,
+					       TEST_FILES, cancel_progress,
+					       NULL));
+
+	for (int i = 0; i < TEST_FILES; i++) {
+		bfree(in[i]);
+		bfree(out[i]);
+	}
+}
+
+/* only files with the input extension are picked up */
+static void directory_test(void **state)
+{
+	struct remux_test *test = *state;
+	char *other = test_path(test->in_dir, 0, ".txt");
+	char *other_out = test_path(test->out_dir, 0, ".txt");
+
+	assert_true(os_quick_write_utf8_file(other, "test", 4, false));
+
+	assert_true(media_remux_directory(test->in_dir, ".mkv", test->out_dir,
+					  ".mkv", NULL, NULL));
+
+	for (int i = 0; i < TEST_FILES; i++) {
+		char *out = test_path(test->out_dir, i, ".mkv");
+		assert_true(os_file_exists(out));
+		bfree(out);
+	}
+
+	assert_false(os_file_exists(other_out));
+
+	bfree(other);
+	bfree(other_out);
+}
+
+static void directory_missing_test(void **state)
+{
+	struct remux_test *test = *state;
+	struct dstr missing = {0};
+
+	dstr_printf(&missing, "%s/missing", test->dir);
+	assert_false(media_remux_directory(missing.array, ".mkv",
+					   test->out_dir, ".mkv", NULL, NULL));
+	dstr_free(&missing);
+}
+
+int main()
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test_setup_teardown(batch_test, setup, teardown),
+		cmocka_unit_test_setup_teardown(batch_missing_input_test, setup,
+						teardown),
+		cmocka_unit_test_setup_teardown(batch_cancel_test, setup,
+						teardown),
+		cmocka_unit_test_setup_teardown(directory_test, setup,
+						teardown),
+		cmocka_unit_test_setup_teardown(directory_missing_test, setup,
+						teardown),
+	};
+
+	av_register_all();
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
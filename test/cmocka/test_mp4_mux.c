@@ -0,0 +1,293 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include <string.h>
+
+#include <util/array-serializer.h>
+#include "mp4-mux.h"
+
+/* three one second GOPs at 30fps with 48khz audio */
+#define TEST_FPS 30
+#define TEST_FRAMES 90
+#define TEST_GOP 30
+#define TEST_AUDIO_FRAME 1024
+#define TEST_AUDIO_SIZE 10
+
+static const uint8_t avcc_header[] = {0x01, 0x64, 0x00, 0x1F, 0xFF, 0xE1,
+				      0x00, 0x04, 0x67, 0x64, 0x00, 0x1F,
+				      0x01, 0x00, 0x02, 0x68, 0xEE};
+static const uint8_t asc_header[] = {0x11, 0x90};
+
+struct test_box {
+	char type[5];
+	size_t offset;
+	size_t size;
+};
+
+static void init_mux(struct mp4_mux *mux)
+{
+	memset(mux, 0, sizeof(*mux));
+
+	mux->tracks[0].type = OBS_ENCODER_VIDEO;
+	mux->tracks[0].track_id = 1;
+	mux->tracks[0].timescale = TEST_FPS;
+	mux->tracks[0].width = 1280;
+	mux->tracks[0].height = 720;
+	mux->tracks[0].header = bmemdup(avcc_header, sizeof(avcc_header));
+	mux->tracks[0].header_size = sizeof(avcc_header);
+
+	mux->tracks[1].type = OBS_ENCODER_AUDIO;
+	mux->tracks[1].track_id = 2;
+	mux->tracks[1].timescale = 48000;
+	mux->tracks[1].channels = 2;
+	mux->tracks[1].bitrate = 160000;
+	mux->tracks[1].header = bmemdup(asc_header, sizeof(asc_header));
+	mux->tracks[1].header_size = sizeof(asc_header);
+
+	mux->num_tracks = 2;
+}
+
+static void add_video(struct mp4_mux *mux, int frame, bool *flushed,
+		      struct serializer *s)
+{
+	uint8_t data[] = {0x00, 0x00, 0x00, 0x01, 0x41, 0x01, 0x02, 0x03};
+	struct encoder_packet packet = {0};
+
+	packet.type = OBS_ENCODER_VIDEO;
+	packet.data = data;
+	packet.size = sizeof(data);
+	packet.pts = packet.dts = frame;
+	packet.timebase_num = 1;
+	packet.timebase_den = TEST_FPS;
+	packet.dts_usec = (int64_t)frame * 1000000 / TEST_FPS;
+	packet.keyframe = frame % TEST_GOP == 0;
+
+	if (packet.keyframe)
+		data[4] = 0x65;
+
+	*flushed = true;
+	if (mp4_mux_needs_flush(mux, &packet))
+		*flushed = mp4_mux_write_fragment(mux, s, &packet);
+
+	mp4_mux_add_packet(mux, &packet);
+}
+
+/* audio packets are ref-counted like encoder packets, the mux keeps its own
+ * reference */
+static void add_audio(struct mp4_mux *mux, int frame)
+{
+	long *refs = bzalloc(sizeof(long) + TEST_AUDIO_SIZE);
+	struct encoder_packet packet = {0};
+
+	*refs = 1;
+	packet.type = OBS_ENCODER_AUDIO;
+	packet.data = (uint8_t *)(refs + 1);
+	packet.size = TEST_AUDIO_SIZE;
+	packet.pts = packet.dts = (int64_t)frame * TEST_AUDIO_FRAME;
+	packet.timebase_num = 1;
+	packet.timebase_den = 48000;
+	packet.dts_usec = packet.dts * 1000000 / 48000;
+
+	mp4_mux_add_packet(mux, &packet);
+	obs_encoder_packet_release(&packet);
+}
+
+/* writes the whole stream, returns false on the first failed write */
+static bool write_stream(struct mp4_mux *mux, struct serializer *s)
+{
+	int audio_frame = 0;
+	bool success;
+
+	if (!mp4_mux_write_init_segment(mux, s))
+		return false;
+
+	for (int i = 0; i < TEST_FRAMES; i++) {
+		add_video(mux, i, &success, s);
+		if (!success)
+			return false;
+
+		while ((int64_t)audio_frame * TEST_AUDIO_FRAME * TEST_FPS <
+		       (int64_t)(i + 1) * 48000)
+			add_audio(mux, audio_frame++);
+	}
+
+	if (mp4_mux_needs_flush(mux, NULL) &&
+	    !mp4_mux_write_fragment(mux, s, NULL))
+		return false;
+
+	return mp4_mux_write_index(mux, s);
+}
+
+static inline uint32_t read_be32(const uint8_t *data)
+{
+	return ((uint32_t)data[0] << 24) | ((uint32_t)data[1] << 16) |
+	       ((uint32_t)data[2] << 8) | (uint32_t)data[3];
+}
+
+static inline uint64_t read_be64(const uint8_t *data)
+{
+	return ((uint64_t)read_be32(data) << 32) | read_be32(data + 4);
+}
+
+/* splits data into boxes, failing if the sizes don't add up */
+static size_t read_boxes(const uint8_t *data, size_t offset, size_t end,
+			 struct test_box *boxes, size_t max)
+{
+	size_t count = 0;
+
+	while (offset < end) {
+		struct test_box *box = &boxes[count++];
+
+		assert_true(count <= max);
+		assert_true(end - offset >= 8);
+
+		box->offset = offset;
+		box->size = read_be32(data + offset);
+		memcpy(box->type, data + offset + 4, 4);
+		box->type[4] = 0;
+
+		assert_true(box->size >= 8);
+		assert_true(box->size <= end - offset);
+		offset += box->size;
+	}
+
+	return count;
+}
+
+/* ftyp and moov, then a moof + mdat pair per GOP, then the mfra index
+ * pointing back at each moof */
+static void layout_test(void **state)
+{
+	static const char *expected[] = {"ftyp", "moov", "moof", "mdat",
+					 "moof", "mdat", "moof", "mdat",
+					 "mfra"};
+	static const char *moov_expected[] = {"mvhd", "trak", "trak", "mvex"};
+	struct array_output_data data;
+	struct serializer s;
+	struct mp4_mux mux;
+	struct test_box boxes[16];
+	struct test_box children[16];
+	const struct test_box *mfra;
+	const uint8_t *bytes;
+	size_t count;
+
+	init_mux(&mux);
+	array_output_serializer_init(&s, &data);
+
+	assert_true(write_stream(&mux, &s));
+	bytes = data.bytes.array;
+
+	count = read_boxes(bytes, 0, data.bytes.num, boxes, 16);
+	assert_int_equal(count, sizeof(expected) / sizeof(expected[0]));
+	for (size_t i = 0; i < count; i++)
+		assert_string_equal(boxes[i].type, expected[i]);
+
+	count = read_boxes(bytes, boxes[1].offset + 8,
+			   boxes[1].offset + boxes[1].size, children, 16);
+	assert_int_equal(count,
+			 sizeof(moov_expected) / sizeof(moov_expected[0]));
+	for (size_t i = 0; i < count; i++)
+		assert_string_equal(children[i].type, moov_expected[i]);
+
+	/* one traf per track in every fragment */
+	for (size_t i = 2; i < 8; i += 2) {
+		count = read_boxes(bytes, boxes[i].offset + 8,
+				   boxes[i].offset + boxes[i].size, children,
+				   16);
+		assert_int_equal(count, 3);
+		assert_string_equal(children[0].type, "mfhd");
+		assert_int_equal(read_be32(bytes + children[0].offset + 12),
+				 i / 2);
+		assert_string_equal(children[1].type, "traf");
+		assert_string_equal(children[2].type, "traf");
+	}
+
+	/* video track tfra, then mfro holding the size of the whole mfra */
+	mfra = &boxes[8];
+	count = read_boxes(bytes, mfra->offset + 8, mfra->offset + mfra->size,
+			   children, 16);
+	assert_int_equal(count, 2);
+	assert_string_equal(children[0].type, "tfra");
+	assert_string_equal(children[1].type, "mfro");
+	assert_int_equal(read_be32(bytes + children[1].offset + 12),
+			 mfra->size);
+
+	/* version 1 entries: 8 byte time and offset, then three 1 byte
+	 * numbers */
+	assert_int_equal(read_be32(bytes + children[0].offset + 12), 1);
+	assert_int_equal(read_be32(bytes + children[0].offset + 20), 3);
+	for (size_t i = 0; i < 3; i++) {
+		const uint8_t *entry = bytes + children[0].offset + 24 + i * 19;
+
+		assert_int_equal(read_be64(entry), i * TEST_GOP);
+		assert_int_equal(read_be64(entry + 8), boxes[2 + i * 2].offset);
+	}
+
+	array_output_serializer_free(&data);
+	mp4_mux_free(&mux);
+}
+
+struct limited_output {
+	struct array_output_data data;
+	struct serializer s;
+	size_t limit;
+};
+
+static size_t limited_write(void *param, const void *data, size_t size)
+{
+	struct limited_output *out = param;
+	size_t left = out->limit - out->data.bytes.num;
+
+	if (size > left)
+		size = left;
+
+	return out->s.write(&out->data, data, size);
+}
+
+static int64_t limited_get_pos(void *param)
+{
+	struct limited_output *out = param;
+	return out->s.get_pos(&out->data);
+}
+
+/* a short write is reported no matter which part of the file it hits, and
+ * the queued samples are still released */
+static void write_failure_test(void **state)
+{
+	/* init segment, first moof, first mdat payload, mfra */
+	static const size_t limits[] = {0, 1500, 2500, 6900};
+
+	for (size_t i = 0; i < sizeof(limits) / sizeof(limits[0]); i++) {
+		long allocs = bnum_allocs();
+		struct limited_output out;
+		struct serializer s = {0};
+		struct mp4_mux mux;
+
+		init_mux(&mux);
+		array_output_serializer_init(&out.s, &out.data);
+		out.limit = limits[i];
+
+		s.data = &out;
+		s.write = limited_write;
+		s.get_pos = limited_get_pos;
+
+		assert_false(write_stream(&mux, &s));
+		assert_true(out.data.bytes.num <= limits[i]);
+
+		mp4_mux_free(&mux);
+		array_output_serializer_free(&out.data);
+		assert_int_equal(bnum_allocs(), allocs);
+	}
+}
+
+int main()
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(layout_test),
+		cmocka_unit_test(write_failure_test),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,238 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include <string.h>
+#include <sys/socket.h>
+
+#include <util/bmem.h>
+#include "librtmp/rtmp_sys.h"
+
+#define FLV_TAG_HEADER_SIZE 11
+
+/* large enough to hold both writes of the biggest tag */
+#define CAPTURE_SIZE (1 << 20)
+
+struct capture {
+	uint8_t *data;
+	int size;
+};
+
+static struct capture *current_capture;
+
+static int capture_send(RTMPSockBuf *sb, const char *buf, int len, void *param)
+{
+	struct capture *capture = current_capture;
+
+	assert_true(capture->size + len <= CAPTURE_SIZE);
+	memcpy(capture->data + capture->size, buf, len);
+	capture->size += len;
+
+	UNUSED_PARAMETER(sb);
+	UNUSED_PARAMETER(param);
+	return len;
+}
+
+struct test_tag {
+	char header[FLV_TAG_HEADER_SIZE + 5];
+	char *payload;
+	int payload_size;
+
+	/* header + payload + previous tag size, as RTMP_Write gets it */
+	char *flat;
+	int flat_size;
+};
+
+static void init_tag(struct test_tag *tag, int payload_size, uint32_t ts)
+{
+	int body_size = payload_size + 5;
+	char *header = tag->header;
+
+	memset(tag, 0, sizeof(*tag));
+
+	header[0] = RTMP_PACKET_TYPE_VIDEO;
+	header[1] = (char)(body_size >> 16);
+	header[2] = (char)(body_size >> 8);
+	header[3] = (char)body_size;
+	header[4] = (char)(ts >> 16);
+	header[5] = (char)(ts >> 8);
+	header[6] = (char)ts;
+	header[7] = (char)(ts >> 24);
+
+	/* avc nal unit, no composition offset */
+	header[11] = 0x17;
+	header[12] = 1;
+
+	tag->payload_size = payload_size;
+	tag->payload = bmalloc(payload_size);
+	for (int i = 0; i < payload_size; i++)
+		tag->payload[i] = (char)(i * 7);
+
+	tag->flat_size = (int)sizeof(tag->header) + payload_size + 4;
+	tag->flat = bzalloc(tag->flat_size);
+	memcpy(tag->flat, tag->header, sizeof(tag->header));
+	memcpy(tag->flat + sizeof(tag->header), tag->payload, payload_size);
+}
+
+static void free_tag(struct test_tag *tag)
+{
+	bfree(tag->payload);
+	bfree(tag->flat);
+}
+
+static RTMP *create_rtmp(void)
+{
+	RTMP *r = bmalloc(sizeof(RTMP));
+	RTMP_Init(r);
+	r->m_outChunkSize = RTMP_DEFAULT_CHUNKSIZE;
+	return r;
+}
+
+static void destroy_rtmp(RTMP *r)
+{
+	RTMP_Close(r);
+	bfree(r);
+}
+
+/* the first tag goes out with a full chunk header, the second one with a
+ * medium header since it has a timestamp */
+static void write_tags(RTMP *r, bool vectored, struct test_tag *tags)
+{
+	for (size_t i = 0; i < 2; i++) {
+		struct test_tag *tag = &tags[i];
+
+		if (vectored) {
+			RTMPIOVec iov[2] = {
+				{tag->header, (int)sizeof(tag->header)},
+				{tag->payload, tag->payload_size},
+			};
+
+			assert_true(RTMP_WriteV(r, iov, 2, 0) > 0);
+		} else {
+			assert_true(RTMP_Write(r, tag->flat, tag->flat_size,
+					       0) > 0);
+		}
+	}
+}
+
+/* covers sizes under one chunk up to many chunks, with the payload ending
+ * both on and off a chunk boundary */
+static const int test_sizes[] = {1,    100,  123,  251,   1000,
+				 4091, 4096, 9999, 20000, 65536};
+
+#define NUM_SIZES (sizeof(test_sizes) / sizeof(test_sizes[0]))
+
+/* through the custom send function, which queues the chunks */
+static void custom_send_test(void **state)
+{
+	struct capture expected = {bmalloc(CAPTURE_SIZE), 0};
+	struct capture actual = {bmalloc(CAPTURE_SIZE), 0};
+
+	for (size_t i = 0; i < NUM_SIZES; i++) {
+		struct test_tag tags[2];
+		RTMP *flat = create_rtmp();
+		RTMP *vectored = create_rtmp();
+
+		init_tag(&tags[0], test_sizes[i], 0);
+		init_tag(&tags[1], test_sizes[i], 33);
+
+		flat->m_bCustomSend = vectored->m_bCustomSend = 1;
+		flat->m_customSendFunc = capture_send;
+		vectored->m_customSendFunc = capture_send;
+
+		expected.size = actual.size = 0;
+
+		current_capture = &expected;
+		write_tags(flat, false, tags);
+		current_capture = &actual;
+		write_tags(vectored, true, tags);
+
+		assert_int_equal(actual.size, expected.size);
+		assert_memory_equal(actual.data, expected.data, expected.size);
+
+		destroy_rtmp(flat);
+		destroy_rtmp(vectored);
+		free_tag(&tags[0]);
+		free_tag(&tags[1]);
+	}
+
+	bfree(expected.data);
+	bfree(actual.data);
+}
+
+static int read_all(int fd, uint8_t *data)
+{
+	int size = 0;
+	int ret;
+
+	while ((ret = (int)recv(fd, data + size, CAPTURE_SIZE - size,
+				MSG_DONTWAIT)) > 0)
+		size += ret;
+
+	return size;
+}
+
+static RTMP *create_socket_rtmp(int sv[2])
+{
+	int buf_size = CAPTURE_SIZE;
+	RTMP *r = create_rtmp();
+
+	assert_int_equal(socketpair(AF_UNIX, SOCK_STREAM, 0, sv), 0);
+	setsockopt(sv[0], SOL_SOCKET, SO_SNDBUF, &buf_size, sizeof(buf_size));
+	setsockopt(sv[1], SOL_SOCKET, SO_RCVBUF, &buf_size, sizeof(buf_size));
+
+	/* RTMP_Close closes the sending end */
+	r->m_sb.sb_socket = sv[0];
+	return r;
+}
+
+/* straight to a socket, where RTMP_WriteV hands the chunk headers and the
+ * payload to the kernel without copying them together first */
+static void socket_send_test(void **state)
+{
+	uint8_t *expected = bmalloc(CAPTURE_SIZE);
+	uint8_t *actual = bmalloc(CAPTURE_SIZE);
+
+	for (size_t i = 0; i < NUM_SIZES; i++) {
+		struct test_tag tags[2];
+		int flat_sv[2];
+		int vectored_sv[2];
+		RTMP *flat = create_socket_rtmp(flat_sv);
+		RTMP *vectored = create_socket_rtmp(vectored_sv);
+		int expected_size, actual_size;
+
+		init_tag(&tags[0], test_sizes[i], 0);
+		init_tag(&tags[1], test_sizes[i], 33);
+
+		write_tags(flat, false, tags);
+		write_tags(vectored, true, tags);
+
+		expected_size = read_all(flat_sv[1], expected);
+		actual_size = read_all(vectored_sv[1], actual);
+
+		assert_true(expected_size > 2 * test_sizes[i]);
+		assert_int_equal(actual_size, expected_size);
+		assert_memory_equal(actual, expected, expected_size);
+
+		destroy_rtmp(flat);
+		destroy_rtmp(vectored);
+		closesocket(flat_sv[1]);
+		closesocket(vectored_sv[1]);
+		free_tag(&tags[0]);
+		free_tag(&tags[1]);
+	}
+
+	bfree(expected);
+	bfree(actual);
+}
+
+int main()
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(custom_send_test),
+		cmocka_unit_test(socket_send_test),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
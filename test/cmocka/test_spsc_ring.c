@@ -0,0 +1,88 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include <util/spsc-ring.h>
+
+static void spsc_ring_push_pop_test(void **state)
+{
+	struct spsc_ring ring;
+	int out[8];
+
+	spsc_ring_init(&ring, sizeof(int), 5);
+	assert_int_equal(ring.capacity, 8);
+
+	for (int i = 0; i < 8; i++)
+		assert_true(spsc_ring_push_back(&ring, &i));
+
+	int extra = 8;
+	assert_false(spsc_ring_push_back(&ring, &extra));
+	assert_int_equal(spsc_ring_size(&ring), 8);
+
+	assert_int_equal(spsc_ring_pop_front_batch(&ring, out, 3), 3);
+	assert_int_equal(out[0], 0);
+	assert_int_equal(out[2], 2);
+
+	/* wrap around the end of the storage */
+	for (int i = 8; i < 11; i++)
+		assert_true(spsc_ring_push_back(&ring, &i));
+
+	assert_int_equal(spsc_ring_pop_front_batch(&ring, out, 8), 8);
+	for (int i = 0; i < 8; i++)
+		assert_int_equal(out[i], i + 3);
+
+	assert_false(spsc_ring_pop_front(&ring, out));
+	spsc_ring_free(&ring);
+}
+
+static bool keep_even(void *param, void *elem)
+{
+	int *removed = param;
+	int val = *(int *)elem;
+
+	if (val & 1) {
+		(*removed)++;
+		return false;
+	}
+	return true;
+}
+
+static void spsc_ring_compact_test(void **state)
+{
+	struct spsc_ring ring;
+	int removed = 0;
+	int out[8];
+
+	spsc_ring_init(&ring, sizeof(int), 8);
+
+	for (int i = 0; i < 6; i++)
+		spsc_ring_push_back(&ring, &i);
+	spsc_ring_pop_front(&ring, out);
+	for (int i = 6; i < 9; i++)
+		spsc_ring_push_back(&ring, &i);
+
+	assert_int_equal(spsc_ring_compact(&ring, keep_even, &removed), 4);
+	assert_int_equal(removed, 4);
+	assert_int_equal(spsc_ring_size(&ring), 4);
+	assert_int_equal(*(int *)spsc_ring_data(&ring, 0), 2);
+	assert_null(spsc_ring_data(&ring, 4));
+
+	assert_int_equal(spsc_ring_pop_front_batch(&ring, out, 8), 4);
+	assert_int_equal(out[0], 2);
+	assert_int_equal(out[1], 4);
+	assert_int_equal(out[2], 6);
+	assert_int_equal(out[3], 8);
+
+	spsc_ring_free(&ring);
+}
+
+int main()
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(spsc_ring_push_pop_test),
+		cmocka_unit_test(spsc_ring_compact_test),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,158 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <string.h>
+
+#include <util/bmem.h>
+#include <util/platform.h>
+#include <util/threading.h>
+#include <util/trace.h>
+
+static const char *dump_file = "test_trace.json";
+
+static size_t count_str(const char *haystack, const char *needle)
+{
+	size_t count = 0;
+
+	while ((haystack = strstr(haystack, needle)) != NULL) {
+		haystack += strlen(needle);
+		count++;
+	}
+	return count;
+}
+
+static char *dump_trace(void)
+{
+	assert_true(trace_dump_chrome_json(dump_file));
+	return os_quick_read_utf8_file(dump_file);
+}
+
+static void trace_disabled_test(void **state)
+{
+	trace_stop();
+	assert_false(trace_enabled());
+	assert_int_equal(trace_begin(), 0);
+
+	trace_end("ignored", 1, 0);
+	trace_instant("ignored", 1);
+
+	char *json = dump_trace();
+	assert_non_null(json);
+	assert_null(strstr(json, "ignored"));
+	bfree(json);
+
+	trace_free();
+	os_unlink(dump_file);
+}
+
+static void trace_events_test(void **state)
+{
+	trace_start();
+	trace_set_thread_name("test \"thread\"");
+
+	uint64_t start = trace_begin();
+	assert_true(start != 0);
+	trace_end("frame", 42, start);
+	trace_event("render", 42, 1000, 3500);
+	trace_instant("lagged_frame", 43);
+	trace_stop();
+
+	char *json = dump_trace();
+	assert_non_null(json);
+	assert_non_null(strstr(json, "\"traceEvents\":["));
+	assert_non_null(strstr(json, "\"name\":\"test \\\"thread\\\"\""));
+	assert_non_null(strstr(json, "\"name\":\"render\",\"ph\":\"X\""));
+	assert_non_null(strstr(json, "\"ts\":1.000,\"dur\":2.500"));
+	assert_non_null(strstr(json, "\"name\":\"lagged_frame\",\"ph\":\"i\""));
+	assert_int_equal(count_str(json, "\"frame\":42}"), 2);
+	assert_int_equal(count_str(json, "\"frame\":43}"), 1);
+	bfree(json);
+
+	trace_free();
+	os_unlink(dump_file);
+}
+
+static void trace_wrap_test(void **state)
+{
+	trace_start();
+
+	/* the ring holds 8192 events.  once it is full, the oldest slot is
+	 * the next one to be written, so it is left out of the dump. */
+	for (uint64_t i = 0; i < 8192 + 100; i++)
+		trace_event("event", i, 1000 + i, 2000 + i);
+	trace_stop();
+
+	char *json = dump_trace();
+	assert_non_null(json);
+	assert_int_equal(count_str(json, "\"ph\":\"X\""), 8191);
+	assert_null(strstr(json, "\"frame\":100}"));
+	assert_non_null(strstr(json, "\"frame\":101}"));
+	assert_non_null(strstr(json, "\"frame\":8291}"));
+	bfree(json);
+
+	trace_free();
+	os_unlink(dump_file);
+}
+
+static void trace_clear_test(void **state)
+{
+	trace_start();
+	trace_event("before", 1, 1000, 2000);
+	trace_clear();
+	trace_event("after", 2, 3000, 4000);
+	trace_stop();
+
+	char *json = dump_trace();
+	assert_non_null(json);
+	assert_null(strstr(json, "\"name\":\"before\""));
+	assert_non_null(strstr(json, "\"name\":\"after\""));
+	bfree(json);
+
+	trace_free();
+	os_unlink(dump_file);
+}
+
+static void *trace_thread(void *param)
+{
+	trace_event("thread", (uint64_t)(uintptr_t)param, 1000, 2000);
+	return NULL;
+}
+
+/* more threads than there are rings come and go one after another.  each
+ * one gets the ring of an exited thread, so none of them lose events. */
+static void trace_thread_reuse_test(void **state)
+{
+	trace_start();
+
+	for (uintptr_t i = 0; i < 300; i++) {
+		pthread_t thread;
+		assert_int_equal(pthread_create(&thread, NULL, trace_thread,
+						(void *)i),
+				 0);
+		pthread_join(thread, NULL);
+	}
+	trace_stop();
+
+	char *json = dump_trace();
+	assert_non_null(json);
+	assert_non_null(strstr(json, "\"frame\":299}"));
+	assert_int_equal(count_str(json, "\"name\":\"thread_name\""), 1);
+	bfree(json);
+
+	trace_free();
+	os_unlink(dump_file);
+}
+
+int main()
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(trace_disabled_test),
+		cmocka_unit_test(trace_events_test),
+		cmocka_unit_test(trace_wrap_test),
+		cmocka_unit_test(trace_clear_test),
+		cmocka_unit_test(trace_thread_reuse_test),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
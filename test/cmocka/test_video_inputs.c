@@ -0,0 +1,156 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include <util/threading.h>
+#include <util/platform.h>
+#include <media-io/video-io.h>
+#include <media-io/video-frame.h>
+
+/* less than the frame cache, since cached frames go back in order and the
+ * stalled input keeps holding the first one */
+#define TEST_FRAMES 12
+
+struct test_input {
+	volatile long frames;
+	pthread_t thread;
+	os_event_t *resume;
+};
+
+static void test_callback(void *param, struct video_data *frame)
+{
+	struct test_input *input = param;
+
+	if (input->resume)
+		os_event_wait(input->resume);
+
+	input->thread = pthread_self();
+	os_atomic_inc_long(&input->frames);
+
+	UNUSED_PARAMETER(frame);
+}
+
+static void wait_for(volatile long *count, long target)
+{
+	for (int i = 0; i < 5000 && os_atomic_load_long(count) < target; i++)
+		os_sleep_ms(1);
+}
+
+static video_t *open_video(void)
+{
+	struct video_output_info info = {
+		.name = "test",
+		.format = VIDEO_FORMAT_I420,
+		.fps_num = 30,
+		.fps_den = 1,
+		.width = 64,
+		.height = 64,
+		.cache_size = 16,
+		.colorspace = VIDEO_CS_709,
+		.range = VIDEO_RANGE_PARTIAL,
+	};
+	video_t *video;
+
+	assert_int_equal(video_output_open(&video, &info),
+			 VIDEO_OUTPUT_SUCCESS);
+	return video;
+}
+
+static void push_frame(video_t *video, uint64_t timestamp)
+{
+	struct video_frame frame;
+
+	assert_true(video_output_lock_frame(video, &frame, 1, timestamp));
+	video_output_unlock_frame(video);
+}
+
+/* a stalled input skips frames itself while the other input keeps getting
+ * every frame */
+static void stalled_input_test(void **state)
+{
+	struct test_input slow = {0};
+	struct test_input fast = {0};
+	video_t *video = open_video();
+	uint32_t skipped;
+
+	assert_int_equal(os_event_init(&slow.resume, OS_EVENT_TYPE_MANUAL), 0);
+
+	video_output_set_parallel_inputs(video, true);
+	assert_true(video_output_connect(video, NULL, test_callback, &slow));
+	assert_true(video_output_connect(video, NULL, test_callback, &fast));
+
+	for (long i = 0; i < TEST_FRAMES; i++) {
+		push_frame(video, (uint64_t)i * 1000000);
+		wait_for(&fast.frames, i + 1);
+		assert_int_equal(os_atomic_load_long(&fast.frames), i + 1);
+	}
+
+	skipped = video_output_get_input_skipped_frames(video, test_callback,
+							&slow);
+	assert_true(skipped > 0);
+	assert_int_equal(video_output_get_input_skipped_frames(
+				 video, test_callback, &fast),
+			 0);
+
+	os_event_signal(slow.resume);
+	wait_for(&slow.frames, TEST_FRAMES - (long)skipped);
+	assert_int_equal(os_atomic_load_long(&slow.frames),
+			 TEST_FRAMES - (long)skipped);
+
+	video_output_disconnect(video, test_callback, &slow);
+	video_output_disconnect(video, test_callback, &fast);
+	video_output_close(video);
+	os_event_destroy(slow.resume);
+
+	UNUSED_PARAMETER(state);
+}
+
+/* inputs only get their own threads while more than one is connected, and
+ * the setting applies to inputs that are already connected */
+static void input_threads_test(void **state)
+{
+	struct test_input a = {0};
+	struct test_input b = {0};
+	video_t *video = open_video();
+	pthread_t video_thread;
+
+	assert_true(video_output_connect(video, NULL, test_callback, &a));
+	assert_true(video_output_connect(video, NULL, test_callback, &b));
+
+	push_frame(video, 0);
+	wait_for(&a.frames, 1);
+	wait_for(&b.frames, 1);
+	assert_true(pthread_equal(a.thread, b.thread));
+	video_thread = a.thread;
+
+	video_output_set_parallel_inputs(video, true);
+
+	push_frame(video, 1000000);
+	wait_for(&a.frames, 2);
+	wait_for(&b.frames, 2);
+	assert_false(pthread_equal(a.thread, b.thread));
+	assert_false(pthread_equal(a.thread, video_thread));
+
+	video_output_disconnect(video, test_callback, &b);
+
+	push_frame(video, 2000000);
+	wait_for(&a.frames, 3);
+	assert_int_equal(os_atomic_load_long(&a.frames), 3);
+	assert_true(pthread_equal(a.thread, video_thread));
+
+	video_output_disconnect(video, test_callback, &a);
+	video_output_close(video);
+
+	UNUSED_PARAMETER(state);
+}
+
+int main()
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(stalled_input_test),
+		cmocka_unit_test(input_threads_test),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
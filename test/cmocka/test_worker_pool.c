@@ -0,0 +1,63 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include <util/worker-pool.h>
+#include <util/threading.h>
+
+#define NUM_TASKS 1000
+
+static void count_task(void *param, size_t idx)
+{
+	volatile long *counts = param;
+	os_atomic_inc_long(&counts[idx]);
+}
+
+/* every task has to run exactly once per batch, and the pool has to be
+ * reusable for any number of batches */
+static void worker_pool_run_test(void **state)
+{
+	worker_pool_t *pool = worker_pool_create("test worker", NULL, 4);
+	static volatile long counts[NUM_TASKS];
+
+	assert_non_null(pool);
+	assert_true(worker_pool_num_threads(pool) <= 4);
+
+	for (size_t count = 0; count <= NUM_TASKS; count += 37) {
+		for (size_t i = 0; i < NUM_TASKS; i++)
+			counts[i] = 0;
+
+		worker_pool_run(pool, count, count_task, (void *)counts);
+
+		for (size_t i = 0; i < NUM_TASKS; i++)
+			assert_int_equal(counts[i], i < count ? 1 : 0);
+	}
+
+	worker_pool_destroy(pool);
+}
+
+static void worker_pool_no_threads_test(void **state)
+{
+	worker_pool_t *pool = worker_pool_create("test worker", NULL, 0);
+	volatile long counts[3] = {0};
+
+	assert_non_null(pool);
+	assert_int_equal(worker_pool_num_threads(pool), 0);
+
+	worker_pool_run(pool, 3, count_task, (void *)counts);
+	for (size_t i = 0; i < 3; i++)
+		assert_int_equal(counts[i], 1);
+
+	worker_pool_destroy(pool);
+}
+
+int main()
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(worker_pool_run_test),
+		cmocka_unit_test(worker_pool_no_threads_test),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}